@@ -8,10 +8,12 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <climits>
 #include <fstream>
 #include <elf.h>
 #include "logging.hpp" // logError, logMsg
 #include "arghandler.hpp"
+#include "procinfo.hpp" // processPath
 
 
 #if defined(__LP64__)
@@ -28,10 +30,19 @@ static const char *HELP[] = {
 	"",
 	"Description: A basic (crude) debugger for FreeBSD",
 	"",
-	"Usage: ./freedbg PROG [ARGS]",
+	"Usage: ./freedbg [OPTIONS] PROG [ARGS]",
+	"       ./freedbg [OPTIONS] -p PID",
 	"",
 	"Options:", 
 	"\t-h, --help                Show this message and exit.",
+	"\t--profile HZ              Sample PROG's stack HZ times a second until it exits, instead of debugging interactively",
+	"\t-o, --output FILE         Folded stacks file written by --profile (Default: freedbg.folded)",
+	"\t--trace FUNC[,FUNC...]    Time every call to the given functions until PROG exits, then print a latency summary",
+	"\t--coverage FILE           Record which basic blocks of PROG run until it exits, and write them to FILE in drcov format",
+	"\t--stats-json FILE         Write ptrace/wait statistics to FILE as JSON when FreeDBG exits (needs a FREEDBG_STATS build)",
+	"\t-p, --pid PID             Attach to the running process PID instead of starting PROG ('quit' detaches from it)",
+	"\t--snapshot                With -p, copy registers, stack and backtrace of every thread, detach at once, and report the pause",
+	"\t-m, --memory ADDR:LEN,... Memory ranges --snapshot also copies, e.g. 'config:0x40,0x804a000:256'",
 	"\tPROG [ARGS]               Path of file (and arguments, optionally) to execute and debug"
 	"",
 	0
@@ -39,6 +50,8 @@ static const char *HELP[] = {
 
 static const char *TRYMSG = "Try './freedbg --help' for more information\n";
 
+static char attached_elf[PATH_MAX]; // Executable of the process given with -p
+
 
 static int checkFile(const char *filepath)
 {
@@ -65,19 +78,36 @@ int parseArguments(int argc, char **argv, DbgArgs &args)
 
 	if (argc < 2)
 	{
-		fprintf(stderr, "Usage: ./freedbg PROG [ARGS]\n%s", TRYMSG);
+		fprintf(stderr, "Usage: ./freedbg [OPTIONS] PROG [ARGS]\n%s", TRYMSG);
 		return -1;
 	}
 
 	/* Assign default values */
 	args.target_elf = 0;
 	args.target_args = 0;
+	args.profile_hz = 0;
+	args.profile_output = "freedbg.folded";
+	args.trace_functions = 0;
+	args.coverage_output = 0;
+	args.stats_output = 0;
+	args.attach_pid = 0;
+	args.snapshot = false;
+	args.snapshot_memory = 0;
 
 	int index = 1;
 
 	while(1)
 	{
-		if (index == argc) { break; }
+		if (index == argc)
+		{
+			if (args.snapshot && !args.attach_pid)
+			{
+				logError("Option '--snapshot' requires '-p PID'\n%s", TRYMSG);
+				return -1;
+			}
+			if (args.attach_pid) { return 0; }
+			break;
+		}
 
 		/* Display help message */
 		else if ((strncmp(argv[index], "-h\0", 3) == 0) || (strncmp(argv[index], "--help\0", 7)) == 0)
@@ -89,7 +119,111 @@ int parseArguments(int argc, char **argv, DbgArgs &args)
 			return -1;
 		}
 
+		/* Sampling profiler mode */
+		else if (strncmp(argv[index], "--profile\0", 10) == 0)
+		{
+			char *end = 0;
+			long hz = (index + 1 < argc) ? strtol(argv[index + 1], &end, 10) : 0;
+			if (hz <= 0 || hz > 10000 || *end != '\0')
+			{
+				logError("Option '--profile' requires a rate between 1 and 10000 Hz\n%s", TRYMSG);
+				return -1;
+			}
+			args.profile_hz = hz;
+			index += 2;
+		}
+
+		/* Function call tracer mode */
+		else if (strncmp(argv[index], "--trace\0", 8) == 0)
+		{
+			if (index + 1 == argc)
+			{
+				logError("Option '--trace' requires a comma separated list of functions\n%s", TRYMSG);
+				return -1;
+			}
+			args.trace_functions = argv[index + 1];
+			index += 2;
+		}
+
+		/* Basic block coverage mode */
+		else if (strncmp(argv[index], "--coverage\0", 11) == 0)
+		{
+			if (index + 1 == argc)
+			{
+				logError("Option '--coverage' requires an output file path\n%s", TRYMSG);
+				return -1;
+			}
+			args.coverage_output = argv[index + 1];
+			index += 2;
+		}
+
+		/* Instrumentation dump */
+		else if (strncmp(argv[index], "--stats-json\0", 13) == 0)
+		{
+			if (index + 1 == argc)
+			{
+				logError("Option '--stats-json' requires a file path\n%s", TRYMSG);
+				return -1;
+			}
+			args.stats_output = argv[index + 1];
+			index += 2;
+		}
+
+		/* Attach to a running process */
+		else if ((strncmp(argv[index], "-p\0", 3) == 0) || (strncmp(argv[index], "--pid\0", 6) == 0))
+		{
+			char *end = 0;
+			long pid = (index + 1 < argc) ? strtol(argv[index + 1], &end, 10) : 0;
+			if (pid <= 0 || *end != '\0')
+			{
+				logError("Option '%s' requires a process ID\n%s", argv[index], TRYMSG);
+				return -1;
+			}
+			if (!processPath(pid, attached_elf, sizeof(attached_elf)))
+			{
+				logError("No process with ID %ld\n%s", pid, TRYMSG);
+				return -1;
+			}
+			if (checkFile(attached_elf) < 0) { return -1; }
+			args.attach_pid = pid;
+			args.target_elf = attached_elf;
+			index += 2;
+		}
+
+		else if (strncmp(argv[index], "--snapshot\0", 11) == 0)
+		{
+			args.snapshot = true;
+			index++;
+		}
+
+		else if ((strncmp(argv[index], "-m\0", 3) == 0) || (strncmp(argv[index], "--memory\0", 9) == 0))
+		{
+			if (index + 1 == argc)
+			{
+				logError("Option '%s' requires a list of ADDR:LEN ranges\n%s", argv[index], TRYMSG);
+				return -1;
+			}
+			args.snapshot_memory = argv[index + 1];
+			index += 2;
+		}
+
+		else if ((strncmp(argv[index], "-o\0", 3) == 0) || (strncmp(argv[index], "--output\0", 9) == 0))
+		{
+			if (index + 1 == argc)
+			{
+				logError("Option '%s' requires a file path\n%s", argv[index], TRYMSG);
+				return -1;
+			}
+			args.profile_output = argv[index + 1];
+			index += 2;
+		}
+
 		/* Set target ELF */
+		else if (args.attach_pid || args.snapshot)
+		{
+			logError("Unexpected '%s', '-p' and '--snapshot' work on a running process\n%s", argv[index], TRYMSG);
+			return -1;
+		}
 		else
 		{
 
@@ -106,5 +240,6 @@ int parseArguments(int argc, char **argv, DbgArgs &args)
 			}
 		}
 	}
-	return 0;
+	fprintf(stderr, "Usage: ./freedbg [OPTIONS] PROG [ARGS]\n%s", TRYMSG); // Options, but no program
+	return -1;
 }
\ No newline at end of file
@@ -9,6 +9,14 @@
 typedef struct {
 	char *target_elf;
 	char **target_args;
+	unsigned int profile_hz; // 0 = interactive
+	const char *profile_output;
+	const char *trace_functions; // 0 = interactive
+	const char *coverage_output; // 0 = interactive
+	const char *stats_output; // JSON written at exit, 0 = none
+	int attach_pid; // 0 = start PROG
+	bool snapshot;
+	const char *snapshot_memory; // ADDR:LEN[,ADDR:LEN...] copied by --snapshot, 0 = none
 } DbgArgs;
 
 
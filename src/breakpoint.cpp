@@ -0,0 +1,214 @@
+/*
+* FreeDBG - Breakpoint Class & Breakpoint Table
+*/
+
+#include <vector>
+#include <cstdint>
+#include "breakpoint.hpp" // Breakpoint, BreakpointTable, BPHANDLE
+#include "memcache.hpp" // MemoryCache
+#include "debugregs.hpp" // DebugRegisters, DR_EXEC
+#include "condition.hpp" // Condition
+
+
+#define INDEX_EMPTY NO_BREAKPOINT
+#define INDEX_TOMBSTONE (NO_BREAKPOINT - 1)
+#define PAGE_BITMAP_BITS (1 << 20) // Covers every 4K page of a 32-bit address space exactly
+
+
+/***************************
+* Breakpoint Class Methods *
+***************************/
+Breakpoint::Breakpoint(MemoryCache &mem, ADDR addr, bool once) : memory(&mem), address(addr), one_shot(once) {}
+
+Breakpoint::Breakpoint(DebugRegisters &dbregs, ADDR addr) : debug_registers(&dbregs), address(addr) {}
+
+ADDR Breakpoint::getAddress() { return address; }
+
+bool Breakpoint::isHardware() { return debug_registers != NULL; }
+
+bool Breakpoint::isOneShot() { return one_shot; }
+
+BYTE Breakpoint::getSavedInstruction() { return saved_instruction; }
+
+bool Breakpoint::isEnabled() { return enabled; }
+
+bool Breakpoint::enable()
+{
+	if (enabled) { return true; }
+
+	if (isHardware())
+	{
+		hw_slot = debug_registers->allocate(address, DR_EXEC, 1);
+		enabled = (hw_slot >= 0);
+		return enabled;
+	}
+
+	BYTE interrupt = 0xcc; // INT3 opcode
+	if (!memory->read(address, &saved_instruction, 1)) { return false; }
+	if (!memory->write(address, &interrupt, 1)) { return false; }
+
+	enabled = true;
+	return true;
+}
+
+void Breakpoint::disable()
+{
+	if (enabled)
+	{
+		if (isHardware())
+		{
+			debug_registers->release(hw_slot);
+			hw_slot = -1;
+		}
+		else { memory->write(address, &saved_instruction, 1); }
+		enabled = false;
+	}
+}
+
+void Breakpoint::markEnabled(BYTE original_instruction) // For when INT3 was already written by the caller
+{
+	saved_instruction = original_instruction;
+	enabled = true;
+}
+
+Condition &Breakpoint::getCondition() { return condition; }
+
+void Breakpoint::setIgnoreCount(uint32_t count) { ignore_count = count; }
+
+uint32_t Breakpoint::getIgnoreCount() { return ignore_count; }
+
+uint64_t Breakpoint::hitCount() { return hits; }
+
+bool Breakpoint::countHit() // Called once the condition holds, false while hits are still being ignored
+{
+	hits++;
+	if (ignore_count == 0) { return true; }
+	ignore_count--;
+	return false;
+}
+
+
+/********************************
+* BreakpointTable Class Methods *
+********************************/
+BreakpointTable::BreakpointTable(size_t page_size) : page_bits(PAGE_BITMAP_BITS / 64, 0), page_shift(0)
+{
+	while (((size_t)1 << page_shift) < page_size) { page_shift++; }
+	rebuild(64);
+}
+
+size_t BreakpointTable::slotFor(ADDR address) const
+{
+	uint64_t hash = (uint64_t)address * 0x9E3779B97F4A7C15ULL; // Fibonacci hashing
+	return (size_t)(hash >> 32) & (index.size() - 1);
+}
+
+void BreakpointTable::rebuild(size_t capacity)
+{
+	index.assign(capacity, IndexEntry{0, INDEX_EMPTY});
+	index_used = 0;
+	std::fill(page_bits.begin(), page_bits.end(), 0);
+
+	for (BPHANDLE handle = 0; handle < slots.size(); handle++)
+	{
+		if (!live[handle]) { continue; }
+		ADDR address = slots[handle].getAddress();
+		size_t slot = slotFor(address);
+		while (index[slot].handle != INDEX_EMPTY) { slot = (slot + 1) & (index.size() - 1); }
+		index[slot] = IndexEntry{address, handle};
+		index_used++;
+
+		size_t page = (address >> page_shift) & (PAGE_BITMAP_BITS - 1);
+		page_bits[page / 64] |= (uint64_t)1 << (page % 64);
+	}
+}
+
+BPHANDLE BreakpointTable::find(ADDR address) const
+{
+	size_t slot = slotFor(address);
+	while (index[slot].handle != INDEX_EMPTY)
+	{
+		if (index[slot].handle != INDEX_TOMBSTONE && index[slot].address == address) { return index[slot].handle; }
+		slot = (slot + 1) & (index.size() - 1);
+	}
+	return NO_BREAKPOINT;
+}
+
+BPHANDLE BreakpointTable::insert(const Breakpoint &bp)
+{
+	Breakpoint entry = bp;
+	ADDR address = entry.getAddress();
+	BPHANDLE existing = find(address);
+	if (existing != NO_BREAKPOINT) { return existing; }
+
+	BPHANDLE handle;
+	if (!free_slots.empty())
+	{
+		handle = free_slots.back();
+		free_slots.pop_back();
+		slots[handle] = entry;
+		live[handle] = 1;
+	}
+	else
+	{
+		handle = slots.size();
+		slots.push_back(entry);
+		live.push_back(1);
+	}
+	count++;
+
+	if ((index_used + 1) * 2 > index.size()) // Keep load factor (including tombstones) under 1/2
+	{
+		size_t capacity = index.size();
+		while ((count + 1) * 2 > capacity) { capacity *= 2; }
+		rebuild(capacity); // Also indexes the new slot
+		return handle;
+	}
+
+	size_t slot = slotFor(address);
+	while (index[slot].handle != INDEX_EMPTY && index[slot].handle != INDEX_TOMBSTONE) { slot = (slot + 1) & (index.size() - 1); }
+	if (index[slot].handle == INDEX_EMPTY) { index_used++; }
+	index[slot] = IndexEntry{address, handle};
+
+	size_t page = (address >> page_shift) & (PAGE_BITMAP_BITS - 1);
+	page_bits[page / 64] |= (uint64_t)1 << (page % 64);
+	return handle;
+}
+
+bool BreakpointTable::erase(BPHANDLE handle)
+{
+	if (!isLive(handle)) { return false; }
+
+	ADDR address = slots[handle].getAddress();
+	size_t slot = slotFor(address);
+	while (index[slot].handle != handle) { slot = (slot + 1) & (index.size() - 1); }
+	index[slot].handle = INDEX_TOMBSTONE;
+
+	live[handle] = 0;
+	free_slots.push_back(handle);
+	count--;
+	return true;
+}
+
+void BreakpointTable::reserve(size_t total)
+{
+	size_t capacity = index.size();
+	while (total * 2 > capacity) { capacity *= 2; }
+	if (capacity != index.size()) { rebuild(capacity); }
+	slots.reserve(total);
+	live.reserve(total);
+}
+
+bool BreakpointTable::pageHasBreakpoints(ADDR address) const
+{
+	size_t page = (address >> page_shift) & (PAGE_BITMAP_BITS - 1);
+	return (page_bits[page / 64] >> (page % 64)) & 1;
+}
+
+Breakpoint &BreakpointTable::operator[] (BPHANDLE handle) { return slots[handle]; }
+
+bool BreakpointTable::isLive(BPHANDLE handle) const { return handle < slots.size() && live[handle]; }
+
+BPHANDLE BreakpointTable::slotCount() const { return slots.size(); }
+
+size_t BreakpointTable::size() const { return count; }
@@ -0,0 +1,90 @@
+/*
+* FreeDBG - Breakpoint Class & Breakpoint Table (Header)
+*/
+
+#ifndef FREEDBG_BREAKPOINT
+#define FREEDBG_BREAKPOINT
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // BYTE, ADDR
+#include "memcache.hpp" // MemoryCache
+#include "debugregs.hpp" // DebugRegisters
+#include "condition.hpp" // Condition
+
+
+typedef uint32_t BPHANDLE;
+#define NO_BREAKPOINT ((BPHANDLE)-1)
+
+
+class Breakpoint {
+private:
+	MemoryCache *memory = NULL;
+	DebugRegisters *debug_registers = NULL;
+	bool enabled = false;
+	ADDR address;
+	BYTE saved_instruction = 0;
+	int hw_slot = -1;
+	bool one_shot = false;
+	Condition condition; // Empty stops every time
+	uint32_t ignore_count = 0; // Hits to let through before stopping
+	uint64_t hits = 0;
+
+public:
+	Breakpoint(MemoryCache &mem, ADDR addr, bool once = false); // One-shot breakpoints are removed for good the first time they're hit
+	Breakpoint(DebugRegisters &dbregs, ADDR addr); // Hardware breakpoint, text is never patched
+	ADDR getAddress();
+	bool isHardware();
+	bool isOneShot();
+	BYTE getSavedInstruction();
+	bool isEnabled();
+	bool enable();
+	void disable();
+	void markEnabled(BYTE original_instruction);
+	Condition &getCondition();
+	void setIgnoreCount(uint32_t count);
+	uint32_t getIgnoreCount();
+	uint64_t hitCount();
+	bool countHit();
+};
+
+
+/* Breakpoints are stored in a flat slot array and referred to by handle (slot index),
+* so handles stay valid no matter how many breakpoints are added afterwards. Lookups by
+* address go through an open-addressing index of (address, handle) pairs, guarded by a
+* per-page bitmap so traps on pages without breakpoints skip the index entirely. */
+class BreakpointTable {
+private:
+	struct IndexEntry {
+		ADDR address;
+		BPHANDLE handle;
+	};
+
+	std::vector<Breakpoint> slots;
+	std::vector<uint8_t> live;
+	std::vector<BPHANDLE> free_slots;
+	std::vector<IndexEntry> index; // Power of two sized, linear probing
+	size_t index_used = 0; // Live entries + tombstones
+	size_t count = 0;
+	std::vector<uint64_t> page_bits; // Page number modulo bitmap size, bits are only cleared on rebuild
+	unsigned page_shift;
+
+	size_t slotFor(ADDR address) const;
+	void rebuild(size_t capacity);
+
+public:
+	BreakpointTable(size_t page_size);
+	BPHANDLE find(ADDR address) const;
+	BPHANDLE insert(const Breakpoint &bp);
+	bool erase(BPHANDLE handle);
+	void reserve(size_t total);
+	bool pageHasBreakpoints(ADDR address) const;
+	Breakpoint &operator[] (BPHANDLE handle);
+	bool isLive(BPHANDLE handle) const;
+	BPHANDLE slotCount() const;
+	size_t size() const;
+};
+
+
+#endif // FREEDBG_BREAKPOINT
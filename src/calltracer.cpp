@@ -0,0 +1,156 @@
+/*
+* FreeDBG - Function Call Tracer
+*/
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include "logging.hpp" // logMsg
+#include "calltracer.hpp" // CallTracer, LatencyHistogram, TracedFunction, ActiveCall
+
+
+static size_t bucketIndex(uint64_t value)
+{
+	if (value < HISTOGRAM_SUB_BUCKETS) { return value; }
+	int exponent = 63 - __builtin_clzll(value); // >= 4
+	return (exponent - 3) * HISTOGRAM_SUB_BUCKETS + ((value >> (exponent - 4)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+static uint64_t bucketHighest(size_t index) // Largest value that lands in the bucket
+{
+	if (index < HISTOGRAM_SUB_BUCKETS) { return index; }
+	int exponent = index / HISTOGRAM_SUB_BUCKETS + 3;
+	uint64_t step = 1ull << (exponent - 4);
+	return (HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS) * step + (step - 1);
+}
+
+
+/************************************
+* LatencyHistogram Class Methods    *
+************************************/
+LatencyHistogram::LatencyHistogram() : counts(HISTOGRAM_BUCKETS) {}
+
+void LatencyHistogram::record(uint64_t value)
+{
+	counts[bucketIndex(value)]++;
+	count++;
+	sum += value;
+	min = std::min(min, value);
+	max = std::max(max, value);
+}
+
+uint64_t LatencyHistogram::total() { return sum; }
+
+uint64_t LatencyHistogram::samples() { return count; }
+
+uint64_t LatencyHistogram::mean() { return count ? sum / count : 0; }
+
+uint64_t LatencyHistogram::maximum() { return max; }
+
+uint64_t LatencyHistogram::percentile(double percent)
+{
+	if (count == 0) { return 0; }
+	uint64_t rank = std::max<uint64_t>(1, (uint64_t)(percent / 100.0 * count + 0.5));
+	uint64_t seen = 0;
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		seen += counts[i];
+		if (seen >= rank) { return std::max(min, std::min(max, bucketHighest(i))); }
+	}
+	return max;
+}
+
+
+/******************************
+* CallTracer Class Methods    *
+******************************/
+bool CallTracer::addFunction(const std::string &name, ADDR address) // False if another traced name resolves to the same address
+{
+	if (entries.count(address)) { return false; }
+	entries[address] = functions.size();
+	functions.emplace_back();
+	functions.back().name = name;
+	functions.back().address = address;
+	return true;
+}
+
+int CallTracer::functionAt(ADDR address)
+{
+	auto it = entries.find(address);
+	return it == entries.end() ? -1 : (int)it->second;
+}
+
+size_t CallTracer::functionCount() { return functions.size(); }
+
+void CallTracer::enter(uint32_t function, ADDR stack_pointer, ADDR return_address, uint64_t now)
+{
+	functions[function].calls++;
+	active.push_back({function, stack_pointer, return_address, now, overhead});
+}
+
+bool CallTracer::leave(ADDR return_address, ADDR stack_pointer, uint64_t now) // Called at a return address with esp past the return
+{
+	/* Every call whose frame is now below esp is over, only the innermost of them can have returned here normally */
+	bool matched = false;
+	while (!active.empty() && active.back().stack_pointer < stack_pointer)
+	{
+		ActiveCall call = active.back();
+		active.pop_back();
+		bool popped_last = active.empty() || active.back().stack_pointer >= stack_pointer;
+		if (popped_last && call.return_address == return_address)
+		{
+			uint64_t held = overhead - call.overhead;
+			uint64_t elapsed = now - call.entered;
+			functions[call.function].latency.record(elapsed > held ? elapsed - held : 0);
+			matched = true;
+		}
+		else { functions[call.function].unfinished++; }
+	}
+	return matched;
+}
+
+size_t CallTracer::pendingReturns(ADDR return_address) // Active calls still expected to come back to return_address
+{
+	return std::count_if(active.begin(), active.end(), [&](const ActiveCall &call) { return call.return_address == return_address; });
+}
+
+void CallTracer::addStop(uint64_t held)
+{
+	overhead += held;
+	stops++;
+}
+
+void CallTracer::printSummary(double elapsed)
+{
+	for (ActiveCall &call: active) { functions[call.function].unfinished++; }
+	active.clear();
+
+	std::vector<TracedFunction*> sorted;
+	uint64_t calls = 0;
+	for (TracedFunction &function: functions)
+	{
+		sorted.push_back(&function);
+		calls += function.calls;
+	}
+	std::sort(sorted.begin(), sorted.end(), [](TracedFunction *a, TracedFunction *b) { return a->latency.total() > b->latency.total(); });
+
+	printf("%-24s %10s %12s %10s %10s %10s %10s %10s\n", "Function", "Calls", "Total(ms)", "Mean(us)", "p50(us)", "p90(us)", "p99(us)", "Max(us)");
+	for (TracedFunction *function: sorted)
+	{
+		LatencyHistogram &latency = function->latency;
+		printf("%-24s %10llu %12.3f %10.2f %10.2f %10.2f %10.2f %10.2f", function->name.c_str(), (unsigned long long)function->calls,
+			latency.total() / 1e6, latency.mean() / 1e3, latency.percentile(50) / 1e3, latency.percentile(90) / 1e3,
+			latency.percentile(99) / 1e3, latency.maximum() / 1e3);
+		if (function->unfinished) { printf("  (%llu unfinished)", (unsigned long long)function->unfinished); }
+		putchar('\n');
+	}
+
+	logMsg("%llu traced calls in %.3f s, %llu stops", (unsigned long long)calls, elapsed, (unsigned long long)stops);
+	if (calls)
+	{
+		logMsg("Tracer overhead: %.2f us per call (%.1f%% of run time), already subtracted from the latencies above", overhead / 1e3 / calls,
+			elapsed > 0 ? overhead / 1e7 / elapsed : 0.0);
+	}
+}
@@ -0,0 +1,82 @@
+/*
+* FreeDBG - Function Call Tracer (Header)
+*/
+
+#ifndef FREEDBG_CALL_TRACER
+#define FREEDBG_CALL_TRACER
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // ADDR
+
+
+#define HISTOGRAM_SUB_BUCKETS 16 // Linear steps per power of two, values are kept to within 1/16th
+#define HISTOGRAM_BUCKETS (61 * HISTOGRAM_SUB_BUCKETS)
+
+
+/* Log-linear (HDR style) histogram of nanosecond values: exact below 16,
+* then 16 equal buckets between each power of two and the next. */
+class LatencyHistogram {
+private:
+	std::vector<uint64_t> counts;
+	uint64_t count = 0;
+	uint64_t sum = 0;
+	uint64_t min = UINT64_MAX;
+	uint64_t max = 0;
+
+public:
+	LatencyHistogram();
+	void record(uint64_t value);
+	uint64_t total();
+	uint64_t samples();
+	uint64_t mean();
+	uint64_t maximum();
+	uint64_t percentile(double percent);
+};
+
+struct TracedFunction {
+	std::string name;
+	ADDR address;
+	uint64_t calls = 0;
+	uint64_t unfinished = 0; // Left without returning (longjmp, exceptions, exit)
+	LatencyHistogram latency;
+};
+
+struct ActiveCall { // Shadow stack entry for a traced call that hasn't returned yet
+	uint32_t function;
+	ADDR stack_pointer; // esp on entry, pointing at the return address
+	ADDR return_address;
+	uint64_t entered; // Stop time of the entry breakpoint (ns)
+	uint64_t overhead; // Tracer overhead accumulated up to the entry
+};
+
+
+/* Bookkeeping for 'trace' mode. The debugger stops on each traced function's
+* entry and on the return address it finds on the stack; this class matches
+* the two through a shadow stack keyed by esp and removes the time the debugee
+* spent stopped in between, so nested traced calls don't inflate a caller's
+* latency. Timestamps are steady clock nanoseconds taken when waitpid returns. */
+class CallTracer {
+private:
+	std::vector<TracedFunction> functions;
+	std::unordered_map<ADDR,uint32_t> entries; // Entry address -> index into functions
+	std::vector<ActiveCall> active;
+	uint64_t overhead = 0; // Total ns the debugee was held stopped by the tracer
+	uint64_t stops = 0;
+
+public:
+	bool addFunction(const std::string &name, ADDR address);
+	int functionAt(ADDR address);
+	size_t functionCount();
+	void enter(uint32_t function, ADDR stack_pointer, ADDR return_address, uint64_t now);
+	bool leave(ADDR return_address, ADDR stack_pointer, uint64_t now);
+	size_t pendingReturns(ADDR return_address);
+	void addStop(uint64_t held);
+	void printSummary(double elapsed);
+};
+
+
+#endif // FREEDBG_CALL_TRACER
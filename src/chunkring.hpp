@@ -0,0 +1,105 @@
+/*
+* FreeDBG - Chunk Ring Writer (Header)
+*/
+
+#ifndef FREEDBG_CHUNKRING
+#define FREEDBG_CHUNKRING
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+
+/* A fixed ring of chunks between one producer and a writer thread. The producer
+* only ever touches the current chunk and submits it when it's full; the writer
+* hands every submitted chunk to the write callback in order, without holding the
+* lock. If the writer falls a whole ring behind, submit waits for it rather than
+* dropping anything. After a failed write the rest are skipped, so the producer
+* never waits forever. */
+template <typename Chunk>
+class ChunkRing {
+private:
+	std::vector<Chunk> ring;
+	std::function<bool(Chunk&)> write_chunk;
+	size_t head = 0; // Chunk being filled
+	size_t tail = 0; // Next chunk for the writer
+	bool stopping = false;
+	bool failed = false;
+	uint64_t stalls = 0; // Times the producer waited on the writer
+	std::mutex lock;
+	std::condition_variable filled;
+	std::condition_variable drained;
+	std::thread flusher;
+
+	void flushLoop()
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		while (true)
+		{
+			filled.wait(guard, [&]() { return tail != head || stopping; });
+			if (tail == head) { break; } // Stopping, and everything queued is written
+
+			Chunk &chunk = ring[tail];
+			bool skip = failed;
+			guard.unlock();
+			bool written = skip || write_chunk(chunk);
+			guard.lock();
+			if (!written) { failed = true; }
+			tail = (tail + 1) % ring.size();
+			drained.notify_one();
+		}
+	}
+
+public:
+	ChunkRing(size_t count) : ring(count) {}
+	~ChunkRing() { finish(); }
+	ChunkRing(const ChunkRing&) = delete;
+	ChunkRing &operator=(const ChunkRing&) = delete;
+
+	std::vector<Chunk> &chunks() { return ring; } // Only while the writer isn't running
+
+	void start(std::function<bool(Chunk&)> write)
+	{
+		finish();
+		write_chunk = write;
+		head = tail = 0;
+		stopping = failed = false;
+		stalls = 0;
+		flusher = std::thread(&ChunkRing::flushLoop, this);
+	}
+
+	bool isRunning() { return flusher.joinable(); }
+
+	Chunk &current() { return ring[head]; }
+
+	void submit() // Queues the current chunk and moves on to the next free one
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		size_t next = (head + 1) % ring.size();
+		if (next == tail) { stalls++; }
+		drained.wait(guard, [&]() { return next != tail; });
+		head = next;
+		filled.notify_one();
+	}
+
+	bool finish() // Waits until every submitted chunk is written, false if any write failed
+	{
+		if (!flusher.joinable()) { return !failed; }
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		filled.notify_one();
+		flusher.join();
+		return !failed;
+	}
+
+	uint64_t stallCount() { return stalls; }
+};
+
+
+#endif // FREEDBG_CHUNKRING
@@ -0,0 +1,340 @@
+/*
+* FreeDBG - Breakpoint Condition Compiler
+*/
+
+#include <machine/reg.h>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cstdint>
+#include "condition.hpp" // Condition, ConditionInsn, CONDITION_OP, CONDITION_RESULT
+#include "registers.hpp" // R_*, R_FLAGS
+#include "memcache.hpp" // MemoryCache
+
+
+struct NamedRegister {
+	const char *name;
+	int code;
+};
+
+static const NamedRegister REGISTER_NAMES[] = {
+	{"eax", R_EAX}, {"ebx", R_EBX}, {"ecx", R_ECX}, {"edx", R_EDX}, {"esi", R_ESI}, {"edi", R_EDI}, {"ebp", R_EBP},
+	{"eip", R_EIP}, {"esp", R_ESP}, {"eflags", R_EFLAGS}, {"cflag", R_CARRY}, {"zflag", R_ZERO}, {"sflag", R_SIGN},
+	{"oflag", R_OVERFLOW}
+};
+
+static const decltype(&reg::r_eax) REGISTER_FIELDS[] = { // Indexed by R_* code, up to R_EFLAGS
+	&reg::r_eax, &reg::r_ebx, &reg::r_ecx, &reg::r_edx, &reg::r_esi, &reg::r_edi, &reg::r_ebp, &reg::r_eip, &reg::r_esp, &reg::r_eflags
+};
+
+static const DWORD FLAG_MASKS[] = {CARRY_FLAG, ZERO_FLAG, SIGN_FLAG, OVERFLOW_FLAG}; // R_CARRY onwards
+
+struct BinaryOperator {
+	const char *token;
+	uint8_t op;
+};
+
+static const std::vector<BinaryOperator> BINARY_LEVELS[] = { // Loosest binding first, as in C
+	{{"||", OP_OR_JUMP}},
+	{{"&&", OP_AND_JUMP}},
+	{{"|", OP_OR}},
+	{{"^", OP_XOR}},
+	{{"&", OP_AND}},
+	{{"==", OP_EQ}, {"!=", OP_NE}},
+	{{"<=", OP_LE}, {">=", OP_GE}, {"<", OP_LT}, {">", OP_GT}},
+	{{"<<", OP_SHL}, {">>", OP_SHR}},
+	{{"+", OP_ADD}, {"-", OP_SUB}},
+	{{"*", OP_MUL}, {"/", OP_DIV}, {"%", OP_MOD}}
+};
+#define BINARY_LEVEL_COUNT (sizeof(BINARY_LEVELS) / sizeof(BINARY_LEVELS[0]))
+
+
+static bool foldBinary(uint8_t op, DWORD a, DWORD b, DWORD &result) // False if it has to wait for runtime (division by zero)
+{
+	switch (op)
+	{
+		case OP_ADD: result = a + b; return true;
+		case OP_SUB: result = a - b; return true;
+		case OP_MUL: result = a * b; return true;
+		case OP_DIV: result = b ? a / b : 0; return b != 0;
+		case OP_MOD: result = b ? a % b : 0; return b != 0;
+		case OP_AND: result = a & b; return true;
+		case OP_OR: result = a | b; return true;
+		case OP_XOR: result = a ^ b; return true;
+		case OP_SHL: result = a << (b & 31); return true;
+		case OP_SHR: result = a >> (b & 31); return true;
+		case OP_EQ: result = a == b; return true;
+		case OP_NE: result = a != b; return true;
+		case OP_LT: result = a < b; return true;
+		case OP_LE: result = a <= b; return true;
+		case OP_GT: result = a > b; return true;
+		case OP_GE: result = a >= b; return true;
+		default: return false;
+	}
+}
+
+static DWORD foldUnary(uint8_t op, DWORD a)
+{
+	switch (op)
+	{
+		case OP_NEG: return -a;
+		case OP_NOT: return ~a;
+		case OP_LNOT: return !a;
+		default: return a != 0; // OP_BOOL
+	}
+}
+
+
+/***************************
+* Condition Class Methods  *
+***************************/
+bool Condition::compile(const std::string &expression, const std::function<bool(const std::string&, ADDR&)> &resolver)
+{
+	text = expression;
+	code.clear();
+	stack_depth = max_depth = 0;
+	fold_barrier = 0;
+	error.clear();
+	resolve = resolver;
+	cursor = text.c_str();
+
+	bool compiled = parseBinary(0);
+	skipSpace();
+	if (compiled && *cursor) { compiled = fail("unexpected '" + std::string(cursor) + "'"); }
+	if (compiled && max_depth > CONDITION_MAX_STACK) { compiled = fail("expression is nested too deeply"); }
+	if (!compiled) { code.clear(); }
+	resolve = nullptr;
+	cursor = nullptr;
+	return compiled;
+}
+
+bool Condition::fail(const std::string &message)
+{
+	if (error.empty()) { error = message; } // Keep the innermost, it's closest to the real problem
+	return false;
+}
+
+void Condition::skipSpace()
+{
+	while (isspace((unsigned char)*cursor)) { cursor++; }
+}
+
+bool Condition::accept(const char *token)
+{
+	skipSpace();
+	size_t length = strlen(token);
+	if (strncmp(cursor, token, length) != 0) { return false; }
+	if (length == 1 && strchr("|&<>", token[0]) && cursor[1] && strchr("|&<>=", cursor[1])) { return false; } // Part of a longer operator
+	if (length == 1 && token[0] == '!' && cursor[1] == '=') { return false; }
+	cursor += length;
+	return true;
+}
+
+void Condition::emit(uint8_t op, uint32_t operand)
+{
+	/* Fold constants as they come, but never across a jump target: the instructions before it are shared by two paths */
+	size_t size = code.size();
+	DWORD folded;
+	if (op >= OP_ADD && op <= OP_GE && size >= fold_barrier + 2 && code[size - 1].op == OP_CONST && code[size - 2].op == OP_CONST &&
+		foldBinary(op, code[size - 2].operand, code[size - 1].operand, folded))
+	{
+		code.pop_back();
+		code.back().operand = folded;
+		stack_depth--;
+		return;
+	}
+	if (op >= OP_NEG && op <= OP_BOOL && size >= fold_barrier + 1 && code[size - 1].op == OP_CONST)
+	{
+		code.back().operand = foldUnary(op, code.back().operand);
+		return;
+	}
+
+	code.push_back({op, operand});
+	if (op == OP_CONST || op == OP_REG) { stack_depth++; }
+	else if (op >= OP_ADD) { stack_depth--; } // Binary operators, and the fall through path of the jumps
+	if (stack_depth > max_depth) { max_depth = stack_depth; }
+}
+
+bool Condition::parseBinary(int level)
+{
+	if (level == (int)BINARY_LEVEL_COUNT) { return parseUnary(); }
+	if (!parseBinary(level + 1)) { return false; }
+
+	while (true)
+	{
+		const BinaryOperator *matched = nullptr;
+		for (const BinaryOperator &candidate: BINARY_LEVELS[level])
+		{
+			if (accept(candidate.token))
+			{
+				matched = &candidate;
+				break;
+			}
+		}
+		if (!matched) { return true; }
+
+		if (matched->op == OP_AND_JUMP || matched->op == OP_OR_JUMP) // Short circuit: the right side only runs if it matters
+		{
+			size_t jump = code.size();
+			emit(matched->op);
+			if (!parseBinary(level + 1)) { return false; }
+			emit(OP_BOOL);
+			code[jump].operand = code.size();
+			fold_barrier = code.size();
+			continue;
+		}
+		if (!parseBinary(level + 1)) { return false; }
+		emit(matched->op);
+	}
+}
+
+bool Condition::parseUnary()
+{
+	if (accept("-"))
+	{
+		if (!parseUnary()) { return false; }
+		emit(OP_NEG);
+	}
+	else if (accept("~"))
+	{
+		if (!parseUnary()) { return false; }
+		emit(OP_NOT);
+	}
+	else if (accept("!"))
+	{
+		if (!parseUnary()) { return false; }
+		emit(OP_LNOT);
+	}
+	else if (accept("*")) // C style dereference, always 4 bytes
+	{
+		if (!parseUnary()) { return false; }
+		emit(OP_LOAD32);
+	}
+	else { return parsePrimary(); }
+	return true;
+}
+
+bool Condition::parsePrimary()
+{
+	skipSpace();
+	if (accept("("))
+	{
+		if (!parseBinary(0)) { return false; }
+		return accept(")") || fail("missing ')'");
+	}
+
+	if (isdigit((unsigned char)*cursor))
+	{
+		char *end;
+		unsigned long long value = strtoull(cursor, &end, (cursor[0] == '0' && (cursor[1] == 'x' || cursor[1] == 'X')) ? 16 : 10);
+		if (value > UINT32_MAX || isalnum((unsigned char)*end)) { return fail("invalid number '" + std::string(cursor, end - cursor + 1) + "'"); }
+		cursor = end;
+		emit(OP_CONST, (uint32_t)value);
+		return true;
+	}
+
+	bool is_register = (*cursor == '%' || *cursor == '$');
+	if (is_register) { cursor++; }
+	const char *start = cursor;
+	while (isalnum((unsigned char)*cursor) || *cursor == '_' || *cursor == '.' || *cursor == '@') { cursor++; }
+	std::string name(start, cursor - start);
+	if (name.empty()) { return fail(*cursor ? "unexpected '" + std::string(cursor) + "'" : "expression ends too early"); }
+
+	/* Memory access: byte[ADDR], word[ADDR], dword[ADDR] */
+	static const struct { const char *name; uint8_t op; } LOADS[] = {{"byte", OP_LOAD8}, {"word", OP_LOAD16}, {"dword", OP_LOAD32}};
+	for (auto &load: LOADS)
+	{
+		if (is_register || name != load.name || !accept("[")) { continue; }
+		if (!parseBinary(0)) { return false; }
+		if (!accept("]")) { return fail("missing ']'"); }
+		emit(load.op);
+		return true;
+	}
+
+	for (const NamedRegister &reg: REGISTER_NAMES)
+	{
+		if (name != reg.name) { continue; }
+		if (reg.code < R_CARRY) { emit(OP_REG, reg.code); }
+		else // Flags are a masked test of eflags
+		{
+			emit(OP_REG, R_EFLAGS);
+			emit(OP_CONST, FLAG_MASKS[reg.code - R_CARRY]);
+			emit(OP_AND);
+			emit(OP_BOOL);
+		}
+		return true;
+	}
+	if (is_register) { return fail("unknown register '" + name + "'"); }
+
+	ADDR address;
+	if (!resolve || !resolve(name, address)) { return fail("unknown symbol '" + name + "'"); }
+	emit(OP_CONST, address);
+	return true;
+}
+
+bool Condition::isEmpty() { return code.empty(); }
+
+const std::string &Condition::getText() { return text; }
+
+const std::string &Condition::getError() { return error; }
+
+size_t Condition::length() { return code.size(); }
+
+int Condition::evaluate(const struct reg &regs, MemoryCache &memory, DWORD &value, ADDR &fault) // An empty condition is always true
+{
+	DWORD stack[CONDITION_MAX_STACK];
+	int top = -1;
+	const ConditionInsn *insns = code.data();
+	size_t count = code.size();
+	for (size_t pc = 0; pc < count; pc++)
+	{
+		const ConditionInsn &insn = insns[pc];
+		switch (insn.op)
+		{
+			case OP_CONST: stack[++top] = insn.operand; break;
+			case OP_REG: stack[++top] = (DWORD)(regs.*REGISTER_FIELDS[insn.operand]); break;
+			case OP_LOAD8:
+			case OP_LOAD16:
+			case OP_LOAD32:
+			{
+				DWORD loaded = 0;
+				size_t size = (insn.op == OP_LOAD8) ? 1 : (insn.op == OP_LOAD16) ? 2 : 4;
+				if (!memory.read(stack[top], &loaded, size))
+				{
+					fault = stack[top];
+					return CONDITION_BAD_MEMORY;
+				}
+				stack[top] = loaded; // Little endian, the unread high bytes stay zero
+				break;
+			}
+			case OP_NEG: stack[top] = -stack[top]; break;
+			case OP_NOT: stack[top] = ~stack[top]; break;
+			case OP_LNOT: stack[top] = !stack[top]; break;
+			case OP_BOOL: stack[top] = stack[top] != 0; break;
+			case OP_AND_JUMP:
+				if (stack[top] == 0) { pc = insn.operand - 1; }
+				else { top--; }
+				break;
+			case OP_OR_JUMP:
+				if (stack[top] != 0)
+				{
+					stack[top] = 1;
+					pc = insn.operand - 1;
+				}
+				else { top--; }
+				break;
+			case OP_DIV:
+			case OP_MOD:
+				if (stack[top] == 0) { return CONDITION_DIVIDE_BY_ZERO; }
+				// Fall through
+			default:
+				foldBinary(insn.op, stack[top - 1], stack[top], stack[top - 1]);
+				top--;
+				break;
+		}
+	}
+	value = (top >= 0) ? stack[top] : 1;
+	return CONDITION_OK;
+}
@@ -0,0 +1,77 @@
+/*
+* FreeDBG - Breakpoint Condition Compiler (Header)
+*/
+
+#ifndef FREEDBG_CONDITION
+#define FREEDBG_CONDITION
+
+#include <machine/reg.h>
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+#include "types.hpp" // DWORD, ADDR
+#include "memcache.hpp" // MemoryCache
+
+
+#define CONDITION_MAX_STACK 32
+
+
+enum CONDITION_OP {
+	OP_CONST, // Push operand
+	OP_REG, // Push register, operand is an R_* code below R_CARRY
+	OP_LOAD8, OP_LOAD16, OP_LOAD32, // Replace address on top with the value there
+	OP_NEG, OP_NOT, OP_LNOT, OP_BOOL,
+	OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_AND, OP_OR, OP_XOR, OP_SHL, OP_SHR,
+	OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE,
+	OP_AND_JUMP, // && : jump to operand leaving 0 if top is 0, otherwise pop and go on
+	OP_OR_JUMP // || : jump to operand leaving 1 if top isn't 0, otherwise pop and go on
+};
+
+enum CONDITION_RESULT {
+	CONDITION_OK,
+	CONDITION_BAD_MEMORY, // fault is the unreadable address
+	CONDITION_DIVIDE_BY_ZERO
+};
+
+struct ConditionInsn {
+	uint8_t op;
+	uint32_t operand;
+};
+
+
+/* A C-like expression over registers, memory and symbols, compiled once into
+* stack bytecode so it can be evaluated on every breakpoint hit without
+* parsing anything. Arithmetic is unsigned 32-bit. Symbols are resolved to
+* constants when the expression is compiled, and constant subexpressions are
+* folded, so 'table + 8' costs the same as a literal. */
+class Condition {
+private:
+	std::string text;
+	std::vector<ConditionInsn> code;
+	size_t stack_depth = 0;
+	size_t max_depth = 0;
+	size_t fold_barrier = 0; // First instruction constant folding may touch, jump targets move it forward
+
+	const char *cursor = nullptr;
+	std::string error;
+	std::function<bool(const std::string&, ADDR&)> resolve;
+	void skipSpace();
+	bool accept(const char *token);
+	void emit(uint8_t op, uint32_t operand = 0);
+	bool parseBinary(int level);
+	bool parseUnary();
+	bool parsePrimary();
+	bool fail(const std::string &message);
+
+public:
+	bool compile(const std::string &expression, const std::function<bool(const std::string&, ADDR&)> &resolver);
+	bool isEmpty();
+	const std::string &getText();
+	const std::string &getError();
+	size_t length();
+	int evaluate(const struct reg &regs, MemoryCache &memory, DWORD &value, ADDR &fault);
+};
+
+
+#endif // FREEDBG_CONDITION
@@ -0,0 +1,199 @@
+/*
+* FreeDBG - ELF Core File Writer
+*/
+
+#include <sys/types.h>
+#include <sys/procfs.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <elf.h>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include "logging.hpp" // logError
+#include "corefile.hpp" // CoreWriter, CoreThread, CoreSegment, CoreChunk
+#include "chunkring.hpp" // ChunkRing
+
+
+#define CORE_NOTE_NAME "FreeBSD" // Owner of every note, what FreeBSD's own cores use
+
+static size_t align(size_t value, size_t alignment) { return (value + alignment - 1) & ~(alignment - 1); }
+
+static bool writeVector(int fd, struct iovec *iov, int count) // writev until everything is out, it may stop short
+{
+	while (count > 0)
+	{
+		ssize_t written = writev(fd, iov, count);
+		if (written < 0 && errno == EINTR) { continue; }
+		if (written <= 0) { return false; }
+		while (count > 0 && (size_t)written >= iov->iov_len)
+		{
+			written -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count > 0)
+		{
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+	return true;
+}
+
+
+/***************************
+* CoreWriter Class Methods *
+***************************/
+CoreWriter::CoreWriter() : ring(CORE_RING_SLOTS)
+{
+	for (CoreChunk &chunk: ring.chunks()) { chunk.data.resize(CORE_CHUNK_SIZE); }
+}
+
+CoreWriter::~CoreWriter()
+{
+	finish();
+	if (fd >= 0) { close(fd); }
+}
+
+void CoreWriter::addNote(int type, const void *desc, size_t size)
+{
+	Elf32_Nhdr header;
+	header.n_namesz = sizeof(CORE_NOTE_NAME);
+	header.n_descsz = size;
+	header.n_type = type;
+	size_t offset = notes.size();
+	notes.resize(offset + sizeof(header) + align(sizeof(CORE_NOTE_NAME), 4) + align(size, 4), 0);
+	std::memcpy(&notes[offset], &header, sizeof(header));
+	offset += sizeof(header);
+	std::memcpy(&notes[offset], CORE_NOTE_NAME, sizeof(CORE_NOTE_NAME));
+	offset += align(sizeof(CORE_NOTE_NAME), 4);
+	std::memcpy(&notes[offset], desc, size);
+}
+
+void CoreWriter::setProcess(pid_t pid, const char *name, const char *arguments) // Must come before the threads, the process note leads
+{
+	prpsinfo_t info;
+	std::memset(&info, 0, sizeof(info));
+	info.pr_version = PRPSINFO_VERSION;
+	info.pr_psinfosz = sizeof(info);
+	strncpy(info.pr_fname, name, sizeof(info.pr_fname) - 1);
+	strncpy(info.pr_psargs, arguments, sizeof(info.pr_psargs) - 1);
+	info.pr_pid = pid;
+	addNote(NT_PRPSINFO, &info, sizeof(info));
+}
+
+void CoreWriter::addThread(const CoreThread &thread)
+{
+	prstatus_t status;
+	std::memset(&status, 0, sizeof(status));
+	status.pr_version = PRSTATUS_VERSION;
+	status.pr_statussz = sizeof(status);
+	status.pr_gregsetsz = sizeof(gregset_t);
+	status.pr_fpregsetsz = sizeof(fpregset_t);
+	status.pr_cursig = thread.signal;
+	status.pr_pid = thread.lwp;
+	status.pr_reg = thread.regs;
+	addNote(NT_PRSTATUS, &status, sizeof(status));
+	if (thread.have_fpregs) { addNote(NT_FPREGSET, &thread.fpregs, sizeof(thread.fpregs)); }
+}
+
+void CoreWriter::addSegment(ADDR start, ADDR end, int protection) { segments.push_back({start, end, protection}); }
+
+bool CoreWriter::begin(const char *path) // Writes everything but the memory, which follows through buffer and submit
+{
+	size_t page_size = getpagesize();
+	size_t phnum = segments.size() + 1; // The notes, then one per segment
+	if (phnum >= PN_XNUM)
+	{
+		logError("Too many mappings for a core file (%zu)", segments.size());
+		return false;
+	}
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600); // It holds everything in the debugee's memory
+	if (fd < 0)
+	{
+		logError("Unable to open '%s'", path);
+		return false;
+	}
+
+	std::vector<BYTE> headers(sizeof(Elf32_Ehdr) + phnum * sizeof(Elf32_Phdr), 0);
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr *)headers.data();
+	std::memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+	ehdr->e_ident[EI_CLASS] = ELFCLASS32;
+	ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+	ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr->e_ident[EI_OSABI] = ELFOSABI_FREEBSD;
+	ehdr->e_type = ET_CORE;
+	ehdr->e_machine = EM_386;
+	ehdr->e_version = EV_CURRENT;
+	ehdr->e_phoff = sizeof(Elf32_Ehdr);
+	ehdr->e_ehsize = sizeof(Elf32_Ehdr);
+	ehdr->e_phentsize = sizeof(Elf32_Phdr);
+	ehdr->e_phnum = phnum;
+
+	Elf32_Phdr *phdr = (Elf32_Phdr *)(headers.data() + sizeof(Elf32_Ehdr));
+	phdr->p_type = PT_NOTE;
+	phdr->p_offset = headers.size();
+	phdr->p_filesz = notes.size();
+	phdr->p_align = 4;
+	size_t data_offset = align(headers.size() + notes.size(), page_size);
+	size_t offset = data_offset;
+	for (CoreSegment &segment: segments)
+	{
+		phdr++;
+		phdr->p_type = PT_LOAD;
+		phdr->p_offset = offset;
+		phdr->p_vaddr = segment.start;
+		phdr->p_filesz = phdr->p_memsz = segment.end - segment.start;
+		phdr->p_flags = ((segment.protection & PROT_READ) ? PF_R : 0) | ((segment.protection & PROT_WRITE) ? PF_W : 0) |
+			((segment.protection & PROT_EXEC) ? PF_X : 0);
+		phdr->p_align = page_size;
+		offset += segment.end - segment.start;
+	}
+
+	std::vector<BYTE> padding(data_offset - headers.size() - notes.size(), 0);
+	struct iovec iov[3] = {{headers.data(), headers.size()}, {notes.data(), notes.size()}, {padding.data(), padding.size()}};
+	write_calls++;
+	if (!writeVector(fd, iov, 3))
+	{
+		logError("Unable to write to '%s'", path);
+		return false;
+	}
+	written_bytes = data_offset;
+
+	failed = false;
+	ring.start([this](CoreChunk &chunk) {
+		struct iovec data = {chunk.data.data(), chunk.length};
+		if (!writeVector(fd, &data, 1)) { return false; }
+		written_bytes += chunk.length;
+		write_calls++;
+		return true;
+	});
+	return true;
+}
+
+BYTE *CoreWriter::buffer() { return ring.current().data.data(); } // CORE_CHUNK_SIZE bytes to copy the next piece of memory into
+
+void CoreWriter::submit(size_t length) // Queues the filled chunk and moves on to the next free one
+{
+	ring.current().length = length;
+	ring.submit();
+}
+
+bool CoreWriter::finish() // Waits for the writer and closes the file, false if anything failed to be written
+{
+	if (!ring.isRunning()) { return fd >= 0 && !failed; }
+	failed = !ring.finish();
+	if (close(fd) < 0) { failed = true; }
+	fd = -1;
+	if (failed) { logError("Errors occured while writing the core file, it is incomplete"); }
+	return !failed;
+}
+
+uint64_t CoreWriter::writtenBytes() { return written_bytes; }
+
+uint64_t CoreWriter::writeCalls() { return write_calls; }
+
+uint64_t CoreWriter::stallCount() { return ring.stallCount(); }
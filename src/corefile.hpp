@@ -0,0 +1,76 @@
+/*
+* FreeDBG - ELF Core File Writer (Header)
+*/
+
+#ifndef FREEDBG_COREFILE
+#define FREEDBG_COREFILE
+
+#include <machine/reg.h>
+#include <sys/types.h>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // BYTE, ADDR
+#include "chunkring.hpp" // ChunkRing
+
+
+#define CORE_CHUNK_SIZE 0x100000 // Debugee memory copied per PT_IO, a multiple of the page size
+#define CORE_RING_SLOTS 4 // Chunks that can be queued for the writer before copying has to wait
+
+
+struct CoreThread {
+	lwpid_t lwp;
+	struct reg regs;
+	struct fpreg fpregs;
+	bool have_fpregs;
+	int signal; // Signal that stopped the process, 0 for every thread but the one it stopped in
+};
+
+struct CoreChunk {
+	std::vector<BYTE> data;
+	size_t length = 0;
+};
+
+struct CoreSegment {
+	ADDR start;
+	ADDR end; // Exclusive
+	int protection; // PROT_* bits
+};
+
+
+/* Writes a FreeBSD i386 ELF core: headers and notes first, then the memory of
+* every segment in the order they were added. The caller copies debugee memory
+* straight into the ring chunk it's handed while the writer thread writes out the
+* ones before it, so reading the debugee overlaps writing the file and nothing is
+* allocated per page. The first thread added is the one debuggers show when they
+* open the core. */
+class CoreWriter {
+private:
+	int fd = -1;
+	std::vector<BYTE> notes;
+	std::vector<CoreSegment> segments;
+	ChunkRing<CoreChunk> ring;
+	bool failed = false;
+	uint64_t written_bytes = 0;
+	uint64_t write_calls = 0;
+	void addNote(int type, const void *desc, size_t size);
+
+public:
+	CoreWriter();
+	~CoreWriter();
+	CoreWriter(const CoreWriter&) = delete;
+	CoreWriter &operator=(const CoreWriter&) = delete;
+	void setProcess(pid_t pid, const char *name, const char *arguments);
+	void addThread(const CoreThread &thread);
+	void addSegment(ADDR start, ADDR end, int protection);
+	bool begin(const char *path);
+	BYTE *buffer();
+	void submit(size_t length);
+	bool finish();
+	uint64_t writtenBytes();
+	uint64_t writeCalls();
+	uint64_t stallCount();
+};
+
+
+#endif // FREEDBG_COREFILE
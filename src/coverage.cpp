@@ -0,0 +1,152 @@
+/*
+* FreeDBG - Basic Block Coverage
+*/
+
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include "logging.hpp" // logError
+#include "coverage.hpp" // CoverageMap
+#include "x86decode.hpp" // decodeInstruction, X86Instruction, FLOW_*
+
+
+struct DrcovBlock { // Layout of a drcov 'BB Table' entry
+	uint32_t start; // Offset from the module base
+	uint16_t size;
+	uint16_t module;
+};
+
+
+static bool isPadding(const BYTE *code, size_t length) // Alignment filler compilers put between functions and before loop heads
+{
+	static const struct { size_t length; BYTE bytes[7]; } LEA_FILLERS[] = {
+		{3, {0x8d, 0x76, 0x00}}, // lea esi, [esi+0]
+		{4, {0x8d, 0x74, 0x26, 0x00}}, // lea esi, [esi+eiz+0]
+		{6, {0x8d, 0xb6, 0x00, 0x00, 0x00, 0x00}},
+		{7, {0x8d, 0xb4, 0x26, 0x00, 0x00, 0x00, 0x00}},
+		{7, {0x8d, 0xbc, 0x27, 0x00, 0x00, 0x00, 0x00}} // lea edi, [edi+eiz+0]
+	};
+
+	size_t prefixes = 0;
+	while (prefixes < length && (code[prefixes] == 0x66 || code[prefixes] == 0x2e)) { prefixes++; } // Multi-byte NOPs are padded with these
+	if (length - prefixes == 1) { return code[prefixes] == 0x90 || code[prefixes] == 0xcc; } // nop, int3
+	if (length - prefixes >= 2 && code[prefixes] == 0x0f && code[prefixes + 1] == 0x1f) { return true; } // nopl, nopw
+	if (length == 2 && code[0] == 0x89 && (code[1] == 0xf6 || code[1] == 0xff)) { return true; } // mov esi, esi / mov edi, edi
+	for (auto &filler: LEA_FILLERS)
+	{
+		if (length == filler.length && !memcmp(code, filler.bytes, length)) { return true; }
+	}
+	return false;
+}
+
+
+/*****************************
+* CoverageMap Class Methods  *
+*****************************/
+void CoverageMap::addSection(const BYTE *code, size_t length, ADDR address)
+{
+	leaders.push_back(address);
+	section_ends.push_back(address + length);
+
+	bool block_ended = false; // The next real instruction starts a block
+	size_t offset = 0;
+	while (offset < length)
+	{
+		X86Instruction insn;
+		if (!decodeInstruction(code + offset, length - offset, insn))
+		{
+			skipped_bytes++;
+			offset++;
+			block_ended = true; // Whatever decodes next is where the sweep picks up again
+			continue;
+		}
+
+		ADDR current = address + offset;
+		boundaries.push_back(current);
+		if (block_ended && !isPadding(code + offset, insn.length))
+		{
+			leaders.push_back(current);
+			block_ended = false;
+		}
+		if (insn.flow != FLOW_NONE) // Calls end a block too, like they do for DynamoRIO
+		{
+			if (insn.relative) { leaders.push_back(current + insn.length + insn.displacement); }
+			section_ends.push_back(current + insn.length);
+			block_ended = true;
+		}
+		offset += insn.length;
+	}
+}
+
+void CoverageMap::finish() // Settles the leader list once every section has been swept
+{
+	std::sort(boundaries.begin(), boundaries.end());
+	std::sort(section_ends.begin(), section_ends.end());
+	std::sort(leaders.begin(), leaders.end());
+	leaders.erase(std::unique(leaders.begin(), leaders.end()), leaders.end());
+	leaders.erase(std::remove_if(leaders.begin(), leaders.end(), [&](ADDR leader) {
+		return !std::binary_search(boundaries.begin(), boundaries.end(), leader);
+	}), leaders.end());
+
+	/* A block runs until the next leader or the end of its control transfer, whichever comes first */
+	sizes.resize(leaders.size());
+	for (size_t i = 0; i < leaders.size(); i++)
+	{
+		auto end = std::upper_bound(section_ends.begin(), section_ends.end(), leaders[i]);
+		ADDR block_end = (end == section_ends.end()) ? leaders[i] + 1 : *end;
+		if (i + 1 < leaders.size()) { block_end = std::min(block_end, leaders[i + 1]); }
+		sizes[i] = std::min(block_end - leaders[i], (ADDR)COVERAGE_MAX_BLOCK);
+	}
+	hit.assign(leaders.size(), 0);
+	hit_count = 0;
+
+	boundaries.clear();
+	boundaries.shrink_to_fit();
+	section_ends.clear();
+	section_ends.shrink_to_fit();
+}
+
+const std::vector<ADDR> &CoverageMap::blockStarts() { return leaders; }
+
+bool CoverageMap::markHit(ADDR address) // False if address isn't a leader or was already hit
+{
+	auto it = std::lower_bound(leaders.begin(), leaders.end(), address);
+	if (it == leaders.end() || *it != address || hit[it - leaders.begin()]) { return false; }
+	hit[it - leaders.begin()] = 1;
+	hit_count++;
+	return true;
+}
+
+size_t CoverageMap::blockCount() { return leaders.size(); }
+
+size_t CoverageMap::hitCount() { return hit_count; }
+
+size_t CoverageMap::skippedBytes() { return skipped_bytes; }
+
+bool CoverageMap::writeDrcov(const char *path, const char *module_path, ADDR base, ADDR end) // drcov v2 with a single module, readable by Lighthouse and bncov
+{
+	FILE *file = fopen(path, "wb");
+	if (!file)
+	{
+		logError("Unable to open '%s'", path);
+		return false;
+	}
+
+	fprintf(file, "DRCOV VERSION: 2\nDRCOV FLAVOR: freedbg\n");
+	fprintf(file, "Module Table: version 2, count 1\nColumns: id, base, end, entry, checksum, timestamp, path\n");
+	fprintf(file, " 0, 0x%08X, 0x%08X, 0x00000000, 0x00000000, 0x00000000, %s\n", base, end, module_path);
+	fprintf(file, "BB Table: %zu bbs\n", hit_count);
+
+	std::vector<DrcovBlock> table;
+	table.reserve(hit_count);
+	for (size_t i = 0; i < leaders.size(); i++)
+	{
+		if (hit[i]) { table.push_back({(uint32_t)(leaders[i] - base), sizes[i], 0}); }
+	}
+	bool written = fwrite(table.data(), sizeof(DrcovBlock), table.size(), file) == table.size();
+	written = (fclose(file) == 0) && written;
+	if (!written) { logError("Errors occured while writing '%s'", path); }
+	return written;
+}
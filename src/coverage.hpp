@@ -0,0 +1,46 @@
+/*
+* FreeDBG - Basic Block Coverage (Header)
+*/
+
+#ifndef FREEDBG_COVERAGE
+#define FREEDBG_COVERAGE
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // BYTE, ADDR
+
+
+#define COVERAGE_MAX_BLOCK 0xffff // drcov stores block sizes in 16 bits
+
+
+/* Finds basic block leaders in the debugee's code with a linear sweep: the
+* start of every section, every direct branch or call target, and the first
+* real instruction after each control transfer (alignment padding between
+* functions is skipped, nothing ever jumps into it). Targets that don't land
+* on an instruction boundary of the sweep are dropped, so a breakpoint is
+* never planted in the middle of an instruction or in data the sweep got
+* out of step on. Hits are recorded by leader and written out as drcov. */
+class CoverageMap {
+private:
+	std::vector<ADDR> boundaries; // Every decoded instruction start, only kept until finish()
+	std::vector<ADDR> section_ends;
+	std::vector<ADDR> leaders; // Sorted after finish()
+	std::vector<uint16_t> sizes; // Parallel to 'leaders'
+	std::vector<uint8_t> hit;
+	size_t hit_count = 0;
+	size_t skipped_bytes = 0; // Bytes the sweep couldn't decode
+
+public:
+	void addSection(const BYTE *code, size_t length, ADDR address);
+	void finish();
+	const std::vector<ADDR> &blockStarts();
+	bool markHit(ADDR address);
+	size_t blockCount();
+	size_t hitCount();
+	size_t skippedBytes();
+	bool writeDrcov(const char *path, const char *module_path, ADDR base, ADDR end);
+};
+
+
+#endif // FREEDBG_COVERAGE
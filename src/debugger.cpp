@@ -8,412 +8,2790 @@
 */
 
 #include <unistd.h>
+#include <climits>
 #include <cstdlib>
 #include <cstdio>
 #include <cstdint>
 #include <cstring>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <chrono>
+#include <signal.h>
 #include <machine/reg.h>
 #include <sys/types.h>
 #include <sys/ptrace.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include "logging.hpp" // logError, logMsg
-#include "debugger.hpp" // Debugger, Breakpoint, BYTE, WORD, DWORD, ADDR
+#include "debugger.hpp" // Debugger, BYTE, WORD, DWORD, ADDR
+#include "memcache.hpp" // MemoryCache
+#include "registers.hpp" // RegisterFile, R_*, R_FLAGS
+#include "breakpoint.hpp" // Breakpoint, BreakpointTable, BPHANDLE
+#include "debugregs.hpp" // DebugRegisters
+#include "x86decode.hpp" // decodeInstruction, X86Instruction, MAX_INSN_LENGTH
+#include "watchpoint.hpp" // Watchpoint, WATCH_ACCESS
+#include "tracepoint.hpp" // Tracepoint, TraceRecord
+#include "symbols.hpp" // SymbolTable, Symbol
+#include "dwarfindex.hpp" // DwarfIndex
+#include "profiler.hpp" // Profiler
+#include "unwinder.hpp" // Unwinder
+#include "calltracer.hpp" // CallTracer
+#include "syscalltrace.hpp" // SyscallTracer
+#include "recorder.hpp" // TraceRecorder
+#include "tracefile.hpp" // TraceStep
+#include "coverage.hpp" // CoverageMap
+#include "condition.hpp" // Condition, CONDITION_RESULT
+#include "ptracestats.hpp" // dbgPtrace, dbgWaitpid
+#include "eventloop.hpp" // EventLoop, LoopEvent, LOOP_EVENT
+#include "procinfo.hpp" // ProcessMapping, processPath, processMappings
+#include "corefile.hpp" // CoreWriter, CoreThread, CORE_CHUNK_SIZE
+#include "pagesnapshot.hpp" // SnapshotStore, MemorySnapshot, PageChange, PAGE_CHANGE
+
+#define TRACEPOINT_AREA_SIZE 0x10000
+#define INTERRUPT_BENCH_MICROSECONDS 1000 // How long the debugee runs between benchmark interrupts
+#define SNAPSHOT_STACK_WINDOW 0x4000 // Bytes of each thread's stack copied by a snapshot
+#define SNAPSHOT_MAX_DEPTH 128
+#define SNAPSHOT_MAX_RANGE 0x100000
+#define DIFF_MAX_PAGES 32 // Changed pages listed by a memory diff, the rest are only counted
+#define LOOP_MAX_INPUT 0x10000
+#define LOOP_SEED 0x853c49e6748fea9bULL // Fixed, so the inputs of a loop are the same every run
+#define BREAKPOINT_BENCH_BASE 0x08048000 // Where 'break bench' scatters its breakpoints, like a large text segment
+#define BREAKPOINT_BENCH_SPAN 0x1000000
 
 // int ptrace(int request, pid_t pid, caddr_t addr, int data);
 // http://fxr.watson.org/fxr/source/sys/signal.h?v=FREEBSD-8-3
 
 
-/***************************
-* Breakpoint Class Methods *
-***************************/
-Breakpoint::Breakpoint(int pid, ADDR addr) : child_pid(pid), address(addr) {}
+static void hexDump(const BYTE *buffer, size_t size) // Offsets from 0 on the left, ascii on the right
+{
+	int8_t rowlength = 16; // Bytes per line
+	int8_t columnsize = 8; // Where to put space between output in each line
+	uint16_t linenumber = 0;
+	uint8_t ascii_chars[rowlength]; // Characters for ascii output after each line
 
-bool Breakpoint::isEnabled() { return enabled; }
+	std::memset(ascii_chars, '.', rowlength);
 
-bool Breakpoint::enable()
-{
-	if (enabled) { return true; }
+	printf("%04X: ", linenumber);
+
+	for (size_t offset = 0; offset < size; offset++)
+	{
+		printf("%02X ", buffer[offset]);
 
-	DWORD instructions = ptrace(PT_READ_I, child_pid, (caddr_t)address, 0);
-	if (instructions == -1) { return false; }
+		if ( buffer[offset] > 0x20 && buffer[offset] <= 0x7e )
+		{
+			ascii_chars[offset % rowlength] = buffer[offset];
+		}
 
-	/* Assuming little endianness */
-	saved_instruction = static_cast<BYTE>(instructions & 0xFF);
-	DWORD instruction_w_interrupt = ((instructions & ~0xFF) | 0xcc); // INT3 opcode
+		if ( (((offset + 1) % rowlength) == 0) || (offset + 1 == size) ) 
+		{
+			// Align ascii columns
+			for (int cursor = (((offset) % rowlength) + 1) * 3; cursor < rowlength*3; cursor++)
+			{
+				printf(" ");
+			}
 
-	if (ptrace(PT_WRITE_I, child_pid, (caddr_t)address, instruction_w_interrupt) < 0) { return false; }
+			printf("\t| ");
 
-	enabled = true;
-	return true;
+			// Print ascii representation
+			for (int i = 0; i < rowlength; i++)
+			{
+				printf("%c ", ascii_chars[i]);
+			}
+			printf("|\n");
+
+			// Print new linenumber and refill ascii_chars with periods
+			if (offset + 1 != size)
+			{
+				printf("%04X: ", linenumber + (offset + 1));
+				std::memset(ascii_chars, '.', rowlength);
+			}			
+		}
+	}
 }
 
-void Breakpoint::disable()
+
+static uint64_t nextRandom(uint64_t &state) // xorshift64*
 {
-	if (enabled)
-	{
-		DWORD instructions = ptrace(PT_READ_I, child_pid, (caddr_t)address, 0);
-		DWORD og_instruction = ((instructions & ~0xFF) | saved_instruction);
-		ptrace(PT_WRITE_I, child_pid, (caddr_t)address, og_instruction);
-		enabled = false;
-	}
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 0x2545f4914f6cdd1dULL;
 }
 
 
 /*************************
 * Debugger Class Methods *
 *************************/
-Debugger::Debugger(int pid) : child_pid(pid) {}
+Debugger::Debugger(int pid) : child_pid(pid), registers(pid), memory(pid), debug_registers(pid), breakpoints(memory.pageSize()),
+	unwinder(symbols, memory), syscalls(pid), threads(pid), memory_snapshots(memory.pageSize()) {}
 
 bool Debugger::isActive() { return active; }
 
 bool Debugger::waitOnChild()
 {
 	int waitstatus;
-	if (waitpid(child_pid, &waitstatus, 0) < 0)
+	if (dbgWaitpid(child_pid, &waitstatus, 0) < 0)
 	{
+		registers.invalidate();
+		resume_silently = false;
 		logError("Error occured while waiting for child process");
 		active = false;
+		return active;
+	}
+	return handleStatus(waitstatus);
+}
+
+bool Debugger::pollChild() // Non-blocking waitOnChild for the event loop, false if the debugee hasn't changed state yet
+{
+	int waitstatus;
+	pid_t result = dbgWaitpid(child_pid, &waitstatus, WNOHANG);
+	if (result == 0) { return false; } // SIGCHLD of a stop a blocking wait already reaped
+	if (result < 0)
+	{
+		waitOnChild(); // Reports the error the usual way
+		return true;
+	}
+	handleStatus(waitstatus);
+	return true;
+}
+
+void Debugger::waitForStop() // Waits for the debugee to stop, serving the terminal and Ctrl-C meanwhile when there's an event loop
+{
+	LoopEvent event;
+	while (events && events->wait(event))
+	{
+		if (event.type == EVENT_CHILD && pollChild()) { return; }
+		else if (event.type == EVENT_INTERRUPT) { interrupt(); }
+		else if (event.type == EVENT_TIMER && event.ident == interrupt_timer) { interrupt(); }
+		else if (event.type == EVENT_INPUT && input_handler) { input_handler(); }
 	}
-	else if (WIFEXITED(waitstatus))
+	events = nullptr; // The queue failed, stay with blocking waits from now on
+	waitOnChild();
+}
+
+bool Debugger::handleStatus(int waitstatus)
+{
+	registers.invalidate();
+	resume_silently = false;
+	stop_info_fetched = false;
+	checkpoint_faulted = false;
+	watchpoint_stopped = false;
+	if (WIFEXITED(waitstatus))
 	{
 		logMsg("Process %d has exited: %d", child_pid, WEXITSTATUS(waitstatus));
 		active = false;
+		if (syscalls.isEnabled()) { syscalls.printSummary(); }
 	}
 	else if (WIFSIGNALED(waitstatus))
 	{
 		logMsg("Process terminated by signal: %d", WTERMSIG(waitstatus));
 		active = false;
+		if (syscalls.isEnabled()) { syscalls.printSummary(); }
 	}
 	else if (WIFSTOPPED(waitstatus))
 	{
+		if (thread_events && handleThreadEvent()) { return active; }
 		if (WSTOPSIG(waitstatus) == 11) // Might flesh out later
 		{
-			logError("Process stopped by signal: SIGSEGV (Segmentation fault)");
-			active = false;
+			if (handleCheckpointFault()) { resume_silently = checkpoint_faulted = true; }
+			else if (protected_pages.empty() || !handleProtectionFault())
+			{
+				logError("Process stopped by signal: SIGSEGV (Segmentation fault)");
+				active = false;
+			}
 		}
 		else if (WSTOPSIG(waitstatus) == 5) // SIGTRAP (trace trap)
 		{
-			ptrace(PT_GETREGS, child_pid, (caddr_t)&registers, 0);
-			auto it = breakpoints.find(registers.r_eip-1);
-			if (it != breakpoints.end())
+			if (syscalls.isEnabled() && fetchStopInfo() && syscalls.handleStop(stop_info))
 			{
-				if (it->second.isEnabled())
-				{
-					logMsg("Stopped on breakpoint @0x%X", it->first);
-					current_breakpoint = &it->second;
-					current_breakpoint->disable();
-					registers.r_eip--;
-					ptrace(PT_SETREGS, child_pid, (caddr_t)&registers, 0);
-				}
+				resume_silently = true;
+				return active;
+			}
+			if (handleWatchpointTrap())
+			{
+				watchpoint_stopped = true;
+				return active;
+			}
+
+			ADDR eip = registers.read(R_EIP);
+			ADDR trap_address = eip - 1; // INT3 traps after executing, debug register breakpoints before
+			if (retireOneShot(trap_address))
+			{
+				resume_silently = true;
+				return active;
+			}
+			BPHANDLE handle = breakpoints.pageHasBreakpoints(trap_address) ? breakpoints.find(trap_address) : NO_BREAKPOINT;
+			BPHANDLE hw_handle = breakpoints.pageHasBreakpoints(eip) ? breakpoints.find(eip) : NO_BREAKPOINT;
+			if (handle != NO_BREAKPOINT && breakpoints[handle].isEnabled() && !breakpoints[handle].isHardware())
+			{
+				current_breakpoint = handle; // INT3 stays in place, see stepBreakpoint
+				registers.write(R_EIP, trap_address); // Rewound for real once the debugee resumes
+				if (!breakpointShouldStop(handle)) { resume_silently = true; }
+				else if (report_breakpoints) { logMsg("Stopped on breakpoint @0x%X%s%s", trap_address, symbolize(trap_address).c_str(), threadTag().c_str()); }
 			}
+			else if (hw_handle != NO_BREAKPOINT && breakpoints[hw_handle].isEnabled() && breakpoints[hw_handle].isHardware())
+			{
+				current_breakpoint = hw_handle; // Stays armed, nothing to restore
+				if (!breakpointShouldStop(hw_handle)) { resume_silently = true; }
+				else if (report_breakpoints) { logMsg("Stopped on hardware breakpoint @0x%X%s%s", eip, symbolize(eip).c_str(), threadTag().c_str()); }
+			}
+		}
+		else if (WSTOPSIG(waitstatus) == SIGSTOP && pending_stops > 0) // Sent by interrupt
+		{
+			pending_stops--;
+			if (interrupt_requested) { reportInterrupt(); }
+			else { resume_silently = true; } // Something else stopped the debugee first, this one is stale
+		}
+		else if (WSTOPSIG(waitstatus) == SIGINT) // Ctrl-C reaches the whole foreground process group, the debugee included
+		{
+			if (events) { events->clearInterrupt(); } // Handled here, the debugger's own copy mustn't interrupt the next run
+			reportInterrupt();
 		}
 		else
 		{
 			logError("Process stopped by signal: %d", WSTOPSIG(waitstatus));
 		}
 	}
+	if (!resume_silently) { interrupt_requested = false; } // Any reported stop answers an interrupt
 	return active;
 }
 
-void Debugger::start()
+void Debugger::reportInterrupt()
 {
-	active = true;
-	if (!waitOnChild()) { return; }
-	logMsg("Attached to process %d", child_pid);
-	logMsg("Stopped @0x%X", registers.r_eip);
+	if (interrupt_requested)
+	{
+		interrupt_latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() - interrupt_sent;
+	}
+	if (report_interrupts) { logMsg("Interrupted @0x%X%s%s", registers.read(R_EIP), symbolize(registers.read(R_EIP)).c_str(), threadTag().c_str()); }
 }
 
-void Debugger::killProcess()
+void Debugger::resume(int request, int signal) // Cached debugee memory is stale as soon as it runs again
+{
+	registers.flush();
+	debug_registers.flush();
+	memory.invalidate();
+	if (thread_events && request == PT_STEP) { threads.holdOthers(selected_thread); } // Nothing else may trap while one thread steps
+	else if (thread_events) { threads.releaseAll(); }
+	dbgPtrace(request, (request == PT_STEP && selected_thread) ? selected_thread : child_pid, (caddr_t)1, signal);
+}
+
+bool Debugger::fetchStopInfo()
+{
+	if (!stop_info_fetched) { stop_info_fetched = dbgPtrace(PT_LWPINFO, child_pid, (caddr_t)&stop_info, sizeof(stop_info)) >= 0; }
+	return stop_info_fetched;
+}
+
+bool Debugger::handleThreadEvent() // Follows births, exits and forks, true if that's all the stop was
 {
-	if (ptrace(PT_KILL, child_pid, 0, 0) < 0)
+	if (!fetchStopInfo()) { return false; }
+	lwpid_t lwp = stop_info.pl_lwpid;
+	if (stop_info.pl_flags & PL_FLAG_EXITED) // Reported by the thread on its way out
 	{
-		logError("Failed to kill child process %d", child_pid);
+		if (selected_thread == lwp)
+		{
+			selected_thread = 0;
+			current_breakpoint = NO_BREAKPOINT;
+			registers.setThread(0);
+		}
+		threads.remove(lwp);
+		debug_registers.removeThread(lwp);
+		resume_silently = true;
+		return true;
 	}
-	else
+
+	if (!threads.find(lwp)) // Born, or created before events were on
 	{
-		logMsg("Killed child process %d", child_pid);
-		active = false;
+		threads.add(lwp);
+		debug_registers.addThread(lwp);
+	}
+	selectThread(lwp);
+	if (stop_info.pl_flags & PL_FLAG_BORN)
+	{
+		resume_silently = true;
+		return true;
+	}
+	if (stop_info.pl_flags & PL_FLAG_FORKED)
+	{
+		handleFork(stop_info.pl_child_pid, stop_info.pl_flags & PL_FLAG_VFORKED);
+		if (syscalls.isEnabled()) { syscalls.handleStop(stop_info); } // Also fork's syscall exit
+		resume_silently = true;
+		return true;
 	}
+	return false;
 }
 
-void Debugger::detachProcess()
+void Debugger::handleFork(pid_t child, bool shares_memory) // The new process inherited every INT3 and would die on the first one it runs into
 {
-	ptrace(PT_DETACH, child_pid, 0, 0);
-	logMsg("Detached from child process %d", child_pid);
-	active = false;
+	int waitstatus;
+	if (dbgWaitpid(child, &waitstatus, 0) < 0 || !WIFSTOPPED(waitstatus)) { return; }
+	if (!shares_memory) // After vfork the memory is still the parent's, and so are the breakpoints in it
+	{
+		MemoryCache child_memory(child);
+		for (BPHANDLE handle = 0; handle < breakpoints.slotCount(); handle++)
+		{
+			if (!breakpoints.isLive(handle) || !breakpoints[handle].isEnabled() || breakpoints[handle].isHardware()) { continue; }
+			BYTE original = breakpoints[handle].getSavedInstruction();
+			child_memory.write(breakpoints[handle].getAddress(), &original, 1);
+		}
+		if (!protected_pages.empty()) { logError("Process %d inherited the page protections of software watchpoints and may fault", child); }
+		if (checkpoint_taken) { logError("Process %d inherited the write protection of the checkpoint and will fault on its first write to it", child); }
+	}
+	struct dbreg cleared;
+	std::memset(&cleared, 0, sizeof(cleared));
+	dbgPtrace(PT_SETDBREGS, child, (caddr_t)&cleared, 0);
+	dbgPtrace(PT_DETACH, child, (caddr_t)1, hold_forks ? SIGSTOP : 0);
+	if (hold_forks) { logMsg("Process %d forked %d, left stopped without breakpoints for another debugger", child_pid, child); }
+	else { logMsg("Process %d forked %d, released without breakpoints", child_pid, child); }
 }
 
-void Debugger::continueExec()
+void Debugger::selectThread(lwpid_t lwp) // A thread sitting on a breakpoint keeps it parked until it's resumed
 {
-	if (current_breakpoint != NULL) // Step 1 instruction, re-enable breakpoint on previous instruction, then continue
-	{
-		Breakpoint *bp = current_breakpoint;
-		current_breakpoint = NULL;
-		ptrace(PT_STEP, child_pid, (caddr_t)1, 0);
-		if (!waitOnChild()) { return; }
-		bp->enable();
+	if (lwp == selected_thread) { return; }
+	ThreadState *previous = threads.find(selected_thread);
+	if (previous) { previous->breakpoint = current_breakpoint; }
+	ThreadState *next = threads.find(lwp);
+	current_breakpoint = next ? next->breakpoint : NO_BREAKPOINT;
+	if (next) { next->breakpoint = NO_BREAKPOINT; }
+	registers.setThread(lwp);
+	selected_thread = lwp;
+}
 
-		if (current_breakpoint != NULL) { return; } // Just return if another breakpoint is immediatly after the last one
+bool Debugger::passParkedBreakpoints() // Steps other threads off the breakpoints they were left on, false if one stopped on something else
+{
+	lwpid_t selected = selected_thread;
+	for (lwpid_t lwp: threads.ids())
+	{
+		ThreadState *thread = threads.find(lwp);
+		if (!thread || thread->breakpoint == NO_BREAKPOINT) { continue; }
+		selectThread(lwp);
+		if (!passBreakpoint()) { return false; }
 	}
-	ptrace(PT_CONTINUE, child_pid, (caddr_t)1, 0);
-	waitOnChild();
+	selectThread(selected);
+	return true;
 }
 
+std::string Debugger::threadTag() // " in thread N" once there's more than one
+{
+	ThreadState *thread = threads.find(selected_thread);
+	if (!thread || threads.count() < 2) { return ""; }
+	return " in thread " + std::to_string(thread->number);
+}
 
-void Debugger::setBreakpoint(ADDR address)
+int Debugger::singleStep() // Bare single step for internal use, returns the stop signal or -1 if the process is gone
 {
-	auto it = breakpoints.find(address);
-	if (it != breakpoints.end())
+	int waitstatus;
+	do // A first write to a page the checkpoint protects is let through and the step taken again
 	{
-		Breakpoint bp = it->second;
-		if (bp.isEnabled()) { logMsg("Breakpoint @0x%X already enabled", address); }
-		else
-        {
-            if (bp.enable()) { logMsg("Breakpoint @0x%X enabled", address); }
-            else
-            {
-                logError("Unable to enable breakpoint @0x%X (removing from list)", address);
-                breakpoints.erase(address);
-            }
-        }
-	}
-	else
-    {
-        Breakpoint bp(child_pid, address);
-        if (bp.enable())
-        {
-            logMsg("Breakpoint @0x%X set/enabled", address);
-            breakpoints.emplace(address, bp);
-        }
-        else { logError("Unable to set breakpoint @0x%X", address); }
-    }
+		resume(PT_STEP);
+		registers.invalidate();
+		stop_info_fetched = false;
+		if (dbgWaitpid(child_pid, &waitstatus, 0) < 0 || !WIFSTOPPED(waitstatus))
+		{
+			logMsg("Process %d is no longer running", child_pid);
+			active = false;
+			return -1;
+		}
+	} while (WSTOPSIG(waitstatus) == SIGSEGV && handleCheckpointFault());
+	step_watchpoint = (WSTOPSIG(waitstatus) == SIGTRAP) ? triggeredWatchpoint() : nullptr; // Clears DR6 either way, the caller reports it once EIP is right
+	return WSTOPSIG(waitstatus);
 }
 
-void Debugger::unsetBreakpoint(ADDR address)
+size_t Debugger::readCode(ADDR address, BYTE *buffer, size_t size) // Reads instruction bytes as they'd be without breakpoints
 {
-	auto it = breakpoints.find(address);
-	if (it != breakpoints.end())
+	size_t page_size = memory.pageSize();
+	size_t length = size;
+	if (!memory.read(address, buffer, length))
 	{
-		it->second.disable();
-		logMsg("Breakpoint @0x%X disabled", address);
+		length = page_size - (address & (page_size - 1)); // Next page may be unmapped, settle for the rest of this one
+		if (length > size || !memory.read(address, buffer, length)) { return 0; }
 	}
-	else
+
+	hideBreakpoints(address, buffer, length);
+	return length;
+}
+
+void Debugger::hideBreakpoints(ADDR address, BYTE *buffer, size_t size) // Puts the original bytes back over our INT3s in a copy of debugee memory
+{
+	for (BYTE *at = buffer; (at = (BYTE *)memchr(at, 0xcc, buffer + size - at)) != NULL; at++)
 	{
-		logError("No breakpoint set @0x%X", address);
+		ADDR location = address + (at - buffer);
+		if (!breakpoints.pageHasBreakpoints(location)) { continue; }
+		BPHANDLE handle = breakpoints.find(location);
+		if (handle != NO_BREAKPOINT && breakpoints[handle].isEnabled() && !breakpoints[handle].isHardware()) { *at = breakpoints[handle].getSavedInstruction(); }
 	}
 }
 
-void Debugger::deleteBreakpoint(ADDR address)
+bool Debugger::injectSyscall(int number, const std::vector<uint32_t> &args, DWORD &result)
 {
-	if (breakpoints.find(address) != breakpoints.end())
-    {
-        breakpoints.erase(address);
-        logMsg("Breakpoint @0x%X deleted", address);
-    }
-    else { logError("No breakpoint set @0x%X", address); }
+	/* Execute 'int 0x80' in place of the current instruction, with the arguments pushed
+	* below the stack pointer like a libc stub would, then put everything back */
+	const struct reg saved_registers = registers.get();
+	ADDR eip = saved_registers.r_eip;
+	BYTE saved_code[2];
+	BYTE syscall_code[2] = {0xcd, 0x80}; // int 0x80
+	if (!memory.read(eip, saved_code, sizeof(saved_code))) { return false; }
+
+	std::vector<uint32_t> frame(1, 0); // Return address slot, then arguments
+	frame.insert(frame.end(), args.begin(), args.end());
+	ADDR frame_address = (saved_registers.r_esp - 256 - frame.size() * sizeof(uint32_t)) & ~(ADDR)0xf;
+	if (!memory.write(frame_address, frame.data(), frame.size() * sizeof(uint32_t))) { return false; }
+	if (!memory.write(eip, syscall_code, sizeof(syscall_code))) { return false; }
+
+	registers.write(R_EAX, number);
+	registers.write(R_ESP, frame_address);
+	registers.write(R_EFLAGS, saved_registers.r_eflags | RESUME_FLAG); // A hardware breakpoint on eip would trap again before the syscall runs
+	int signal = singleStep();
+	if (signal < 0) { return false; }
+
+	bool ran = signal == SIGTRAP && registers.read(R_EIP) == eip + sizeof(syscall_code); // Any other stop means EAX still holds the number
+	result = registers.read(R_EAX);
+	bool failed = registers.read(R_CARRY); // FreeBSD returns errno in EAX with carry set
+
+	memory.write(eip, saved_code, sizeof(saved_code));
+	registers.set(saved_registers);
+	return ran && !failed;
 }
 
-void Debugger::listBreakpoints()
+ADDR Debugger::mapDebugeeMemory(size_t length, int prot) // Anonymous mapping inside the debugee, 0 on failure
 {
-	for (auto &addr_bp: breakpoints)
-    {
-        ADDR address = addr_bp.first;
-        Breakpoint bp = addr_bp.second;
-        printf("Breakpoint @0x%X: ", address);
-        if (bp.isEnabled()) { puts("Enabled"); }
-        else { puts("Disabled"); }
-    }
+	DWORD result;
+	std::vector<uint32_t> args = {0, (uint32_t)length, (uint32_t)prot, MAP_PRIVATE | MAP_ANON, (uint32_t)-1, 0, 0}; // off_t takes two words
+	if (!injectSyscall(SYS_mmap, args, result)) { return 0; }
+	return result;
 }
 
-
-void Debugger::stepInto()
+bool Debugger::queryProtection(ADDR address, int &prot)
 {
-	if (current_breakpoint != NULL)
-	{
-		Breakpoint *bp = current_breakpoint;
-		ptrace(PT_STEP, child_pid, (caddr_t)1, 0);
-		if (!waitOnChild()) { return; }
-		bp->enable();
-		if (bp == current_breakpoint) { current_breakpoint = NULL; } // Just return if another breakpoint is immediatly after the last one
-		else { return; }
-	}
-	else
+	struct ptrace_vm_entry entry;
+	std::memset(&entry, 0, sizeof(entry));
+	while (true)
 	{
-		ptrace(PT_STEP, child_pid, (caddr_t)1, 0);
-		if (!waitOnChild()) { return; }
+		entry.pve_path = NULL;
+		entry.pve_pathlen = 0;
+		if (dbgPtrace(PT_VM_ENTRY, child_pid, (caddr_t)&entry, 0) < 0) { return false; }
+		if (address >= entry.pve_start && address <= entry.pve_end) // pve_end is inclusive
+		{
+			prot = entry.pve_prot;
+			return true;
+		}
 	}
-	if (current_breakpoint == NULL) { logMsg("Stopped @0x%X", registers.r_eip); }
 }
 
-void Debugger::stepOver()
+bool Debugger::protectPage(ADDR page) // Applies whatever protection the page's watchpoints currently need
 {
+	auto it = protected_pages.find(page);
+	if (it == protected_pages.end()) { return false; }
+
+	ProtectedPage &info = it->second;
+	int prot = info.original_prot;
+	if (info.read_watches > 0) { prot = PROT_NONE; }
+	else if (info.write_watches > 0) { prot &= ~PROT_WRITE; }
 
+	DWORD result;
+	return injectSyscall(SYS_mprotect, {(uint32_t)page, (uint32_t)memory.pageSize(), (uint32_t)prot}, result);
 }
 
-void Debugger::stepUntil(ADDR address)
+bool Debugger::handleProtectionFault() // Returns false if the fault wasn't caused by a software watchpoint
 {
-	auto it = breakpoints.find(address);
-	if (it != breakpoints.end()) // If theres already a breakpoint enabled at that address, just continue
+	if (!fetchStopInfo() || !(stop_info.pl_flags & PL_FLAG_SI)) { return false; }
+	struct ptrace_lwpinfo info = stop_info;
+
+	ADDR page_mask = ~(ADDR)(memory.pageSize() - 1);
+	ADDR fault_address = (ADDR)info.pl_siginfo.si_addr;
+	auto page_it = protected_pages.find(fault_address & page_mask);
+	if (page_it == protected_pages.end()) { return false; }
+
+	bool is_write = registers.get().r_err & 0x2; // Page fault error code: bit 1 is set for writes
+	ADDR access_start = fault_address; // si_addr is only the first byte of the access
+	size_t access_size = 1;
+	BYTE code[MAX_INSN_LENGTH];
+	X86Instruction insn;
+	if (decodeInstruction(code, readCode(registers.read(R_EIP), code, sizeof(code)), insn)) { access_size = insn.access_size; }
+
+	/* Lift the protection, let the faulting instruction run, then protect the page(s) again */
+	std::vector<ADDR> lifted;
+	DWORD result;
+	int signal = SIGSEGV;
+	while (signal == SIGSEGV)
 	{
-		bool previously_disabled = !it->second.isEnabled(); // If breakpoint was disabled, re-enable, then disable again once stopped
-		it->second.enable();
-		continueExec();
-		if (previously_disabled) { it->second.disable(); }
+		ADDR page = fault_address & page_mask;
+		if (protected_pages.find(page) == protected_pages.end() || std::find(lifted.begin(), lifted.end(), page) != lifted.end()) { break; }
+		if (!injectSyscall(SYS_mprotect, {(uint32_t)page, (uint32_t)memory.pageSize(), (uint32_t)protected_pages[page].original_prot}, result)) { break; }
+		lifted.push_back(page);
+
+		signal = singleStep();
+		if (signal == SIGSEGV) // Access straddles into another protected page
+		{
+			if (dbgPtrace(PT_LWPINFO, child_pid, (caddr_t)&info, sizeof(info)) < 0) { break; }
+			fault_address = (ADDR)info.pl_siginfo.si_addr;
+		}
 	}
-	else
+
+	/* A hit overlaps the watched bytes, or for writes changed them on a page the step was let onto */
+	bool hit = false;
+	for (auto &wp: watchpoints)
 	{
-		Breakpoint bp(child_pid, address); // Enable temporary breakpoint, continue to it, then disable breakpoint
-		bp.enable();
-		continueExec();
-		if (current_breakpoint == NULL) // Since this bp isn't "registered", the IP needs to be rewound if no other breaks were hit along the way
+		if (signal != SIGTRAP) { break; }
+		if (wp.isHardware() || !(wp.getAccess() & (is_write ? WATCH_WRITE : WATCH_READ))) { continue; }
+		bool overlaps = access_start < wp.getAddress() + wp.getLength() && wp.getAddress() < (uint64_t)access_start + access_size;
+		bool changed = false;
+		if (is_write && !overlaps && std::any_of(lifted.begin(), lifted.end(), [&](ADDR page) {
+			return page < wp.getAddress() + wp.getLength() && wp.getAddress() < (uint64_t)page + memory.pageSize(); }))
 		{
-			registers.r_eip--;
-			ptrace(PT_SETREGS, child_pid, (caddr_t)&registers, 0);
-			logMsg("Stopped @0x%X", registers.r_eip);
+			std::vector<BYTE> current(wp.getLength());
+			changed = memory.read(wp.getAddress(), current.data(), current.size()) && current != wp.value();
 		}
-		bp.disable();
+		if (!overlaps && !changed) { continue; }
+		reportWatchpoint(wp); // Read while the page is still accessible
+		hit = true;
 	}
+	bool hardware_hit = signal == SIGTRAP && reportStepWatchpoint();
+	for (ADDR page: lifted) { protectPage(page); }
+
+	if (signal == SIGSEGV) { return false; } // A real fault after all
+	if (!hit && !hardware_hit) { resume_silently = true; }
+	return true;
 }
 
+const CheckpointRange *Debugger::findCheckpointRange(ADDR page)
+{
+	auto it = std::upper_bound(checkpoint_ranges.begin(), checkpoint_ranges.end(), page, [](ADDR address, const CheckpointRange &range) {
+		return address < range.start;
+	});
+	if (it == checkpoint_ranges.begin() || page >= (--it)->end) { return nullptr; }
+	return &*it;
+}
 
-void Debugger::writeRegister(int regcode, DWORD value)
+bool Debugger::markCheckpointDirty(ADDR page) // Must come before the page is written, the first time copies what it holds
 {
-	struct reg regs;
-	ptrace(PT_GETREGS, child_pid, (caddr_t)&regs, 0);
-	switch (regcode)
+	CheckpointPage &entry = checkpoint_pages[page];
+	if (entry.original.empty())
 	{
-		case R_EAX:
-			regs.r_eax = value;
-			break;
-		case R_EBX:
-			regs.r_ebx = value;
-			break;
-		case R_ECX:
-			regs.r_ecx = value;
-			break;
-		case R_EDX:
-			regs.r_edx = value;
-			break;
-		case R_ESI:
-			regs.r_esi = value;
-			break;
-		case R_EDI:
-			regs.r_edi = value;
-			break;
-		case R_EBP:
-			regs.r_ebp = value;
-			break;
-		case R_EIP:
-			regs.r_eip = value;
-			break;
-		case R_ESP:
-			regs.r_esp = value;
-			break;
-		case R_CARRY:
-			if (value) { regs.r_eflags |= CARRY_FLAG; } // If given value isn't zero, set flag
-			else { regs.r_eflags &= ~CARRY_FLAG; } // If given value is zero, unset flag
-			break;
-		case R_ZERO:
-			if (value) { regs.r_eflags |= ZERO_FLAG; } 
-			else { regs.r_eflags &= ~ZERO_FLAG; } 
-			break;
-		case R_SIGN:
-			if (value) { regs.r_eflags |= SIGN_FLAG; } 
-			else { regs.r_eflags &= ~SIGN_FLAG; } 
-			break;
-		case R_OVERFLOW:
-			if (value) { regs.r_eflags |= OVERFLOW_FLAG; } 
-			else { regs.r_eflags &= ~OVERFLOW_FLAG; } 
-			break;
-		default:
-			break;
+		entry.original.resize(memory.pageSize());
+		if (memory.readDirect(page, entry.original.data(), entry.original.size()) != entry.original.size())
+		{
+			checkpoint_pages.erase(page);
+			return false;
+		}
+	}
+	if (!entry.dirty)
+	{
+		entry.dirty = true;
+		dirty_pages.push_back(page);
 	}
-	ptrace(PT_SETREGS, child_pid, (caddr_t)&regs, 0);
+	return true;
 }
 
-void Debugger::writeMemory()
+bool Debugger::handleCheckpointFault() // Returns false if the fault wasn't a first write to a page the checkpoint protects
 {
+	if (!checkpoint_taken || !fetchStopInfo() || !(stop_info.pl_flags & PL_FLAG_SI) || !(registers.get().r_err & 0x2)) { return false; }
+	ADDR page = (ADDR)stop_info.pl_siginfo.si_addr & ~(ADDR)(memory.pageSize() - 1);
+	const CheckpointRange *range = findCheckpointRange(page);
+	auto it = checkpoint_pages.find(page);
+	if (range == nullptr || (it != checkpoint_pages.end() && it->second.writable)) { return false; }
 
+	/* Keep what it holds now and let the write through, the debugee retries it when it resumes */
+	DWORD result;
+	if (!markCheckpointDirty(page)) { return false; }
+	if (!injectSyscall(SYS_mprotect, {(uint32_t)page, (uint32_t)memory.pageSize(), (uint32_t)range->prot}, result)) { return false; }
+	checkpoint_pages[page].writable = true;
+	checkpoint_faults++;
+	return true;
 }
 
-void Debugger::printRegisters()
+bool Debugger::rollBack() // Puts the checkpoint's registers and every page written since back, false if some of it couldn't be
 {
-	struct reg regs;
-	ptrace(PT_GETREGS, child_pid, (caddr_t)&regs, 0);
-	printf("EAX: %X\n", regs.r_eax);
-	printf("EBX: %X\n", regs.r_ebx);
-	printf("ECX: %X\n", regs.r_ecx);
-	printf("EDX: %X\n", regs.r_edx);
-	printf("ESI: %X\n", regs.r_esi);
-	printf("EDI: %X\n", regs.r_edi);
-	printf("EBP: %X\n", regs.r_ebp);
-	printf("EIP: %X\n", regs.r_eip);
-	printf("ESP: %X\n", regs.r_esp);
-	printf("EFLAGS: %X [ ", regs.r_eflags); // Probably more efficient way to do this
-	if (regs.r_eflags & CARRY_FLAG) { printf("CF "); }
-    if (regs.r_eflags & ZERO_FLAG) { printf("ZF "); }
-    if (regs.r_eflags & SIGN_FLAG) { printf("SF "); }
-    if (regs.r_eflags & OVERFLOW_FLAG) { printf("OF "); }
-    puts("]");
-
-}
+	if (!active || !checkpoint_taken) { return false; }
+	size_t page_size = memory.pageSize();
+	bool restored = true;
+	std::sort(dirty_pages.begin(), dirty_pages.end());
 
-void Debugger::printMemory(ADDR address, size_t size)
-{
-	BYTE buffer[size];
-	struct ptrace_io_desc io_desc;
-	io_desc.piod_op = PIOD_READ_D;
-	io_desc.piod_offs = (void *)address;
-	io_desc.piod_addr = (void *)buffer;
-	io_desc.piod_len = size;
+	/* Adjacent pages go back with one write */
+	for (size_t first = 0, last = 0; first < dirty_pages.size(); first = last)
+	{
+		last = first + 1;
+		while (last < dirty_pages.size() && dirty_pages[last] == dirty_pages[last - 1] + page_size) { last++; }
+		restore_buffer.resize((last - first) * page_size);
+		for (size_t i = first; i < last; i++) { std::memcpy(&restore_buffer[(i - first) * page_size], checkpoint_pages[dirty_pages[i]].original.data(), page_size); }
+		if (!memory.write(dirty_pages[first], restore_buffer.data(), restore_buffer.size())) { restored = false; }
+	}
 
-	if (ptrace(PT_IO, child_pid, (caddr_t)&io_desc, 0) < 0)
+	/* And lose their write access again with one mprotect, pages that keep it stay dirty so they're always put back */
+	std::vector<ADDR> still_dirty;
+	for (size_t first = 0, last = 0; first < dirty_pages.size(); first = last)
 	{
-		logError("Unable to read from 0x%X", address);
-		return;
+		CheckpointPage &entry = checkpoint_pages[dirty_pages[first]];
+		last = first + 1;
+		if (!entry.writable)
+		{
+			entry.dirty = false;
+			continue;
+		}
+		const CheckpointRange *range = findCheckpointRange(dirty_pages[first]);
+		while (last < dirty_pages.size() && dirty_pages[last] == dirty_pages[last - 1] + page_size && dirty_pages[last] < range->end &&
+			checkpoint_pages[dirty_pages[last]].writable) { last++; }
+		DWORD result;
+		bool protect = injectSyscall(SYS_mprotect, {(uint32_t)dirty_pages[first], (uint32_t)((last - first) * page_size), (uint32_t)(range->prot & ~PROT_WRITE)}, result);
+		for (size_t i = first; i < last; i++)
+		{
+			CheckpointPage &page = checkpoint_pages[dirty_pages[i]];
+			page.writable = page.dirty = !protect;
+			if (!protect) { still_dirty.push_back(dirty_pages[i]); }
+		}
+		if (!protect) { restored = false; }
 	}
+	dirty_pages.swap(still_dirty);
 
-	int8_t rowlength = 16; // Bytes per line
-	int8_t columnsize = 8; // Where to put space between output in each line
-	uint16_t linenumber = 0;
-	uint8_t ascii_chars[rowlength]; // Characters for ascii output after each line
+	registers.set(checkpoint_registers);
+	current_breakpoint = breakpoints.isLive(checkpoint_breakpoint) ? checkpoint_breakpoint : NO_BREAKPOINT;
+	return restored;
+}
 
-	std::memset(ascii_chars, '.', rowlength);
+void Debugger::releaseCheckpoint() // Gives the debugee its write access back and forgets the checkpoint
+{
+	if (!checkpoint_taken) { return; }
+	DWORD result;
+	for (CheckpointRange &range: checkpoint_ranges)
+	{
+		if (active && !injectSyscall(SYS_mprotect, {(uint32_t)range.start, (uint32_t)(range.end - range.start), (uint32_t)range.prot}, result))
+		{
+			logError("Unable to give write access back to 0x%X-0x%X", range.start, range.end);
+		}
+	}
+	checkpoint_taken = false;
+	checkpoint_ranges.clear();
+	checkpoint_pages.clear();
+	dirty_pages.clear();
+}
 
-	printf("%04X: ", linenumber);
+bool Debugger::readMappings(std::vector<ProcessMapping> &mappings) // The memory map as the debugee sees it, without the checkpoint's write protection
+{
+	if (!processMappings(child_pid, mappings)) { return false; }
+	if (!checkpoint_taken) { return true; }
 
-	for (size_t offset = 0; offset < size; offset++)
+	/* Pages written since the checkpoint split its ranges into pieces, put them back together */
+	std::vector<ProcessMapping> merged;
+	merged.reserve(mappings.size());
+	for (ProcessMapping &mapping: mappings)
 	{
-		printf("%02X ", buffer[offset]);
-
-		if ( buffer[offset] > 0x20 && buffer[offset] <= 0x7e )
+		const CheckpointRange *range = findCheckpointRange(mapping.start);
+		if (range) { mapping.protection = range->prot; }
+		if (range && !merged.empty() && merged.back().end == mapping.start && findCheckpointRange(merged.back().start) == range)
 		{
-			ascii_chars[offset % rowlength] = buffer[offset];
+			merged.back().end = mapping.end;
+			continue;
 		}
-
-		if ( (((offset + 1) % rowlength) == 0) || (offset + 1 == size) ) 
+		merged.push_back(mapping);
+	}
+	mappings.swap(merged);
+	return true;
+}
+
+Watchpoint *Debugger::triggeredWatchpoint() // Runs on every trap, so DR6 is cleared even when a hardware breakpoint fired
+{
+	unsigned watched = 0; // Slots hardware watchpoints own, a hardware breakpoint's slot firing isn't a watchpoint hit
+	for (auto &wp: watchpoints)
+	{
+		for (int slot = 0; slot < DEBUG_SLOTS; slot++)
+		{
+			if (wp.ownsSlot(slot)) { watched |= 1u << slot; }
+		}
+	}
+
+	int slot = debug_registers.triggeredSlot(watched);
+	if (slot < 0) { return nullptr; }
+	for (auto &wp: watchpoints)
+	{
+		if (wp.ownsSlot(slot)) { return &wp; }
+	}
+	return nullptr;
+}
+
+bool Debugger::handleWatchpointTrap()
+{
+	Watchpoint *wp = triggeredWatchpoint();
+	if (wp == nullptr) { return false; }
+	reportWatchpoint(*wp);
+	return true;
+}
+
+bool Debugger::reportStepWatchpoint() // Reports a watchpoint hit by the last singleStep, true if there was one and the debugee should stay stopped
+{
+	if (step_watchpoint == nullptr) { return false; }
+	Watchpoint *wp = step_watchpoint;
+	step_watchpoint = nullptr;
+	reportWatchpoint(*wp);
+	watchpoint_stopped = true;
+	return true;
+}
+
+void Debugger::reportWatchpoint(Watchpoint &wp)
+{
+	std::vector<BYTE> current(wp.getLength());
+	std::vector<BYTE> &previous = wp.value();
+	if (!memory.read(wp.getAddress(), current.data(), current.size()))
+	{
+		logMsg("Watchpoint @0x%X accessed, stopped @0x%X", wp.getAddress(), registers.read(R_EIP));
+		return;
+	}
+
+	size_t first_change = 0;
+	while (first_change < current.size() && current[first_change] == previous[first_change]) { first_change++; }
+
+	if (first_change == current.size())
+	{
+		logMsg("Watchpoint @0x%X read, stopped @0x%X", wp.getAddress(), registers.read(R_EIP));
+	}
+	else
+	{
+		logMsg("Watchpoint @0x%X written (first change @0x%X), stopped @0x%X", wp.getAddress(),
+			wp.getAddress() + first_change, registers.read(R_EIP));
+		size_t shown = std::min(current.size(), (size_t)16); // Up to 16 bytes, starting at the first change if possible
+		size_t start = std::min(first_change, current.size() - shown);
+		printf("Old: ");
+		for (size_t i = start; i < start + shown; i++) { printf("%02X ", previous[i]); }
+		printf("\nNew: ");
+		for (size_t i = start; i < start + shown; i++) { printf("%02X ", current[i]); }
+		printf("\n");
+	}
+	previous = current;
+}
+
+std::string Debugger::symbolize(ADDR address) // " <symbol+0xoffset> at file:line" for messages, empty if unknown
+{
+	std::string name = symbols.describe(address);
+	if (name.empty() && lines.functionAt(address)) { name = lines.functionAt(address); } // Static functions stripped from .symtab
+	std::string text = name.empty() ? name : " <" + name + ">";
+
+	std::string file;
+	uint32_t line;
+	if (lines.describe(address, file, line)) { text += " at " + file.substr(file.rfind('/') + 1) + ":" + std::to_string(line); }
+	return text;
+}
+
+bool Debugger::loadSymbols(const char *path)
+{
+	auto begin = std::chrono::steady_clock::now();
+	if (!symbols.load(path))
+	{
+		logError("Unable to load symbols from '%s'", path);
+		return false;
+	}
+
+	if (symbols.isRelocatable()) // Find where the kernel put the image, its first mapping is the one at file offset 0
+	{
+		char target[PATH_MAX];
+		if (!realpath(path, target)) { strncpy(target, path, sizeof(target) - 1); }
+
+		std::vector<ProcessMapping> mappings; // Read with sysctl, so this also works before attaching
+		bool found = false;
+		if (processMappings(child_pid, mappings))
+		{
+			for (ProcessMapping &mapping: mappings)
+			{
+				if (mapping.offset != 0 || mapping.path != target) { continue; }
+				symbols.setLoadAddress(mapping.start);
+				found = true;
+				break;
+			}
+		}
+		if (!found) { logError("Unable to find where '%s' is loaded, symbols are unrelocated", path); }
+	}
+
+	double elapsed = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - begin).count();
+	logMsg("Loaded %zu symbols from '%s' in %.2f ms", symbols.size(), path, elapsed);
+
+	begin = std::chrono::steady_clock::now();
+	if (!lines.load(symbols, path))
+	{
+		logMsg("No DWARF line information in '%s'", path);
+		return true;
+	}
+	lines.setBias(symbols.getBias());
+	elapsed = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - begin).count();
+	if (lines.loadedFromCache())
+	{
+		logMsg("Loaded line index (%zu rows, %zu files, %zu functions) from cache in %.2f ms", lines.rowCount(),
+			lines.fileCount(), lines.functionCount(), elapsed);
+	}
+	else
+	{
+		logMsg("Built line index (%zu rows, %zu files, %zu functions) on %d threads in %.2f ms", lines.rowCount(),
+			lines.fileCount(), lines.functionCount(), lines.threadsUsed(), elapsed);
+	}
+	return true;
+}
+
+bool Debugger::resolveSourceLine(const std::string &text, std::vector<ADDR> &addresses) // 'FILE:LINE', one address per function the line was compiled into
+{
+	size_t colon = text.rfind(':');
+	if (colon == std::string::npos || colon == 0) { return false; }
+	size_t end;
+	unsigned long line;
+	try { line = std::stoul(text.substr(colon + 1), &end, 10); }
+	catch(...) { return false; }
+	if (end != text.length() - colon - 1) { return false; }
+	return lines.lookupLine(std::string_view(text).substr(0, colon), line, addresses);
+}
+
+bool Debugger::resolveAddress(const std::string &text, ADDR &address) // Accepts 'symbol', 'symbol+OFFSET', 'FILE:LINE' or a hex address
+{
+	if (text.find(':') != std::string::npos)
+	{
+		std::vector<ADDR> addresses;
+		if (!resolveSourceLine(text, addresses)) { return false; }
+		address = addresses.front();
+		return true;
+	}
+
+	size_t plus = text.find('+');
+	ADDR offset = 0;
+	if (plus != std::string::npos)
+	{
+		try { offset = std::stoul(text.substr(plus + 1), 0, 16); }
+		catch(...) { return false; }
+	}
+
+	if (symbols.lookup(std::string_view(text).substr(0, plus), address))
+	{
+		address += offset;
+		return true;
+	}
+	if (plus != std::string::npos) { return false; }
+
+	size_t end;
+	try { address = std::stoul(text, &end, 16); }
+	catch(...) { return false; }
+	return end == text.length();
+}
+
+void Debugger::profile(unsigned int hz, const char *folded_path) // Runs the debugee to completion under the sampling profiler
+{
+	registers.flush();
+	memory.invalidate();
+	Profiler profiler(child_pid, registers, symbols, lines, unwinder);
+	logMsg("Profiling process %d at %u Hz", child_pid, hz);
+	profiler.run(hz);
+	active = false;
+
+	profiler.printFlat(25);
+	profiler.printPauseStats();
+	if (profiler.writeFolded(folded_path)) { logMsg("Folded stacks written to '%s'", folded_path); }
+}
+
+void Debugger::traceCalls(const std::string &function_list) // Runs the debugee to completion, timing every call to the listed functions
+{
+	CallTracer tracer;
+	size_t start = 0;
+	while (start <= function_list.length())
+	{
+		size_t end = function_list.find(',', start);
+		if (end == std::string::npos) { end = function_list.length(); }
+		std::string name = function_list.substr(start, end - start);
+		start = end + 1;
+		if (name.empty()) { continue; }
+
+		ADDR address;
+		if (!resolveAddress(name, address)) { logError("Unable to resolve '%s', not tracing it", name.c_str()); }
+		else if (!tracer.addFunction(name, address)) { logError("'%s' is already traced under another name", name.c_str()); }
+		else if (breakpoints.find(address) == NO_BREAKPOINT)
+		{
+			Breakpoint bp(memory, address);
+			if (bp.enable()) { breakpoints.insert(bp); }
+			else { logError("Unable to set breakpoint on '%s' @0x%X", name.c_str(), address); }
+		}
+	}
+	if (tracer.functionCount() == 0)
+	{
+		logError("Nothing to trace");
+		return;
+	}
+
+	auto clock = []() { return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); };
+	std::unordered_map<ADDR,BPHANDLE> return_breakpoints; // Temporary breakpoints planted on return addresses
+	uint64_t started = clock();
+	uint64_t stopped = 0;
+	int waitstatus = 0;
+	int pending_signal = 0;
+	logMsg("Tracing %zu function(s) in process %d", tracer.functionCount(), child_pid);
+
+	while (true)
+	{
+		if (stopped) { tracer.addStop(clock() - stopped); }
+		resume(PT_CONTINUE, pending_signal);
+		pending_signal = 0;
+		if (dbgWaitpid(child_pid, &waitstatus, 0) < 0 || !WIFSTOPPED(waitstatus)) { break; }
+		stopped = clock();
+		registers.invalidate();
+
+		if (WSTOPSIG(waitstatus) != SIGTRAP)
+		{
+			pending_signal = WSTOPSIG(waitstatus);
+			stopped = 0; // Not the tracer's doing
+			continue;
+		}
+		ADDR address = registers.read(R_EIP) - 1;
+		BPHANDLE handle = breakpoints.pageHasBreakpoints(address) ? breakpoints.find(address) : NO_BREAKPOINT;
+		if (handle == NO_BREAKPOINT || !breakpoints[handle].isEnabled()) { continue; }
+		registers.write(R_EIP, address);
+
+		auto planted = return_breakpoints.find(address);
+		if (planted != return_breakpoints.end() || tracer.pendingReturns(address) > 0)
+		{
+			tracer.leave(address, registers.read(R_ESP), stopped);
+			if (planted != return_breakpoints.end() && tracer.pendingReturns(address) == 0) // Nothing else will come back here, no need to step over it either
+			{
+				breakpoints[handle].disable();
+				breakpoints.erase(handle);
+				return_breakpoints.erase(planted);
+				continue;
+			}
+		}
+
+		int function = tracer.functionAt(address);
+		if (function >= 0)
+		{
+			ADDR esp = registers.read(R_ESP);
+			uint32_t return_address;
+			if (memory.read(esp, &return_address, sizeof(return_address)))
+			{
+				tracer.enter(function, esp, return_address, stopped);
+				if (breakpoints.find(return_address) == NO_BREAKPOINT)
+				{
+					Breakpoint bp(memory, return_address);
+					if (bp.enable()) { return_breakpoints[return_address] = breakpoints.insert(bp); }
+				}
+			}
+		}
+
+		/* Step past the INT3 without taking it out, so other threads (and recursion) still hit it */
+		if (!displacedStep(handle) && active)
+		{
+			breakpoints[handle].disable();
+			int signal = singleStep();
+			if (breakpoints.isLive(handle)) { breakpoints[handle].enable(); }
+			if (signal < 0) { break; }
+			if (signal != SIGTRAP) { pending_signal = signal; }
+		}
+		reportStepWatchpoint(); // Only reported, tracing runs to the end regardless
+		if (!active) { break; }
+	}
+	active = false;
+
+	if (WIFEXITED(waitstatus)) { logMsg("Process %d has exited: %d", child_pid, WEXITSTATUS(waitstatus)); }
+	else if (WIFSIGNALED(waitstatus)) { logMsg("Process terminated by signal: %d", WTERMSIG(waitstatus)); }
+	tracer.printSummary((clock() - started) / 1e9);
+}
+
+void Debugger::collectCoverage(const char *module_path, const char *output_path) // Runs the debugee to completion with a one-shot breakpoint on every basic block
+{
+	auto begin = std::chrono::steady_clock::now();
+	std::vector<CodeSection> sections;
+	if (!symbols.getCodeSections(sections))
+	{
+		logError("No executable sections in '%s'", module_path);
+		return;
+	}
+	for (auto &section: sections) { coverage.addSection(section.data, section.length, section.address); }
+	coverage.finish();
+	double elapsed = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - begin).count();
+	logMsg("Found %zu basic blocks in %zu section(s) in %.2f ms", coverage.blockCount(), sections.size(), elapsed);
+	if (coverage.skippedBytes()) { logMsg("%zu byte(s) of code couldn't be decoded and were skipped", coverage.skippedBytes()); }
+	setBreakpoints(coverage.blockStarts(), true);
+
+	/* Every block costs one stop the first time it runs and nothing after, so the run converges on native speed */
+	auto started = std::chrono::steady_clock::now();
+	uint64_t stops = 0;
+	int waitstatus = 0;
+	int pending_signal = 0;
+	while (true)
+	{
+		resume(PT_CONTINUE, pending_signal);
+		pending_signal = 0;
+		if (dbgWaitpid(child_pid, &waitstatus, 0) < 0 || !WIFSTOPPED(waitstatus)) { break; }
+		registers.invalidate();
+		if (WSTOPSIG(waitstatus) != SIGTRAP) { pending_signal = WSTOPSIG(waitstatus); } // Delivered untouched, the program may rely on it
+		else if (retireOneShot(registers.read(R_EIP) - 1)) { stops++; }
+	}
+	active = false;
+	elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+	if (WIFEXITED(waitstatus)) { logMsg("Process %d has exited: %d", child_pid, WEXITSTATUS(waitstatus)); }
+	else if (WIFSIGNALED(waitstatus)) { logMsg("Process terminated by signal: %d", WTERMSIG(waitstatus)); }
+	logMsg("Covered %zu of %zu basic blocks (%.1f%%) in %.3f s, %llu breakpoint stops", coverage.hitCount(), coverage.blockCount(),
+		coverage.blockCount() ? 100.0 * coverage.hitCount() / coverage.blockCount() : 0.0, elapsed, (unsigned long long)stops);
+
+	char module[PATH_MAX] = {};
+	if (!realpath(module_path, module)) { strncpy(module, module_path, sizeof(module) - 1); }
+	ADDR image_start, image_end;
+	symbols.getImageRange(image_start, image_end);
+	if (coverage.writeDrcov(output_path, module, image_start, image_end)) { logMsg("Coverage written to '%s' (drcov)", output_path); }
+}
+
+void Debugger::start() // Waits for the exec stop of the process we forked, nothing to do after attach
+{
+	if (active) { return; }
+	active = true;
+	if (!waitOnChild()) { return; }
+	logMsg("Attached to process %d", child_pid);
+	logMsg("Stopped @0x%X%s", registers.read(R_EIP), symbolize(registers.read(R_EIP)).c_str());
+}
+
+bool Debugger::attach() // Stops a running process and takes it over, the counterpart of start for -p
+{
+	if (dbgPtrace(PT_ATTACH, child_pid, 0, 0) < 0)
+	{
+		logError("Unable to attach to process %d", child_pid);
+		return false;
+	}
+	int waitstatus;
+	if (dbgWaitpid(child_pid, &waitstatus, 0) < 0 || !WIFSTOPPED(waitstatus))
+	{
+		logError("Process %d is no longer running", child_pid);
+		return false;
+	}
+	active = true;
+	attached = true;
+	logMsg("Attached to process %d", child_pid);
+	logMsg("Stopped @0x%X%s", registers.read(R_EIP), symbolize(registers.read(R_EIP)).c_str());
+	return true;
+}
+
+bool Debugger::isAttached() { return attached; }
+
+void Debugger::snapshot(const char *memory_ranges) // Attach, copy registers, stacks and memory, detach, and only then make sense of the copy
+{
+	/* Everything that doesn't need the target stopped happens before attaching */
+	std::vector<std::pair<ADDR,size_t>> ranges;
+	std::string list = memory_ranges ? memory_ranges : "";
+	for (size_t start = 0; start < list.size();)
+	{
+		size_t end = list.find(',', start);
+		if (end == std::string::npos) { end = list.size(); }
+		std::string range = list.substr(start, end - start);
+		size_t colon = range.rfind(':');
+		ADDR address;
+		unsigned long length = 0;
+		try { length = (colon != std::string::npos) ? std::stoul(range.substr(colon + 1), 0, 0) : 0; }
+		catch(...) { length = 0; }
+		if (length == 0 || length > SNAPSHOT_MAX_RANGE || !resolveAddress(range.substr(0, colon), address))
+		{
+			logError("Invalid memory range '%s', expected ADDR:LEN", range.c_str());
+			return;
+		}
+		ranges.push_back({address, length});
+		start = end + 1;
+	}
+	std::vector<ProcessMapping> mappings;
+	processMappings(child_pid, mappings); // To keep stack reads inside their mapping
+
+	std::vector<std::vector<BYTE>> range_data(ranges.size());
+	for (size_t i = 0; i < ranges.size(); i++) { range_data[i].resize(ranges[i].second); }
+	struct ThreadCopy {
+		lwpid_t lwp;
+		struct reg regs;
+		bool have_regs;
+		std::vector<BYTE> stack;
+	};
+	std::vector<ThreadCopy> copies;
+	uint64_t requests = 0;
+	auto io = [&](ADDR address, BYTE *buffer, size_t length) -> size_t {
+		struct ptrace_io_desc io_desc;
+		io_desc.piod_op = PIOD_READ_D;
+		io_desc.piod_offs = (void *)(uintptr_t)address;
+		io_desc.piod_addr = buffer;
+		io_desc.piod_len = length;
+		requests++;
+		return (dbgPtrace(PT_IO, child_pid, (caddr_t)&io_desc, 0) < 0) ? 0 : io_desc.piod_len;
+	};
+
+	/* The pause: one request per thread for registers and one for its stack, one per memory range */
+	auto attaching = std::chrono::steady_clock::now();
+	requests++;
+	if (dbgPtrace(PT_ATTACH, child_pid, 0, 0) < 0)
+	{
+		logError("Unable to attach to process %d", child_pid);
+		return;
+	}
+	int waitstatus = 0;
+	std::vector<int> pending_signals; // Overtook our SIGSTOP, held back until detach so the target doesn't run their handlers meanwhile
+	while (dbgWaitpid(child_pid, &waitstatus, 0) >= 0 && WIFSTOPPED(waitstatus) && WSTOPSIG(waitstatus) != SIGSTOP)
+	{
+		pending_signals.push_back(WSTOPSIG(waitstatus));
+		requests++;
+		dbgPtrace(PT_CONTINUE, child_pid, (caddr_t)1, 0);
+	}
+	if (!WIFSTOPPED(waitstatus))
+	{
+		logError("Process %d is no longer running", child_pid);
+		return;
+	}
+	auto stopped = std::chrono::steady_clock::now();
+
+	std::vector<lwpid_t> lwps(std::max(dbgPtrace(PT_GETNUMLWPS, child_pid, 0, 0), 0));
+	requests++;
+	if (!lwps.empty())
+	{
+		lwps.resize(std::max(dbgPtrace(PT_GETLWPLIST, child_pid, (caddr_t)lwps.data(), lwps.size()), 0));
+		requests++;
+	}
+	copies.resize(lwps.size());
+	for (size_t i = 0; i < lwps.size(); i++)
+	{
+		ThreadCopy &copy = copies[i];
+		copy.lwp = lwps[i];
+		requests++;
+		copy.have_regs = dbgPtrace(PT_GETREGS, copy.lwp, (caddr_t)&copy.regs, 0) >= 0;
+		if (!copy.have_regs) { continue; }
+		ADDR esp = copy.regs.r_esp;
+		ADDR limit = (esp | (memory.pageSize() - 1)) + 1; // Unknown mapping, its own page is certainly there
+		for (ProcessMapping &mapping: mappings)
+		{
+			if (esp >= mapping.start && esp < mapping.end) { limit = mapping.end; }
+		}
+		copy.stack.resize(std::min((size_t)SNAPSHOT_STACK_WINDOW, (size_t)(limit - esp)));
+		copy.stack.resize(io(esp, copy.stack.data(), copy.stack.size()));
+	}
+	for (size_t i = 0; i < ranges.size(); i++) { range_data[i].resize(io(ranges[i].first, range_data[i].data(), ranges[i].second)); }
+
+	requests++;
+	dbgPtrace(PT_DETACH, child_pid, (caddr_t)1, pending_signals.empty() ? 0 : pending_signals[0]);
+	auto detached = std::chrono::steady_clock::now();
+	for (size_t i = 1; i < pending_signals.size(); i++) { kill(child_pid, pending_signals[i]); } // Each handed back once, in the order they came
+
+	/* Nothing below touches the target */
+	for (ThreadCopy &copy: copies)
+	{
+		printf("\nThread LWP %d:\n", (int)copy.lwp);
+		if (!copy.have_regs)
+		{
+			printf("  (registers unavailable)\n");
+			continue;
+		}
+		const struct reg &regs = copy.regs;
+		printf("  eax=%08X ebx=%08X ecx=%08X edx=%08X esi=%08X edi=%08X\n  ebp=%08X esp=%08X eip=%08X eflags=%08X\n", regs.r_eax, regs.r_ebx,
+			regs.r_ecx, regs.r_edx, regs.r_esi, regs.r_edi, regs.r_ebp, regs.r_esp, regs.r_eip, regs.r_eflags);
+		std::vector<ADDR> frames;
+		unwinder.setWindow(regs.r_esp, copy.stack.data(), copy.stack.size());
+		unwinder.unwind(regs, frames, SNAPSHOT_MAX_DEPTH, true);
+		for (size_t i = 0; i < frames.size(); i++)
+		{
+			ADDR location = i == 0 ? frames[i] : frames[i] - 1;
+			printf("  #%-2zu 0x%08X%s\n", i, frames[i], symbolize(location).c_str());
+		}
+		if (unwinder.leftWindow()) { printf("  (stack continues past the %zu bytes copied)\n", copy.stack.size()); }
+	}
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		printf("\nMemory @0x%X%s, %zu bytes:\n", ranges[i].first, symbolize(ranges[i].first).c_str(), ranges[i].second);
+		if (range_data[i].size() < ranges[i].second) { printf("(only %zu bytes readable)\n", range_data[i].size()); }
+		if (!range_data[i].empty()) { hexDump(range_data[i].data(), range_data[i].size()); }
+	}
+
+	double paused = std::chrono::duration<double,std::milli>(detached - attaching).count();
+	double copying = std::chrono::duration<double,std::milli>(detached - stopped).count();
+	printf("\n");
+	logMsg("Process %d was paused for %.3f ms (attach to detach), %.3f ms of it after the stop was seen, %llu ptrace requests", child_pid,
+		paused, copying, (unsigned long long)requests);
+}
+
+void Debugger::enableThreadEvents() // Report thread births and exits, and hand forked children over instead of letting them escape
+{
+	if (!active || thread_events) { return; }
+	if (dbgPtrace(PT_LWP_EVENTS, child_pid, 0, 1) < 0 || !threads.refresh())
+	{
+		logError("Unable to follow the threads of process %d", child_pid);
+		return;
+	}
+	if (dbgPtrace(PT_FOLLOW_FORK, child_pid, 0, 1) < 0) { logError("Unable to follow forks of process %d", child_pid); }
+	for (lwpid_t lwp: threads.ids()) { debug_registers.addThread(lwp); }
+	thread_events = true;
+	if (fetchStopInfo()) { selectThread(stop_info.pl_lwpid); }
+}
+
+void Debugger::listThreads()
+{
+	if (!thread_events)
+	{
+		logError("Threads aren't being followed");
+		return;
+	}
+	for (lwpid_t lwp: threads.ids())
+	{
+		ThreadState *thread = threads.find(lwp);
+		bool selected = (lwp == selected_thread);
+		struct reg regs;
+		bool have_regs = true;
+		if (selected) { regs = registers.get(); } // May hold unflushed changes
+		else { have_regs = dbgPtrace(PT_GETREGS, lwp, (caddr_t)&regs, 0) >= 0; }
+		struct ptrace_lwpinfo info;
+		const char *name = (dbgPtrace(PT_LWPINFO, lwp, (caddr_t)&info, sizeof(info)) >= 0) ? info.pl_tdname : "";
+		bool on_breakpoint = selected ? current_breakpoint != NO_BREAKPOINT : thread->breakpoint != NO_BREAKPOINT;
+
+		printf("%c %-3d LWP %-7d %-16s", selected ? '*' : ' ', thread->number, (int)lwp, name);
+		if (have_regs) { printf(" 0x%08X%s", (ADDR)regs.r_eip, symbolize(regs.r_eip).c_str()); }
+		printf("%s\n", on_breakpoint ? " (on breakpoint)" : "");
+	}
+	logMsg("%zu thread(s)", threads.count());
+}
+
+void Debugger::switchThread(int number)
+{
+	ThreadState *thread = thread_events ? threads.findNumber(number) : nullptr;
+	if (!thread)
+	{
+		logError("No thread %d", number);
+		return;
+	}
+	selectThread(thread->lwp);
+	logMsg("Thread %d (LWP %d) @0x%X%s", number, (int)thread->lwp, registers.read(R_EIP), symbolize(registers.read(R_EIP)).c_str());
+}
+
+void Debugger::backtraceAllThreads()
+{
+	if (!thread_events)
+	{
+		printBacktrace();
+		return;
+	}
+	lwpid_t selected = selected_thread;
+	for (lwpid_t lwp: threads.ids())
+	{
+		selectThread(lwp);
+		printf("\nThread %d (LWP %d):\n", threads.find(lwp)->number, (int)lwp);
+		printBacktrace();
+	}
+	selectThread(selected);
+}
+
+void Debugger::setForkMode(bool hold)
+{
+	hold_forks = hold;
+	logMsg(hold ? "Forked children will be left stopped for another debugger" : "Forked children will run on their own");
+}
+
+void Debugger::killProcess()
+{
+	if (dbgPtrace(PT_KILL, child_pid, 0, 0) < 0)
+	{
+		logError("Failed to kill child process %d", child_pid);
+	}
+	else
+	{
+		logMsg("Killed child process %d", child_pid);
+		active = false;
+	}
+}
+
+void Debugger::detachProcess()
+{
+	/* Leave nothing behind that would trap once we're gone */
+	for (BPHANDLE handle = 0; handle < breakpoints.slotCount(); handle++)
+	{
+		if (breakpoints.isLive(handle)) { breakpoints[handle].disable(); }
+	}
+	while (!watchpoints.empty()) { deleteWatchpoint(watchpoints.back().getAddress()); }
+	releaseCheckpoint();
+	for (auto &tp: tracepoints) { tp.remove(); } // Trampolines stay mapped, in case a thread is still inside one
+	registers.flush();
+	debug_registers.flush();
+	threads.releaseAll();
+	dbgPtrace(PT_DETACH, child_pid, 0, 0);
+	logMsg("Detached from child process %d", child_pid);
+	active = false;
+}
+
+bool Debugger::displacedStep(BPHANDLE bp) // Runs a copy of the breakpointed instruction from the scratch page
+{
+	if (scratch_unavailable) { return false; }
+	if (scratch_address == 0)
+	{
+		scratch_address = mapDebugeeMemory(memory.pageSize(), PROT_READ | PROT_WRITE | PROT_EXEC);
+		if (scratch_address == 0)
+		{
+			scratch_unavailable = true;
+			return false;
+		}
+	}
+
+	ADDR address = breakpoints[bp].getAddress();
+	BYTE code[MAX_INSN_LENGTH];
+	X86Instruction insn;
+	size_t length = readCode(address, code, sizeof(code));
+	if (length == 0 || !decodeInstruction(code, length, insn)) { return false; }
+
+	if (scratch_contents != address)
+	{
+		if (!memory.write(scratch_address, code, insn.length)) { return false; }
+		scratch_contents = address;
+	}
+
+	registers.write(R_EIP, scratch_address);
+	int signal = singleStep();
+	if (signal != SIGTRAP)
+	{
+		if (signal > 0) { registers.write(R_EIP, address); } // Let the caller retry in place
+		return false;
+	}
+
+	/* Map the instruction pointer (and a pushed return address) back to the original location.
+	* Relative branch targets were computed from the scratch address, absolute ones are fine as is. */
+	ADDR eip = registers.read(R_EIP);
+	ADDR next = address + insn.length;
+	if (eip == scratch_address + insn.length) { registers.write(R_EIP, next); }
+	else if (insn.relative) { registers.write(R_EIP, eip - scratch_address + address); }
+
+	if (insn.flow == FLOW_CALL)
+	{
+		uint32_t return_address = next;
+		memory.write(registers.read(R_ESP), &return_address, sizeof(return_address));
+	}
+	return true;
+}
+
+bool Debugger::breakpointShouldStop(BPHANDLE handle) // Runs the breakpoint's condition and ignore count against the stop's registers
+{
+	Breakpoint &bp = breakpoints[handle];
+	Condition &condition = bp.getCondition();
+	if (!condition.isEmpty())
+	{
+		DWORD value;
+		ADDR fault;
+		int result = condition.evaluate(registers.get(), memory, value, fault);
+		if (result == CONDITION_BAD_MEMORY)
+		{
+			logError("Condition '%s' reads unmapped memory @0x%X, stopping", condition.getText().c_str(), fault);
+			return true;
+		}
+		if (result == CONDITION_DIVIDE_BY_ZERO)
+		{
+			logError("Condition '%s' divides by zero, stopping", condition.getText().c_str());
+			return true;
+		}
+		if (!value) { return false; }
+	}
+	return bp.countHit();
+}
+
+bool Debugger::passBreakpoint() // Gets the debugee past the breakpoint it's stopped on, false if something else stopped it first
+{
+	if (current_breakpoint == NO_BREAKPOINT) { return true; }
+	if (breakpoints[current_breakpoint].isHardware()) // Let it run once, then it's armed again
+	{
+		current_breakpoint = NO_BREAKPOINT;
+		registers.write(R_EFLAGS, registers.read(R_EFLAGS) | RESUME_FLAG);
+		return true;
+	}
+	return stepBreakpoint();
+}
+
+bool Debugger::retireOneShot(ADDR address) // Takes out a one-shot INT3 that was just hit and rewinds onto its instruction
+{
+	BPHANDLE handle = breakpoints.pageHasBreakpoints(address) ? breakpoints.find(address) : NO_BREAKPOINT;
+	if (handle == NO_BREAKPOINT || !breakpoints[handle].isOneShot() || !breakpoints[handle].isEnabled()) { return false; }
+	breakpoints[handle].disable();
+	breakpoints.erase(handle);
+	registers.write(R_EIP, address);
+	coverage.markHit(address);
+	return true;
+}
+
+bool Debugger::stepBreakpoint() // Executes the instruction under the current breakpoint, false if something else stopped the debugee
+{
+	BPHANDLE bp = current_breakpoint;
+	current_breakpoint = NO_BREAKPOINT;
+	resume_silently = false; // Only set again if the step stops on a breakpoint whose condition doesn't hold
+	bool inserted = breakpoints.isLive(bp) && breakpoints[bp].isEnabled();
+
+	if (inserted && displacedStep(bp)) { return !reportStepWatchpoint(); } // EIP is back at the original location for the report
+	if (!active) { return false; }
+
+	/* No displaced stepping, fall back to removing the INT3 for one step */
+	if (inserted) { breakpoints[bp].disable(); }
+	resume(PT_STEP);
+	bool stopped = waitOnChild();
+	if (inserted && breakpoints.isLive(bp)) { breakpoints[bp].enable(); }
+	return stopped && current_breakpoint == NO_BREAKPOINT && !watchpoint_stopped;
+}
+
+void Debugger::continueExec()
+{
+	if (thread_events && threads.count() > 1 && !passParkedBreakpoints()) { return; }
+	do // Conditional breakpoints that don't hold resume silently, and have to be stepped past like any other
+	{
+		if (!passBreakpoint()) { continue; } // Just return if another breakpoint is immediatly after the last one
+		resume(syscalls.isEnabled() ? PT_SYSCALL : PT_CONTINUE); // PT_SYSCALL also stops at every syscall entry and exit
+		syscalls.resumed();
+		waitForStop();
+	} while (active && resume_silently);
+}
+
+bool Debugger::attachEventLoop(EventLoop &loop, std::function<void()> on_input) // Lets continueExec be interrupted, on_input runs whenever the terminal has input meanwhile
+{
+	if (!loop.watchChild(child_pid)) { return false; }
+	events = &loop;
+	input_handler = on_input;
+	return true;
+}
+
+void Debugger::interrupt() // Stops the running debugee, the stop is reported by whichever wait is in progress
+{
+	if (interrupt_requested) { return; }
+	interrupt_sent = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	if (kill(child_pid, SIGSTOP) < 0)
+	{
+		logError("Unable to interrupt process %d", child_pid);
+		return;
+	}
+	interrupt_requested = true;
+	pending_stops++;
+}
+
+void Debugger::benchmarkInterrupts(uint32_t rounds) // Lets the debugee run briefly and interrupts it from a timer, timing SIGSTOP to handler
+{
+	if (!events)
+	{
+		logError("Interrupt benchmark needs the event loop");
+		return;
+	}
+	LatencyHistogram latency;
+	uint32_t round = 0;
+	report_interrupts = false;
+	for (; round < rounds && active; round++)
+	{
+		interrupt_latency = 0;
+		interrupt_timer = events->addTimer(INTERRUPT_BENCH_MICROSECONDS, false);
+		if (!interrupt_timer) { break; }
+		continueExec();
+		events->removeTimer(interrupt_timer);
+		interrupt_timer = 0;
+		if (interrupt_latency == 0) { break; } // A breakpoint, signal or exit came first
+		latency.record(interrupt_latency);
+	}
+	report_interrupts = true;
+
+	if (round < rounds) { logMsg("Benchmark ended after %u of %u interrupts", round, rounds); }
+	if (latency.samples())
+	{
+		printf("Interrupt to handler over %llu stops: mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n", (unsigned long long)latency.samples(),
+			latency.mean() / 1000.0, latency.percentile(50) / 1000.0, latency.percentile(99) / 1000.0, latency.maximum() / 1000.0);
+	}
+	if (active) { logMsg("Stopped @0x%X%s", registers.read(R_EIP), symbolize(registers.read(R_EIP)).c_str()); }
+}
+
+
+void Debugger::benchmarkBreakpointHits(uint64_t hits) // Runs through hits breakpoint hits with displaced stepping, then as many removing the INT3 for each step
+{
+	static const char *MODES[] = {"Displaced stepping", "Remove/step/reinsert"};
+	bool scratch_was_unavailable = scratch_unavailable;
+	report_breakpoints = false;
+	for (int mode = 0; mode < 2 && active; mode++)
+	{
+		scratch_unavailable = scratch_was_unavailable || mode == 1; // displacedStep gives up at once, so stepBreakpoint falls back
+		uint64_t hit = 0;
+		auto started = std::chrono::steady_clock::now();
+		while (hit < hits && active)
+		{
+			if (thread_events && threads.count() > 1 && !passParkedBreakpoints()) { break; }
+			if (passBreakpoint())
+			{
+				resume(syscalls.isEnabled() ? PT_SYSCALL : PT_CONTINUE);
+				syscalls.resumed();
+				waitForStop();
+			}
+			if (current_breakpoint != NO_BREAKPOINT) { hit++; } // Whether or not its condition held
+			else if (!resume_silently) { break; } // Stopped by something else
+		}
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+		if (mode == 0) { scratch_was_unavailable = scratch_unavailable; } // Mapping the scratch page may have just failed
+		if (mode == 0 && scratch_was_unavailable) { logMsg("No scratch page in the debugee, the first run falls back as well"); }
+		printf("%-22s %llu hits in %.3f s (%.0f hits/s)\n", MODES[mode], (unsigned long long)hit, elapsed, elapsed > 0 ? hit / elapsed : 0.0);
+		if (hit < hits)
+		{
+			logMsg("Benchmark ended after %llu of %llu hits", (unsigned long long)hit, (unsigned long long)hits);
+			break;
+		}
+	}
+	scratch_unavailable = scratch_was_unavailable;
+	report_breakpoints = true;
+	if (active) { logMsg("Stopped @0x%X%s", registers.read(R_EIP), symbolize(registers.read(R_EIP)).c_str()); }
+}
+
+void Debugger::setBreakpoint(ADDR address, bool hardware)
+{
+	BPHANDLE handle = breakpoints.find(address);
+	if (handle != NO_BREAKPOINT)
+	{
+		Breakpoint &bp = breakpoints[handle];
+		if (bp.isEnabled()) { logMsg("Breakpoint @0x%X already enabled", address); }
+		else
+        {
+            if (bp.enable()) { logMsg("Breakpoint @0x%X enabled", address); }
+            else
+            {
+                logError("Unable to enable breakpoint @0x%X (removing from list)", address);
+                breakpoints.erase(handle);
+            }
+        }
+	}
+	else
+    {
+        Breakpoint bp = hardware ? Breakpoint(debug_registers, address) : Breakpoint(memory, address);
+        if (bp.enable())
+        {
+            logMsg("%s @0x%X set/enabled", hardware ? "Hardware breakpoint" : "Breakpoint", address);
+            breakpoints.insert(bp);
+        }
+        else if (hardware) { logError("Unable to set hardware breakpoint @0x%X (no free debug registers)", address); }
+        else { logError("Unable to set breakpoint @0x%X", address); }
+    }
+}
+
+size_t Debugger::setBreakpoints(std::vector<ADDR> addresses, bool one_shot)
+{
+	auto start_time = std::chrono::steady_clock::now();
+	std::sort(addresses.begin(), addresses.end());
+	addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+	breakpoints.reserve(breakpoints.size() + addresses.size());
+
+	size_t page_size = memory.pageSize();
+	std::vector<BYTE> page_buffer(page_size);
+	size_t set_count = 0;
+	size_t page_count = 0;
+	size_t index = 0;
+
+	/* Patch every breakpoint on a page in a local copy, then write the patched span back at once */
+	while (index < addresses.size())
+	{
+		ADDR page = addresses[index] & ~(ADDR)(page_size - 1);
+		size_t page_end = index;
+		while (page_end < addresses.size() && (addresses[page_end] & ~(ADDR)(page_size - 1)) == page) { page_end++; }
+
+		if (!memory.read(page, page_buffer.data(), page_size))
+		{
+			logError("Unable to read page @0x%X, skipping %zu breakpoint(s)", page, page_end - index);
+			index = page_end;
+			continue;
+		}
+
+		size_t first = page_size;
+		size_t last = 0;
+		std::vector<std::pair<ADDR,BYTE>> patched;
+		for (size_t i = index; i < page_end; i++)
+		{
+			BPHANDLE handle = breakpoints.find(addresses[i]);
+			if (handle != NO_BREAKPOINT && (one_shot || breakpoints[handle].isEnabled() || breakpoints[handle].isHardware())) { continue; } // One-shots leave user breakpoints alone
+
+			size_t offset = addresses[i] - page;
+			patched.emplace_back(addresses[i], page_buffer[offset]);
+			page_buffer[offset] = 0xcc; // INT3 opcode
+			first = std::min(first, offset);
+			last = std::max(last, offset);
+		}
+		index = page_end;
+		if (patched.empty()) { continue; }
+
+		if (!memory.write(page + first, page_buffer.data() + first, last - first + 1))
+		{
+			logError("Unable to write page @0x%X, skipping %zu breakpoint(s)", page, patched.size());
+			continue;
+		}
+		page_count++;
+
+		for (auto &addr_byte: patched)
+		{
+			BPHANDLE handle = breakpoints.insert(Breakpoint(memory, addr_byte.first, one_shot)); // Returns existing handle if already known
+			breakpoints[handle].markEnabled(addr_byte.second);
+			set_count++;
+		}
+	}
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	logMsg("%zu breakpoint(s) set across %zu page(s) in %.3f ms (%.0f insertions/s)", set_count, page_count,
+		elapsed * 1000, elapsed > 0 ? set_count / elapsed : 0.0);
+	return set_count;
+}
+
+bool Debugger::compileCondition(const std::string &expression, Condition &condition)
+{
+	if (condition.compile(expression, [this](const std::string &name, ADDR &address) { return resolveAddress(name, address); })) { return true; }
+	logError("Invalid condition '%s': %s", expression.c_str(), condition.getError().c_str());
+	return false;
+}
+
+void Debugger::setBreakpointCondition(ADDR address, const std::string &expression) // Sets the breakpoint first if needed, an empty expression removes the condition
+{
+	Condition condition;
+	if (!expression.empty() && !compileCondition(expression, condition)) { return; }
+
+	BPHANDLE handle = breakpoints.find(address);
+	if (handle == NO_BREAKPOINT)
+	{
+		setBreakpoint(address);
+		handle = breakpoints.find(address);
+		if (handle == NO_BREAKPOINT) { return; }
+	}
+	breakpoints[handle].getCondition() = condition;
+	if (expression.empty()) { logMsg("Breakpoint @0x%X is unconditional", address); }
+	else { logMsg("Breakpoint @0x%X stops if %s (%zu instructions)", address, expression.c_str(), condition.length()); }
+}
+
+void Debugger::setBreakpointIgnoreCount(ADDR address, uint32_t count)
+{
+	BPHANDLE handle = breakpoints.find(address);
+	if (handle == NO_BREAKPOINT)
+	{
+		logError("No breakpoint set @0x%X", address);
+		return;
+	}
+	breakpoints[handle].setIgnoreCount(count);
+	logMsg("Will ignore next %u hit(s) of breakpoint @0x%X", count, address);
+}
+
+void Debugger::unsetBreakpoint(ADDR address)
+{
+	BPHANDLE handle = breakpoints.find(address);
+	if (handle != NO_BREAKPOINT)
+	{
+		breakpoints[handle].disable();
+		logMsg("Breakpoint @0x%X disabled", address);
+	}
+	else
+	{
+		logError("No breakpoint set @0x%X", address);
+	}
+}
+
+void Debugger::deleteBreakpoint(ADDR address)
+{
+	BPHANDLE handle = breakpoints.find(address);
+	if (handle != NO_BREAKPOINT)
+    {
+        breakpoints[handle].disable();
+        breakpoints.erase(handle);
+        if (current_breakpoint == handle) { current_breakpoint = NO_BREAKPOINT; }
+        logMsg("Breakpoint @0x%X deleted", address);
+    }
+    else { logError("No breakpoint set @0x%X", address); }
+}
+
+void Debugger::listBreakpoints()
+{
+	for (BPHANDLE handle = 0; handle < breakpoints.slotCount(); handle++)
+    {
+        if (!breakpoints.isLive(handle)) { continue; }
+        Breakpoint &bp = breakpoints[handle];
+        printf("%s @0x%X%s: %s, %llu hit(s)", bp.isHardware() ? "Hardware breakpoint" : "Breakpoint", bp.getAddress(), symbolize(bp.getAddress()).c_str(),
+            bp.isEnabled() ? "Enabled" : "Disabled", (unsigned long long)bp.hitCount());
+        if (!bp.getCondition().isEmpty()) { printf(", if %s", bp.getCondition().getText().c_str()); }
+        if (bp.getIgnoreCount()) { printf(", ignoring next %u", bp.getIgnoreCount()); }
+        putchar('\n');
+    }
+}
+
+void Debugger::benchmarkBreakpoints(uint64_t lookups) // Times the breakpoint table against std::unordered_map on throwaway tables, the debugee isn't touched
+{
+	static const size_t SIZES[] = {1000, 10000, 100000};
+	uint64_t random = LOOP_SEED;
+	printf("%-10s %14s %14s %14s   (ns per lookup, half of them hits)\n", "Entries", "find", "page+find", "unordered_map");
+	for (size_t entries: SIZES)
+	{
+		BreakpointTable table(memory.pageSize());
+		std::unordered_map<ADDR,BPHANDLE> map;
+		std::vector<ADDR> addresses;
+		table.reserve(entries);
+		map.reserve(entries);
+		while (addresses.size() < entries)
+		{
+			ADDR address = BREAKPOINT_BENCH_BASE + nextRandom(random) % BREAKPOINT_BENCH_SPAN;
+			if (table.find(address) != NO_BREAKPOINT) { continue; }
+			map[address] = table.insert(Breakpoint(memory, address));
+			addresses.push_back(address);
+		}
+
+		/* Hits are spread over the table, misses over the whole address space like stray traps */
+		std::vector<ADDR> probes(lookups);
+		for (uint64_t i = 0; i < lookups; i++)
+		{
+			probes[i] = (i & 1) ? (ADDR)nextRandom(random) : addresses[nextRandom(random) % entries];
+		}
+
+		uint64_t found[3] = {0, 0, 0};
+		double elapsed[3];
+		auto started = std::chrono::steady_clock::now();
+		for (ADDR probe: probes) { found[0] += table.find(probe) != NO_BREAKPOINT; }
+		elapsed[0] = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+		started = std::chrono::steady_clock::now();
+		for (ADDR probe: probes) { found[1] += table.pageHasBreakpoints(probe) && table.find(probe) != NO_BREAKPOINT; }
+		elapsed[1] = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+		started = std::chrono::steady_clock::now();
+		for (ADDR probe: probes) { found[2] += map.find(probe) != map.end(); }
+		elapsed[2] = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+		if (found[0] != found[1] || found[0] != found[2]) { logError("Lookups disagree (%llu, %llu, %llu hits)", (unsigned long long)found[0],
+			(unsigned long long)found[1], (unsigned long long)found[2]); }
+		printf("%-10zu %14.1f %14.1f %14.1f\n", entries, elapsed[0] * 1e9 / lookups, elapsed[1] * 1e9 / lookups, elapsed[2] * 1e9 / lookups);
+	}
+}
+
+
+void Debugger::setWatchpoint(ADDR address, size_t length, int access)
+{
+	static const char *ACCESS_NAMES[] = {"", "r", "w", "rw"};
+	for (auto &wp: watchpoints)
+	{
+		if (wp.getAddress() == address)
+		{
+			logError("Watchpoint @0x%X already set", address);
+			return;
+		}
+	}
+
+	Watchpoint wp(address, length, access);
+	if (length == 0 || !memory.read(address, wp.value().data(), length))
+	{
+		logError("Unable to watch %zu bytes @0x%X", length, address);
+		return;
+	}
+
+	if (wp.armHardware(debug_registers))
+	{
+		logMsg("Hardware watchpoint @0x%X set (%zu bytes, %s)", address, length, ACCESS_NAMES[access]);
+		watchpoints.push_back(wp);
+		return;
+	}
+
+	/* Too big for the debug registers, fall back to protecting the pages */
+	if (checkpoint_taken)
+	{
+		logError("Watchpoint @0x%X needs page protection, which the checkpoint is using, delete the checkpoint first", address);
+		return;
+	}
+	ADDR page_mask = ~(ADDR)(memory.pageSize() - 1);
+	ADDR first_page = address & page_mask;
+	ADDR last_page = (address + length - 1) & page_mask;
+	for (ADDR page = first_page; page <= last_page; page += memory.pageSize())
+	{
+		auto it = protected_pages.find(page);
+		if (it == protected_pages.end())
+		{
+			int prot;
+			if (!queryProtection(page, prot)) { prot = PROT_READ | PROT_WRITE; }
+			it = protected_pages.emplace(page, ProtectedPage{prot, 0, 0}).first;
+		}
+		if (access & WATCH_READ) { it->second.read_watches++; }
+		else { it->second.write_watches++; }
+		if (!protectPage(page)) { logError("Unable to protect page @0x%X", page); }
+	}
+	logMsg("Watchpoint @0x%X set (%zu bytes, %s) using page protection on %zu page(s)", address, length,
+		ACCESS_NAMES[access], (size_t)((last_page - first_page) / memory.pageSize() + 1));
+	watchpoints.push_back(wp);
+}
+
+void Debugger::deleteWatchpoint(ADDR address)
+{
+	for (auto it = watchpoints.begin(); it != watchpoints.end(); it++)
+	{
+		if (it->getAddress() != address) { continue; }
+
+		if (it->isHardware()) { it->disarm(); }
+		else
+		{
+			ADDR page_mask = ~(ADDR)(memory.pageSize() - 1);
+			ADDR last_page = (address + it->getLength() - 1) & page_mask;
+			for (ADDR page = address & page_mask; page <= last_page; page += memory.pageSize())
+			{
+				ProtectedPage &info = protected_pages[page];
+				if (it->getAccess() & WATCH_READ) { info.read_watches--; }
+				else { info.write_watches--; }
+				protectPage(page); // Back to the original protection once nothing watches it
+				if (info.read_watches == 0 && info.write_watches == 0) { protected_pages.erase(page); }
+			}
+		}
+		watchpoints.erase(it);
+		logMsg("Watchpoint @0x%X deleted", address);
+		return;
+	}
+	logError("No watchpoint set @0x%X", address);
+}
+
+void Debugger::listWatchpoints()
+{
+	static const char *ACCESS_NAMES[] = {"", "r", "w", "rw"};
+	for (auto &wp: watchpoints)
+	{
+		printf("Watchpoint @0x%X: %zu bytes, %s (%s)\n", wp.getAddress(), wp.getLength(), ACCESS_NAMES[wp.getAccess()],
+			wp.isHardware() ? "hardware" : "page protection");
+	}
+}
+
+
+void Debugger::setTracepoint(ADDR address, bool log_registers)
+{
+	for (auto &tp: tracepoints)
+	{
+		if (address >= tp.getAddress() && address < tp.getAddress() + tp.getLength())
+		{
+			logError("Tracepoint @0x%X already covers 0x%X", tp.getAddress(), address);
+			return;
+		}
+	}
+
+	BYTE code[MAX_INSN_LENGTH * 2];
+	size_t length = readCode(address, code, sizeof(code));
+	if (length == 0)
+	{
+		logError("Unable to read code @0x%X", address);
+		return;
+	}
+
+	/* The jump overwrites up to a few instructions, none of which may be breakpointed or half executed */
+	ADDR eip = registers.read(R_EIP);
+	for (ADDR cursor = address; cursor < address + TRACE_JUMP_LENGTH + MAX_INSN_LENGTH; cursor++)
+	{
+		if ((cursor != address && cursor == eip) || (breakpoints.pageHasBreakpoints(cursor) && breakpoints.find(cursor) != NO_BREAKPOINT))
+		{
+			logError("Unable to set tracepoint @0x%X (breakpoint or instruction pointer @0x%X in the way)", address, cursor);
+			return;
+		}
+	}
+
+	size_t size = (Tracepoint::areaSize(log_registers) + 15) & ~(size_t)15;
+	if (tracepoint_area == 0 || tracepoint_area_used + size > TRACEPOINT_AREA_SIZE)
+	{
+		tracepoint_area = mapDebugeeMemory(TRACEPOINT_AREA_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC);
+		tracepoint_area_used = 0;
+		if (tracepoint_area == 0)
+		{
+			logError("Unable to map trampoline memory in process %d", child_pid);
+			return;
+		}
+	}
+
+	Tracepoint tp(memory, address, log_registers);
+	if (!tp.install(code, length, tracepoint_area + tracepoint_area_used))
+	{
+		logError("Unable to set tracepoint @0x%X (instructions can't be relocated)", address);
+		return;
+	}
+	tracepoint_area_used += size;
+	tracepoints.push_back(tp);
+	logMsg("Tracepoint @0x%X set (%zu bytes relocated%s)", address, tp.getLength(), log_registers ? ", logging registers" : "");
+}
+
+void Debugger::deleteTracepoint(ADDR address)
+{
+	for (auto it = tracepoints.begin(); it != tracepoints.end(); it++)
+	{
+		if (it->getAddress() != address) { continue; }
+		it->remove(); // Trampoline memory isn't reused, the counters stay readable until the process exits
+		tracepoints.erase(it);
+		logMsg("Tracepoint @0x%X deleted", address);
+		return;
+	}
+	logError("No tracepoint set @0x%X", address);
+}
+
+void Debugger::listTracepoints()
+{
+	for (auto &tp: tracepoints)
+	{
+		uint32_t hits = 0;
+		tp.readHits(hits);
+		printf("Tracepoint @0x%X: %u hits%s\n", tp.getAddress(), hits, tp.logsRegisters() ? " (logging registers)" : "");
+	}
+}
+
+void Debugger::printTracepoint(ADDR address)
+{
+	for (auto &tp: tracepoints)
+	{
+		if (tp.getAddress() != address) { continue; }
+
+		uint32_t hits = 0;
+		std::vector<TraceRecord> records;
+		if (!tp.readHits(hits) || !tp.readRecords(records))
+		{
+			logError("Unable to read tracepoint data for 0x%X", address);
+			return;
+		}
+		printf("Tracepoint @0x%X: %u hits\n", address, hits);
+		uint32_t number = hits - records.size();
+		for (auto &record: records)
+		{
+			printf("#%u EAX: %X EBX: %X ECX: %X EDX: %X ESI: %X EDI: %X EBP: %X ESP: %X EFLAGS: %X\n", number++, record.eax,
+				record.ebx, record.ecx, record.edx, record.esi, record.edi, record.ebp, record.esp, record.eflags);
+		}
+		return;
+	}
+	logError("No tracepoint set @0x%X", address);
+}
+
+
+void Debugger::stepInto()
+{
+	if (current_breakpoint != NO_BREAKPOINT && breakpoints[current_breakpoint].isHardware())
+	{
+		BPHANDLE bp = current_breakpoint;
+		registers.write(R_EFLAGS, registers.read(R_EFLAGS) | RESUME_FLAG);
+		resume(PT_STEP);
+		if (!waitOnChild()) { return; }
+		if (bp == current_breakpoint) { current_breakpoint = NO_BREAKPOINT; } // Just return if another breakpoint is immediatly after the last one
+		else if (!resume_silently) { return; }
+	}
+	else if (current_breakpoint != NO_BREAKPOINT)
+	{
+		if (!stepBreakpoint() && !resume_silently) { return; } // Carries on if it only stopped on a breakpoint whose condition doesn't hold
+	}
+	else
+	{
+		do // Step again if the instruction only got as far as a first write to a page the checkpoint protects
+		{
+			resume(PT_STEP);
+			if (!waitOnChild()) { return; }
+		} while (checkpoint_faulted);
+	}
+	if (current_breakpoint == NO_BREAKPOINT || resume_silently) { logMsg("Stopped @0x%X%s", registers.read(R_EIP), symbolize(registers.read(R_EIP)).c_str()); }
+}
+
+void Debugger::stepOver() // Runs calls to completion with a temporary breakpoint on the return address
+{
+	ADDR address = registers.read(R_EIP);
+	BYTE code[MAX_INSN_LENGTH];
+	X86Instruction insn;
+	size_t length = readCode(address, code, sizeof(code));
+
+	if (length > 0 && decodeInstruction(code, length, insn) && insn.flow == FLOW_CALL)
+	{
+		stepUntil(address + insn.length);
+	}
+	else
+	{
+		stepInto();
+	}
+}
+
+void Debugger::stepUntil(ADDR address)
+{
+	BPHANDLE handle = breakpoints.find(address);
+	if (handle != NO_BREAKPOINT) // If theres already a breakpoint enabled at that address, just continue
+	{
+		bool previously_disabled = !breakpoints[handle].isEnabled(); // If breakpoint was disabled, re-enable, then disable again once stopped
+		breakpoints[handle].enable();
+		continueExec();
+		if (previously_disabled && breakpoints.isLive(handle)) { breakpoints[handle].disable(); }
+	}
+	else
+	{
+		Breakpoint bp(debug_registers, address); // Enable temporary breakpoint, continue to it, then disable breakpoint
+		if (!bp.enable()) // Prefer a debug register, fall back to patching INT3 if they're all taken
+		{
+			bp = Breakpoint(memory, address);
+			bp.enable();
+		}
+		continueExec();
+		ADDR eip = active ? registers.read(R_EIP) : 0;
+		if (current_breakpoint == NO_BREAKPOINT && (eip == address || (!bp.isHardware() && eip - 1 == address))) // Since this bp isn't "registered", the IP needs to be rewound if no other breaks (or an interrupt) got in the way
+		{
+			if (!bp.isHardware()) { registers.write(R_EIP, address); }
+			logMsg("Stopped @0x%X%s", registers.read(R_EIP), symbolize(registers.read(R_EIP)).c_str());
+		}
+		bp.disable();
+	}
+}
+
+const BasicBlock *Debugger::decodeBlock(ADDR start) // Null if the first instruction can't be decoded
+{
+	auto it = blocks.find(start);
+	if (it != blocks.end()) { return &it->second; }
+
+	BasicBlock block = {};
+	ADDR address = start;
+	BYTE code[MAX_INSN_LENGTH];
+	X86Instruction insn;
+	while (true)
+	{
+		size_t length = readCode(address, code, sizeof(code));
+		if (length == 0 || !decodeInstruction(code, length, insn)) // End the block in front of it, it gets stepped on its own
+		{
+			if (block.instructions == 0) { return nullptr; }
+			block.successor_count = 1;
+			block.successors[0] = address;
+			break;
+		}
+
+		block.branch = address;
+		block.instructions++;
+		ADDR next = address + insn.length;
+		ADDR target = next + insn.displacement;
+		if (insn.flow == FLOW_BRANCH && insn.relative)
+		{
+			block.successor_count = 2;
+			block.successors[0] = next;
+			block.successors[1] = target;
+			break;
+		}
+		if ((insn.flow == FLOW_JUMP || insn.flow == FLOW_CALL) && insn.relative)
+		{
+			block.successor_count = 1;
+			block.successors[0] = target;
+			break;
+		}
+		if (insn.flow != FLOW_NONE) { break; } // ret, indirect jmp/call
+		if (block.instructions == BLOCK_MAX_INSTRUCTIONS)
+		{
+			block.successor_count = 1;
+			block.successors[0] = next;
+			break;
+		}
+		address = next;
+	}
+	return &blocks.emplace(start, block).first->second;
+}
+
+int Debugger::runBlock(ADDR until, ADDR &from, uint32_t &instructions) // Runs to the start of the next block with one stop where possible
+{
+	ADDR start = registers.read(R_EIP);
+	const BasicBlock *block = decodeBlock(start);
+	from = 0;
+	instructions = 0;
+
+	/* On a user breakpoint, something undecodable, or a one instruction block: a plain step costs no more */
+	if (current_breakpoint != NO_BREAKPOINT || !block || block->branch == start)
+	{
+		if (current_breakpoint != NO_BREAKPOINT && !breakpoints[current_breakpoint].isHardware())
+		{
+			if (!stepBreakpoint() && !resume_silently) { return BLOCK_STOPPED; }
+		}
+		else
+		{
+			if (current_breakpoint != NO_BREAKPOINT) { registers.write(R_EFLAGS, registers.read(R_EFLAGS) | RESUME_FLAG); }
+			current_breakpoint = NO_BREAKPOINT;
+			if (singleStep() != SIGTRAP || reportStepWatchpoint()) { return BLOCK_STOPPED; }
+		}
+		block_stops++;
+		instructions = 1;
+		if (block && block->branch == start) { from = start; }
+		return registers.read(R_EIP) == until ? BLOCK_UNTIL : BLOCK_DONE;
+	}
+
+	/* Stop on every place the block can go to. If that's unknown, or a target lies inside the block (where it
+	* would be hit on the way), stop on the last instruction and step it instead. The block's own start is fine
+	* for a debug register, which RESUME_FLAG skips once, but not for an INT3. */
+	bool until_inside = until > start && until <= block->branch;
+	bool step_last = block->successor_count == 0;
+	for (int i = 0; i < block->successor_count; i++)
+	{
+		if (block->successors[i] > start && block->successors[i] <= block->branch) { step_last = true; }
+	}
+
+	std::vector<Breakpoint> planted;
+	auto plant = [&](ADDR target) {
+		BPHANDLE handle = breakpoints.find(target);
+		if (handle != NO_BREAKPOINT && breakpoints[handle].isEnabled()) { return true; } // The user's breakpoint stops there anyway
+		Breakpoint bp(debug_registers, target); // Debug registers leave the text alone, INT3 only once they run out
+		if (!bp.enable())
+		{
+			if (target == start) { return false; }
+			bp = Breakpoint(memory, target);
+			if (!bp.enable()) { return false; }
+		}
+		planted.push_back(bp);
+		return true;
+	};
+	if (until_inside) { plant(until); }
+	else if (!step_last)
+	{
+		for (int i = 0; i < block->successor_count && !step_last; i++) { step_last = !plant(block->successors[i]); }
+		if (step_last)
+		{
+			for (Breakpoint &bp: planted) { bp.disable(); }
+			planted.clear();
+		}
+	}
+	if (step_last && !until_inside) { plant(block->branch); }
+
+	registers.write(R_EFLAGS, registers.read(R_EFLAGS) | RESUME_FLAG);
+	do
+	{
+		if (!passBreakpoint()) { continue; }
+		resume(PT_CONTINUE);
+		waitOnChild();
+	} while (active && resume_silently);
+	block_stops++;
+
+	ADDR hit = 0;
+	if (active && current_breakpoint == NO_BREAKPOINT)
+	{
+		ADDR eip = registers.read(R_EIP);
+		for (Breakpoint &bp: planted)
+		{
+			if (bp.isHardware() && eip == bp.getAddress()) { hit = eip; }
+			else if (!bp.isHardware() && eip - 1 == bp.getAddress())
+			{
+				hit = eip - 1;
+				registers.write(R_EIP, hit);
+			}
+		}
+	}
+	for (Breakpoint &bp: planted) { bp.disable(); }
+	if (!hit) { return BLOCK_STOPPED; }
+
+	if (until_inside)
+	{
+		for (ADDR address = start; address < until; instructions++) // Count up to it, the block is already known to decode
+		{
+			BYTE code[MAX_INSN_LENGTH];
+			X86Instruction insn;
+			decodeInstruction(code, readCode(address, code, sizeof(code)), insn);
+			address += insn.length;
+		}
+		return BLOCK_UNTIL;
+	}
+	if (step_last)
+	{
+		if (singleStep() != SIGTRAP || reportStepWatchpoint()) { return BLOCK_STOPPED; }
+		block_stops++;
+	}
+	from = block->branch;
+	instructions = block->instructions;
+	return registers.read(R_EIP) == until ? BLOCK_UNTIL : BLOCK_DONE;
+}
+
+void Debugger::stepBlocks(uint64_t count, ADDR until) // count 0 runs until 'until', a breakpoint or exit
+{
+	auto started = std::chrono::steady_clock::now();
+	uint64_t stops = block_stops;
+	uint64_t run = 0;
+	uint64_t instructions = 0;
+	while (active && (count == 0 || run < count))
+	{
+		ADDR from;
+		uint32_t executed;
+		int result = runBlock(until, from, executed);
+		if (result == BLOCK_STOPPED) { break; }
+		if (from) { block_edges[std::make_pair(from, (ADDR)registers.read(R_EIP))]++; }
+		instructions += executed;
+		run++;
+		if (result == BLOCK_UNTIL) { break; }
+	}
+	block_instructions += instructions;
+	stops = block_stops - stops;
+
+	double elapsed = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - started).count();
+	if (count != 1) // One block is just a step, keep it quiet
+	{
+		logMsg("%llu block(s), %llu instruction(s) in %.3f ms, %.1f instructions per stop", (unsigned long long)run,
+			(unsigned long long)instructions, elapsed, stops ? (double)instructions / stops : 0.0);
+	}
+	if (active && current_breakpoint == NO_BREAKPOINT) { logMsg("Stopped @0x%X%s", registers.read(R_EIP), symbolize(registers.read(R_EIP)).c_str()); }
+}
+
+void Debugger::printBlockStats(bool reset)
+{
+	std::vector<std::pair<std::pair<ADDR,ADDR>,uint64_t>> sorted(block_edges.begin(), block_edges.end());
+	std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::pair<ADDR,ADDR>,uint64_t> &a, const std::pair<std::pair<ADDR,ADDR>,uint64_t> &b) {
+		return a.second > b.second;
+	});
+	for (size_t i = 0; i < sorted.size() && i < 25; i++)
+	{
+		printf("%10llu  0x%08X%s -> 0x%08X%s\n", (unsigned long long)sorted[i].second, sorted[i].first.first, symbolize(sorted[i].first.first).c_str(),
+			sorted[i].first.second, symbolize(sorted[i].first.second).c_str());
+	}
+	printf("%zu distinct edges, %zu decoded blocks, %llu instructions in %llu stops (%.1f per stop)\n", block_edges.size(), blocks.size(),
+		(unsigned long long)block_instructions, (unsigned long long)block_stops, block_stops ? (double)block_instructions / block_stops : 0.0);
+	if (reset)
+	{
+		block_edges.clear();
+		block_instructions = block_stops = 0;
+	}
+}
+
+void Debugger::record(uint64_t limit, ADDR until, const char *path, bool by_block) // Steps into a trace file, limit 0 and until 0 run to the next breakpoint
+{
+	TraceRecorder recorder;
+	if (!recorder.start(path)) { return; }
+	logMsg("Recording to '%s'", path);
+
+	auto started = std::chrono::steady_clock::now();
+	uint64_t steps = 0;
+	uint64_t instructions = 0;
+	TraceStep step;
+	while (active && (limit == 0 || steps < limit))
+	{
+		const struct reg &regs = registers.get();
+		ADDR eip = regs.r_eip;
+		if (steps > 0)
 		{
-			// Align ascii columns
-			for (int cursor = (((offset) % rowlength) + 1) * 3; cursor < rowlength*3; cursor++)
+			if (eip == until) { break; }
+			BPHANDLE handle = breakpoints.pageHasBreakpoints(eip) ? breakpoints.find(eip) : NO_BREAKPOINT;
+			if (handle != NO_BREAKPOINT && breakpoints[handle].isEnabled())
 			{
-				printf(" ");
+				current_breakpoint = handle; // Stepped past below if its condition doesn't hold
+				if (breakpointShouldStop(handle))
+				{
+					logMsg("Stopped on %sbreakpoint @0x%X%s", breakpoints[handle].isHardware() ? "hardware " : "", eip, symbolize(eip).c_str());
+					break;
+				}
 			}
+		}
 
-			printf("\t| ");
+		step.eip = regs.r_eip;
+		step.regs[0] = regs.r_eax;
+		step.regs[1] = regs.r_ebx;
+		step.regs[2] = regs.r_ecx;
+		step.regs[3] = regs.r_edx;
+		step.regs[4] = regs.r_esi;
+		step.regs[5] = regs.r_edi;
+		step.regs[6] = regs.r_ebp;
+		step.regs[7] = regs.r_esp;
+		step.regs[8] = regs.r_eflags;
+		recorder.record(step);
+		steps++;
 
-			// Print ascii representation
-			for (int i = 0; i < rowlength; i++)
+		if (by_block) // One record per block, taken at its first instruction
+		{
+			ADDR from;
+			uint32_t executed;
+			int result = runBlock(until, from, executed);
+			if (result == BLOCK_STOPPED) { break; }
+			if (from) { block_edges[std::make_pair(from, (ADDR)registers.read(R_EIP))]++; }
+			instructions += executed;
+			block_instructions += executed;
+			continue;
+		}
+		instructions++;
+		if (current_breakpoint != NO_BREAKPOINT && !breakpoints[current_breakpoint].isHardware())
+		{
+			if (!stepBreakpoint() && !resume_silently) { break; }
+			continue;
+		}
+		if (current_breakpoint != NO_BREAKPOINT)
+		{
+			current_breakpoint = NO_BREAKPOINT;
+			registers.write(R_EFLAGS, registers.read(R_EFLAGS) | RESUME_FLAG);
+		}
+		int signal = singleStep();
+		if (signal > 0 && signal != SIGTRAP)
+		{
+			logError("Process stopped by signal: %d", signal);
+			break;
+		}
+		if (reportStepWatchpoint()) { break; }
+	}
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+	recorder.stop();
+	logMsg("Recorded %llu %s (%llu instructions) in %.3f s (%.0f instructions/s), writer stalled %llu time(s)", (unsigned long long)steps,
+		by_block ? "blocks" : "steps", (unsigned long long)instructions, elapsed, elapsed > 0 ? instructions / elapsed : 0.0,
+		(unsigned long long)recorder.stallCount());
+	logMsg("Trace is %llu bytes (%.2f per step, %llu before compression)", (unsigned long long)recorder.writtenBytes(),
+		steps ? (double)recorder.writtenBytes() / steps : 0.0, (unsigned long long)recorder.rawBytes());
+	if (active && current_breakpoint == NO_BREAKPOINT) { logMsg("Stopped @0x%X%s", registers.read(R_EIP), symbolize(registers.read(R_EIP)).c_str()); }
+}
+
+void Debugger::checkpoint() // Registers now, memory pages copied as they're first written from here on
+{
+	if (!active)
+	{
+		logError("No process to checkpoint");
+		return;
+	}
+	for (Watchpoint &wp: watchpoints)
+	{
+		if (!wp.isHardware())
+		{
+			logError("Software watchpoints protect pages the same way checkpoints do, delete them first");
+			return;
+		}
+	}
+	std::vector<ProcessMapping> mappings;
+	if (!readMappings(mappings))
+	{
+		logError("Unable to read the memory map of process %d", child_pid);
+		return;
+	}
+	releaseCheckpoint();
+
+	/* Every writable mapping loses write access, apart from the pages we mapped in ourselves */
+	std::vector<std::pair<ADDR,ADDR>> excluded;
+	if (scratch_address) { excluded.push_back({scratch_address, scratch_address + (ADDR)memory.pageSize()}); }
+	if (tracepoint_area) { excluded.push_back({tracepoint_area, tracepoint_area + TRACEPOINT_AREA_SIZE}); }
+	std::sort(excluded.begin(), excluded.end());
+	checkpoint_taken = true;
+	size_t protected_bytes = 0;
+	for (ProcessMapping &mapping: mappings)
+	{
+		if ((mapping.protection & (PROT_READ | PROT_WRITE)) != (PROT_READ | PROT_WRITE) || !mapping.dumpable) { continue; }
+		ADDR cursor = mapping.start;
+		std::vector<CheckpointRange> pieces;
+		for (auto &area: excluded)
+		{
+			if (area.second <= cursor || area.first >= mapping.end) { continue; }
+			if (area.first > cursor) { pieces.push_back({cursor, area.first, mapping.protection}); }
+			cursor = std::max(cursor, area.second);
+		}
+		if (cursor < mapping.end) { pieces.push_back({cursor, mapping.end, mapping.protection}); }
+
+		for (CheckpointRange &range: pieces)
+		{
+			DWORD result;
+			if (!injectSyscall(SYS_mprotect, {(uint32_t)range.start, (uint32_t)(range.end - range.start), (uint32_t)(range.prot & ~PROT_WRITE)}, result))
 			{
-				printf("%c ", ascii_chars[i]);
+				logError("Unable to write protect 0x%X-0x%X, it won't be restored", range.start, range.end);
+				continue;
 			}
-			printf("|\n");
+			checkpoint_ranges.push_back(range);
+			protected_bytes += range.end - range.start;
+		}
+	}
+	checkpoint_registers = registers.get();
+	checkpoint_breakpoint = current_breakpoint;
+	checkpoint_faults = 0;
+	logMsg("Checkpoint @0x%X%s: %zu writable range(s) (%zu KB) write protected, pages are copied as they're first written",
+		checkpoint_registers.r_eip, symbolize(checkpoint_registers.r_eip).c_str(), checkpoint_ranges.size(), protected_bytes / 1024);
+}
 
-			// Print new linenumber and refill ascii_chars with periods
-			if (offset + 1 != size)
+void Debugger::deleteCheckpoint()
+{
+	if (!checkpoint_taken)
+	{
+		logError("No checkpoint to delete");
+		return;
+	}
+	releaseCheckpoint();
+	logMsg("Checkpoint deleted");
+}
+
+void Debugger::restoreCheckpoint()
+{
+	if (!checkpoint_taken)
+	{
+		logError("No checkpoint to restore, take one with 'checkpoint'");
+		return;
+	}
+	size_t pages = dirty_pages.size();
+	auto started = std::chrono::steady_clock::now();
+	if (!rollBack())
+	{
+		logError("Unable to restore all of the checkpoint");
+		return;
+	}
+	double elapsed = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - started).count();
+	logMsg("Restored the checkpoint @0x%X%s: registers and %zu page(s) written since, in %.3f ms", registers.read(R_EIP),
+		symbolize(registers.read(R_EIP)).c_str(), pages, elapsed);
+}
+
+void Debugger::loop(uint64_t count, ADDR until, ADDR input, size_t input_length) // Runs from the checkpoint to 'until' count times, with new random bytes at input each time
+{
+	if (!checkpoint_taken || !active)
+	{
+		logError("No checkpoint to loop from, take one with 'checkpoint'");
+		return;
+	}
+	if (input_length > LOOP_MAX_INPUT)
+	{
+		logError("Input is limited to %d bytes", LOOP_MAX_INPUT);
+		return;
+	}
+
+	/* A temporary breakpoint ends each iteration, a user breakpoint there would report every one */
+	BPHANDLE existing = breakpoints.find(until);
+	bool reenable = existing != NO_BREAKPOINT && breakpoints[existing].isEnabled();
+	if (reenable) { breakpoints[existing].disable(); }
+	Breakpoint bp(debug_registers, until);
+	if (!bp.enable())
+	{
+		bp = Breakpoint(memory, until);
+		if (!bp.enable())
+		{
+			logError("Unable to set breakpoint @0x%X", until);
+			if (reenable) { breakpoints[existing].enable(); }
+			return;
+		}
+	}
+
+	std::vector<BYTE> data(input_length);
+	uint64_t random = LOOP_SEED;
+	uint64_t iterations = 0;
+	uint64_t restored_pages = 0;
+	uint64_t faults = checkpoint_faults;
+	bool reached = true;
+	auto started = std::chrono::steady_clock::now();
+	while (iterations < count)
+	{
+		restored_pages += dirty_pages.size();
+		if (!rollBack())
+		{
+			logError("Unable to restore the checkpoint");
+			break;
+		}
+		for (size_t offset = 0; offset < input_length; offset += sizeof(uint64_t))
+		{
+			uint64_t value = nextRandom(random);
+			std::memcpy(&data[offset], &value, std::min(sizeof(value), input_length - offset));
+		}
+		if (input_length && !patchMemory(input, data.data(), input_length))
+		{
+			logError("Unable to write the input to 0x%X", input);
+			break;
+		}
+		iterations++;
+
+		continueExec();
+		ADDR eip = active ? registers.read(R_EIP) : 0;
+		reached = active && current_breakpoint == NO_BREAKPOINT && (eip == until || (!bp.isHardware() && eip - 1 == until));
+		if (!reached) { break; }
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+	if (active && reached && !bp.isHardware()) { registers.write(R_EIP, until); } // Not registered, so nothing rewound it
+	bp.disable();
+	if (reenable && breakpoints.isLive(existing)) { breakpoints[existing].enable(); }
+
+	logMsg("%llu iteration(s) in %.3f s (%.0f/s), %.1f page(s) restored and %.1f write fault(s) per iteration", (unsigned long long)iterations,
+		elapsed, elapsed > 0 ? iterations / elapsed : 0.0, iterations ? (double)restored_pages / iterations : 0.0,
+		iterations ? (double)(checkpoint_faults - faults) / iterations : 0.0);
+	if (!reached)
+	{
+		logMsg("Iteration %llu didn't reach 0x%X%s", (unsigned long long)iterations, until, symbolize(until).c_str());
+		if (input_length)
+		{
+			printf("Its input @0x%X:\n", input);
+			hexDump(data.data(), input_length);
+		}
+	}
+}
+
+void Debugger::writeRegister(int regcode, DWORD value)
+{
+	registers.write(regcode, value);
+}
+
+void Debugger::writeMemory(ADDR address, const std::vector<BYTE> &bytes)
+{
+	if (!patchMemory(address, bytes.data(), bytes.size()))
+	{
+		logError("Unable to write %zu bytes to 0x%X", bytes.size(), address);
+		return;
+	}
+	logMsg("Wrote %zu byte(s) @0x%X%s", bytes.size(), address, symbolize(address).c_str());
+}
+
+bool Debugger::patchMemory(ADDR address, const BYTE *data, size_t size) // Writes for the user: INT3s stay over the new bytes, a checkpoint can put the old ones back
+{
+	if (size == 0) { return true; }
+	size_t page_size = memory.pageSize();
+	ADDR last_page = (address + size - 1) & ~(ADDR)(page_size - 1);
+	for (ADDR page = address & ~(ADDR)(page_size - 1); checkpoint_taken; page += page_size)
+	{
+		if (findCheckpointRange(page) && !markCheckpointDirty(page)) { return false; }
+		if (page == last_page) { break; }
+	}
+
+	std::vector<BYTE> patched(data, data + size);
+	for (size_t offset = 0; offset < size; offset++)
+	{
+		if (!breakpoints.pageHasBreakpoints(address + offset)) { continue; }
+		BPHANDLE handle = breakpoints.find(address + offset);
+		if (handle == NO_BREAKPOINT || !breakpoints[handle].isEnabled() || breakpoints[handle].isHardware()) { continue; }
+		breakpoints[handle].markEnabled(patched[offset]); // Runs the new instruction when it's stepped past
+		patched[offset] = 0xcc;
+	}
+	if (!memory.write(address, patched.data(), size)) { return false; }
+	scratch_contents = 0; // The displaced copy may be of an instruction that was just overwritten
+	blocks.clear(); // Decoded blocks may be as well
+	return true;
+}
+
+void Debugger::printRegisters()
+{
+	const struct reg &regs = registers.get();
+	printf("EAX: %X\n", regs.r_eax);
+	printf("EBX: %X\n", regs.r_ebx);
+	printf("ECX: %X\n", regs.r_ecx);
+	printf("EDX: %X\n", regs.r_edx);
+	printf("ESI: %X\n", regs.r_esi);
+	printf("EDI: %X\n", regs.r_edi);
+	printf("EBP: %X\n", regs.r_ebp);
+	printf("EIP: %X\n", regs.r_eip);
+	printf("ESP: %X\n", regs.r_esp);
+	printf("EFLAGS: %X [ ", regs.r_eflags); // Probably more efficient way to do this
+	if (regs.r_eflags & CARRY_FLAG) { printf("CF "); }
+    if (regs.r_eflags & ZERO_FLAG) { printf("ZF "); }
+    if (regs.r_eflags & SIGN_FLAG) { printf("SF "); }
+    if (regs.r_eflags & OVERFLOW_FLAG) { printf("OF "); }
+    puts("]");
+
+}
+
+void Debugger::printMemory(ADDR address, size_t size)
+{
+	BYTE buffer[size];
+	if (!memory.read(address, buffer, size))
+	{
+		logError("Unable to read from 0x%X", address);
+		return;
+	}
+	hexDump(buffer, size);
+}
+
+void Debugger::traceSyscalls(bool enable, const char *log_path)
+{
+	if (!enable)
+	{
+		syscalls.disable();
+		logMsg("Syscall tracing disabled");
+	}
+	else if (syscalls.enable(log_path))
+	{
+		if (log_path) { logMsg("Tracing syscalls, logging to %s", strcmp(log_path, "-") ? log_path : "stdout"); }
+		else { logMsg("Counting syscalls"); }
+	}
+}
+
+void Debugger::printSyscallStats(bool reset)
+{
+	syscalls.printSummary();
+	if (reset) { syscalls.reset(); }
+}
+
+void Debugger::printBacktrace()
+{
+	std::vector<ADDR> frames;
+	auto started = std::chrono::steady_clock::now();
+	unwinder.unwind(registers.get(), frames, 64);
+	double elapsed = std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now() - started).count();
+
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		ADDR location = i == 0 ? frames[i] : frames[i] - 1; // Name the call, not whatever follows it
+		printf("#%-2zu 0x%08X%s\n", i, frames[i], symbolize(location).c_str());
+	}
+	logMsg("%zu frames in %.1f us", frames.size(), elapsed);
+}
+
+void Debugger::evaluateExpression(const std::string &expression, uint64_t repeat) // Prints the value at the current stop, repeat > 1 times the evaluator
+{
+	Condition condition;
+	if (!compileCondition(expression, condition)) { return; }
+
+	DWORD value = 0;
+	ADDR fault = 0;
+	const struct reg &regs = registers.get();
+	int result = CONDITION_OK;
+	auto started = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < repeat && result == CONDITION_OK; i++) { result = condition.evaluate(regs, memory, value, fault); }
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+	if (result == CONDITION_BAD_MEMORY) { logError("Unable to read memory @0x%X", fault); }
+	else if (result == CONDITION_DIVIDE_BY_ZERO) { logError("Division by zero"); }
+	else { printf("%s = 0x%X (%u)\n", expression.c_str(), value, value); }
+	if (repeat > 1)
+	{
+		logMsg("%llu evaluations of %zu instructions in %.3f ms (%.2f million/s)", (unsigned long long)repeat, condition.length(),
+			elapsed * 1000, elapsed > 0 ? repeat / elapsed / 1e6 : 0.0);
+	}
+}
+
+void Debugger::printCacheStats()
+{
+	uint64_t hits = memory.hits();
+	uint64_t misses = memory.misses();
+	uint64_t total = hits + misses;
+	printf("Memory cache: %llu hits, %llu misses (%llu%% hit rate)\n", (unsigned long long)hits,
+		(unsigned long long)misses, total ? (unsigned long long)(hits * 100 / total) : 0ULL);
+	printf("Cached pages: %zu (%zu bytes each)\n", memory.cachedPages(), memory.pageSize());
+}
+
+bool Debugger::isDebuggerMemory(ADDR page) // Pages we mapped into the debugee ourselves
+{
+	return (scratch_address != 0 && page == scratch_address) || (tracepoint_area != 0 && page >= tracepoint_area && page < tracepoint_area + TRACEPOINT_AREA_SIZE);
+}
+
+void Debugger::dumpCore(const char *path) // ELF core of the current stop, laid out like FreeBSD's own so gdb and lldb can open it
+{
+	std::vector<ProcessMapping> mappings;
+	if (!active || !readMappings(mappings))
+	{
+		logError("Unable to read the memory map of process %d", child_pid);
+		return;
+	}
+	mappings.erase(std::remove_if(mappings.begin(), mappings.end(), [](const ProcessMapping &mapping) {
+		return !(mapping.protection & PROT_READ) || !mapping.dumpable;
+	}), mappings.end());
+
+	CoreWriter core;
+	char executable[PATH_MAX];
+	const char *name = "";
+	if (processPath(child_pid, executable, sizeof(executable)))
+	{
+		const char *slash = strrchr(executable, '/');
+		name = slash ? slash + 1 : executable;
+	}
+	core.setProcess(child_pid, name, name);
+
+	/* The thread the registers belong to goes first, it's the one the core opens on */
+	lwpid_t current = selected_thread;
+	bool have_info = fetchStopInfo();
+	if (current == 0 && have_info) { current = stop_info.pl_lwpid; }
+	int signal = (have_info && (stop_info.pl_flags & PL_FLAG_SI)) ? stop_info.pl_siginfo.si_signo : 0;
+	std::vector<lwpid_t> lwps(std::max(dbgPtrace(PT_GETNUMLWPS, child_pid, 0, 0), 0));
+	if (!lwps.empty()) { lwps.resize(std::max(dbgPtrace(PT_GETLWPLIST, child_pid, (caddr_t)lwps.data(), lwps.size()), 0)); }
+	std::stable_partition(lwps.begin(), lwps.end(), [&](lwpid_t lwp) { return lwp == current; });
+	size_t thread_count = 0;
+	for (lwpid_t lwp: lwps)
+	{
+		CoreThread thread;
+		thread.lwp = lwp;
+		if (lwp == current) { thread.regs = registers.get(); } // May hold changes that aren't written back yet
+		else if (dbgPtrace(PT_GETREGS, lwp, (caddr_t)&thread.regs, 0) < 0) { continue; }
+		thread.have_fpregs = dbgPtrace(PT_GETFPREGS, lwp, (caddr_t)&thread.fpregs, 0) >= 0;
+		thread.signal = (lwp == current) ? signal : 0;
+		core.addThread(thread);
+		thread_count++;
+	}
+
+	for (ProcessMapping &mapping: mappings) { core.addSegment(mapping.start, mapping.end, mapping.protection); }
+	if (!core.begin(path)) { return; }
+
+	size_t page_size = memory.pageSize();
+	uint64_t unreadable = 0;
+	auto started = std::chrono::steady_clock::now();
+	for (ProcessMapping &mapping: mappings)
+	{
+		size_t size = mapping.end - mapping.start;
+		for (size_t done = 0, length = 0; done < size; done += length)
+		{
+			ADDR address = mapping.start + done;
+			BYTE *buffer = core.buffer();
+			length = std::min((size_t)CORE_CHUNK_SIZE, size - done);
+			size_t copied = memory.readDirect(address, buffer, length);
+			if (copied < length) // Something in the chunk can't be read (guard page, nothing backing it), go page by page and leave those zeroed
 			{
-				printf("%04X: ", linenumber + (offset + 1));
-				std::memset(ascii_chars, '.', rowlength);
-			}			
+				for (size_t offset = copied & ~(page_size - 1); offset < length; offset += page_size)
+				{
+					size_t piece = std::min(page_size, length - offset);
+					if (memory.readDirect(address + offset, buffer + offset, piece) == piece) { continue; }
+					std::memset(buffer + offset, 0, piece);
+					unreadable++;
+				}
+			}
+			hideBreakpoints(address, buffer, length);
+			core.submit(length);
+		}
+	}
+	bool complete = core.finish();
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+	double megabytes = core.writtenBytes() / 1048576.0;
+	logMsg("%s %s: %zu thread(s), %zu mappings, %.1f MB in %.3f s (%.1f MB/s, %llu writes, copying waited on the disk %llu times)",
+		complete ? "Wrote" : "Partially wrote", path, thread_count, mappings.size(), megabytes, elapsed, elapsed > 0 ? megabytes / elapsed : 0.0,
+		(unsigned long long)core.writeCalls(), (unsigned long long)core.stallCount());
+	if (unreadable) { logMsg("%llu page(s) couldn't be read and were written as zeros", (unsigned long long)unreadable); }
+}
+
+bool Debugger::takeMemorySnapshot(MemorySnapshot &snapshot) // Every readable page of writable memory, apart from our own
+{
+	std::vector<ProcessMapping> mappings;
+	if (!active || !readMappings(mappings))
+	{
+		logError("Unable to read the memory map of process %d", child_pid);
+		return false;
+	}
+
+	size_t page_size = memory.pageSize();
+	std::vector<BYTE> buffer(CORE_CHUNK_SIZE);
+	auto started = std::chrono::steady_clock::now();
+	for (ProcessMapping &mapping: mappings)
+	{
+		if ((mapping.protection & (PROT_READ | PROT_WRITE)) != (PROT_READ | PROT_WRITE) || !mapping.dumpable) { continue; }
+		size_t size = mapping.end - mapping.start;
+		for (size_t done = 0, length = 0; done < size; done += length)
+		{
+			ADDR address = mapping.start + done;
+			length = std::min(buffer.size(), size - done);
+			size_t copied = memory.readDirect(address, buffer.data(), length);
+			for (size_t offset = 0; offset + page_size <= length; offset += page_size)
+			{
+				if (isDebuggerMemory(address + offset)) { continue; }
+				if (offset + page_size > copied && memory.readDirect(address + offset, buffer.data() + offset, page_size) != page_size) { continue; }
+				memory_snapshots.addPage(snapshot, address + offset, buffer.data() + offset);
+			}
 		}
 	}
+	snapshot.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+	return true;
+}
+
+void Debugger::saveMemorySnapshot()
+{
+	MemorySnapshot taken;
+	if (!takeMemorySnapshot(taken)) { return; }
+	MemorySnapshot &snapshot = memory_snapshots.keep(taken);
+	logMsg("Snapshot %d: %zu pages of writable memory in %.3f ms, %zu new or changed and stored (%zu KB), %zu distinct pages held in all",
+		snapshot.number, snapshot.pages.size(), snapshot.elapsed * 1000, snapshot.stored_pages, snapshot.stored_pages * memory.pageSize() / 1024,
+		memory_snapshots.uniquePages());
+}
+
+void Debugger::listMemorySnapshots()
+{
+	for (const MemorySnapshot &snapshot: memory_snapshots.list())
+	{
+		printf("%-3d %zu pages, %zu stored by it\n", snapshot.number, snapshot.pages.size(), snapshot.stored_pages);
+	}
+	logMsg("%zu snapshot(s) holding %zu distinct pages", memory_snapshots.list().size(), memory_snapshots.uniquePages());
+}
+
+void Debugger::deleteMemorySnapshot(int number)
+{
+	if (memory_snapshots.remove(number)) { logMsg("Deleted snapshot %d", number); }
+	else { logError("No snapshot %d", number); }
+}
+
+void Debugger::diffMemorySnapshots(int from, int to) // from 0 is the latest snapshot, to 0 is memory as it is now
+{
+	MemorySnapshot *before = from ? memory_snapshots.find(from) : memory_snapshots.latest();
+	if (!before)
+	{
+		if (from) { logError("No snapshot %d", from); }
+		else { logError("No snapshot to compare with, take one with 'snapshot'"); }
+		return;
+	}
+	MemorySnapshot now;
+	MemorySnapshot *after = &now;
+	if (to && !(after = memory_snapshots.find(to)))
+	{
+		logError("No snapshot %d", to);
+		return;
+	}
+	if (!to && !takeMemorySnapshot(now)) { return; }
+
+	std::vector<PageChange> changes;
+	auto started = std::chrono::steady_clock::now();
+	memory_snapshots.diff(*before, *after, changes);
+	double elapsed = std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - started).count();
+
+	size_t counts[3] = {0, 0, 0}; // By PAGE_CHANGE
+	for (size_t i = 0; i < changes.size(); i++)
+	{
+		const PageChange &change = changes[i];
+		counts[change.kind]++;
+		if (i >= DIFF_MAX_PAGES) { continue; }
+		printf("0x%08X%s: ", change.page, symbolize(change.page).c_str());
+		if (change.kind == PAGE_CHANGED) { printf("%zu byte(s) changed in +0x%zX..+0x%zX\n", change.bytes, change.first, change.last); }
+		else { printf("%s\n", change.kind == PAGE_ADDED ? "new page" : "no longer mapped"); }
+	}
+	if (changes.size() > DIFF_MAX_PAGES) { printf("... and %zu more page(s)\n", changes.size() - DIFF_MAX_PAGES); }
+
+	std::string target = to ? "snapshot " + std::to_string(to) : "now";
+	logMsg("Snapshot %d to %s: %zu page(s) changed, %zu new, %zu gone, %zu unchanged skipped, compared in %.3f ms", before->number, target.c_str(),
+		counts[PAGE_CHANGED], counts[PAGE_ADDED], counts[PAGE_REMOVED], after->pages.size() - counts[PAGE_CHANGED] - counts[PAGE_ADDED], elapsed);
+	if (!to)
+	{
+		now.pages.clear();
+		memory_snapshots.prune(); // Drops the copies only the comparison needed
+	}
 }
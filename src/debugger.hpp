@@ -6,92 +6,242 @@
 #define FREEDBG_DEBUGGER
 
 #include <machine/reg.h>
+#include <sys/types.h>
+#include <sys/ptrace.h>
+#include <vector>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <functional>
 #include <cstdint>
 #include <cstddef>
+#include "types.hpp" // BYTE, WORD, DWORD, ADDR
+#include "memcache.hpp" // MemoryCache
+#include "registers.hpp" // RegisterFile, R_*
+#include "breakpoint.hpp" // Breakpoint, BreakpointTable, BPHANDLE
+#include "debugregs.hpp" // DebugRegisters
+#include "watchpoint.hpp" // Watchpoint, WATCH_ACCESS
+#include "tracepoint.hpp" // Tracepoint
+#include "symbols.hpp" // SymbolTable
+#include "dwarfindex.hpp" // DwarfIndex
+#include "unwinder.hpp" // Unwinder
+#include "syscalltrace.hpp" // SyscallTracer
+#include "coverage.hpp" // CoverageMap
+#include "condition.hpp" // Condition
+#include "eventloop.hpp" // EventLoop
+#include "threads.hpp" // ThreadList, ThreadState
+#include "pagesnapshot.hpp" // SnapshotStore, MemorySnapshot
+#include "procinfo.hpp" // ProcessMapping
+
+
+struct ProtectedPage { // Page protected by the debugger on behalf of software watchpoints
+	int original_prot;
+	int read_watches;
+	int write_watches;
+};
 
-#define BYTE uint8_t
-
-#if defined(__LP64__)
-typedef uint32_t WORD;
-typedef uint64_t DWORD;
-#else
-typedef uint16_t WORD;
-typedef uint32_t DWORD;
-#endif // (__LP64__)
-
-typedef DWORD ADDR;
-
-
-enum {
-    R_EAX = 0,
-    R_EBX,
-    R_ECX,
-    R_EDX,
-    R_ESI,
-    R_EDI,
-    R_EBP,
-    R_EIP,
-    R_ESP,
-    R_CARRY,
-    R_ZERO,
-    R_SIGN,
-    R_OVERFLOW
+struct CheckpointRange { // Writable memory the checkpoint write protects, so the first write to each page is seen
+	ADDR start;
+	ADDR end; // Exclusive
+	int prot; // Protection it had before the checkpoint
 };
 
-enum R_FLAGS {
-    CARRY_FLAG = 1 << 0,
-    ZERO_FLAG = 1 << 6,
-    SIGN_FLAG = 1 << 7,
-    OVERFLOW_FLAG = 1 << 11
+struct CheckpointPage { // Page written since the checkpoint was taken
+	std::vector<BYTE> original; // Contents at the checkpoint
+	bool dirty = false; // Written since the last restore
+	bool writable = false; // Protection lifted after the debugee wrote to it
 };
 
-class Breakpoint {
-private:
-	int child_pid;
-	bool enabled = false;
-	ADDR address;
-	BYTE saved_instruction = 0;
+#define BLOCK_MAX_INSTRUCTIONS 256 // Longer straight-line runs are split
 
-public:
-	Breakpoint(int pid, ADDR addr);
-	bool isEnabled();
-	bool enable();
-	void disable();
+struct BasicBlock { // Straight-line run of instructions ending in a control transfer, decoded once from the text
+	ADDR branch; // Last instruction
+	uint32_t instructions;
+	int successor_count; // 0 when the target isn't known statically (ret, indirect) and the last instruction has to be stepped
+	ADDR successors[2];
+};
+
+enum BLOCK_RESULT {
+	BLOCK_DONE, // Now at the first instruction of the next block
+	BLOCK_UNTIL, // Reached the requested address
+	BLOCK_STOPPED // Breakpoint, signal or exit got in the way
+};
+
+struct EdgeHash {
+	size_t operator()(const std::pair<ADDR,ADDR> &edge) const { return std::hash<uint64_t>()(((uint64_t)edge.first << 32) ^ edge.second); }
 };
 
 
 class Debugger {
 private:
 	int child_pid;
-	Breakpoint *current_breakpoint = NULL;
+	BPHANDLE current_breakpoint = NO_BREAKPOINT;
 	volatile bool active = false;
-	struct reg registers;
-	std::unordered_map<ADDR,Breakpoint> breakpoints;
+	RegisterFile registers;
+	MemoryCache memory;
+	DebugRegisters debug_registers;
+	BreakpointTable breakpoints;
+	std::vector<Watchpoint> watchpoints;
+	std::unordered_map<ADDR,ProtectedPage> protected_pages;
+	bool resume_silently = false; // Set by waitOnChild for stops the user doesn't need to see
+	ADDR scratch_address = 0; // Debugee page breakpointed instructions are displaced to
+	ADDR scratch_contents = 0; // Breakpoint whose instruction is currently copied there
+	bool scratch_unavailable = false;
+	std::vector<Tracepoint> tracepoints;
+	ADDR tracepoint_area = 0; // Debugee mapping trampolines and their counters are carved from
+	size_t tracepoint_area_used = 0;
+	SymbolTable symbols;
+	DwarfIndex lines;
+	Unwinder unwinder;
+	SyscallTracer syscalls;
+	CoverageMap coverage;
+	std::unordered_map<ADDR,BasicBlock> blocks; // By start address, the text is assumed not to change
+	std::unordered_map<std::pair<ADDR,ADDR>,uint64_t,EdgeHash> block_edges; // (branch, target) -> times taken
+	uint64_t block_instructions = 0;
+	uint64_t block_stops = 0;
+	EventLoop *events = nullptr; // Owned by the interface, null means plain blocking waits
+	std::function<void()> input_handler;
+	uintptr_t interrupt_timer = 0; // Timer that interrupts the debugee when it fires
+	int pending_stops = 0; // SIGSTOPs sent by interrupt that haven't shown up yet
+	bool interrupt_requested = false;
+	bool report_interrupts = true;
+	bool report_breakpoints = true;
+	uint64_t interrupt_sent = 0; // Steady clock ns
+	uint64_t interrupt_latency = 0; // From interrupt_sent to the stop being handled
+	ThreadList threads;
+	bool thread_events = false; // PT_LWP_EVENTS and PT_FOLLOW_FORK are on
+	lwpid_t selected_thread = 0; // Thread registers and stepping apply to, 0 before threads are followed
+	bool attached = false; // Taken over with -p rather than started by us
+	bool hold_forks = false; // Leave forked children stopped instead of letting them run
+	struct ptrace_lwpinfo stop_info; // PT_LWPINFO of the current stop, fetched at most once per stop
+	bool stop_info_fetched = false;
+	SnapshotStore memory_snapshots;
+	bool checkpoint_taken = false;
+	struct reg checkpoint_registers;
+	BPHANDLE checkpoint_breakpoint = NO_BREAKPOINT;
+	std::vector<CheckpointRange> checkpoint_ranges; // By address
+	std::unordered_map<ADDR,CheckpointPage> checkpoint_pages; // By page address
+	std::vector<ADDR> dirty_pages; // Written since the last restore
+	std::vector<BYTE> restore_buffer; // Adjacent dirty pages are written back with one request
+	bool checkpoint_faulted = false; // The stop was a first write to a protected page, handled silently
+	bool watchpoint_stopped = false; // The stop was a hardware watchpoint, already reported
+	Watchpoint *step_watchpoint = nullptr; // Hardware watchpoint the last internal single step hit, not reported yet
+	uint64_t checkpoint_faults = 0;
+	bool fetchStopInfo();
+	bool handleThreadEvent();
+	void handleFork(pid_t child, bool shares_memory);
+	void selectThread(lwpid_t lwp);
+	bool passParkedBreakpoints();
+	std::string threadTag();
 	bool waitOnChild();
+	bool pollChild();
+	void waitForStop();
+	bool handleStatus(int waitstatus);
+	void reportInterrupt();
+	void resume(int request, int signal = 0);
+	int singleStep();
+	size_t readCode(ADDR address, BYTE *buffer, size_t size);
+	void hideBreakpoints(ADDR address, BYTE *buffer, size_t size);
+	bool isDebuggerMemory(ADDR page);
+	bool takeMemorySnapshot(MemorySnapshot &snapshot);
+	bool patchMemory(ADDR address, const BYTE *data, size_t size);
+	const CheckpointRange *findCheckpointRange(ADDR page);
+	bool markCheckpointDirty(ADDR page);
+	bool handleCheckpointFault();
+	bool rollBack();
+	void releaseCheckpoint();
+	bool readMappings(std::vector<ProcessMapping> &mappings);
+	bool injectSyscall(int number, const std::vector<uint32_t> &args, DWORD &result);
+	ADDR mapDebugeeMemory(size_t length, int prot);
+	bool displacedStep(BPHANDLE bp);
+	bool stepBreakpoint();
+	bool retireOneShot(ADDR address);
+	bool breakpointShouldStop(BPHANDLE handle);
+	bool passBreakpoint();
+	bool compileCondition(const std::string &expression, Condition &condition);
+	bool queryProtection(ADDR address, int &prot);
+	bool protectPage(ADDR page);
+	bool handleProtectionFault();
+	Watchpoint *triggeredWatchpoint();
+	bool handleWatchpointTrap();
+	bool reportStepWatchpoint();
+	void reportWatchpoint(Watchpoint &wp);
+	std::string symbolize(ADDR address);
+	const BasicBlock *decodeBlock(ADDR start);
+	int runBlock(ADDR until, ADDR &from, uint32_t &instructions);
 
 public:
 	Debugger(int pid);
 	bool isActive();
 	void start();
+	bool attach();
+	bool isAttached();
+	void snapshot(const char *memory_ranges);
 	void killProcess();
 	void detachProcess();
 	void continueExec();
-
-	void setBreakpoint(ADDR address);
+	bool attachEventLoop(EventLoop &loop, std::function<void()> on_input);
+	void interrupt();
+	void benchmarkInterrupts(uint32_t rounds);
+
+	bool loadSymbols(const char *path);
+	bool resolveAddress(const std::string &text, ADDR &address);
+	bool resolveSourceLine(const std::string &text, std::vector<ADDR> &addresses);
+	void profile(unsigned int hz, const char *folded_path);
+	void traceCalls(const std::string &function_list);
+	void traceSyscalls(bool enable, const char *log_path = nullptr);
+	void printSyscallStats(bool reset);
+	void collectCoverage(const char *module_path, const char *output_path);
+
+	void setBreakpoint(ADDR address, bool hardware = false);
+	size_t setBreakpoints(std::vector<ADDR> addresses, bool one_shot = false);
+	void setBreakpointCondition(ADDR address, const std::string &expression);
+	void setBreakpointIgnoreCount(ADDR address, uint32_t count);
 	void unsetBreakpoint(ADDR address);
 	void deleteBreakpoint(ADDR address);
 	void listBreakpoints();
+	void benchmarkBreakpoints(uint64_t lookups);
+	void benchmarkBreakpointHits(uint64_t hits);
+
+	void setWatchpoint(ADDR address, size_t length, int access);
+	void deleteWatchpoint(ADDR address);
+	void listWatchpoints();
+
+	void setTracepoint(ADDR address, bool log_registers);
+	void deleteTracepoint(ADDR address);
+	void listTracepoints();
+	void printTracepoint(ADDR address);
+
+	void enableThreadEvents();
+	void listThreads();
+	void switchThread(int number);
+	void backtraceAllThreads();
+	void setForkMode(bool hold);
 
 	void stepInto();
 	void stepOver();
 	void stepUntil(ADDR address);
+	void stepBlocks(uint64_t count, ADDR until);
+	void printBlockStats(bool reset);
+	void record(uint64_t limit, ADDR until, const char *path, bool by_block);
+	void checkpoint();
+	void deleteCheckpoint();
+	void restoreCheckpoint();
+	void loop(uint64_t count, ADDR until, ADDR input, size_t input_length);
 	
 	void writeRegister(int regcode, DWORD value);
-	void writeMemory();
+	void writeMemory(ADDR address, const std::vector<BYTE> &bytes);
 	void printRegisters();
 	void printMemory(ADDR address, size_t size);
-	
+	void printBacktrace();
+	void evaluateExpression(const std::string &expression, uint64_t repeat);
+	void printCacheStats();
+	void dumpCore(const char *path);
+	void saveMemorySnapshot();
+	void listMemorySnapshots();
+	void deleteMemorySnapshot(int number);
+	void diffMemorySnapshots(int from, int to);
+
 };
 
 
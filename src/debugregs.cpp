@@ -0,0 +1,119 @@
+/*
+* FreeDBG - x86 Debug Registers
+*/
+
+#include <machine/reg.h>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/ptrace.h>
+#include "debugregs.hpp" // DebugRegisters, DR_ACCESS
+#include "ptracestats.hpp" // dbgPtrace
+
+
+#define DR7_ENABLE(slot) (1u << ((slot) * 2)) // Local enable bit
+#define DR7_FIELD_SHIFT(slot) (16 + (slot) * 4) // R/W (2 bits) then LEN (2 bits)
+
+
+DebugRegisters::DebugRegisters(int pid) : child_pid(pid) {}
+
+void DebugRegisters::fetch()
+{
+	if (fetched) { return; }
+	if (dbgPtrace(PT_GETDBREGS, child_pid, (caddr_t)&dbregs, 0) < 0) { std::memset(&dbregs, 0, sizeof(dbregs)); }
+	fetched = true;
+}
+
+int DebugRegisters::allocate(ADDR address, int access, size_t length) // Returns slot number, or -1 if none are free
+{
+	unsigned len_bits;
+	switch (length)
+	{
+		case 1: len_bits = 0; break;
+		case 2: len_bits = 1; break;
+		case 4: len_bits = 3; break;
+		default: return -1;
+	}
+	if (access == DR_EXEC) { len_bits = 0; } // Execute breakpoints must use length 1
+	if (address & (length - 1)) { return -1; } // Must be naturally aligned
+
+	fetch();
+	for (int slot = 0; slot < DEBUG_SLOTS; slot++)
+	{
+		if (dbregs.dr[7] & DR7_ENABLE(slot)) { continue; }
+		dbregs.dr[slot] = address;
+		dbregs.dr[7] &= ~(0xfu << DR7_FIELD_SHIFT(slot));
+		dbregs.dr[7] |= ((len_bits << 2) | (unsigned)access) << DR7_FIELD_SHIFT(slot);
+		dbregs.dr[7] |= DR7_ENABLE(slot);
+		dirty = true;
+		return slot;
+	}
+	return -1;
+}
+
+void DebugRegisters::release(int slot)
+{
+	if (slot < 0 || slot >= DEBUG_SLOTS) { return; }
+	fetch();
+	dbregs.dr[7] &= ~(DR7_ENABLE(slot) | (0xfu << DR7_FIELD_SHIFT(slot)));
+	dbregs.dr[slot] = 0;
+	dirty = true;
+}
+
+int DebugRegisters::freeSlots()
+{
+	fetch();
+	int count = 0;
+	for (int slot = 0; slot < DEBUG_SLOTS; slot++)
+	{
+		if (!(dbregs.dr[7] & DR7_ENABLE(slot))) { count++; }
+	}
+	return count;
+}
+
+int DebugRegisters::triggeredSlot(unsigned slot_mask) // Checks DR6 after a trap for the slots in slot_mask (bit per slot), -1 if none of them fired
+{
+	fetch();
+	if (!(dbregs.dr[7] & 0xff)) { return -1; } // Nothing armed, nothing can have fired
+	struct dbreg current;
+	if (dbgPtrace(PT_GETDBREGS, child_pid, (caddr_t)&current, 0) < 0) { return -1; }
+
+	if (current.dr[6] & 0xf) // DR6 is sticky, clear it before the next resume whichever slot fired, or the next trap gets blamed on it
+	{
+		dbregs.dr[6] = 0;
+		dirty = true;
+	}
+	for (int slot = 0; slot < DEBUG_SLOTS; slot++)
+	{
+		if ((slot_mask & (1u << slot)) && (current.dr[6] & (1u << slot)) && (dbregs.dr[7] & DR7_ENABLE(slot))) { return slot; }
+	}
+	return -1;
+}
+
+bool DebugRegisters::flush()
+{
+	if (!dirty) { return true; }
+	dirty = false;
+	if (threads.empty()) { return dbgPtrace(PT_SETDBREGS, child_pid, (caddr_t)&dbregs, 0) >= 0; }
+	bool written = true;
+	for (lwpid_t lwp: threads)
+	{
+		if (dbgPtrace(PT_SETDBREGS, lwp, (caddr_t)&dbregs, 0) < 0) { written = false; }
+	}
+	return written;
+}
+
+void DebugRegisters::addThread(lwpid_t lwp) // A new thread gets whatever is armed right away, the others are unaffected
+{
+	if (std::find(threads.begin(), threads.end(), lwp) != threads.end()) { return; }
+	threads.push_back(lwp);
+	fetch();
+	if (dbregs.dr[7] & 0xff) { dbgPtrace(PT_SETDBREGS, lwp, (caddr_t)&dbregs, 0); }
+}
+
+void DebugRegisters::removeThread(lwpid_t lwp)
+{
+	auto it = std::find(threads.begin(), threads.end(), lwp);
+	if (it != threads.end()) { threads.erase(it); }
+}
@@ -0,0 +1,51 @@
+/*
+* FreeDBG - x86 Debug Registers (Header)
+*/
+
+#ifndef FREEDBG_DEBUGREGS
+#define FREEDBG_DEBUGREGS
+
+#include <machine/reg.h>
+#include <sys/types.h>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // ADDR
+
+#define DEBUG_SLOTS 4 // DR0-DR3
+
+
+enum DR_ACCESS { // DR7 R/W field values
+    DR_EXEC = 0,
+    DR_WRITE = 1,
+    DR_READWRITE = 3
+};
+
+
+/* Copy of the debugee's debug registers (PT_GETDBREGS/PT_SETDBREGS). Unlike the
+* general registers they only change when we change them, so they're fetched once
+* and only written back (right before the debugee resumes) after being modified.
+* They're per thread in hardware, so once threads are known the same set is
+* written to every one of them. */
+class DebugRegisters {
+private:
+	int child_pid;
+	std::vector<lwpid_t> threads; // Empty means only the thread that reported the stop
+	struct dbreg dbregs;
+	bool fetched = false;
+	bool dirty = false;
+	void fetch();
+
+public:
+	DebugRegisters(int pid);
+	int allocate(ADDR address, int access, size_t length);
+	void release(int slot);
+	int freeSlots();
+	int triggeredSlot(unsigned slot_mask);
+	bool flush();
+	void addThread(lwpid_t lwp);
+	void removeThread(lwpid_t lwp);
+};
+
+
+#endif // FREEDBG_DEBUGREGS
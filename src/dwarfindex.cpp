@@ -0,0 +1,827 @@
+/*
+* FreeDBG - DWARF Line and Function Index
+*
+*/
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <climits>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dwarfindex.hpp" // DwarfIndex, LineRow, FunctionRange, DwarfIndexHeader
+#include "dwarfreader.hpp" // DwarfReader
+#include "symbols.hpp" // SymbolTable
+
+
+struct Section {
+	const BYTE *data = nullptr;
+	size_t size = 0;
+};
+
+struct DwarfSections {
+	Section info, abbrev, line, str, line_str, str_offsets, addr, ranges, rnglists;
+};
+
+struct UnitSpan { // Whole unit, header included
+	const BYTE *start;
+	const BYTE *end;
+};
+
+struct UnitFormat {
+	int version;
+	size_t offset_size; // 4 for 32-bit DWARF, 8 for 64-bit
+	size_t address_size;
+};
+
+struct UnitFunction {
+	uint32_t low;
+	uint32_t high;
+	std::string_view name;
+};
+
+struct UnitResult { // What one worker extracted from one unit
+	std::vector<LineRow> rows; // File numbers index 'paths'
+	std::vector<std::string> paths;
+	std::vector<UnitFunction> functions;
+};
+
+
+/********************
+* Attribute Forms   *
+********************/
+enum FORM_KIND {
+	KIND_NONE,
+	KIND_CONSTANT,
+	KIND_STRING,
+	KIND_STRX, // Index into .debug_str_offsets
+	KIND_ADDRESS,
+	KIND_ADDRX, // Index into .debug_addr
+	KIND_UNIT_REF, // Offset from the start of the unit
+	KIND_SECTION_REF, // Offset from the start of .debug_info
+	KIND_LISTX // Index into a location/range list offset table
+};
+
+struct FormValue {
+	int kind = KIND_NONE;
+	uint64_t value = 0;
+	const char *text = nullptr;
+};
+
+static const char *sectionString(const Section &section, uint64_t offset)
+{
+	if (offset >= section.size || !memchr(section.data + offset, 0, section.size - offset)) { return nullptr; }
+	return (const char*)section.data + offset;
+}
+
+static bool readForm(DwarfReader &r, uint64_t form, const UnitFormat &format, const DwarfSections &sections, int64_t implicit, FormValue &out)
+{
+	out = FormValue();
+	switch (form)
+	{
+		case 0x01: out.kind = KIND_ADDRESS; out.value = r.fixed(format.address_size); break; // addr
+		case 0x03: r.skip(r.u16()); break; // block2
+		case 0x04: r.skip(r.u32()); break; // block4
+		case 0x05: out.kind = KIND_CONSTANT; out.value = r.u16(); break; // data2
+		case 0x06: out.kind = KIND_CONSTANT; out.value = r.u32(); break; // data4
+		case 0x07: out.kind = KIND_CONSTANT; out.value = r.u64(); break; // data8
+		case 0x08: out.kind = KIND_STRING; out.text = r.cstr(); break; // string
+		case 0x09: case 0x18: r.skip(r.uleb()); break; // block, exprloc
+		case 0x0a: r.skip(r.u8()); break; // block1
+		case 0x0b: case 0x0c: out.kind = KIND_CONSTANT; out.value = r.u8(); break; // data1, flag
+		case 0x0d: out.kind = KIND_CONSTANT; out.value = r.sleb(); break; // sdata
+		case 0x0e: out.kind = KIND_STRING; out.text = sectionString(sections.str, r.fixed(format.offset_size)); break; // strp
+		case 0x0f: out.kind = KIND_CONSTANT; out.value = r.uleb(); break; // udata
+		case 0x22: case 0x23: out.kind = KIND_LISTX; out.value = r.uleb(); break; // loclistx, rnglistx
+		case 0x10: out.kind = KIND_SECTION_REF; out.value = r.fixed(format.version == 2 ? format.address_size : format.offset_size); break; // ref_addr
+		case 0x11: out.kind = KIND_UNIT_REF; out.value = r.u8(); break; // ref1
+		case 0x12: out.kind = KIND_UNIT_REF; out.value = r.u16(); break; // ref2
+		case 0x13: out.kind = KIND_UNIT_REF; out.value = r.u32(); break; // ref4
+		case 0x14: out.kind = KIND_UNIT_REF; out.value = r.u64(); break; // ref8
+		case 0x15: out.kind = KIND_UNIT_REF; out.value = r.uleb(); break; // ref_udata
+		case 0x16: return readForm(r, r.uleb(), format, sections, implicit, out); // indirect
+		case 0x17: out.kind = KIND_CONSTANT; out.value = r.fixed(format.offset_size); break; // sec_offset
+		case 0x19: out.kind = KIND_CONSTANT; out.value = 1; break; // flag_present
+		case 0x1a: case 0x1f02: out.kind = KIND_STRX; out.value = r.uleb(); break; // strx, GNU_str_index
+		case 0x1b: case 0x1f01: out.kind = KIND_ADDRX; out.value = r.uleb(); break; // addrx, GNU_addr_index
+		case 0x1c: r.skip(4); break; // ref_sup4
+		case 0x1d: case 0x1f20: case 0x1f21: r.skip(format.offset_size); break; // strp_sup, GNU_ref_alt, GNU_strp_alt
+		case 0x1e: r.skip(16); break; // data16
+		case 0x1f: out.kind = KIND_STRING; out.text = sectionString(sections.line_str, r.fixed(format.offset_size)); break; // line_strp
+		case 0x20: case 0x24: r.skip(8); break; // ref_sig8, ref_sup8
+		case 0x21: out.kind = KIND_CONSTANT; out.value = implicit; break; // implicit_const
+		case 0x25: case 0x26: case 0x27: case 0x28: out.kind = KIND_STRX; out.value = r.fixed(form - 0x24); break; // strx1-4
+		case 0x29: case 0x2a: case 0x2b: case 0x2c: out.kind = KIND_ADDRX; out.value = r.fixed(form - 0x28); break; // addrx1-4
+		default: return false;
+	}
+	return r.ok;
+}
+
+static std::vector<UnitSpan> splitUnits(const Section &section) // Walks unit headers only, so the units can be handed out to workers
+{
+	std::vector<UnitSpan> units;
+	const BYTE *cursor = section.data;
+	const BYTE *end = section.data + section.size;
+	while (cursor < end)
+	{
+		DwarfReader r(cursor, end);
+		uint64_t length = r.u32();
+		if (length == 0xffffffff) { length = r.u64(); }
+		if (!r.ok || length == 0 || length > (uint64_t)(end - r.cursor)) { break; }
+		units.push_back({cursor, r.cursor + length});
+		cursor = r.cursor + length;
+	}
+	return units;
+}
+
+static size_t readUnitLength(DwarfReader &r) // Returns the offset size the unit uses
+{
+	if (r.u32() != 0xffffffff) { return 4; }
+	r.u64();
+	return 8;
+}
+
+
+/********************
+* Line Programs     *
+********************/
+static std::string joinPath(const std::string &directory, const char *name)
+{
+	if (directory.empty() || name[0] == '/') { return name; }
+	return directory + "/" + name;
+}
+
+static bool readEntryTable(DwarfReader &r, const UnitFormat &format, const DwarfSections &sections,
+	const std::vector<std::string> &directories, std::vector<std::string> &out) // DWARF 5 directory/file tables
+{
+	uint8_t format_count = r.u8();
+	std::vector<std::pair<uint64_t,uint64_t>> entry_format; // Content type, form
+	for (int i = 0; i < format_count; i++)
+	{
+		uint64_t type = r.uleb();
+		entry_format.push_back({type, r.uleb()});
+	}
+
+	uint64_t count = r.uleb();
+	for (uint64_t i = 0; i < count && r.ok; i++)
+	{
+		const char *path = "";
+		uint64_t directory = 0;
+		for (auto &field: entry_format)
+		{
+			FormValue value;
+			if (!readForm(r, field.second, format, sections, 0, value)) { return false; }
+			if (field.first == 1 && value.kind == KIND_STRING && value.text) { path = value.text; } // DW_LNCT_path
+			else if (field.first == 2 && value.kind == KIND_CONSTANT) { directory = value.value; } // DW_LNCT_directory_index
+		}
+		out.push_back(joinPath(directory < directories.size() ? directories[directory] : "", path));
+	}
+	return r.ok;
+}
+
+static void parseLineProgram(const DwarfSections &sections, UnitSpan unit, UnitResult &out)
+{
+	DwarfReader r(unit.start, unit.end);
+	UnitFormat format;
+	format.offset_size = readUnitLength(r);
+	format.version = r.u16();
+	format.address_size = 4;
+	if (format.version < 2 || format.version > 5) { return; }
+	if (format.version >= 5)
+	{
+		format.address_size = r.u8();
+		r.u8(); // segment_selector_size
+	}
+	uint64_t header_length = r.fixed(format.offset_size);
+	if (!r.ok || header_length > (uint64_t)(unit.end - r.cursor)) { return; }
+	const BYTE *program = r.cursor + header_length;
+
+	uint8_t min_instruction_length = r.u8();
+	if (format.version >= 4) { r.u8(); } // maximum_operations_per_instruction, VLIW only
+	bool default_is_stmt = r.u8();
+	int8_t line_base = r.u8();
+	uint8_t line_range = r.u8();
+	uint8_t opcode_base = r.u8();
+	uint8_t standard_lengths[256] = {0};
+	for (int i = 1; i < opcode_base; i++) { standard_lengths[i] = r.u8(); }
+	if (!r.ok || line_range == 0) { return; }
+
+	std::vector<std::string> directories;
+	if (format.version < 5)
+	{
+		directories.push_back(""); // Compilation directory, only known from .debug_info
+		while (r.ok)
+		{
+			const char *directory = r.cstr();
+			if (!*directory) { break; }
+			directories.push_back(directory);
+		}
+		out.paths.push_back(""); // File numbers start at 1
+		while (r.ok)
+		{
+			const char *name = r.cstr();
+			if (!*name) { break; }
+			uint64_t directory = r.uleb();
+			r.uleb(); // Modification time
+			r.uleb(); // Length
+			out.paths.push_back(joinPath(directory < directories.size() ? directories[directory] : "", name));
+		}
+	}
+	else
+	{
+		std::vector<std::string> none;
+		if (!readEntryTable(r, format, sections, none, directories)) { return; }
+		if (!readEntryTable(r, format, sections, directories, out.paths)) { return; }
+	}
+	if (!r.ok) { return; }
+
+	/* State machine from DWARF 5 section 6.2, keeping only is_stmt rows */
+	r.cursor = program;
+	uint64_t address = 0;
+	uint32_t file = 1;
+	int64_t line = 1;
+	bool is_stmt = default_is_stmt;
+	bool discard = false; // Sequence of a function the linker dropped
+	uint64_t tombstone = format.address_size >= 8 ? ~(uint64_t)0 : ((uint64_t)1 << (format.address_size * 8)) - 1;
+	size_t sequence_start = out.rows.size();
+
+	while (r.ok && r.cursor < unit.end)
+	{
+		uint8_t opcode = r.u8();
+		if (opcode >= opcode_base) // Special opcode: advance both, then append a row
+		{
+			uint8_t adjusted = opcode - opcode_base;
+			address += (adjusted / line_range) * min_instruction_length;
+			line += line_base + adjusted % line_range;
+			if (is_stmt) { out.rows.push_back({(uint32_t)address, file, (uint32_t)line}); }
+			continue;
+		}
+
+		switch (opcode)
+		{
+			case 0: // Extended opcode
+			{
+				uint64_t length = r.uleb();
+				if (length == 0 || !r.has(length)) { break; }
+				const BYTE *next = r.cursor + length;
+				uint8_t extended = r.u8();
+				if (extended == 1) // end_sequence
+				{
+					out.rows.push_back({(uint32_t)address, file, 0});
+					if (discard) { out.rows.resize(sequence_start); }
+					sequence_start = out.rows.size();
+					address = 0;
+					file = 1;
+					line = 1;
+					is_stmt = default_is_stmt;
+					discard = false;
+				}
+				else if (extended == 2) // set_address
+				{
+					address = r.fixed(length - 1);
+					if (address == 0 || address == tombstone) { discard = true; }
+				}
+				r.cursor = next;
+				break;
+			}
+			case 1: if (is_stmt) { out.rows.push_back({(uint32_t)address, file, (uint32_t)line}); } break; // copy
+			case 2: address += r.uleb() * min_instruction_length; break; // advance_pc
+			case 3: line += r.sleb(); break; // advance_line
+			case 4: file = r.uleb(); break; // set_file
+			case 6: is_stmt = !is_stmt; break; // negate_stmt
+			case 8: address += ((255 - opcode_base) / line_range) * min_instruction_length; break; // const_add_pc
+			case 9: address += r.u16(); break; // fixed_advance_pc
+			case 7: case 10: case 11: break; // basic_block, prologue_end, epilogue_begin
+			default: for (int i = 0; i < standard_lengths[opcode]; i++) { r.uleb(); } break; // set_column, set_isa, unknown
+		}
+	}
+	out.rows.resize(sequence_start); // Drop a sequence that never ended
+}
+
+
+/********************
+* Subprograms       *
+********************/
+struct Abbreviation {
+	uint64_t tag = 0;
+	bool children = false;
+	std::vector<std::pair<uint64_t,uint64_t>> attributes; // Name, form
+	std::vector<int64_t> implicit; // Parallel to attributes, for implicit_const
+};
+
+static bool parseAbbreviations(const Section &section, uint64_t offset, std::vector<Abbreviation> &out)
+{
+	if (offset >= section.size) { return false; }
+	DwarfReader r(section.data + offset, section.data + section.size);
+	while (r.ok)
+	{
+		uint64_t code = r.uleb();
+		if (code == 0) { break; }
+		if (code > 100000) { return false; } // Codes are dense in practice, refuse to allocate for garbage
+		if (code >= out.size()) { out.resize(code + 1); }
+
+		Abbreviation &abbreviation = out[code];
+		abbreviation.tag = r.uleb();
+		abbreviation.children = r.u8();
+		while (r.ok)
+		{
+			uint64_t name = r.uleb();
+			uint64_t form = r.uleb();
+			if (name == 0 && form == 0) { break; }
+			abbreviation.attributes.push_back({name, form});
+			abbreviation.implicit.push_back(form == 0x21 ? r.sleb() : 0);
+		}
+	}
+	return r.ok;
+}
+
+struct SubprogramDIE {
+	FormValue name;
+	FormValue low;
+	FormValue high;
+	FormValue ranges;
+	uint64_t origin = 0; // DW_AT_specification/abstract_origin, section offset
+};
+
+static void parseInfoUnit(const DwarfSections &sections, UnitSpan unit, UnitResult &out)
+{
+	DwarfReader r(unit.start, unit.end);
+	UnitFormat format;
+	format.offset_size = readUnitLength(r);
+	format.version = r.u16();
+	if (format.version < 2 || format.version > 5) { return; }
+
+	uint64_t abbreviation_offset;
+	if (format.version >= 5)
+	{
+		uint8_t unit_type = r.u8();
+		format.address_size = r.u8();
+		abbreviation_offset = r.fixed(format.offset_size);
+		if (unit_type == 4 || unit_type == 5) { r.u64(); } // Skeleton/split unit id
+		else if (unit_type != 1 && unit_type != 3) { return; } // Type units hold no code
+	}
+	else
+	{
+		abbreviation_offset = r.fixed(format.offset_size);
+		format.address_size = r.u8();
+	}
+
+	std::vector<Abbreviation> abbreviations;
+	if (!r.ok || !parseAbbreviations(sections.abbrev, abbreviation_offset, abbreviations)) { return; }
+
+	uint64_t unit_offset = unit.start - sections.info.data;
+	uint64_t str_offsets_base = format.offset_size * 2; // Past the table header, in case the unit doesn't say
+	uint64_t addr_base = format.offset_size * 2;
+	uint64_t rnglists_base = format.offset_size * 2 + 4;
+	FormValue unit_low; // Base address for range lists
+	std::unordered_map<uint64_t,SubprogramDIE> declarations; // Named subprograms, by section offset
+	std::vector<SubprogramDIE> definitions;
+
+	while (r.ok && r.cursor < unit.end)
+	{
+		uint64_t die_offset = r.cursor - sections.info.data;
+		uint64_t code = r.uleb();
+		if (code == 0) { continue; } // End of a sibling list
+		if (code >= abbreviations.size() || abbreviations[code].tag == 0) { return; }
+
+		const Abbreviation &abbreviation = abbreviations[code];
+		bool unit_die = abbreviation.tag == 0x11 || abbreviation.tag == 0x41 || abbreviation.tag == 0x4a; // compile/partial/skeleton
+		bool subprogram = abbreviation.tag == 0x2e;
+		SubprogramDIE die;
+		for (size_t i = 0; i < abbreviation.attributes.size(); i++)
+		{
+			FormValue value;
+			if (!readForm(r, abbreviation.attributes[i].second, format, sections, abbreviation.implicit[i], value)) { return; }
+			uint64_t attribute = abbreviation.attributes[i].first;
+			if (unit_die)
+			{
+				if (attribute == 0x72) { str_offsets_base = value.value; } // DW_AT_str_offsets_base
+				else if (attribute == 0x73) { addr_base = value.value; } // DW_AT_addr_base
+				else if (attribute == 0x74) { rnglists_base = value.value; } // DW_AT_rnglists_base
+				else if (attribute == 0x11) { unit_low = value; } // DW_AT_low_pc
+			}
+			else if (subprogram)
+			{
+				if (attribute == 0x03) { die.name = value; } // DW_AT_name
+				else if (attribute == 0x11) { die.low = value; } // DW_AT_low_pc
+				else if (attribute == 0x12) { die.high = value; } // DW_AT_high_pc
+				else if (attribute == 0x55) { die.ranges = value; } // DW_AT_ranges, hot/cold split functions
+				else if (attribute == 0x47 || attribute == 0x31) // DW_AT_specification, DW_AT_abstract_origin
+				{
+					if (value.kind == KIND_UNIT_REF) { die.origin = unit_offset + value.value; }
+					else if (value.kind == KIND_SECTION_REF) { die.origin = value.value; }
+				}
+			}
+		}
+
+		if (subprogram)
+		{
+			if (die.name.kind != KIND_NONE || die.origin) { declarations[die_offset] = die; }
+			if ((die.low.kind != KIND_NONE && die.high.kind != KIND_NONE) || die.ranges.kind != KIND_NONE) { definitions.push_back(die); }
+		}
+	}
+
+	/* Resolved once the whole unit is read: the bases live in the unit DIE, names may be on a declaration */
+	auto readAddress = [&](const FormValue &value, uint64_t &address) {
+		if (value.kind == KIND_ADDRESS) { address = value.value; return true; }
+		if (value.kind != KIND_ADDRX) { return false; }
+		uint64_t offset = addr_base + value.value * format.address_size;
+		if (offset + format.address_size > sections.addr.size) { return false; }
+		DwarfReader entry(sections.addr.data + offset, sections.addr.data + sections.addr.size);
+		address = entry.fixed(format.address_size);
+		return true;
+	};
+	auto readName = [&](const FormValue &value) -> const char* {
+		if (value.kind == KIND_STRING) { return value.text; }
+		if (value.kind != KIND_STRX) { return nullptr; }
+		uint64_t offset = str_offsets_base + value.value * format.offset_size;
+		if (offset + format.offset_size > sections.str_offsets.size) { return nullptr; }
+		DwarfReader entry(sections.str_offsets.data + offset, sections.str_offsets.data + sections.str_offsets.size);
+		return sectionString(sections.str, entry.fixed(format.offset_size));
+	};
+
+	auto readIndexed = [&](uint64_t index, uint64_t &address) {
+		FormValue value;
+		value.kind = KIND_ADDRX;
+		value.value = index;
+		return readAddress(value, address);
+	};
+	auto readRanges = [&](const FormValue &value, std::vector<std::pair<uint64_t,uint64_t>> &pieces) {
+		uint64_t base = 0, start, end;
+		readAddress(unit_low, base);
+		if (format.version < 5) // .debug_ranges: pairs relative to the unit's base, (-1, address) rebases
+		{
+			if (value.kind != KIND_CONSTANT || value.value >= sections.ranges.size) { return; }
+			DwarfReader list(sections.ranges.data + value.value, sections.ranges.data + sections.ranges.size);
+			uint64_t selector = format.address_size >= 8 ? ~(uint64_t)0 : ((uint64_t)1 << (format.address_size * 8)) - 1;
+			while (list.ok)
+			{
+				start = list.fixed(format.address_size);
+				end = list.fixed(format.address_size);
+				if (!list.ok || (start == 0 && end == 0)) { break; }
+				if (start == selector) { base = end; }
+				else { pieces.push_back({base + start, base + end}); }
+			}
+			return;
+		}
+
+		uint64_t offset = value.value; // .debug_rnglists, DWARF 5 section 2.17.3
+		if (value.kind == KIND_LISTX)
+		{
+			uint64_t slot = rnglists_base + value.value * format.offset_size;
+			if (slot + format.offset_size > sections.rnglists.size) { return; }
+			DwarfReader entry(sections.rnglists.data + slot, sections.rnglists.data + sections.rnglists.size);
+			offset = rnglists_base + entry.fixed(format.offset_size);
+		}
+		else if (value.kind != KIND_CONSTANT) { return; }
+		if (offset >= sections.rnglists.size) { return; }
+
+		DwarfReader list(sections.rnglists.data + offset, sections.rnglists.data + sections.rnglists.size);
+		while (list.ok)
+		{
+			switch (list.u8())
+			{
+				case 0: return; // end_of_list
+				case 1: readIndexed(list.uleb(), base); break; // base_addressx
+				case 2: // startx_endx
+					if (readIndexed(list.uleb(), start) & readIndexed(list.uleb(), end)) { pieces.push_back({start, end}); }
+					break;
+				case 3: // startx_length
+					if (readIndexed(list.uleb(), start)) { pieces.push_back({start, start + list.uleb()}); }
+					else { list.uleb(); }
+					break;
+				case 4: // offset_pair
+					start = base + list.uleb();
+					pieces.push_back({start, base + list.uleb()});
+					break;
+				case 5: base = list.fixed(format.address_size); break; // base_address
+				case 6: // start_end
+					start = list.fixed(format.address_size);
+					pieces.push_back({start, list.fixed(format.address_size)});
+					break;
+				case 7: // start_length
+					start = list.fixed(format.address_size);
+					pieces.push_back({start, start + list.uleb()});
+					break;
+				default: return;
+			}
+		}
+	};
+
+	std::vector<std::pair<uint64_t,uint64_t>> pieces;
+	for (auto &die: definitions)
+	{
+		pieces.clear();
+		if (die.ranges.kind != KIND_NONE) { readRanges(die.ranges, pieces); }
+		else
+		{
+			uint64_t low, high;
+			if (!readAddress(die.low, low)) { continue; }
+			if (die.high.kind == KIND_CONSTANT) { high = low + die.high.value; } // DWARF 4+: length
+			else if (!readAddress(die.high, high)) { continue; }
+			pieces.push_back({low, high});
+		}
+
+		const SubprogramDIE *named = &die;
+		for (int hops = 0; named->name.kind == KIND_NONE && named->origin && hops < 4; hops++)
+		{
+			auto it = declarations.find(named->origin);
+			if (it == declarations.end()) { break; }
+			named = &it->second;
+		}
+		const char *name = readName(named->name);
+		if (!name) { continue; }
+		for (auto &piece: pieces)
+		{
+			if (piece.first == 0 || piece.second <= piece.first || piece.second > UINT32_MAX) { continue; } // Dropped by the linker
+			out.functions.push_back({(uint32_t)piece.first, (uint32_t)piece.second, name});
+		}
+	}
+}
+
+
+/**************************
+* DwarfIndex Class Methods *
+**************************/
+DwarfIndex::~DwarfIndex()
+{
+	if (mapping) { munmap(mapping, mapping_size); }
+}
+
+bool DwarfIndex::attach(const BYTE *data, size_t size) // Validates a serialized index and points the tables into it
+{
+	if (size < sizeof(DwarfIndexHeader)) { return false; }
+	const DwarfIndexHeader *candidate = (const DwarfIndexHeader*)data;
+	if (candidate->magic != DWARF_INDEX_MAGIC || candidate->version != DWARF_INDEX_VERSION) { return false; }
+
+	uint64_t expected = sizeof(DwarfIndexHeader) + (uint64_t)candidate->row_count * sizeof(LineRow)
+		+ (uint64_t)candidate->file_count * sizeof(uint32_t) + (uint64_t)candidate->function_count * sizeof(FunctionRange)
+		+ candidate->strings_size;
+	if (expected != size || candidate->strings_size == 0 || data[size - 1] != 0) { return false; }
+
+	header = candidate;
+	rows = (const LineRow*)(data + sizeof(DwarfIndexHeader));
+	files = (const uint32_t*)(rows + header->row_count);
+	functions = (const FunctionRange*)(files + header->file_count);
+	strings = (const char*)(functions + header->function_count);
+	return true;
+}
+
+bool DwarfIndex::mapCache(const std::string &path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) { return false; }
+	struct stat info;
+	void *data = MAP_FAILED;
+	if (fstat(fd, &info) == 0 && info.st_size > 0) { data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0); }
+	close(fd);
+	if (data == MAP_FAILED) { return false; }
+
+	if (!attach((const BYTE*)data, info.st_size))
+	{
+		munmap(data, info.st_size);
+		return false;
+	}
+	mapping = data;
+	mapping_size = info.st_size;
+	return true;
+}
+
+const char *DwarfIndex::string(uint32_t offset) { return offset < header->strings_size ? strings + offset : ""; }
+
+bool DwarfIndex::build(SymbolTable &elf)
+{
+	DwarfSections sections;
+	if (!elf.getSection(".debug_line", sections.line.data, sections.line.size)) { return false; }
+	elf.getSection(".debug_info", sections.info.data, sections.info.size);
+	elf.getSection(".debug_abbrev", sections.abbrev.data, sections.abbrev.size);
+	elf.getSection(".debug_str", sections.str.data, sections.str.size);
+	elf.getSection(".debug_line_str", sections.line_str.data, sections.line_str.size);
+	elf.getSection(".debug_str_offsets", sections.str_offsets.data, sections.str_offsets.size);
+	elf.getSection(".debug_addr", sections.addr.data, sections.addr.size);
+	elf.getSection(".debug_ranges", sections.ranges.data, sections.ranges.size);
+	elf.getSection(".debug_rnglists", sections.rnglists.data, sections.rnglists.size);
+
+	/* Units are independent, so workers just pull the next one off a shared counter */
+	std::vector<UnitSpan> line_units = splitUnits(sections.line);
+	std::vector<UnitSpan> info_units = splitUnits(sections.info);
+	std::vector<UnitResult> line_results(line_units.size());
+	std::vector<UnitResult> info_results(info_units.size());
+	size_t total = line_units.size() + info_units.size();
+	std::atomic<size_t> next_unit(0);
+	auto worker = [&]() {
+		for (size_t unit = next_unit++; unit < total; unit = next_unit++)
+		{
+			if (unit < line_units.size()) { parseLineProgram(sections, line_units[unit], line_results[unit]); }
+			else { parseInfoUnit(sections, info_units[unit - line_units.size()], info_results[unit - line_units.size()]); }
+		}
+	};
+
+	thread_count = std::max(1, (int)std::min<size_t>(std::thread::hardware_concurrency(), total));
+	std::vector<std::thread> threads;
+	for (int i = 1; i < thread_count; i++) { threads.emplace_back(worker); }
+	worker();
+	for (auto &thread: threads) { thread.join(); }
+
+	/* Merge: intern every path and name once, renumber each unit's rows into the global file table */
+	std::vector<char> pool;
+	std::unordered_map<std::string_view,uint32_t> interned; // Views into the unit results and the ELF mapping, both outlive this
+	auto intern = [&](std::string_view text) {
+		auto it = interned.find(text);
+		if (it != interned.end()) { return it->second; }
+		uint32_t offset = pool.size();
+		pool.insert(pool.end(), text.begin(), text.end());
+		pool.push_back(0);
+		interned.emplace(text, offset);
+		return offset;
+	};
+	intern(""); // Offset 0, for unknown files
+
+	std::vector<LineRow> all_rows;
+	std::vector<uint32_t> file_table;
+	std::unordered_map<uint32_t,uint32_t> file_numbers; // String offset -> file number
+	size_t row_total = 0;
+	for (auto &result: line_results) { row_total += result.rows.size(); }
+	all_rows.reserve(row_total);
+	for (auto &result: line_results)
+	{
+		std::vector<uint32_t> renumber(result.paths.size());
+		for (size_t i = 0; i < result.paths.size(); i++)
+		{
+			uint32_t offset = intern(result.paths[i]);
+			auto it = file_numbers.try_emplace(offset, file_table.size()).first;
+			if (it->second == file_table.size()) { file_table.push_back(offset); }
+			renumber[i] = it->second;
+		}
+		for (auto row: result.rows)
+		{
+			if (row.file >= renumber.size()) { continue; }
+			row.file = renumber[row.file];
+			all_rows.push_back(row);
+		}
+	}
+	std::sort(all_rows.begin(), all_rows.end(), [](const LineRow &a, const LineRow &b) {
+		if (a.address != b.address) { return a.address < b.address; }
+		return (a.line != 0) < (b.line != 0); // A sequence ending where the next begins sorts first
+	});
+
+	std::vector<FunctionRange> all_functions;
+	for (auto &result: info_results)
+	{
+		for (auto &function: result.functions) { all_functions.push_back({function.low, function.high, intern(function.name)}); }
+	}
+	std::sort(all_functions.begin(), all_functions.end(), [](const FunctionRange &a, const FunctionRange &b) { return a.low < b.low; });
+
+	DwarfIndexHeader built = {DWARF_INDEX_MAGIC, DWARF_INDEX_VERSION, (uint32_t)all_rows.size(), (uint32_t)file_table.size(),
+		(uint32_t)all_functions.size(), (uint32_t)pool.size()};
+	blob.clear();
+	auto append = [&](const void *data, size_t size) { blob.insert(blob.end(), (const BYTE*)data, (const BYTE*)data + size); };
+	append(&built, sizeof(built));
+	append(all_rows.data(), all_rows.size() * sizeof(LineRow));
+	append(file_table.data(), file_table.size() * sizeof(uint32_t));
+	append(all_functions.data(), all_functions.size() * sizeof(FunctionRange));
+	append(pool.data(), pool.size());
+	return attach(blob.data(), blob.size());
+}
+
+static std::string cacheDirectory() // $XDG_CACHE_HOME/freedbg or ~/.cache/freedbg, created on demand
+{
+	std::string base;
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	if (xdg && *xdg) { base = xdg; }
+	else if (home && *home)
+	{
+		base = std::string(home) + "/.cache";
+		mkdir(base.c_str(), 0755);
+	}
+	else { return std::string(); }
+
+	std::string directory = base + "/freedbg";
+	if (mkdir(directory.c_str(), 0755) < 0 && errno != EEXIST) { return std::string(); }
+	return directory;
+}
+
+bool DwarfIndex::load(SymbolTable &elf, const char *path)
+{
+	std::string key = elf.getBuildId();
+	if (key.empty()) // No build-id: fall back to the file's identity, so a rebuild still invalidates the cache
+	{
+		struct stat info;
+		char resolved[PATH_MAX];
+		if (stat(path, &info) < 0 || !realpath(path, resolved)) { return false; }
+		uint64_t hash = 14695981039346656037ull; // FNV-1a
+		for (const char *c = resolved; *c; c++) { hash = (hash ^ (BYTE)*c) * 1099511628211ull; }
+		char fallback[64];
+		snprintf(fallback, sizeof(fallback), "%016llx-%llx-%llx", (unsigned long long)hash,
+			(unsigned long long)info.st_size, (unsigned long long)info.st_mtime);
+		key = fallback;
+	}
+
+	std::string directory = cacheDirectory();
+	std::string cache_path = directory + "/" + key + ".idx";
+	if (!directory.empty() && mapCache(cache_path))
+	{
+		from_cache = true;
+		return true;
+	}
+
+	if (!build(elf)) { return false; }
+	if (directory.empty()) { return true; }
+
+	/* Written under a temporary name first, a concurrent debugger never maps half a file */
+	std::string temporary = cache_path + ".tmp" + std::to_string(getpid());
+	int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) { return true; }
+	bool written = write(fd, blob.data(), blob.size()) == (ssize_t)blob.size();
+	close(fd);
+	if (!written || rename(temporary.c_str(), cache_path.c_str()) < 0) { unlink(temporary.c_str()); }
+	return true;
+}
+
+void DwarfIndex::setBias(ADDR load_bias) { bias = load_bias; }
+
+bool DwarfIndex::isLoaded() { return header != nullptr; }
+
+bool DwarfIndex::loadedFromCache() { return from_cache; }
+
+int DwarfIndex::threadsUsed() { return thread_count; }
+
+size_t DwarfIndex::rowCount() { return header ? header->row_count : 0; }
+
+size_t DwarfIndex::fileCount() { return header ? header->file_count : 0; }
+
+size_t DwarfIndex::functionCount() { return header ? header->function_count : 0; }
+
+bool DwarfIndex::lookupLine(std::string_view file, uint32_t line, std::vector<ADDR> &addresses) // First address of the line in every function it appears in
+{
+	addresses.clear();
+	if (!header || line == 0) { return false; }
+
+	/* 'file' matches a full path or any trailing run of path components */
+	std::vector<bool> matching(header->file_count, false);
+	bool any = false;
+	for (uint32_t i = 0; i < header->file_count; i++)
+	{
+		std::string_view path = string(files[i]);
+		if (path.size() < file.size() || path.compare(path.size() - file.size(), file.size(), file)) { continue; }
+		if (path.size() == file.size() || path[path.size() - file.size() - 1] == '/') { matching[i] = any = true; }
+	}
+	if (!any) { return false; }
+
+	/* Lines without code (comments, declarations) resolve to the next one that has some */
+	uint32_t target = UINT32_MAX;
+	for (uint32_t i = 0; i < header->row_count; i++)
+	{
+		if (rows[i].file < header->file_count && matching[rows[i].file] && rows[i].line >= line && rows[i].line < target) { target = rows[i].line; }
+	}
+	if (target == UINT32_MAX) { return false; }
+
+	std::unordered_map<uint64_t,uint32_t> lowest; // Per function, or per address outside any known function
+	for (uint32_t i = 0; i < header->row_count; i++)
+	{
+		if (rows[i].file >= header->file_count || !matching[rows[i].file] || rows[i].line != target) { continue; }
+		const FunctionRange *function = std::upper_bound(functions, functions + header->function_count, rows[i].address,
+			[](uint32_t address, const FunctionRange &range) { return address < range.low; });
+		uint64_t key = (uint64_t)1 << 32 | rows[i].address;
+		if (function != functions && rows[i].address < (function - 1)->high) { key = function - 1 - functions; }
+		auto it = lowest.try_emplace(key, rows[i].address).first;
+		it->second = std::min(it->second, rows[i].address);
+	}
+	for (auto &entry: lowest) { addresses.push_back(entry.second + bias); }
+	std::sort(addresses.begin(), addresses.end());
+	return true;
+}
+
+bool DwarfIndex::describe(ADDR address, std::string &file, uint32_t &line) // Source position of the row covering address
+{
+	if (!header) { return false; }
+	uint32_t linked = address - bias;
+	const LineRow *row = std::upper_bound(rows, rows + header->row_count, linked,
+		[](uint32_t value, const LineRow &entry) { return value < entry.address; });
+	if (row == rows || (row - 1)->line == 0 || (row - 1)->file >= header->file_count) { return false; } // Before the first row, or in a gap between sequences
+	row--;
+	file = string(files[row->file]);
+	line = row->line;
+	return true;
+}
+
+const char *DwarfIndex::functionAt(ADDR address)
+{
+	if (!header) { return nullptr; }
+	uint32_t linked = address - bias;
+	const FunctionRange *function = std::upper_bound(functions, functions + header->function_count, linked,
+		[](uint32_t value, const FunctionRange &range) { return value < range.low; });
+	if (function == functions || linked >= (function - 1)->high) { return nullptr; }
+	return string((function - 1)->name);
+}
@@ -0,0 +1,87 @@
+/*
+* FreeDBG - DWARF Line and Function Index (Header)
+*/
+
+#ifndef FREEDBG_DWARF_INDEX
+#define FREEDBG_DWARF_INDEX
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // BYTE, ADDR
+#include "symbols.hpp" // SymbolTable
+
+
+#define DWARF_INDEX_MAGIC 0x58444946 // "FIDX"
+#define DWARF_INDEX_VERSION 1
+
+
+struct LineRow { // One is_stmt row of a line program, line 0 marks the end of a sequence
+	uint32_t address;
+	uint32_t file;
+	uint32_t line;
+};
+
+struct FunctionRange { // DW_TAG_subprogram with a contiguous pc range
+	uint32_t low;
+	uint32_t high;
+	uint32_t name;
+};
+
+struct DwarfIndexHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t row_count; // LineRow[], sorted by address
+	uint32_t file_count; // uint32_t string offsets
+	uint32_t function_count; // FunctionRange[], sorted by low
+	uint32_t strings_size; // NUL terminated strings, referenced by offset
+};
+
+
+/* Source line table and function ranges built from .debug_line and .debug_info.
+* Compilation units are parsed in parallel, then merged into one flat blob laid out
+* as DwarfIndexHeader, rows, files, functions and strings. The same blob is written
+* to ~/.cache/freedbg/BUILD-ID.idx and later mapped straight back in, so loading
+* an unchanged binary a second time costs a single mmap. Addresses are as linked. */
+class DwarfIndex {
+private:
+	void *mapping = nullptr;
+	size_t mapping_size = 0;
+	std::vector<BYTE> blob; // Used instead of a mapping when the cache couldn't be written
+	const DwarfIndexHeader *header = nullptr;
+	const LineRow *rows = nullptr;
+	const uint32_t *files = nullptr;
+	const FunctionRange *functions = nullptr;
+	const char *strings = nullptr;
+	ADDR bias = 0;
+	bool from_cache = false;
+	int thread_count = 0;
+	bool attach(const BYTE *data, size_t size);
+	bool mapCache(const std::string &path);
+	bool build(SymbolTable &elf);
+	const char *string(uint32_t offset);
+
+public:
+	DwarfIndex() = default;
+	DwarfIndex(const DwarfIndex&) = delete;
+	DwarfIndex &operator=(const DwarfIndex&) = delete;
+	~DwarfIndex();
+
+	bool load(SymbolTable &elf, const char *path);
+	void setBias(ADDR load_bias);
+	bool isLoaded();
+	bool loadedFromCache();
+	int threadsUsed();
+	size_t rowCount();
+	size_t fileCount();
+	size_t functionCount();
+
+	bool lookupLine(std::string_view file, uint32_t line, std::vector<ADDR> &addresses);
+	bool describe(ADDR address, std::string &file, uint32_t &line);
+	const char *functionAt(ADDR address);
+};
+
+
+#endif // FREEDBG_DWARF_INDEX
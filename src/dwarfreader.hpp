@@ -0,0 +1,82 @@
+/*
+* FreeDBG - DWARF Byte Reader (Header)
+*/
+
+#ifndef FREEDBG_DWARF_READER
+#define FREEDBG_DWARF_READER
+
+#include <cstdint>
+#include <cstring>
+#include "types.hpp" // BYTE
+
+
+/* Bounds checked little endian reader, a short read poisons it instead of running off the section */
+struct DwarfReader {
+	const BYTE *cursor;
+	const BYTE *end;
+	bool ok = true;
+
+	DwarfReader(const BYTE *start, const BYTE *stop) : cursor(start), end(stop) {}
+	bool has(uint64_t count)
+	{
+		if ((uint64_t)(end - cursor) >= count) { return true; }
+		ok = false;
+		cursor = end;
+		return false;
+	}
+	uint64_t fixed(size_t count)
+	{
+		uint64_t value = 0;
+		if (!has(count)) { return 0; }
+		for (size_t i = 0; i < count; i++) { value |= (uint64_t)cursor[i] << (i * 8); }
+		cursor += count;
+		return value;
+	}
+	uint8_t u8() { return fixed(1); }
+	uint16_t u16() { return fixed(2); }
+	uint32_t u32() { return fixed(4); }
+	uint64_t u64() { return fixed(8); }
+	uint64_t uleb()
+	{
+		uint64_t value = 0;
+		for (int shift = 0; has(1); shift += 7)
+		{
+			BYTE byte = *cursor++;
+			if (shift < 64) { value |= (uint64_t)(byte & 0x7f) << shift; }
+			if (!(byte & 0x80)) { break; }
+		}
+		return value;
+	}
+	int64_t sleb()
+	{
+		int64_t value = 0;
+		int shift = 0;
+		BYTE byte = 0;
+		while (has(1))
+		{
+			byte = *cursor++;
+			if (shift < 64) { value |= (int64_t)(byte & 0x7f) << shift; }
+			shift += 7;
+			if (!(byte & 0x80)) { break; }
+		}
+		if (shift < 64 && (byte & 0x40)) { value |= -((int64_t)1 << shift); }
+		return value;
+	}
+	const char *cstr()
+	{
+		const BYTE *start = cursor;
+		const BYTE *nul = (const BYTE*)memchr(cursor, 0, end - cursor);
+		if (!nul)
+		{
+			ok = false;
+			cursor = end;
+			return "";
+		}
+		cursor = nul + 1;
+		return (const char*)start;
+	}
+	void skip(uint64_t count) { if (has(count)) { cursor += count; } }
+};
+
+
+#endif // FREEDBG_DWARF_READER
@@ -0,0 +1,93 @@
+/*
+* FreeDBG - Event Loop
+*/
+
+#include <sys/types.h>
+#include <sys/event.h>
+#include <unistd.h>
+#include <chrono>
+#include <csignal>
+#include <cerrno>
+#include <cstdint>
+#include "eventloop.hpp" // EventLoop, LoopEvent, LOOP_EVENT
+#include "logging.hpp" // logError
+
+
+static uint64_t clockNanoseconds() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+
+/***************************
+* EventLoop Class Methods  *
+***************************/
+EventLoop::EventLoop()
+{
+	queue = kqueue();
+	if (queue < 0) { logError("Unable to create event queue, the debugee can't be interrupted while it runs"); }
+}
+
+EventLoop::~EventLoop()
+{
+	if (queue >= 0) { close(queue); }
+}
+
+bool EventLoop::isOpen() { return queue >= 0; }
+
+bool EventLoop::change(uintptr_t ident, short filter, unsigned short flags, unsigned int fflags, int64_t data)
+{
+	struct kevent change;
+	EV_SET(&change, ident, filter, flags, fflags, data, nullptr);
+	return queue >= 0 && kevent(queue, &change, 1, nullptr, 0, nullptr) == 0;
+}
+
+bool EventLoop::watchChild(pid_t pid) // SIGCHLD covers stops, NOTE_EXIT makes sure an exit is never missed
+{
+	return change(SIGCHLD, EVFILT_SIGNAL, EV_ADD) && change(pid, EVFILT_PROC, EV_ADD, NOTE_EXIT);
+}
+
+bool EventLoop::watchInput(int fd) { return change(fd, EVFILT_READ, EV_ADD); }
+
+void EventLoop::unwatchInput(int fd) { change(fd, EVFILT_READ, EV_DELETE); }
+
+bool EventLoop::watchInterrupt() // EVFILT_SIGNAL still sees an ignored SIGINT, ignoring it keeps Ctrl-C from killing the debugger
+{
+	if (!change(SIGINT, EVFILT_SIGNAL, EV_ADD)) { return false; }
+	signal(SIGINT, SIG_IGN);
+	return true;
+}
+
+void EventLoop::clearInterrupt() // Drops a Ctrl-C that hasn't been collected yet
+{
+	if (change(SIGINT, EVFILT_SIGNAL, EV_DELETE)) { change(SIGINT, EVFILT_SIGNAL, EV_ADD); }
+}
+
+uintptr_t EventLoop::addTimer(unsigned int microseconds, bool repeat) // 0 if it couldn't be armed
+{
+	uintptr_t timer = next_timer++;
+	if (!change(timer, EVFILT_TIMER, EV_ADD | (repeat ? 0 : EV_ONESHOT), NOTE_USECONDS, microseconds)) { return 0; }
+	return timer;
+}
+
+void EventLoop::removeTimer(uintptr_t timer) { change(timer, EVFILT_TIMER, EV_DELETE); } // Fails harmlessly if a one shot already fired
+
+bool EventLoop::wait(LoopEvent &event) // Blocks until the next event, false if the queue is unusable
+{
+	struct kevent received;
+	int count;
+	do { count = kevent(queue, nullptr, 0, &received, 1, nullptr); } while (count < 0 && errno == EINTR);
+	if (count <= 0 || (received.flags & EV_ERROR))
+	{
+		logError("Event queue failed, falling back to blocking waits");
+		return false;
+	}
+
+	event.ident = received.ident;
+	event.received = clockNanoseconds();
+	switch (received.filter)
+	{
+		case EVFILT_SIGNAL: event.type = (received.ident == SIGINT) ? EVENT_INTERRUPT : EVENT_CHILD; break;
+		case EVFILT_PROC: event.type = EVENT_CHILD; break;
+		case EVFILT_READ: event.type = EVENT_INPUT; break;
+		default: event.type = EVENT_TIMER; break;
+	}
+	return true;
+}
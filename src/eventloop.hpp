@@ -0,0 +1,54 @@
+/*
+* FreeDBG - Event Loop (Header)
+*/
+
+#ifndef FREEDBG_EVENT_LOOP
+#define FREEDBG_EVENT_LOOP
+
+#include <sys/types.h>
+#include <cstdint>
+
+
+enum LOOP_EVENT {
+	EVENT_CHILD, // A watched process stopped, exited or was killed (SIGCHLD or NOTE_EXIT), reap it with a non-blocking wait
+	EVENT_INPUT, // A watched descriptor is readable, ident is the descriptor
+	EVENT_INTERRUPT, // Ctrl-C (SIGINT) reached the debugger
+	EVENT_TIMER // ident is the timer returned by addTimer
+};
+
+struct LoopEvent {
+	int type;
+	uintptr_t ident;
+	uint64_t received; // Steady clock ns when kevent returned it
+};
+
+
+/* One kqueue multiplexing everything the debugger waits on while a debugee
+* runs: its stops and exit, the terminal, Ctrl-C and timers. Stops arrive as
+* SIGCHLD, so several debugees can share one loop; the event only says that
+* something happened, the owner still reaps the status with WNOHANG and must
+* tolerate finding nothing (a stop already reaped by a blocking wait). */
+class EventLoop {
+private:
+	int queue = -1;
+	uintptr_t next_timer = 1;
+	bool change(uintptr_t ident, short filter, unsigned short flags, unsigned int fflags = 0, int64_t data = 0);
+
+public:
+	EventLoop();
+	~EventLoop();
+	EventLoop(const EventLoop&) = delete;
+	EventLoop &operator=(const EventLoop&) = delete;
+	bool isOpen();
+	bool watchChild(pid_t pid);
+	bool watchInput(int fd);
+	void unwatchInput(int fd);
+	bool watchInterrupt();
+	void clearInterrupt();
+	uintptr_t addTimer(unsigned int microseconds, bool repeat);
+	void removeTimer(uintptr_t timer);
+	bool wait(LoopEvent &event);
+};
+
+
+#endif // FREEDBG_EVENT_LOOP
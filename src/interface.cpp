@@ -8,12 +8,18 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include <sstream> 
+#include <fstream>
 #include <cstdio>
-#include <iostream>
+#include <cstdlib>
+#include <cctype>
+#include <cstdint>
 #include <exception>
+#include <unistd.h>
 #include "interface.hpp" // DebuggerCLI, Command
 #include "logging.hpp" // logError, logMsg
+#include "ptracestats.hpp" // printStats
 
 
 
@@ -27,6 +33,7 @@ std::unordered_map<std::string, int> register_map = { // second values from enum
     {"ebp", R_EBP},
     {"eip", R_EIP},
     {"esp", R_ESP},
+    {"eflags", R_EFLAGS},
     {"cflag", R_CARRY},
     {"zflag", R_ZERO},
     {"sflag", R_SIGN},
@@ -38,21 +45,71 @@ static const char *HELP[] = { // Update this and add more detail
 	"help(h)",
 	"\t - Display this list of commands",
 	"quit(q)",
-	"\t - Kill debugee process and exit FreeDBG",
+	"\t - Kill debugee process (detach from it if attached with -p) and exit FreeDBG",
 	"clear",
 	"\t - Clear terminal screen",
 	"detach",
 	"\t - Detach from debugee process and exit FreeDBG",
 	"continue/run [to/until ADDR]",
 	"\t - Resume execution of debugee process indefinetly or until specified address",
-	"breakpoint(break) ADDR [enable|disable|delete]",
-	"\t - Set/enable, disable, or delete breakpoint at given address",
+	"interrupt(i) [bench N]",
+	"\t - Stop the debugee while it runs (typed during 'continue', or Ctrl-C), or time N interrupts of it (Default: 100)",
+	"breakpoint(break) ADDR [enable|disable|delete|hw]",
+	"\t - Set/enable, disable, or delete breakpoint at given address ('hw' uses a debug register instead of INT3)",
+	"breakpoint(break) ADDR if EXPR | ignore N",
+	"\t - Only stop when EXPR is non-zero (no EXPR makes it unconditional), or let the next N hits through without stopping",
+	"breakpoint(break) file PATH | range START END STEP",
+	"\t - Set breakpoints on every address listed in PATH, or every STEP bytes from START up to END",
+	"breakpoint(break) bench [N]",
+	"\t - Time N lookups (Default: 1000000) in breakpoint tables of 1000, 10000 and 100000 entries against std::unordered_map",
+	"breakpoint(break) bench hits [N]",
+	"\t - Continue through N breakpoint hits (Default: 10000) stepping over them displaced, then N more taking the INT3 out, and compare hits/s",
+	"watch ADDR LEN [r|w|rw] | ADDR delete | list",
+	"\t - Stop when LEN bytes at given address are read and/or written (Default: w), delete or list watchpoints",
+	"tracepoint(trace) ADDR [regs|show|delete] | list",
+	"\t - Count hits (and log registers) at given address without stopping, show logged hits, delete or list tracepoints",
 	"step(s) [to/until ADDR]",
 	"\t - Execute one instruction, or until given address",
-	"set %register VALUE",
-	"\t - Assign value to register (preceeded by percent sign)",
-	"print [ADDRESS SIZE | registers(regs)]",
-	"\t - Read/print registers or SIZE bytes of data at given address (Default: 4 bytes)",
+	"next(n) | step over",
+	"\t - Execute one instruction, running calls to completion",
+	"step(s) block [N | until ADDR]",
+	"\t - Run to the start of the next basic block, N blocks on, or until given address, counting branch edges",
+	"blocks [reset]",
+	"\t - Show the most taken branch edges and instructions per stop of block stepping, then optionally clear them",
+	"checkpoint [delete]",
+	"\t - Save registers and write protect memory so pages can be copied as they're first written, or drop the checkpoint",
+	"restore",
+	"\t - Go back to the checkpoint, writing back registers and only the pages written since",
+	"loop N until ADDR [input ADDR LEN]",
+	"\t - Restore the checkpoint and run to given address N times, writing LEN fresh random bytes to the input address each time",
+	"record [block] [N | until ADDR] [FILE]",
+	"\t - Single-step (or block-step) N times, up to given address or the next breakpoint, saving every step to a compressed trace (Default: freedbg.trace)",
+	"syscalls on [FILE|-] | off | stats [reset]",
+	"\t - Count and time every syscall while the debugee runs (logging each to FILE or stdout), stop, or print/reset the counts",
+	"backtrace(bt)",
+	"\t - Print the call stack of the current stop",
+	"thread [list | N | apply all bt]",
+	"\t - List threads, select thread N for registers, stepping and backtraces, or print every thread's call stack",
+	"fork detach|stop",
+	"\t - Let forked children run with the breakpoints taken out (Default), or leave them stopped for another debugger",
+	"eval [bench N] EXPR",
+	"\t - Print the value of EXPR at the current stop, or time N evaluations of it",
+	"set %register VALUE | ADDR BYTES",
+	"\t - Assign value to register (preceeded by percent sign), or write BYTES (hex, e.g. '90 90' or '41424300') to memory at given address",
+	"stats [reset]",
+	"\t - Show count and latency of every ptrace request, wait and log message, and the stops by signal (needs a FREEDBG_STATS build)",
+	"print [ADDRESS SIZE | registers(regs) | cache]",
+	"\t - Read/print registers, SIZE bytes of data at given address (Default: 4 bytes), or memory cache statistics",
+	"gcore [FILE]",
+	"\t - Write an ELF core file of the debugee as it is at this stop, for gdb or lldb (Default: freedbg.core)",
+	"snapshot [list | delete N]",
+	"\t - Save a copy of the debugee's writable memory (only pages changed since earlier snapshots are stored), list or delete snapshots",
+	"diff [A [B]]",
+	"\t - Show the pages that changed between snapshots A and B, or from A (Default: the latest) to memory as it is now",
+	"",
+	"ADDR can be a hex address, a symbol name, SYMBOL+OFFSET (hex) or FILE:LINE, e.g. 'break main+0x1a', 'break parse.c:120'",
+	"EXPR is C-like unsigned 32-bit arithmetic over registers (eax, %eax, zflag...), symbols, numbers (0x for hex) and memory",
+	"(byte[ADDR], word[ADDR], dword[ADDR] or *ADDR), e.g. 'break parse if eax == 3 && byte[esi] != 0'",
 	0
 };
 
@@ -62,12 +119,10 @@ static const char *HELP[] = { // Update this and add more detail
 ************************/
 std::string &Command::operator[] (size_t i) { return cmdline[i]; }
 
-void Command::getInput()
+void Command::getInput(const std::string &line)
 {
     std::string cmd;
-    std::string command;
-    std::getline(std::cin, command);
-    std::stringstream cmdstream(command);
+    std::stringstream cmdstream(line);
     while(std::getline(cmdstream, cmd, delim))
     {
         cmdline.push_back(cmd);
@@ -78,15 +133,124 @@ void Command::getInput()
 int Command::length() { return argcount; }
 
 
+static std::string joinArguments(Command &command, int first) // Rest of the line from command[first], e.g. an expression with spaces in it
+{
+	std::string text;
+	for (int i = first; i < command.length(); i++)
+	{
+		if (command[i].empty()) { continue; } // Repeated spaces
+		if (!text.empty()) { text += ' '; }
+		text += command[i];
+	}
+	return text;
+}
+
+static bool parseHexBytes(const std::string &text, std::vector<BYTE> &bytes) // Pairs of hex digits, optionally separated by spaces, e.g. '90 90' or '41424300'
+{
+	bytes.clear();
+	for (size_t i = 0; i < text.size(); i++)
+	{
+		if (text[i] == ' ') { continue; }
+		if (i + 1 >= text.size() || !isxdigit((unsigned char)text[i]) || !isxdigit((unsigned char)text[i + 1])) { return false; }
+		bytes.push_back((BYTE)std::stoul(text.substr(i, 2), 0, 16));
+		i++;
+	}
+	return !bytes.empty();
+}
+
+
 /**************************** 
 * DebuggerCLI Class Methods *
 ****************************/
 DebuggerCLI::DebuggerCLI(Debugger &dbgr) : debugger(&dbgr)
 {
+	if (events.isOpen() && events.watchInput(STDIN_FILENO) && events.watchInterrupt()) // Otherwise continuing blocks until the debugee stops
+	{
+		debugger->attachEventLoop(events, [this]() { readWhileRunning(); });
+	}
 	if (!debugger->isActive()) { debugger->start(); }
+	debugger->enableThreadEvents();
+}
+
+bool DebuggerCLI::readInput(std::vector<std::string> &lines) // One read of the terminal, split into whole lines; false once it's closed
+{
+	char buffer[256];
+	ssize_t length = read(STDIN_FILENO, buffer, sizeof(buffer));
+	if (length <= 0)
+	{
+		if (!partial_input.empty()) { lines.push_back(partial_input); } // Last line without a newline
+		partial_input.clear();
+		input_closed = true;
+		return false;
+	}
+
+	partial_input.append(buffer, length);
+	size_t start = 0;
+	for (size_t end; (end = partial_input.find('\n', start)) != std::string::npos; start = end + 1)
+	{
+		lines.push_back(partial_input.substr(start, end - start));
+	}
+	partial_input.erase(0, start); // A line split across reads waits for the rest
+	return true;
+}
+
+bool DebuggerCLI::nextLine(std::string &line) // Type-ahead first, then blocks for a whole line; false at end of input
+{
+	while (typed_ahead.empty() && !input_closed)
+	{
+		std::vector<std::string> lines;
+		readInput(lines);
+		typed_ahead.insert(typed_ahead.end(), lines.begin(), lines.end());
+	}
+	if (typed_ahead.empty()) { return false; }
+	line = typed_ahead.front();
+	typed_ahead.pop_front();
+	return true;
+}
+
+void DebuggerCLI::readWhileRunning() // Terminal input that arrives while the debugee runs, only a few commands make sense then
+{
+	std::vector<std::string> lines;
+	if (!readInput(lines)) { events.unwatchInput(STDIN_FILENO); } // End of input, nothing more to listen for
+
+	for (std::string &line: lines)
+	{
+		std::string trimmed = line;
+		trimmed.erase(0, trimmed.find_first_not_of(" \t\r"));
+		trimmed.erase(trimmed.find_last_not_of(" \t\r") + 1);
+		if (!trimmed.compare("interrupt") || !trimmed.compare("i")) { debugger->interrupt(); }
+		else if (!trimmed.compare("stats")) { printStats(false); }
+		else { typed_ahead.push_back(line); } // Everything else waits for the debugee to stop, as it would at the prompt
+	}
 }
 
 
+bool DebuggerCLI::parseStepLimit(Command &command, int &index, uint64_t &limit, ADDR &until) // Optional 'N' or 'until ADDR' at command[index]
+{
+	limit = 0;
+	until = 0;
+	if (command.length() > index + 1 && (!command[index].compare("until") || !command[index].compare("to")))
+	{
+		if (!debugger->resolveAddress(command[index + 1], until))
+		{
+			logError("Invalid address '%s'", command[index + 1].c_str());
+			return false;
+		}
+		index += 2;
+	}
+	else if (command.length() > index && isdigit(command[index][0]))
+	{
+		try { limit = std::stoull(command[index]); }
+		catch(...)
+		{
+			logError("Invalid count '%s'", command[index].c_str());
+			return false;
+		}
+		index++;
+	}
+	return true;
+}
+
 void DebuggerCLI::loop() // Kind of a trainwreck
 {
 	printf("\n~ FreeDBG Interactive Interface ~\n(Type 'help' for list of commands)");
@@ -97,12 +261,14 @@ void DebuggerCLI::loop() // Kind of a trainwreck
 		printf("%s", prefix);
 		fflush(stdout);
 		Command command;
-		command.getInput();
+		std::string line;
+		if (nextLine(line)) { command.getInput(line); }
 		
 		if (command.length() == 0) {} // Do nothing
 		else if (!command[0].compare("q") || !command[0].compare("quit"))
 		{
-			debugger->killProcess();
+			if (debugger->isAttached()) { debugger->detachProcess(); } // Not ours to kill
+			else { debugger->killProcess(); }
 			break;
 		}
 		else if (!command[0].compare("clear")) // Might remove this
@@ -115,12 +281,13 @@ void DebuggerCLI::loop() // Kind of a trainwreck
 			{
 				if (!command[1].compare("to") || !command[1].compare("until"))
 				{
-					try { debugger->stepUntil(std::stoul(command[2], 0, 16)); }
-					catch(...)
+					ADDR address;
+					if (!debugger->resolveAddress(command[2], address))
 					{
-						logError("Invalid address '%s'", command[1].c_str());
+						logError("Invalid address '%s'", command[2].c_str());
 						continue;
 					}
+					debugger->stepUntil(address);
 				}
 				else
 				{
@@ -132,6 +299,18 @@ void DebuggerCLI::loop() // Kind of a trainwreck
 				debugger->continueExec();
 			}
 		}
+		else if (!command[0].compare("interrupt") || !command[0].compare("i"))
+		{
+			if (command.length() >= 2 && !command[1].compare("bench"))
+			{
+				unsigned long rounds = 100;
+				try { rounds = (command.length() > 2) ? std::stoul(command[2]) : rounds; }
+				catch(...) { rounds = 0; }
+				if (rounds == 0 || rounds > UINT32_MAX) { logError("Invalid count '%s'", command[2].c_str()); }
+				else { debugger->benchmarkInterrupts(rounds); }
+			}
+			else { logMsg("The debugee is already stopped, 'interrupt' stops it while it runs after 'continue'"); }
+		}
 		else if (!command[0].compare("break") || !command[0].compare("breakpoint"))
 		{
 			if (command.length() < 2)
@@ -146,19 +325,102 @@ void DebuggerCLI::loop() // Kind of a trainwreck
 				continue;
 			}
 
-			unsigned long address; // Fix this
-			try { address = std::stoul(command[1], 0, 16); }
-			catch(...)
+			if (!command[1].compare("bench"))
+			{
+				bool hits = command.length() > 2 && !command[2].compare("hits");
+				int count_arg = hits ? 3 : 2;
+				unsigned long long count = hits ? 10000 : 1000000;
+				try { count = (command.length() > count_arg) ? std::stoull(command[count_arg]) : count; }
+				catch(...) { count = 0; }
+				if (count == 0) { logError("Invalid count '%s'", command[count_arg].c_str()); }
+				else if (hits) { debugger->benchmarkBreakpointHits(count); }
+				else { debugger->benchmarkBreakpoints(count); }
+				continue;
+			}
+
+			if (!command[1].compare("file"))
+			{
+				if (command.length() < 3)
+				{
+					logError("Command 'breakpoint file' requires argument 'path'");
+					continue;
+				}
+				std::ifstream addrfile(command[2]);
+				if (!addrfile)
+				{
+					logError("Unable to open '%s'", command[2].c_str());
+					continue;
+				}
+				std::vector<ADDR> addresses;
+				std::string line;
+				while (std::getline(addrfile, line)) // One hex address per line, '#' starts a comment
+				{
+					line = line.substr(0, line.find('#'));
+					if (line.find_first_not_of(" \t\r") == std::string::npos) { continue; }
+					line = line.substr(line.find_first_not_of(" \t"));
+					line = line.substr(0, line.find_last_not_of(" \t\r") + 1);
+					ADDR address;
+					if (debugger->resolveAddress(line, address)) { addresses.push_back(address); }
+					else { logError("Invalid address '%s'", line.c_str()); }
+				}
+				debugger->setBreakpoints(addresses);
+				continue;
+			}
+
+			if (!command[1].compare("range"))
+			{
+				if (command.length() < 5)
+				{
+					logError("Command 'breakpoint range' requires arguments 'start', 'end' and 'step'");
+					continue;
+				}
+				ADDR start, end;
+				unsigned long step = 0;
+				try { step = std::stoul(command[4], 0, 16); }
+				catch(...) {}
+				if (!debugger->resolveAddress(command[2], start) || !debugger->resolveAddress(command[3], end) || step == 0 || end < start)
+				{
+					logError("Invalid range '%s %s %s'", command[2].c_str(), command[3].c_str(), command[4].c_str());
+					continue;
+				}
+				std::vector<ADDR> addresses;
+				for (uint64_t address = start; address < end; address += step) { addresses.push_back(address); } // 64-bit, so a step past 0xFFFFFFFF ends the loop instead of wrapping
+				debugger->setBreakpoints(addresses);
+				continue;
+			}
+
+			std::vector<ADDR> line_addresses; // A source line can be compiled into several functions (inlining, templates)
+			if ((command.length() == 2 || !command[2].compare("enable")) && debugger->resolveSourceLine(command[1], line_addresses) && line_addresses.size() > 1)
+			{
+				for (ADDR line_address: line_addresses) { debugger->setBreakpoint(line_address); }
+				continue;
+			}
+
+			ADDR address;
+			if (!debugger->resolveAddress(command[1], address))
 			{
 				logError("Invalid address '%s'", command[1].c_str());
 				continue;
 			}
 
-			if (command.length() == 3)
+			if (command.length() >= 3 && !command[2].compare("if"))
+			{
+				debugger->setBreakpointCondition(address, joinArguments(command, 3));
+			}
+			else if (command.length() >= 3 && !command[2].compare("ignore"))
+			{
+				unsigned long count = 0;
+				try { count = (command.length() == 4) ? std::stoul(command[3], 0, 0) : 0; }
+				catch(...) { count = 0; }
+				if (command.length() != 4 || count > UINT32_MAX) { logError("Command 'breakpoint ignore' requires argument 'count'"); }
+				else { debugger->setBreakpointIgnoreCount(address, count); }
+			}
+			else if (command.length() == 3)
 			{
 				if (!command[2].compare("enable")) { debugger->setBreakpoint(address); }
 				else if (!command[2].compare("disable")) { debugger->unsetBreakpoint(address); }
 				else if (!command[2].compare("delete")) { debugger->deleteBreakpoint(address); }
+				else if (!command[2].compare("hw")) { debugger->setBreakpoint(address, true); }
 				else { logError("Invalid breakpoint option '%s'", command[2].c_str()); }
 			}
 			else // Default: Set/enable
@@ -166,9 +428,97 @@ void DebuggerCLI::loop() // Kind of a trainwreck
 				debugger->setBreakpoint(address); 
 			} 
 		}
+		else if (!command[0].compare("watch"))
+		{
+			if (command.length() < 2)
+			{
+				logError("Command 'watch' requires arguments 'address' and 'length'");
+				continue;
+			}
+			if (!command[1].compare("list"))
+			{
+				debugger->listWatchpoints();
+				continue;
+			}
+
+			ADDR address;
+			if (!debugger->resolveAddress(command[1], address))
+			{
+				logError("Invalid address '%s'", command[1].c_str());
+				continue;
+			}
+
+			if (command.length() == 3 && !command[2].compare("delete"))
+			{
+				debugger->deleteWatchpoint(address);
+				continue;
+			}
+			if (command.length() < 3)
+			{
+				logError("Command 'watch' requires argument 'length'");
+				continue;
+			}
+
+			size_t length;
+			try { length = std::stoul(command[2], 0, 0); }
+			catch(...)
+			{
+				logError("Invalid length '%s'", command[2].c_str());
+				continue;
+			}
+
+			int access = WATCH_WRITE;
+			if (command.length() > 3)
+			{
+				if (!command[3].compare("r")) { access = WATCH_READ; }
+				else if (!command[3].compare("w")) { access = WATCH_WRITE; }
+				else if (!command[3].compare("rw")) { access = WATCH_READWRITE; }
+				else
+				{
+					logError("Invalid watch access '%s'", command[3].c_str());
+					continue;
+				}
+			}
+			debugger->setWatchpoint(address, length, access);
+		}
+		else if (!command[0].compare("tracepoint") || !command[0].compare("trace"))
+		{
+			if (command.length() < 2)
+			{
+				logError("Command 'tracepoint' requires argument 'address'");
+				continue;
+			}
+			if (!command[1].compare("list"))
+			{
+				debugger->listTracepoints();
+				continue;
+			}
+
+			ADDR address;
+			if (!debugger->resolveAddress(command[1], address))
+			{
+				logError("Invalid address '%s'", command[1].c_str());
+				continue;
+			}
+
+			if (command.length() == 2) { debugger->setTracepoint(address, false); }
+			else if (!command[2].compare("regs")) { debugger->setTracepoint(address, true); }
+			else if (!command[2].compare("show")) { debugger->printTracepoint(address); }
+			else if (!command[2].compare("delete")) { debugger->deleteTracepoint(address); }
+			else { logError("Invalid tracepoint option '%s'", command[2].c_str()); }
+		}
 		else if (!command[0].compare("s") || !command[0].compare("step"))
 		{
 			if (command.length() < 2) { debugger->stepInto(); }
+			else if (!command[1].compare("over")) { debugger->stepOver(); }
+			else if (!command[1].compare("block"))
+			{
+				uint64_t limit;
+				ADDR until;
+				int index = 2;
+				if (!parseStepLimit(command, index, limit, until)) { continue; }
+				debugger->stepBlocks(limit == 0 && until == 0 ? 1 : limit, until);
+			}
 			else if (!command[1].compare("to") || !command[1].compare("until"))
 			{
 				if (command.length() != 3)
@@ -176,18 +526,86 @@ void DebuggerCLI::loop() // Kind of a trainwreck
 					logError("Command 'step until' requires argument 'address'");
 					continue;
 				}
-				try { debugger->stepUntil(std::stoul(command[2], 0, 16)); }
-				catch(...)
+				ADDR address;
+				if (!debugger->resolveAddress(command[2], address))
 				{
-					logError("Invalid address '%s'", command[1].c_str());
+					logError("Invalid address '%s'", command[2].c_str());
 					continue;
 				}
+				debugger->stepUntil(address);
 			}
 			else
 			{
 				logError("Invalid print target '%s'", command[1].c_str());
 			}
 		}
+		else if (!command[0].compare("record"))
+		{
+			uint64_t limit;
+			ADDR until;
+			int index = 1;
+			bool by_block = command.length() > 1 && !command[1].compare("block");
+			if (by_block) { index++; }
+			if (!parseStepLimit(command, index, limit, until)) { continue; }
+			debugger->record(limit, until, command.length() > index ? command[index].c_str() : "freedbg.trace", by_block);
+		}
+		else if (!command[0].compare("checkpoint"))
+		{
+			if (command.length() == 1) { debugger->checkpoint(); }
+			else if (!command[1].compare("delete")) { debugger->deleteCheckpoint(); }
+			else { logError("Invalid checkpoint option '%s'", command[1].c_str()); }
+		}
+		else if (!command[0].compare("restore"))
+		{
+			debugger->restoreCheckpoint();
+		}
+		else if (!command[0].compare("loop"))
+		{
+			if (command.length() < 4 || !isdigit(command[1][0]) || (command[2].compare("until") && command[2].compare("to")) ||
+				(command.length() > 4 && (command.length() != 7 || command[4].compare("input"))))
+			{
+				logError("Command 'loop' requires a count and 'until ADDR', optionally followed by 'input ADDR LEN'");
+				continue;
+			}
+			uint64_t count;
+			ADDR until;
+			ADDR input = 0;
+			unsigned long input_length = 0;
+			try { count = std::stoull(command[1]); }
+			catch(...)
+			{
+				logError("Invalid count '%s'", command[1].c_str());
+				continue;
+			}
+			if (!debugger->resolveAddress(command[3], until))
+			{
+				logError("Invalid address '%s'", command[3].c_str());
+				continue;
+			}
+			if (command.length() == 7)
+			{
+				if (!debugger->resolveAddress(command[5], input))
+				{
+					logError("Invalid address '%s'", command[5].c_str());
+					continue;
+				}
+				try { input_length = std::stoul(command[6], 0, 0); }
+				catch(...)
+				{
+					logError("Invalid length '%s'", command[6].c_str());
+					continue;
+				}
+			}
+			debugger->loop(count, until, input, input_length);
+		}
+		else if (!command[0].compare("blocks"))
+		{
+			debugger->printBlockStats(command.length() > 1 && !command[1].compare("reset"));
+		}
+		else if (!command[0].compare("n") || !command[0].compare("next"))
+		{
+			debugger->stepOver();
+		}
 		else if (!command[0].compare("set"))
 		{
 			if (command.length() < 3)
@@ -211,9 +629,77 @@ void DebuggerCLI::loop() // Kind of a trainwreck
 			}
 			else
 			{
-				logError("Invalid 'set' target '%s'", command[1].c_str());
+				ADDR address;
+				std::vector<BYTE> bytes;
+				if (!debugger->resolveAddress(command[1], address))
+				{
+					logError("Invalid 'set' target '%s'", command[1].c_str());
+					continue;
+				}
+				if (!parseHexBytes(joinArguments(command, 2), bytes))
+				{
+					logError("Invalid bytes '%s', expected hex like '90 90' or '41424300'", joinArguments(command, 2).c_str());
+					continue;
+				}
+				debugger->writeMemory(address, bytes);
 			}
 		}
+		else if (!command[0].compare("syscalls"))
+		{
+			if (command.length() < 2)
+			{
+				logError("Command 'syscalls' requires argument 'on', 'off' or 'stats'");
+				continue;
+			}
+			if (!command[1].compare("on")) { debugger->traceSyscalls(true, command.length() > 2 ? command[2].c_str() : nullptr); }
+			else if (!command[1].compare("off")) { debugger->traceSyscalls(false); }
+			else if (!command[1].compare("stats")) { debugger->printSyscallStats(command.length() > 2 && !command[2].compare("reset")); }
+			else
+			{
+				logError("Invalid 'syscalls' argument '%s'", command[1].c_str());
+			}
+		}
+		else if (!command[0].compare("bt") || !command[0].compare("backtrace"))
+		{
+			debugger->printBacktrace();
+		}
+		else if (!command[0].compare("thread"))
+		{
+			if (command.length() == 1 || !command[1].compare("list")) { debugger->listThreads(); }
+			else if (command.length() == 4 && !command[1].compare("apply") && !command[2].compare("all") && (!command[3].compare("bt") || !command[3].compare("backtrace")))
+			{
+				debugger->backtraceAllThreads();
+			}
+			else if (isdigit(command[1][0])) { debugger->switchThread(std::atoi(command[1].c_str())); }
+			else { logError("Invalid thread option '%s'", command[1].c_str()); }
+		}
+		else if (!command[0].compare("fork"))
+		{
+			if (command.length() == 2 && !command[1].compare("detach")) { debugger->setForkMode(false); }
+			else if (command.length() == 2 && !command[1].compare("stop")) { debugger->setForkMode(true); }
+			else { logError("Command 'fork' requires argument 'detach' or 'stop'"); }
+		}
+		else if (!command[0].compare("eval"))
+		{
+			uint64_t repeat = 1;
+			int first = 1;
+			if (command.length() > 3 && !command[1].compare("bench"))
+			{
+				try { repeat = std::stoull(command[2], 0, 0); }
+				catch(...) { repeat = 0; }
+				first = 3;
+			}
+			if (command.length() <= first || repeat == 0)
+			{
+				logError("Command 'eval' requires argument 'expression' (and a count for 'eval bench')");
+				continue;
+			}
+			debugger->evaluateExpression(joinArguments(command, first), repeat);
+		}
+		else if (!command[0].compare("stats"))
+		{
+			printStats(command.length() > 1 && !command[1].compare("reset"));
+		}
 		else if (!command[0].compare("print"))
 		{
 			if (command.length() < 2)
@@ -225,12 +711,15 @@ void DebuggerCLI::loop() // Kind of a trainwreck
 			{
 				debugger->printRegisters();
 			}
+			else if (!command[1].compare("cache"))
+			{
+				debugger->printCacheStats();
+			}
 			else
 			{
-				unsigned long address; // Fix this
+				ADDR address;
 				size_t datasize = 4;
-				try { address = std::stoul(command[1], 0, 16); }
-				catch(...)
+				if (!debugger->resolveAddress(command[1], address))
 				{
 					logError("Invalid address or 'print' target '%s'", command[1].c_str());
 					continue;
@@ -248,6 +737,32 @@ void DebuggerCLI::loop() // Kind of a trainwreck
 				debugger->printMemory(address, datasize);
 			}
 		}
+		else if (!command[0].compare("gcore"))
+		{
+			debugger->dumpCore(command.length() > 1 ? command[1].c_str() : "freedbg.core");
+		}
+		else if (!command[0].compare("snapshot"))
+		{
+			if (command.length() == 1) { debugger->saveMemorySnapshot(); }
+			else if (!command[1].compare("list")) { debugger->listMemorySnapshots(); }
+			else if (command.length() == 3 && !command[1].compare("delete") && isdigit(command[2][0])) { debugger->deleteMemorySnapshot(std::atoi(command[2].c_str())); }
+			else { logError("Invalid snapshot option '%s'", command[1].c_str()); }
+		}
+		else if (!command[0].compare("diff"))
+		{
+			int numbers[2] = {0, 0}; // Latest snapshot, current memory
+			bool valid = command.length() <= 3;
+			for (int i = 1; i < command.length() && valid; i++)
+			{
+				valid = isdigit(command[i][0]) && (numbers[i - 1] = std::atoi(command[i].c_str())) > 0;
+			}
+			if (!valid)
+			{
+				logError("Command 'diff' takes up to two snapshot numbers");
+				continue;
+			}
+			debugger->diffMemorySnapshots(numbers[0], numbers[1]);
+		}
 		else if (!command[0].compare("h") || !command[0].compare("help"))
 		{
 			for (int i = 0; HELP[i]; i++) 
@@ -5,9 +5,13 @@
 #ifndef FREEDBG_DBG_INTERFACE
 #define FREEDBG_DBG_INTERFACE
 
+#include <string>
 #include <vector>
+#include <deque>
 #include <cstddef>
+#include <cstdint>
 #include "debugger.hpp"
+#include "eventloop.hpp" // EventLoop
 
 
 class Command {
@@ -18,7 +22,7 @@ private:
 
 public:
 	std::string &operator[] (size_t i);
-    void getInput();
+    void getInput(const std::string &line);
     int length();
 };
 
@@ -26,6 +30,14 @@ public:
 class DebuggerCLI {
 private:
 	Debugger *debugger;
+	EventLoop events;
+	std::string partial_input; // Read from the terminal, still waiting for its newline
+	std::deque<std::string> typed_ahead; // Whole lines waiting for the prompt
+	bool input_closed = false;
+	bool readInput(std::vector<std::string> &lines);
+	bool nextLine(std::string &line);
+	void readWhileRunning();
+	bool parseStepLimit(Command &command, int &index, uint64_t &limit, ADDR &until);
 
 public:
 	DebuggerCLI(Debugger &dbgr);
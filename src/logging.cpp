@@ -8,26 +8,42 @@
 
 #include <cstdio>
 #include <cstdarg>
+#ifdef FREEDBG_STATS
+#include <chrono>
+#include "ptracestats.hpp" // countOutput
+#endif
 
 
 void logError(const char *format, ...)
 {
+#ifdef FREEDBG_STATS
+	auto begin = std::chrono::steady_clock::now();
+#endif
 	fprintf(stderr, "[!] ");
 	va_list arg;
 	va_start(arg, format);
     vfprintf(stderr, format, arg);
     va_end(arg);
     fputs("\n", stderr);
+#ifdef FREEDBG_STATS
+	countOutput(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+#endif
 }
 
 
 void logMsg(const char *format, ...)
 {
+#ifdef FREEDBG_STATS
+	auto begin = std::chrono::steady_clock::now();
+#endif
 	fprintf(stdout, "[*] ");
 	va_list arg;
 	va_start(arg, format);
     vfprintf(stdout, format, arg);
     va_end(arg);
     fputs("\n", stdout);
+#ifdef FREEDBG_STATS
+	countOutput(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+#endif
 }
 
@@ -14,6 +14,7 @@
 #include "arghandler.hpp" // DbgArgs, parseArguments
 #include "debugger.hpp" // Debugger
 #include "interface.hpp" // DebuggerCLI
+#include "ptracestats.hpp" // writeStatsJson
 
 
 int main(int argc, char **argv)
@@ -21,7 +22,7 @@ int main(int argc, char **argv)
 	DbgArgs args;
 	if (parseArguments(argc, argv, args) < 0) { return 1; }
 
-	int pid = fork();
+	int pid = args.attach_pid ? args.attach_pid : fork();
 	if (pid < 0)
 	{
 		logError("Error occured while forking");
@@ -38,8 +39,42 @@ int main(int argc, char **argv)
 	else
 	{
 		Debugger debugger(pid);
-		DebuggerCLI cli(debugger);
-		cli.loop();
+		if (args.snapshot)
+		{
+			debugger.loadSymbols(args.target_elf); // Before attaching, none of it needs the process stopped
+			debugger.snapshot(args.snapshot_memory);
+		}
+		else if (args.attach_pid && !debugger.attach()) {} // Nothing to debug
+		else if (args.profile_hz)
+		{
+			debugger.start();
+			if (debugger.isActive())
+			{
+				debugger.loadSymbols(args.target_elf);
+				debugger.profile(args.profile_hz, args.profile_output);
+			}
+		}
+		else if (args.trace_functions)
+		{
+			debugger.start();
+			if (debugger.isActive())
+			{
+				debugger.loadSymbols(args.target_elf);
+				debugger.traceCalls(args.trace_functions);
+			}
+		}
+		else if (args.coverage_output)
+		{
+			debugger.start();
+			if (debugger.isActive() && debugger.loadSymbols(args.target_elf)) { debugger.collectCoverage(args.target_elf, args.coverage_output); }
+		}
+		else
+		{
+			DebuggerCLI cli(debugger);
+			if (debugger.isActive()) { debugger.loadSymbols(args.target_elf); }
+			cli.loop();
+		}
+		if (args.stats_output && writeStatsJson(args.stats_output)) { logMsg("Statistics written to '%s'", args.stats_output); }
 	}
 
 	logMsg("FreeDBG exited gracefully");	
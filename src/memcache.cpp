@@ -0,0 +1,107 @@
+/*
+* FreeDBG - Debugee Memory Cache
+*/
+
+#include <unistd.h>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/ptrace.h>
+#include "memcache.hpp" // MemoryCache, BYTE, ADDR
+#include "ptracestats.hpp" // dbgPtrace
+
+
+MemoryCache::MemoryCache(int pid) : child_pid(pid), page_size(getpagesize()) {}
+
+BYTE *MemoryCache::getPage(ADDR page)
+{
+	auto it = pages.find(page);
+	if (it != pages.end())
+	{
+		hit_count++;
+		return it->second.data();
+	}
+
+	miss_count++;
+	std::vector<BYTE> buffer(page_size);
+	struct ptrace_io_desc io_desc;
+	io_desc.piod_op = PIOD_READ_D;
+	io_desc.piod_offs = (void *)page;
+	io_desc.piod_addr = (void *)buffer.data();
+	io_desc.piod_len = page_size;
+
+	if (dbgPtrace(PT_IO, child_pid, (caddr_t)&io_desc, 0) < 0 || io_desc.piod_len != page_size) { return NULL; }
+
+	return pages.emplace(page, std::move(buffer)).first->second.data();
+}
+
+bool MemoryCache::read(ADDR address, void *buffer, size_t size)
+{
+	BYTE *out = static_cast<BYTE *>(buffer);
+	while (size > 0)
+	{
+		ADDR page = address & ~(ADDR)(page_size - 1);
+		size_t offset = address - page;
+		size_t chunk = page_size - offset;
+		if (chunk > size) { chunk = size; }
+
+		BYTE *data = getPage(page);
+		if (data == NULL) { return false; }
+		std::memcpy(out, data + offset, chunk);
+
+		out += chunk;
+		address += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+size_t MemoryCache::readDirect(ADDR address, void *buffer, size_t size) // One PT_IO straight into the caller's buffer for bulk copies, bypassing the cache; returns the bytes read
+{
+	struct ptrace_io_desc io_desc;
+	io_desc.piod_op = PIOD_READ_D;
+	io_desc.piod_offs = (void *)address;
+	io_desc.piod_addr = buffer;
+	io_desc.piod_len = size;
+
+	if (dbgPtrace(PT_IO, child_pid, (caddr_t)&io_desc, 0) < 0) { return 0; }
+	return io_desc.piod_len; // Short when the range runs into an unmapped or unreadable page
+}
+
+bool MemoryCache::write(ADDR address, const void *buffer, size_t size)
+{
+	struct ptrace_io_desc io_desc;
+	io_desc.piod_op = PIOD_WRITE_I; // Ignores page protections, so text can be patched as well
+	io_desc.piod_offs = (void *)address;
+	io_desc.piod_addr = const_cast<void *>(buffer);
+	io_desc.piod_len = size;
+
+	if (dbgPtrace(PT_IO, child_pid, (caddr_t)&io_desc, 0) < 0 || io_desc.piod_len != size) { return false; }
+
+	/* Keep cached copies coherent instead of dropping them */
+	const BYTE *in = static_cast<const BYTE *>(buffer);
+	while (size > 0)
+	{
+		ADDR page = address & ~(ADDR)(page_size - 1);
+		size_t offset = address - page;
+		size_t chunk = page_size - offset;
+		if (chunk > size) { chunk = size; }
+
+		auto it = pages.find(page);
+		if (it != pages.end()) { std::memcpy(it->second.data() + offset, in, chunk); }
+
+		in += chunk;
+		address += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+void MemoryCache::invalidate() { pages.clear(); }
+
+size_t MemoryCache::pageSize() { return page_size; }
+
+size_t MemoryCache::cachedPages() { return pages.size(); }
+
+uint64_t MemoryCache::hits() { return hit_count; }
+
+uint64_t MemoryCache::misses() { return miss_count; }
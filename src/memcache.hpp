@@ -0,0 +1,40 @@
+/*
+* FreeDBG - Debugee Memory Cache (Header)
+*/
+
+#ifndef FREEDBG_MEMCACHE
+#define FREEDBG_MEMCACHE
+
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp"
+
+
+/* Page-granular read cache for debugee memory. Every read fills whole pages
+* with a single PT_IO request, writes go straight through to the process and
+* update any cached copy. Must be invalidated whenever the debugee resumes. */
+class MemoryCache {
+private:
+	int child_pid;
+	size_t page_size;
+	std::unordered_map<ADDR,std::vector<BYTE>> pages; // Keyed by page base address
+	uint64_t hit_count = 0;
+	uint64_t miss_count = 0;
+	BYTE *getPage(ADDR page);
+
+public:
+	MemoryCache(int pid);
+	bool read(ADDR address, void *buffer, size_t size);
+	size_t readDirect(ADDR address, void *buffer, size_t size);
+	bool write(ADDR address, const void *buffer, size_t size);
+	void invalidate();
+	size_t pageSize();
+	size_t cachedPages();
+	uint64_t hits();
+	uint64_t misses();
+};
+
+
+#endif // FREEDBG_MEMCACHE
@@ -0,0 +1,133 @@
+/*
+* FreeDBG - Memory Snapshots
+*/
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstring>
+#include <cstdint>
+#include "pagesnapshot.hpp" // SnapshotStore, MemorySnapshot, SnapshotPage, PageChange, PAGE_CHANGE
+
+
+static uint64_t hashPage(const BYTE *data, size_t size) // Not cryptographic, pages are only shared after memcmp agrees
+{
+	uint64_t hash = 0x9e3779b97f4a7c15ULL;
+	for (size_t offset = 0; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t))
+	{
+		uint64_t word;
+		std::memcpy(&word, data + offset, sizeof(word));
+		hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 32;
+	}
+	return hash;
+}
+
+
+/******************************
+* SnapshotStore Class Methods *
+******************************/
+SnapshotStore::SnapshotStore(size_t page_size) : page_size(page_size) {}
+
+void SnapshotStore::addPage(MemorySnapshot &snapshot, ADDR page, const BYTE *data)
+{
+	uint64_t hash = hashPage(data, page_size);
+	auto known = by_hash.find(hash);
+	PageData copy = (known != by_hash.end()) ? known->second.lock() : nullptr;
+	if (!copy || std::memcmp(copy->data(), data, page_size) != 0)
+	{
+		copy = std::make_shared<const std::vector<BYTE>>(data, data + page_size);
+		by_hash[hash] = copy; // A collision just means the older copy isn't shared any more
+		snapshot.stored_pages++;
+	}
+	snapshot.pages[page] = {hash, copy};
+}
+
+MemorySnapshot &SnapshotStore::keep(MemorySnapshot &snapshot) // Numbers it and takes it over
+{
+	snapshot.number = next_number++;
+	snapshots.push_back(std::move(snapshot));
+	return snapshots.back();
+}
+
+MemorySnapshot *SnapshotStore::find(int number)
+{
+	for (MemorySnapshot &snapshot: snapshots)
+	{
+		if (snapshot.number == number) { return &snapshot; }
+	}
+	return nullptr;
+}
+
+MemorySnapshot *SnapshotStore::latest() { return snapshots.empty() ? nullptr : &snapshots.back(); }
+
+bool SnapshotStore::remove(int number)
+{
+	for (auto it = snapshots.begin(); it != snapshots.end(); ++it)
+	{
+		if (it->number != number) { continue; }
+		snapshots.erase(it);
+		prune();
+		return true;
+	}
+	return false;
+}
+
+void SnapshotStore::prune() // Forgets the hashes of copies nothing holds any more
+{
+	for (auto it = by_hash.begin(); it != by_hash.end();)
+	{
+		if (it->second.expired()) { it = by_hash.erase(it); }
+		else { ++it; }
+	}
+}
+
+const std::vector<MemorySnapshot> &SnapshotStore::list() { return snapshots; }
+
+size_t SnapshotStore::uniquePages() // Page copies held across all snapshots
+{
+	prune();
+	return by_hash.size();
+}
+
+void SnapshotStore::diff(const MemorySnapshot &from, const MemorySnapshot &to, std::vector<PageChange> &changes) // In address order
+{
+	changes.clear();
+	auto old_page = from.pages.begin();
+	auto new_page = to.pages.begin();
+	while (old_page != from.pages.end() || new_page != to.pages.end())
+	{
+		if (new_page == to.pages.end() || (old_page != from.pages.end() && old_page->first < new_page->first))
+		{
+			changes.push_back({old_page->first, PAGE_REMOVED, 0, 0, page_size});
+			++old_page;
+			continue;
+		}
+		if (old_page == from.pages.end() || new_page->first < old_page->first)
+		{
+			changes.push_back({new_page->first, PAGE_ADDED, 0, 0, page_size});
+			++new_page;
+			continue;
+		}
+
+		const SnapshotPage &before = old_page->second;
+		const SnapshotPage &after = new_page->second;
+		if (before.data != after.data) // Shared copies are equal by construction
+		{
+			const BYTE *a = before.data->data();
+			const BYTE *b = after.data->data();
+			PageChange change = {new_page->first, PAGE_CHANGED, page_size, 0, 0};
+			for (size_t offset = 0; offset < page_size; offset++)
+			{
+				if (a[offset] == b[offset]) { continue; }
+				if (change.bytes++ == 0) { change.first = offset; }
+				change.last = offset;
+			}
+			if (change.bytes) { changes.push_back(change); }
+		}
+		++old_page;
+		++new_page;
+	}
+}
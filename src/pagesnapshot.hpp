@@ -0,0 +1,72 @@
+/*
+* FreeDBG - Memory Snapshots (Header)
+*/
+
+#ifndef FREEDBG_PAGE_SNAPSHOT
+#define FREEDBG_PAGE_SNAPSHOT
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // BYTE, ADDR
+
+
+typedef std::shared_ptr<const std::vector<BYTE>> PageData;
+
+struct SnapshotPage {
+	uint64_t hash;
+	PageData data; // Shared by every snapshot that saw the same contents
+};
+
+struct MemorySnapshot {
+	int number = 0; // 0 until it's kept
+	std::map<ADDR,SnapshotPage> pages; // By page address
+	size_t stored_pages = 0; // Pages it had to copy, the rest it shares
+	double elapsed = 0; // Seconds it took to take
+};
+
+enum PAGE_CHANGE {
+	PAGE_CHANGED,
+	PAGE_ADDED, // Only in the later snapshot
+	PAGE_REMOVED // Only in the earlier one
+};
+
+struct PageChange {
+	ADDR page;
+	int kind;
+	size_t first; // Offsets of the first and last differing byte, PAGE_CHANGED only
+	size_t last;
+	size_t bytes; // How many bytes differ
+};
+
+
+/* Copies of the debugee's writable memory at chosen stops. Pages are hashed as
+* they're added, and one whose contents some snapshot already holds (unchanged
+* since the last snapshot, or a copy of another page, like all the zero pages)
+* shares that copy, so each snapshot only stores the pages that changed. A diff
+* skips every page the two snapshots share without looking at it. */
+class SnapshotStore {
+private:
+	size_t page_size;
+	std::vector<MemorySnapshot> snapshots;
+	std::unordered_map<uint64_t,std::weak_ptr<const std::vector<BYTE>>> by_hash; // Latest copy seen with each hash
+	int next_number = 1;
+
+public:
+	SnapshotStore(size_t page_size);
+	void addPage(MemorySnapshot &snapshot, ADDR page, const BYTE *data);
+	MemorySnapshot &keep(MemorySnapshot &snapshot);
+	MemorySnapshot *find(int number);
+	MemorySnapshot *latest();
+	bool remove(int number);
+	void prune();
+	const std::vector<MemorySnapshot> &list();
+	size_t uniquePages();
+	void diff(const MemorySnapshot &from, const MemorySnapshot &to, std::vector<PageChange> &changes);
+};
+
+
+#endif // FREEDBG_PAGE_SNAPSHOT
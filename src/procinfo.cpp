@@ -0,0 +1,45 @@
+/*
+* FreeDBG - Process Information
+*/
+
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#include <sys/user.h>
+#include <sys/mman.h>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include "procinfo.hpp" // ProcessMapping, processPath, processMappings
+
+
+bool processPath(pid_t pid, char *path, size_t size) // Executable the process is running
+{
+	int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_PATHNAME, (int)pid};
+	size_t length = size;
+	if (sysctl(mib, 4, path, &length, nullptr, 0) < 0 || length == 0) { return false; }
+	path[size - 1] = '\0';
+	return true;
+}
+
+bool processMappings(pid_t pid, std::vector<ProcessMapping> &mappings) // One sysctl for the whole map, where PT_VM_ENTRY takes a request per mapping
+{
+	int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_VMMAP, (int)pid};
+	size_t length = 0;
+	if (sysctl(mib, 4, nullptr, &length, nullptr, 0) < 0) { return false; }
+	length = length * 4 / 3; // The map may grow between the two calls
+	std::vector<char> buffer(length);
+	if (sysctl(mib, 4, buffer.data(), &length, nullptr, 0) < 0) { return false; }
+
+	mappings.clear();
+	for (size_t offset = 0; offset + sizeof(int) <= length;)
+	{
+		const struct kinfo_vmentry *entry = (const struct kinfo_vmentry *)&buffer[offset];
+		if (entry->kve_structsize <= 0) { break; }
+		int protection = ((entry->kve_protection & KVME_PROT_READ) ? PROT_READ : 0) | ((entry->kve_protection & KVME_PROT_WRITE) ? PROT_WRITE : 0) |
+			((entry->kve_protection & KVME_PROT_EXEC) ? PROT_EXEC : 0);
+		bool dumpable = entry->kve_type != KVME_TYPE_DEVICE && !(entry->kve_flags & KVME_FLAG_NOCOREDUMP);
+		mappings.push_back({(ADDR)entry->kve_start, (ADDR)entry->kve_end, entry->kve_offset, entry->kve_path, protection, dumpable});
+		offset += entry->kve_structsize; // Records are packed, the path is cut short
+	}
+	return true;
+}
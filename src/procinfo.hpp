@@ -0,0 +1,32 @@
+/*
+* FreeDBG - Process Information (Header)
+*/
+
+#ifndef FREEDBG_PROCINFO
+#define FREEDBG_PROCINFO
+
+#include <sys/types.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // ADDR
+
+
+struct ProcessMapping {
+	ADDR start;
+	ADDR end; // Exclusive
+	uint64_t offset; // Into the mapped file
+	std::string path; // Empty for anonymous memory
+	int protection; // PROT_* bits
+	bool dumpable; // Neither device memory nor excluded from core dumps (MAP_NOCORE)
+};
+
+
+/* Process details read through sysctl rather than ptrace, so they work on
+* processes that aren't (yet) traced and don't stop anything to get them. */
+bool processPath(pid_t pid, char *path, size_t size);
+bool processMappings(pid_t pid, std::vector<ProcessMapping> &mappings);
+
+
+#endif // FREEDBG_PROCINFO
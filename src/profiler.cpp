@@ -0,0 +1,216 @@
+/*
+* FreeDBG - Sampling Profiler
+*/
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cstdio>
+#include <signal.h>
+#include <machine/reg.h>
+#include <sys/types.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include "logging.hpp" // logError, logMsg
+#include "profiler.hpp" // Profiler, StackHash
+#include "registers.hpp" // RegisterFile
+#include "symbols.hpp" // SymbolTable, Symbol
+#include "dwarfindex.hpp" // DwarfIndex
+#include "unwinder.hpp" // Unwinder
+#include "ptracestats.hpp" // dbgPtrace, dbgWaitpid
+
+
+Profiler::Profiler(int pid, RegisterFile &regs, SymbolTable &symtab, DwarfIndex &index, Unwinder &unwind) : child_pid(pid),
+	registers(&regs), symbols(&symtab), lines(&index), unwinder(&unwind), stack_buffer(PROFILE_STACK_WINDOW) {}
+
+bool Profiler::findStack(ADDR esp) // Bounds of the mapping esp points into, so the window read never runs off its end
+{
+	struct ptrace_vm_entry entry;
+	std::memset(&entry, 0, sizeof(entry));
+	while (dbgPtrace(PT_VM_ENTRY, child_pid, (caddr_t)&entry, 0) == 0)
+	{
+		if (esp >= entry.pve_start && esp <= entry.pve_end)
+		{
+			stack_low = entry.pve_start;
+			stack_high = entry.pve_end + 1; // pve_end is inclusive
+			return true;
+		}
+		entry.pve_path = NULL;
+		entry.pve_pathlen = 0;
+	}
+	return false;
+}
+
+bool Profiler::takeSample() // Runs while the debugee is stopped: two ptrace calls, nothing else
+{
+	registers->invalidate();
+	const struct reg &regs = registers->get();
+	ADDR esp = regs.r_esp;
+	if ((esp < stack_low || esp >= stack_high) && !findStack(esp)) { return false; }
+
+	struct ptrace_io_desc io_desc;
+	io_desc.piod_op = PIOD_READ_D;
+	io_desc.piod_offs = (void *)esp;
+	io_desc.piod_addr = (void *)stack_buffer.data();
+	io_desc.piod_len = std::min((size_t)PROFILE_STACK_WINDOW, (size_t)(stack_high - esp));
+	if (dbgPtrace(PT_IO, child_pid, (caddr_t)&io_desc, 0) < 0) { return false; }
+
+	/* Unwind the copy only, a frame that needs memory outside it ends the stack */
+	unwinder->setWindow(esp, stack_buffer.data(), io_desc.piod_len);
+	unwinder->unwind(regs, frames, PROFILE_MAX_DEPTH, true);
+	if (unwinder->leftWindow()) { truncated++; }
+	return true;
+}
+
+bool Profiler::run(unsigned int hz) // Samples until the debugee exits, false if it couldn't be traced
+{
+	auto interval = std::chrono::nanoseconds(1000000000ull / hz);
+	auto next = std::chrono::steady_clock::now() + interval;
+	void (*previous_handler)(int) = signal(SIGINT, SIG_IGN); // Ctrl-C reaches the debugee, its exit ends the profile
+	dbgPtrace(PT_CONTINUE, child_pid, (caddr_t)1, 0);
+
+	int waitstatus = 0;
+	bool traced = true;
+	while (true)
+	{
+		std::this_thread::sleep_until(next);
+		next += interval;
+		if (next < std::chrono::steady_clock::now()) { next = std::chrono::steady_clock::now() + interval; } // Fell behind, don't burst
+
+		if (kill(child_pid, SIGSTOP) < 0) // Already gone, collect its exit status
+		{
+			traced = dbgWaitpid(child_pid, &waitstatus, 0) >= 0;
+			break;
+		}
+
+		/* Other signals can overtake our SIGSTOP, pass them on and keep waiting for it */
+		int signal_number = 0;
+		while (signal_number != SIGSTOP)
+		{
+			if (dbgWaitpid(child_pid, &waitstatus, 0) < 0 || !WIFSTOPPED(waitstatus)) { break; }
+			signal_number = WSTOPSIG(waitstatus);
+			if (signal_number != SIGSTOP) { dbgPtrace(PT_CONTINUE, child_pid, (caddr_t)1, signal_number == SIGTRAP ? 0 : signal_number); }
+		}
+		if (!WIFSTOPPED(waitstatus)) { break; }
+
+		auto stopped = std::chrono::steady_clock::now();
+		bool sampled = takeSample();
+		dbgPtrace(PT_CONTINUE, child_pid, (caddr_t)1, 0);
+		pauses.push_back(std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now() - stopped).count());
+
+		if (!sampled) { continue; }
+		sample_count++;
+		auto it = stacks.find(frames);
+		if (it != stacks.end()) { it->second++; }
+		else { stacks.emplace(frames, 1); }
+	}
+	signal(SIGINT, previous_handler);
+
+	if (WIFEXITED(waitstatus)) { logMsg("Process %d has exited: %d", child_pid, WEXITSTATUS(waitstatus)); }
+	else if (WIFSIGNALED(waitstatus)) { logMsg("Process terminated by signal: %d", WTERMSIG(waitstatus)); }
+	else
+	{
+		logError("Lost track of process %d", child_pid);
+		traced = false;
+	}
+	return traced;
+}
+
+const std::string &Profiler::functionName(ADDR address)
+{
+	auto it = names.find(address);
+	if (it != names.end()) { return it->second; }
+
+	ADDR offset;
+	const Symbol *symbol = symbols->find(address, offset);
+	const char *function = lines->functionAt(address);
+	std::string name;
+	if (symbol) { name = std::string(symbol->name); }
+	else if (function) { name = function; }
+	else
+	{
+		char hex[16];
+		snprintf(hex, sizeof(hex), "0x%X", address);
+		name = hex;
+	}
+	return names.emplace(address, name).first->second;
+}
+
+void Profiler::printFlat(size_t limit)
+{
+	struct FlatEntry {
+		uint64_t self = 0;
+		uint64_t total = 0;
+	};
+	std::unordered_map<std::string,FlatEntry> flat;
+	std::vector<const std::string*> seen;
+	for (auto &stack: stacks)
+	{
+		seen.clear();
+		for (size_t i = 0; i < stack.first.size(); i++)
+		{
+			const std::string &name = functionName(i == 0 ? stack.first[i] : stack.first[i] - 1); // Return addresses can be past the caller's end
+			if (i == 0) { flat[name].self += stack.second; }
+			if (std::find_if(seen.begin(), seen.end(), [&](const std::string *other) { return *other == name; }) != seen.end()) { continue; } // Recursion counts once per sample
+			seen.push_back(&name);
+			flat[name].total += stack.second;
+		}
+	}
+
+	std::vector<std::pair<std::string,FlatEntry>> sorted(flat.begin(), flat.end());
+	std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string,FlatEntry> &a, const std::pair<std::string,FlatEntry> &b) {
+		return a.second.self != b.second.self ? a.second.self > b.second.self : a.second.total > b.second.total;
+	});
+
+	printf("%8s %8s %8s  %s\n", "Self%", "Total%", "Samples", "Function");
+	double scale = sample_count ? 100.0 / sample_count : 0;
+	for (size_t i = 0; i < sorted.size() && i < limit; i++)
+	{
+		printf("%7.2f%% %7.2f%% %8llu  %s\n", sorted[i].second.self * scale, sorted[i].second.total * scale,
+			(unsigned long long)sorted[i].second.self, sorted[i].first.c_str());
+	}
+}
+
+bool Profiler::writeFolded(const char *path) // One "root;...;leaf count" line per distinct stack, as flamegraph.pl expects
+{
+	std::unordered_map<std::string,uint64_t> folded; // Stacks differing only in offsets fold together
+	std::string line;
+	for (auto &stack: stacks)
+	{
+		line.clear();
+		for (size_t i = stack.first.size(); i-- > 0;)
+		{
+			line += functionName(i == 0 ? stack.first[i] : stack.first[i] - 1);
+			if (i != 0) { line += ';'; }
+		}
+		folded[line] += stack.second;
+	}
+
+	FILE *file = fopen(path, "w");
+	if (!file)
+	{
+		logError("Unable to open '%s'", path);
+		return false;
+	}
+	for (auto &entry: folded) { fprintf(file, "%s %llu\n", entry.first.c_str(), (unsigned long long)entry.second); }
+	fclose(file);
+	return true;
+}
+
+void Profiler::printPauseStats()
+{
+	logMsg("%llu samples, %zu distinct stacks, %llu cut off at the %d byte stack window", (unsigned long long)sample_count,
+		stacks.size(), (unsigned long long)truncated, PROFILE_STACK_WINDOW);
+	if (pauses.empty()) { return; }
+
+	std::vector<double> sorted(pauses);
+	std::sort(sorted.begin(), sorted.end());
+	double sum = 0;
+	for (double pause: sorted) { sum += pause; }
+	logMsg("Pause per sample (us): mean %.1f, p50 %.1f, p99 %.1f, max %.1f", sum / sorted.size(), sorted[sorted.size() / 2],
+		sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)], sorted.back());
+}
@@ -0,0 +1,67 @@
+/*
+* FreeDBG - Sampling Profiler (Header)
+*/
+
+#ifndef FREEDBG_PROFILER
+#define FREEDBG_PROFILER
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // BYTE, DWORD, ADDR
+#include "registers.hpp" // RegisterFile
+#include "symbols.hpp" // SymbolTable
+#include "dwarfindex.hpp" // DwarfIndex
+#include "unwinder.hpp" // Unwinder
+
+
+#define PROFILE_STACK_WINDOW 0x2000 // Bytes of stack read per sample, frames beyond it are cut off
+#define PROFILE_MAX_DEPTH 128
+
+
+struct StackHash { // FNV-1a over the frame addresses
+	size_t operator()(const std::vector<ADDR> &stack) const
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (ADDR address: stack) { hash = (hash ^ address) * 1099511628211ull; }
+		return hash;
+	}
+};
+
+
+/* Stops the debugee HZ times a second with SIGSTOP, takes the registers and one
+* PT_IO read of the top of the stack, resumes it, and only then unwinds the
+* copy, without touching the debugee again. Identical stacks share one counter; symbolizing is left until
+* the debugee has exited, so it costs nothing while samples are being taken. */
+class Profiler {
+private:
+	int child_pid;
+	RegisterFile *registers;
+	SymbolTable *symbols;
+	DwarfIndex *lines;
+	Unwinder *unwinder;
+	std::unordered_map<std::vector<ADDR>,uint64_t,StackHash> stacks; // Leaf first
+	std::vector<double> pauses; // Microseconds the debugee spent stopped for each sample
+	uint64_t sample_count = 0;
+	uint64_t truncated = 0; // Samples whose unwind ran off the end of the stack window
+	ADDR stack_low = 0; // Mapping the stack window is clipped to
+	ADDR stack_high = 0;
+	std::vector<BYTE> stack_buffer;
+	std::vector<ADDR> frames;
+	std::unordered_map<ADDR,std::string> names;
+	bool findStack(ADDR esp);
+	bool takeSample();
+	const std::string &functionName(ADDR address);
+
+public:
+	Profiler(int pid, RegisterFile &regs, SymbolTable &symtab, DwarfIndex &index, Unwinder &unwind);
+	bool run(unsigned int hz);
+	void printFlat(size_t limit);
+	bool writeFolded(const char *path);
+	void printPauseStats();
+};
+
+
+#endif // FREEDBG_PROFILER
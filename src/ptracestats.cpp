@@ -0,0 +1,190 @@
+/*
+* FreeDBG - Instrumented Ptrace Layer
+*/
+
+#include <map>
+#include <string>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include "logging.hpp" // logError, logMsg
+#include "ptracestats.hpp" // dbgPtrace, dbgWaitpid
+#include "calltracer.hpp" // LatencyHistogram
+
+
+#ifdef FREEDBG_STATS
+
+struct CallStats {
+	uint64_t errors = 0;
+	LatencyHistogram latency;
+};
+
+static std::map<int,CallStats> requests; // By request, ordered for printing
+static CallStats waits;
+static std::map<int,uint64_t> stops; // By signal
+static uint64_t exits = 0;
+static CallStats output; // logMsg/logError, errors unused
+
+static uint64_t clockNanoseconds() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+int dbgPtrace(int request, pid_t pid, caddr_t addr, int data)
+{
+	uint64_t begin = clockNanoseconds();
+	int result = ptrace(request, pid, addr, data);
+	uint64_t elapsed = clockNanoseconds() - begin;
+	int saved_errno = errno; // Callers may still want to look at it
+	CallStats &stats = requests[request];
+	stats.latency.record(elapsed);
+	if (result < 0) { stats.errors++; }
+	errno = saved_errno;
+	return result;
+}
+
+pid_t dbgWaitpid(pid_t pid, int *status, int options) // Time spent here is mostly the debugee running
+{
+	uint64_t begin = clockNanoseconds();
+	pid_t result = waitpid(pid, status, options);
+	uint64_t elapsed = clockNanoseconds() - begin;
+	int saved_errno = errno;
+	waits.latency.record(elapsed);
+	if (result < 0) { waits.errors++; }
+	else if (result > 0 && WIFSTOPPED(*status)) { stops[WSTOPSIG(*status)]++; }
+	else if (result > 0) { exits++; }
+	errno = saved_errno;
+	return result;
+}
+
+void countOutput(uint64_t nanoseconds) { output.latency.record(nanoseconds); }
+
+static const char *requestName(int request)
+{
+	switch (request)
+	{
+		case PT_TRACE_ME: return "PT_TRACE_ME";
+		case PT_CONTINUE: return "PT_CONTINUE";
+		case PT_KILL: return "PT_KILL";
+		case PT_STEP: return "PT_STEP";
+		case PT_ATTACH: return "PT_ATTACH";
+		case PT_DETACH: return "PT_DETACH";
+		case PT_IO: return "PT_IO";
+		case PT_LWPINFO: return "PT_LWPINFO";
+		case PT_GETNUMLWPS: return "PT_GETNUMLWPS";
+		case PT_GETLWPLIST: return "PT_GETLWPLIST";
+		case PT_SUSPEND: return "PT_SUSPEND";
+		case PT_RESUME: return "PT_RESUME";
+		case PT_SYSCALL: return "PT_SYSCALL";
+		case PT_FOLLOW_FORK: return "PT_FOLLOW_FORK";
+		case PT_GETREGS: return "PT_GETREGS";
+		case PT_SETREGS: return "PT_SETREGS";
+		case PT_GETDBREGS: return "PT_GETDBREGS";
+		case PT_SETDBREGS: return "PT_SETDBREGS";
+		case PT_VM_ENTRY: return "PT_VM_ENTRY";
+#ifdef PT_LWP_EVENTS
+		case PT_LWP_EVENTS: return "PT_LWP_EVENTS";
+#endif
+#ifdef PT_GET_SC_ARGS
+		case PT_GET_SC_ARGS: return "PT_GET_SC_ARGS";
+		case PT_GET_SC_RET: return "PT_GET_SC_RET";
+#endif
+#ifdef PT_COREDUMP
+		case PT_COREDUMP: return "PT_COREDUMP";
+#endif
+		default: return nullptr;
+	}
+}
+
+static std::string callName(int request)
+{
+	const char *name = requestName(request);
+	return name ? std::string(name) : "request " + std::to_string(request);
+}
+
+static void printCallStats(const char *name, CallStats &stats)
+{
+	LatencyHistogram &latency = stats.latency;
+	printf("%-16s %10llu %8llu %12.3f %10.2f %10.2f %10.2f %10.2f\n", name, (unsigned long long)latency.samples(), (unsigned long long)stats.errors,
+		latency.total() / 1e6, latency.mean() / 1e3, latency.percentile(50) / 1e3, latency.percentile(99) / 1e3, latency.maximum() / 1e3);
+}
+
+static void writeCallStats(FILE *file, const std::string &name, CallStats &stats, bool last)
+{
+	LatencyHistogram &latency = stats.latency;
+	fprintf(file, "    \"%s\": {\"calls\": %llu, \"errors\": %llu, \"total_ns\": %llu, \"mean_ns\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu}%s\n",
+		name.c_str(), (unsigned long long)latency.samples(), (unsigned long long)stats.errors, (unsigned long long)latency.total(),
+		(unsigned long long)latency.mean(), (unsigned long long)latency.percentile(50), (unsigned long long)latency.percentile(99),
+		(unsigned long long)latency.maximum(), last ? "" : ",");
+}
+
+bool statsEnabled() { return true; }
+
+void printStats(bool reset)
+{
+	printf("%-16s %10s %8s %12s %10s %10s %10s %10s\n", "Call", "Count", "Errors", "Total ms", "Mean us", "p50 us", "p99 us", "Max us");
+	uint64_t ptrace_total = 0;
+	for (auto &request: requests)
+	{
+		printCallStats(callName(request.first).c_str(), request.second);
+		ptrace_total += request.second.latency.total();
+	}
+	printCallStats("waitpid", waits);
+	printCallStats("log output", output);
+	printf("Time in ptrace: %.3f ms, waiting on the debugee: %.3f ms, writing messages: %.3f ms\n", ptrace_total / 1e6,
+		waits.latency.total() / 1e6, output.latency.total() / 1e6);
+
+	printf("Stops:");
+	for (auto &stop: stops) { printf(" %s=%llu", strsignal(stop.first), (unsigned long long)stop.second); }
+	printf("%s, exits=%llu\n", stops.empty() ? " none" : "", (unsigned long long)exits);
+
+	if (reset)
+	{
+		requests.clear();
+		waits = CallStats();
+		output = CallStats();
+		stops.clear();
+		exits = 0;
+	}
+}
+
+bool writeStatsJson(const char *path)
+{
+	FILE *file = fopen(path, "w");
+	if (!file)
+	{
+		logError("Unable to open '%s'", path);
+		return false;
+	}
+
+	fprintf(file, "{\n  \"ptrace\": {\n");
+	size_t remaining = requests.size();
+	for (auto &request: requests) { writeCallStats(file, callName(request.first), request.second, --remaining == 0); }
+	fprintf(file, "  },\n  \"calls\": {\n");
+	writeCallStats(file, "waitpid", waits, false);
+	writeCallStats(file, "log_output", output, true);
+	fprintf(file, "  },\n  \"stops\": {");
+	remaining = stops.size();
+	for (auto &stop: stops) { fprintf(file, "\"%d\": %llu%s", stop.first, (unsigned long long)stop.second, --remaining ? ", " : ""); }
+	fprintf(file, "},\n  \"exits\": %llu\n}\n", (unsigned long long)exits);
+	return fclose(file) == 0;
+}
+
+#else
+
+bool statsEnabled() { return false; }
+
+void printStats(bool)
+{
+	logError("Statistics aren't compiled in, rebuild with 'make CXXFLAGS=-DFREEDBG_STATS'");
+}
+
+bool writeStatsJson(const char *)
+{
+	logError("Statistics aren't compiled in, rebuild with 'make CXXFLAGS=-DFREEDBG_STATS'");
+	return false;
+}
+
+#endif // FREEDBG_STATS
@@ -0,0 +1,32 @@
+/*
+* FreeDBG - Instrumented Ptrace Layer (Header)
+*/
+
+#ifndef FREEDBG_PTRACE_STATS
+#define FREEDBG_PTRACE_STATS
+
+#include <sys/types.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <cstdint>
+
+
+/* Every ptrace request and wait on the debugee goes through these. Built with
+* -DFREEDBG_STATS (make CXXFLAGS=-DFREEDBG_STATS) each call is counted and timed
+* per request, and each tracee stop is counted per signal. Otherwise they're
+* inline pass-throughs and the instrumentation compiles away entirely. */
+#ifdef FREEDBG_STATS
+int dbgPtrace(int request, pid_t pid, caddr_t addr, int data);
+pid_t dbgWaitpid(pid_t pid, int *status, int options);
+void countOutput(uint64_t nanoseconds);
+#else
+inline int dbgPtrace(int request, pid_t pid, caddr_t addr, int data) { return ptrace(request, pid, addr, data); }
+inline pid_t dbgWaitpid(pid_t pid, int *status, int options) { return waitpid(pid, status, options); }
+#endif // FREEDBG_STATS
+
+bool statsEnabled();
+void printStats(bool reset);
+bool writeStatsJson(const char *path);
+
+
+#endif // FREEDBG_PTRACE_STATS
@@ -0,0 +1,60 @@
+/*
+* FreeDBG - Instruction Trace Recorder
+*/
+
+#include <vector>
+#include "logging.hpp" // logError
+#include "recorder.hpp" // TraceRecorder, RecordChunk
+#include "tracefile.hpp" // TraceEncoder, TraceWriter, TraceStep, TRACE_CHUNK_SIZE
+#include "chunkring.hpp" // ChunkRing
+
+
+TraceRecorder::TraceRecorder() : ring(RECORD_RING_SLOTS)
+{
+	for (RecordChunk &chunk: ring.chunks()) { chunk.data.resize(TRACE_CHUNK_SIZE + TRACE_MAX_RECORD); }
+}
+
+TraceRecorder::~TraceRecorder() { stop(); }
+
+bool TraceRecorder::start(const char *path)
+{
+	stop();
+	if (!writer.open(path)) { return false; }
+	for (RecordChunk &chunk: ring.chunks()) { chunk.length = chunk.steps = 0; }
+	failed = false;
+	encoder.reset();
+	ring.start([this](RecordChunk &chunk) { return writer.writeChunk(chunk.data.data(), chunk.length, chunk.steps, chunk.first_eip); });
+	return true;
+}
+
+void TraceRecorder::record(const TraceStep &step)
+{
+	RecordChunk &chunk = ring.current();
+	if (chunk.steps == 0) { chunk.first_eip = step.eip; }
+	chunk.length += encoder.encode(step, chunk.data.data() + chunk.length);
+	chunk.steps++;
+	if (chunk.length >= TRACE_CHUNK_SIZE) { submit(); }
+}
+
+void TraceRecorder::submit() // Hands the filled chunk to the writer and starts on the next free one
+{
+	ring.submit();
+	ring.current().length = ring.current().steps = 0;
+	encoder.reset(); // Every chunk starts from a zero state so it can be decoded on its own
+}
+
+bool TraceRecorder::stop() // Writes out the partial chunk, waits for the writer, finishes the file
+{
+	if (!ring.isRunning()) { return !failed; }
+	if (ring.current().steps) { submit(); }
+	failed = !ring.finish();
+	if (!writer.close()) { failed = true; }
+	if (failed) { logError("Errors occured while writing the trace file, it may be incomplete"); }
+	return !failed;
+}
+
+uint64_t TraceRecorder::stallCount() { return ring.stallCount(); }
+
+uint64_t TraceRecorder::rawBytes() { return writer.rawBytes(); }
+
+uint64_t TraceRecorder::writtenBytes() { return writer.writtenBytes(); }
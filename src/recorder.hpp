@@ -0,0 +1,51 @@
+/*
+* FreeDBG - Instruction Trace Recorder (Header)
+*/
+
+#ifndef FREEDBG_RECORDER
+#define FREEDBG_RECORDER
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // BYTE
+#include "tracefile.hpp" // TraceEncoder, TraceWriter, TraceStep
+#include "chunkring.hpp" // ChunkRing
+
+
+#define RECORD_RING_SLOTS 8 // Chunks that can be queued for the writer before stepping has to wait
+
+
+struct RecordChunk {
+	std::vector<BYTE> data;
+	size_t length = 0;
+	uint32_t steps = 0;
+	uint32_t first_eip = 0;
+};
+
+
+/* Encodes steps into a ring of chunk sized buffers. The stepping thread only
+* ever touches the slot it's filling; full slots are handed to a writer thread
+* that compresses them and appends them to the trace file. If the writer falls
+* a whole ring behind, recording waits for it rather than dropping steps. */
+class TraceRecorder {
+private:
+	TraceEncoder encoder;
+	TraceWriter writer;
+	ChunkRing<RecordChunk> ring;
+	bool failed = false;
+	void submit();
+
+public:
+	TraceRecorder();
+	~TraceRecorder();
+	bool start(const char *path);
+	void record(const TraceStep &step);
+	bool stop();
+	uint64_t stallCount();
+	uint64_t rawBytes();
+	uint64_t writtenBytes();
+};
+
+
+#endif // FREEDBG_RECORDER
@@ -0,0 +1,133 @@
+/*
+* FreeDBG - Debugee Register File
+*/
+
+#include <machine/reg.h>
+#include <sys/types.h>
+#include <sys/ptrace.h>
+#include "registers.hpp" // RegisterFile, R_*, R_FLAGS
+#include "ptracestats.hpp" // dbgPtrace
+
+
+RegisterFile::RegisterFile(int pid) : child_pid(pid), target(pid) {}
+
+void RegisterFile::setThread(lwpid_t lwp) // 0 goes back to whichever thread reported the stop
+{
+	if (lwp == 0) { lwp = child_pid; }
+	if (lwp == target) { return; }
+	flush();
+	target = lwp;
+	fetched = false;
+}
+
+const struct reg &RegisterFile::get()
+{
+	if (!fetched)
+	{
+		dbgPtrace(PT_GETREGS, target, (caddr_t)&regs, 0);
+		fetched = true;
+	}
+	return regs;
+}
+
+void RegisterFile::set(const struct reg &values) // Replace the whole set, e.g. to restore a saved copy
+{
+	regs = values;
+	fetched = true;
+	dirty = ~0u;
+}
+
+DWORD RegisterFile::read(int regcode)
+{
+	get();
+	switch (regcode)
+	{
+		case R_EAX: return regs.r_eax;
+		case R_EBX: return regs.r_ebx;
+		case R_ECX: return regs.r_ecx;
+		case R_EDX: return regs.r_edx;
+		case R_ESI: return regs.r_esi;
+		case R_EDI: return regs.r_edi;
+		case R_EBP: return regs.r_ebp;
+		case R_EIP: return regs.r_eip;
+		case R_ESP: return regs.r_esp;
+		case R_EFLAGS: return regs.r_eflags;
+		case R_CARRY: return (regs.r_eflags & CARRY_FLAG) != 0;
+		case R_ZERO: return (regs.r_eflags & ZERO_FLAG) != 0;
+		case R_SIGN: return (regs.r_eflags & SIGN_FLAG) != 0;
+		case R_OVERFLOW: return (regs.r_eflags & OVERFLOW_FLAG) != 0;
+		default: return 0;
+	}
+}
+
+void RegisterFile::write(int regcode, DWORD value)
+{
+	get();
+	switch (regcode)
+	{
+		case R_EAX:
+			regs.r_eax = value;
+			break;
+		case R_EBX:
+			regs.r_ebx = value;
+			break;
+		case R_ECX:
+			regs.r_ecx = value;
+			break;
+		case R_EDX:
+			regs.r_edx = value;
+			break;
+		case R_ESI:
+			regs.r_esi = value;
+			break;
+		case R_EDI:
+			regs.r_edi = value;
+			break;
+		case R_EBP:
+			regs.r_ebp = value;
+			break;
+		case R_EIP:
+			regs.r_eip = value;
+			break;
+		case R_ESP:
+			regs.r_esp = value;
+			break;
+		case R_EFLAGS:
+			regs.r_eflags = value;
+			break;
+		case R_CARRY:
+			if (value) { regs.r_eflags |= CARRY_FLAG; } // If given value isn't zero, set flag
+			else { regs.r_eflags &= ~CARRY_FLAG; } // If given value is zero, unset flag
+			break;
+		case R_ZERO:
+			if (value) { regs.r_eflags |= ZERO_FLAG; } 
+			else { regs.r_eflags &= ~ZERO_FLAG; } 
+			break;
+		case R_SIGN:
+			if (value) { regs.r_eflags |= SIGN_FLAG; } 
+			else { regs.r_eflags &= ~SIGN_FLAG; } 
+			break;
+		case R_OVERFLOW:
+			if (value) { regs.r_eflags |= OVERFLOW_FLAG; } 
+			else { regs.r_eflags &= ~OVERFLOW_FLAG; } 
+			break;
+		default:
+			return;
+	}
+	dirty |= 1 << regcode;
+}
+
+bool RegisterFile::flush()
+{
+	if (!dirty) { return true; }
+	dirty = 0;
+	return dbgPtrace(PT_SETREGS, target, (caddr_t)&regs, 0) >= 0;
+}
+
+void RegisterFile::invalidate()
+{
+	fetched = false;
+	dirty = 0;
+}
+
+bool RegisterFile::isDirty() { return dirty != 0; }
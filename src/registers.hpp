@@ -0,0 +1,66 @@
+/*
+* FreeDBG - Debugee Register File (Header)
+*/
+
+#ifndef FREEDBG_REGISTERS
+#define FREEDBG_REGISTERS
+
+#include <machine/reg.h>
+#include <sys/types.h>
+#include <cstdint>
+#include "types.hpp" // DWORD
+
+
+enum {
+    R_EAX = 0,
+    R_EBX,
+    R_ECX,
+    R_EDX,
+    R_ESI,
+    R_EDI,
+    R_EBP,
+    R_EIP,
+    R_ESP,
+    R_EFLAGS,
+    R_CARRY,
+    R_ZERO,
+    R_SIGN,
+    R_OVERFLOW
+};
+
+enum R_FLAGS {
+    CARRY_FLAG = 1 << 0,
+    ZERO_FLAG = 1 << 6,
+    SIGN_FLAG = 1 << 7,
+    OVERFLOW_FLAG = 1 << 11,
+    RESUME_FLAG = 1 << 16 // Suppresses instruction breakpoints for one instruction
+};
+
+
+/* Lazily fetched copy of the debugee's registers. Fetched with one PT_GETREGS
+* the first time it's needed after a stop, modified registers are tracked and
+* written back with a single PT_SETREGS right before the debugee resumes.
+* Requests go to the selected thread, or with the process id to the thread
+* that reported the stop. */
+class RegisterFile {
+private:
+	int child_pid;
+	int target; // LWP id or child_pid
+	struct reg regs;
+	bool fetched = false;
+	uint32_t dirty = 0; // Bitmask of register codes modified since last flush
+
+public:
+	RegisterFile(int pid);
+	void setThread(lwpid_t lwp);
+	const struct reg &get();
+	void set(const struct reg &values);
+	DWORD read(int regcode);
+	void write(int regcode, DWORD value);
+	bool flush();
+	void invalidate();
+	bool isDirty();
+};
+
+
+#endif // FREEDBG_REGISTERS
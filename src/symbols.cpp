@@ -0,0 +1,257 @@
+/*
+* FreeDBG - ELF Symbol Table
+*/
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "symbols.hpp" // SymbolTable, Symbol
+
+
+#if defined(__LP64__)
+#define ElfHdr Elf64_Ehdr
+#define ElfShdr Elf64_Shdr
+#define ElfPhdr Elf64_Phdr
+#define ElfSym Elf64_Sym
+#define ELF_ST_TYPE ELF64_ST_TYPE
+#define ELF_ST_BIND ELF64_ST_BIND
+#else
+#define ElfHdr Elf32_Ehdr
+#define ElfShdr Elf32_Shdr
+#define ElfPhdr Elf32_Phdr
+#define ElfSym Elf32_Sym
+#define ELF_ST_TYPE ELF32_ST_TYPE
+#define ELF_ST_BIND ELF32_ST_BIND
+#endif // (__LP64__)
+
+
+struct SymbolEntry { // Only used while building the table
+	ADDR address;
+	Symbol symbol;
+};
+
+
+static void parseSection(const BYTE *base, size_t mapping_size, const ElfShdr *section, std::vector<SymbolEntry> &pending)
+{
+	const ElfHdr *header = (const ElfHdr*)base;
+	if (section->sh_link >= header->e_shnum || section->sh_entsize != sizeof(ElfSym)) { return; }
+
+	const ElfShdr *strings = (const ElfShdr*)(base + header->e_shoff) + section->sh_link;
+	if (section->sh_offset + section->sh_size > mapping_size || strings->sh_offset + strings->sh_size > mapping_size) { return; }
+
+	const ElfSym *sym = (const ElfSym*)(base + section->sh_offset);
+	const char *strtab = (const char*)(base + strings->sh_offset);
+	size_t count = section->sh_size / sizeof(ElfSym);
+	for (size_t i = 0; i < count; i++, sym++)
+	{
+		int type = ELF_ST_TYPE(sym->st_info);
+		if (type != STT_FUNC && type != STT_OBJECT) { continue; }
+		if (sym->st_shndx == SHN_UNDEF || sym->st_value == 0 || sym->st_name == 0 || sym->st_name >= strings->sh_size) { continue; }
+
+		const char *name = strtab + sym->st_name;
+		size_t length = strnlen(name, strings->sh_size - sym->st_name);
+		pending.push_back({(ADDR)sym->st_value, {(uint32_t)sym->st_size, ELF_ST_BIND(sym->st_info) != STB_LOCAL, std::string_view(name, length)}});
+	}
+}
+
+SymbolTable::~SymbolTable()
+{
+	if (mapping) { munmap(mapping, mapping_size); }
+}
+
+bool SymbolTable::load(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) { return false; }
+	struct stat info;
+	if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(ElfHdr))
+	{
+		close(fd);
+		return false;
+	}
+	mapping_size = info.st_size;
+	mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		mapping = nullptr;
+		return false;
+	}
+
+	const BYTE *base = (const BYTE*)mapping;
+	const ElfHdr *header = (const ElfHdr*)base;
+	if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0) { return false; }
+	if (header->e_shoff + (size_t)header->e_shnum * sizeof(ElfShdr) > mapping_size) { return false; }
+	if (header->e_phoff + (size_t)header->e_phnum * sizeof(ElfPhdr) > mapping_size) { return false; }
+
+	relocatable = header->e_type == ET_DYN;
+	const ElfPhdr *segment = (const ElfPhdr*)(base + header->e_phoff);
+	image_base = (ADDR)-1;
+	image_end = 0;
+	for (int i = 0; i < header->e_phnum; i++)
+	{
+		if (segment[i].p_type != PT_LOAD) { continue; }
+		image_base = std::min(image_base, (ADDR)segment[i].p_vaddr);
+		image_end = std::max(image_end, (ADDR)(segment[i].p_vaddr + segment[i].p_memsz));
+	}
+	if (image_base == (ADDR)-1) { image_base = 0; }
+
+	/* Gather everything, then sort once: far cheaper than keeping a tree ordered for 200k+ inserts */
+	std::vector<SymbolEntry> pending;
+	const ElfShdr *section = (const ElfShdr*)(base + header->e_shoff);
+	for (int i = 0; i < header->e_shnum; i++)
+	{
+		if (section[i].sh_type == SHT_SYMTAB || section[i].sh_type == SHT_DYNSYM) { parseSection(base, mapping_size, &section[i], pending); }
+	}
+
+	/* Aliases share an address; the first after sorting (global, sized) names it in the address index */
+	std::sort(pending.begin(), pending.end(), [](const SymbolEntry &a, const SymbolEntry &b) {
+		if (a.address != b.address) { return a.address < b.address; }
+		if (a.symbol.global != b.symbol.global) { return a.symbol.global; }
+		return a.symbol.size > b.symbol.size;
+	});
+
+	addresses.clear();
+	symbols.clear();
+	names.clear();
+	addresses.reserve(pending.size());
+	symbols.reserve(pending.size());
+	names.reserve(pending.size());
+	for (auto &entry: pending)
+	{
+		if (addresses.empty() || addresses.back() != entry.address)
+		{
+			addresses.push_back(entry.address);
+			symbols.push_back(entry.symbol);
+		}
+
+		/* Locals can share names across translation units, a global always wins */
+		auto it = names.try_emplace(entry.symbol.name, symbols.size() - 1).first;
+		if (entry.symbol.global && !symbols[it->second].global) { it->second = symbols.size() - 1; }
+	}
+	return true;
+}
+
+bool SymbolTable::isRelocatable() { return relocatable; }
+
+void SymbolTable::setLoadAddress(ADDR address) { bias = address - image_base; }
+
+ADDR SymbolTable::getBias() { return bias; }
+
+size_t SymbolTable::size() { return symbols.size(); }
+
+void SymbolTable::getImageRange(ADDR &start, ADDR &end) // Loaded addresses spanned by the PT_LOAD segments
+{
+	start = image_base + bias;
+	end = image_end + bias;
+}
+
+bool SymbolTable::getSection(const char *name, const BYTE *&data, size_t &length, ADDR *address) // Raw contents of a named section in the mapping, and its link-time address
+{
+	if (!mapping) { return false; }
+	const BYTE *base = (const BYTE*)mapping;
+	const ElfHdr *header = (const ElfHdr*)base;
+	const ElfShdr *section = (const ElfShdr*)(base + header->e_shoff);
+	if (header->e_shstrndx >= header->e_shnum) { return false; }
+	const ElfShdr *names_section = &section[header->e_shstrndx];
+	if (names_section->sh_offset + names_section->sh_size > mapping_size) { return false; }
+
+	const char *section_names = (const char*)(base + names_section->sh_offset);
+	for (int i = 0; i < header->e_shnum; i++)
+	{
+		if (section[i].sh_name >= names_section->sh_size || strncmp(section_names + section[i].sh_name, name, names_section->sh_size - section[i].sh_name)) { continue; }
+		if (section[i].sh_type == SHT_NOBITS || section[i].sh_offset + section[i].sh_size > mapping_size) { return false; }
+#ifdef SHF_COMPRESSED
+		if (section[i].sh_flags & SHF_COMPRESSED) { return false; }
+#endif
+		data = base + section[i].sh_offset;
+		length = section[i].sh_size;
+		if (address) { *address = section[i].sh_addr; }
+		return true;
+	}
+	return false;
+}
+
+bool SymbolTable::getCodeSections(std::vector<CodeSection> &sections) // Every executable section with contents in the file, at loaded addresses
+{
+	if (!mapping) { return false; }
+	const BYTE *base = (const BYTE*)mapping;
+	const ElfHdr *header = (const ElfHdr*)base;
+	const ElfShdr *section = (const ElfShdr*)(base + header->e_shoff);
+	for (int i = 0; i < header->e_shnum; i++)
+	{
+		if (section[i].sh_type != SHT_PROGBITS || !(section[i].sh_flags & SHF_EXECINSTR) || !(section[i].sh_flags & SHF_ALLOC)) { continue; }
+		if (section[i].sh_size == 0 || section[i].sh_offset + section[i].sh_size > mapping_size) { continue; }
+		sections.push_back({base + section[i].sh_offset, (size_t)section[i].sh_size, (ADDR)section[i].sh_addr + bias});
+	}
+	return !sections.empty();
+}
+
+std::string SymbolTable::getBuildId() // Hex GNU build-id note, empty if the linker didn't emit one
+{
+	const BYTE *note;
+	size_t length;
+	if (!getSection(".note.gnu.build-id", note, length) || length < 16) { return std::string(); }
+
+	uint32_t name_size, desc_size, type;
+	memcpy(&name_size, note, 4);
+	memcpy(&desc_size, note + 4, 4);
+	memcpy(&type, note + 8, 4);
+	size_t desc_offset = 12 + ((name_size + 3) & ~3u);
+	if (type != 3 || desc_offset + desc_size > length) { return std::string(); } // NT_GNU_BUILD_ID
+
+	std::string id;
+	char digits[3];
+	for (uint32_t i = 0; i < desc_size; i++)
+	{
+		snprintf(digits, sizeof(digits), "%02x", note[desc_offset + i]);
+		id += digits;
+	}
+	return id;
+}
+
+bool SymbolTable::lookup(std::string_view name, ADDR &address)
+{
+	auto it = names.find(name);
+	if (it == names.end()) { return false; }
+	address = addresses[it->second] + bias;
+	return true;
+}
+
+const Symbol *SymbolTable::find(ADDR address, ADDR &offset) // Closest symbol at or below address, if address is inside it
+{
+	ADDR linked = address - bias;
+	auto it = std::upper_bound(addresses.begin(), addresses.end(), linked);
+	if (it == addresses.begin()) { return nullptr; }
+	size_t index = (it - addresses.begin()) - 1;
+
+	offset = linked - addresses[index];
+	const Symbol &symbol = symbols[index];
+	if (symbol.size != 0 && offset >= symbol.size) { return nullptr; }
+	if (symbol.size == 0 && index + 1 == addresses.size()) { return nullptr; } // Unsized and nothing above to bound it
+	return &symbol;
+}
+
+std::string SymbolTable::describe(ADDR address) // "name+0xoffset", or empty if no symbol covers address
+{
+	ADDR offset;
+	const Symbol *symbol = find(address, offset);
+	if (!symbol) { return std::string(); }
+
+	std::string text(symbol->name);
+	if (offset != 0)
+	{
+		char suffix[16];
+		snprintf(suffix, sizeof(suffix), "+0x%X", offset);
+		text += suffix;
+	}
+	return text;
+}
@@ -0,0 +1,68 @@
+/*
+* FreeDBG - ELF Symbol Table (Header)
+*/
+
+#ifndef FREEDBG_SYMBOLS
+#define FREEDBG_SYMBOLS
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // BYTE, ADDR
+
+
+struct Symbol {
+	uint32_t size;
+	bool global;
+	std::string_view name; // Points into the mapped file
+};
+
+struct CodeSection {
+	const BYTE *data; // Points into the mapped file
+	size_t length;
+	ADDR address; // Where it's loaded
+};
+
+
+/* Function and object symbols of the debugee's ELF, from .symtab and .dynsym.
+* The file stays mapped for the table's lifetime so names are never copied.
+* Addresses are kept in their own sorted array, parallel to 'symbols', so a
+* lookup by address is a binary search over densely packed integers. */
+class SymbolTable {
+private:
+	void *mapping = nullptr;
+	size_t mapping_size = 0;
+	bool relocatable = false; // ET_DYN, symbol values are relative to where the image was loaded
+	ADDR image_base = 0; // Lowest PT_LOAD address, as linked
+	ADDR image_end = 0; // End of the highest PT_LOAD segment, as linked
+	ADDR bias = 0;
+	std::vector<ADDR> addresses; // Sorted, as linked
+	std::vector<Symbol> symbols;
+	std::unordered_map<std::string_view,uint32_t> names; // Index into 'symbols'
+
+public:
+	SymbolTable() = default;
+	SymbolTable(const SymbolTable&) = delete;
+	SymbolTable &operator=(const SymbolTable&) = delete;
+	~SymbolTable();
+
+	bool load(const char *path);
+	bool isRelocatable();
+	void setLoadAddress(ADDR address);
+	ADDR getBias();
+	size_t size();
+	void getImageRange(ADDR &start, ADDR &end);
+	bool getCodeSections(std::vector<CodeSection> &sections);
+	bool getSection(const char *name, const BYTE *&data, size_t &length, ADDR *address = nullptr);
+	std::string getBuildId();
+
+	bool lookup(std::string_view name, ADDR &address);
+	const Symbol *find(ADDR address, ADDR &offset);
+	std::string describe(ADDR address);
+};
+
+
+#endif // FREEDBG_SYMBOLS
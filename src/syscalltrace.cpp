@@ -0,0 +1,221 @@
+/*
+* FreeDBG - System Call Tracer
+*
+* TODO:
+*	- Decode string and struct arguments, everything is printed as hex for now
+*/
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/ptrace.h>
+#include "logging.hpp" // logError, logMsg
+#include "syscalltrace.hpp" // SyscallTracer, SyscallStats
+#include "ptracestats.hpp" // dbgPtrace
+
+
+struct SyscallName {
+	unsigned int number;
+	const char *name;
+};
+
+static const SyscallName SYSCALL_NAMES[] = { // sys/kern/syscalls.master, current numbers only
+	{1, "exit"}, {2, "fork"}, {3, "read"}, {4, "write"}, {5, "open"}, {6, "close"}, {7, "wait4"}, {9, "link"},
+	{10, "unlink"}, {12, "chdir"}, {13, "fchdir"}, {15, "chmod"}, {16, "chown"}, {17, "break"}, {20, "getpid"},
+	{21, "mount"}, {22, "unmount"}, {23, "setuid"}, {24, "getuid"}, {25, "geteuid"}, {26, "ptrace"}, {27, "recvmsg"},
+	{28, "sendmsg"}, {29, "recvfrom"}, {30, "accept"}, {31, "getpeername"}, {32, "getsockname"}, {33, "access"},
+	{34, "chflags"}, {35, "fchflags"}, {36, "sync"}, {37, "kill"}, {39, "getppid"}, {41, "dup"}, {43, "getegid"},
+	{44, "profil"}, {45, "ktrace"}, {47, "getgid"}, {49, "getlogin"}, {50, "setlogin"}, {51, "acct"}, {53, "sigaltstack"},
+	{54, "ioctl"}, {55, "reboot"}, {56, "revoke"}, {57, "symlink"}, {58, "readlink"}, {59, "execve"}, {60, "umask"},
+	{61, "chroot"}, {65, "msync"}, {66, "vfork"}, {73, "munmap"}, {74, "mprotect"}, {75, "madvise"}, {78, "mincore"},
+	{79, "getgroups"}, {80, "setgroups"}, {81, "getpgrp"}, {82, "setpgid"}, {83, "setitimer"}, {85, "swapon"},
+	{86, "getitimer"}, {89, "getdtablesize"}, {90, "dup2"}, {92, "fcntl"}, {93, "select"}, {95, "fsync"},
+	{96, "setpriority"}, {97, "socket"}, {98, "connect"}, {100, "getpriority"}, {104, "bind"}, {105, "setsockopt"},
+	{106, "listen"}, {116, "gettimeofday"}, {117, "getrusage"}, {118, "getsockopt"}, {120, "readv"}, {121, "writev"},
+	{122, "settimeofday"}, {123, "fchown"}, {124, "fchmod"}, {126, "setreuid"}, {127, "setregid"}, {128, "rename"},
+	{131, "flock"}, {132, "mkfifo"}, {133, "sendto"}, {134, "shutdown"}, {135, "socketpair"}, {136, "mkdir"},
+	{137, "rmdir"}, {138, "utimes"}, {140, "adjtime"}, {147, "setsid"}, {148, "quotactl"}, {165, "sysarch"},
+	{166, "rtprio"}, {175, "setfib"}, {176, "ntp_adjtime"}, {181, "setgid"}, {182, "setegid"}, {183, "seteuid"},
+	{191, "pathconf"}, {192, "fpathconf"}, {194, "getrlimit"}, {195, "setrlimit"}, {198, "__syscall"}, {202, "__sysctl"},
+	{203, "mlock"}, {204, "munlock"}, {205, "undelete"}, {206, "futimes"}, {207, "getpgid"}, {209, "poll"},
+	{221, "semget"}, {222, "semop"}, {225, "msgget"}, {226, "msgsnd"}, {227, "msgrcv"}, {228, "shmat"}, {230, "shmdt"},
+	{231, "shmget"}, {232, "clock_gettime"}, {233, "clock_settime"}, {234, "clock_getres"}, {235, "ktimer_create"},
+	{236, "ktimer_delete"}, {237, "ktimer_settime"}, {238, "ktimer_gettime"}, {239, "ktimer_getoverrun"},
+	{240, "nanosleep"}, {247, "clock_getcpuclockid2"}, {248, "ntp_gettime"}, {250, "minherit"}, {251, "rfork"},
+	{253, "issetugid"}, {254, "lchown"}, {255, "aio_read"}, {256, "aio_write"}, {257, "lio_listio"}, {274, "lchmod"},
+	{276, "lutimes"}, {289, "preadv"}, {290, "pwritev"}, {298, "fhopen"}, {304, "kldload"}, {305, "kldunload"},
+	{306, "kldfind"}, {307, "kldnext"}, {308, "kldstat"}, {310, "getsid"}, {311, "setresuid"}, {312, "setresgid"},
+	{314, "aio_return"}, {315, "aio_suspend"}, {316, "aio_cancel"}, {317, "aio_error"}, {321, "yield"},
+	{324, "mlockall"}, {325, "munlockall"}, {326, "__getcwd"}, {327, "sched_setparam"}, {328, "sched_getparam"},
+	{329, "sched_setscheduler"}, {330, "sched_getscheduler"}, {331, "sched_yield"}, {332, "sched_get_priority_max"},
+	{333, "sched_get_priority_min"}, {334, "sched_rr_get_interval"}, {335, "utrace"}, {337, "kldsym"}, {338, "jail"},
+	{340, "sigprocmask"}, {341, "sigsuspend"}, {343, "sigpending"}, {345, "sigtimedwait"}, {346, "sigwaitinfo"},
+	{362, "kqueue"}, {392, "uuidgen"}, {393, "sendfile"}, {416, "sigaction"}, {417, "sigreturn"}, {421, "getcontext"},
+	{422, "setcontext"}, {423, "swapcontext"}, {429, "sigwait"}, {430, "thr_create"}, {431, "thr_exit"},
+	{432, "thr_self"}, {433, "thr_kill"}, {436, "jail_attach"}, {454, "_umtx_op"}, {455, "thr_new"}, {456, "sigqueue"},
+	{464, "thr_set_name"}, {465, "aio_fsync"}, {466, "rtprio_thread"}, {475, "pread"}, {476, "pwrite"}, {477, "mmap"},
+	{478, "lseek"}, {479, "truncate"}, {480, "ftruncate"}, {481, "thr_kill2"}, {483, "shm_unlink"}, {484, "cpuset"},
+	{485, "cpuset_setid"}, {486, "cpuset_getid"}, {487, "cpuset_getaffinity"}, {488, "cpuset_setaffinity"},
+	{489, "faccessat"}, {490, "fchmodat"}, {491, "fchownat"}, {492, "fexecve"}, {494, "futimesat"}, {495, "linkat"},
+	{496, "mkdirat"}, {497, "mkfifoat"}, {499, "openat"}, {500, "readlinkat"}, {501, "renameat"}, {502, "symlinkat"},
+	{503, "unlinkat"}, {504, "posix_openpt"}, {506, "jail_get"}, {507, "jail_set"}, {508, "jail_remove"},
+	{510, "__semctl"}, {511, "msgctl"}, {512, "shmctl"}, {513, "lpathconf"}, {516, "cap_enter"}, {517, "cap_getmode"},
+	{518, "pdfork"}, {519, "pdkill"}, {520, "pdgetpid"}, {522, "pselect"}, {530, "posix_fallocate"},
+	{531, "posix_fadvise"}, {532, "wait6"}, {533, "cap_rights_limit"}, {534, "cap_ioctls_limit"}, {535, "cap_ioctls_get"},
+	{536, "cap_fcntls_limit"}, {537, "cap_fcntls_get"}, {538, "bindat"}, {539, "connectat"}, {540, "chflagsat"},
+	{541, "accept4"}, {542, "pipe2"}, {543, "aio_mlock"}, {544, "procctl"}, {545, "ppoll"}, {546, "futimens"},
+	{547, "utimensat"}, {550, "fdatasync"}, {551, "fstat"}, {552, "fstatat"}, {553, "fhstat"}, {554, "getdirentries"},
+	{555, "statfs"}, {556, "fstatfs"}, {557, "getfsstat"}, {558, "fhstatfs"}, {559, "mknodat"}, {560, "kevent"},
+	{561, "cpuset_getdomain"}, {562, "cpuset_setdomain"}, {563, "getrandom"}, {564, "getfhat"}, {565, "fhlink"},
+	{566, "fhlinkat"}, {567, "fhreadlink"}, {568, "funlinkat"}, {569, "copy_file_range"}, {570, "__sysctlbyname"},
+	{571, "shm_open2"}, {572, "shm_rename"}, {573, "sigfastblock"}, {574, "__realpathat"}, {575, "close_range"},
+	{577, "__specialfd"}, {578, "aio_writev"}, {579, "aio_readv"}, {580, "fspacectl"}, {581, "sched_getcpu"},
+	{582, "swapoff"}, {583, "kqueuex"}, {584, "membarrier"}, {585, "timerfd_create"}, {586, "timerfd_gettime"},
+	{587, "timerfd_settime"}, {588, "kcmp"},
+};
+
+static const char *syscallName(unsigned int number, char *fallback, size_t size)
+{
+	static std::vector<const char*> names;
+	if (names.empty())
+	{
+		names.resize(SYSCALL_TABLE_SIZE);
+		for (const SyscallName &entry: SYSCALL_NAMES) { names[entry.number] = entry.name; }
+	}
+	if (number < names.size() && names[number]) { return names[number]; }
+	snprintf(fallback, size, "syscall_%u", number);
+	return fallback;
+}
+
+static uint64_t now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/********************************
+* SyscallTracer Class Methods   *
+********************************/
+SyscallTracer::SyscallTracer(int pid) : child_pid(pid), stats(SYSCALL_TABLE_SIZE) {}
+
+SyscallTracer::~SyscallTracer() { disable(); }
+
+bool SyscallTracer::enable(const char *log_path) // Null for counting only, "-" logs to stdout
+{
+	disable();
+	if (log_path && strcmp(log_path, "-") == 0) { log = stdout; }
+	else if (log_path)
+	{
+		log = fopen(log_path, "w");
+		if (!log)
+		{
+			logError("Unable to open '%s'", log_path);
+			return false;
+		}
+		setvbuf(log, nullptr, _IOFBF, SYSCALL_LOG_BUFFER);
+	}
+	enabled = true;
+	pending.clear();
+	starting.clear();
+	return true;
+}
+
+void SyscallTracer::disable()
+{
+	if (log && log != stdout) { fclose(log); }
+	else if (log) { fflush(log); }
+	log = nullptr;
+	enabled = false;
+}
+
+bool SyscallTracer::isEnabled() { return enabled; }
+
+void SyscallTracer::resumed()
+{
+	if (starting.empty()) { return; }
+	uint64_t time = now();
+	for (lwpid_t lwp: starting)
+	{
+		auto it = pending.find(lwp);
+		if (it != pending.end()) { it->second.started = time; }
+	}
+	starting.clear();
+}
+
+bool SyscallTracer::handleStop(const struct ptrace_lwpinfo &info) // Called for every SIGTRAP while enabled, false if it wasn't a syscall stop
+{
+	if (info.pl_flags & PL_FLAG_SCE)
+	{
+		PendingSyscall &call = pending[info.pl_lwpid];
+		call.code = info.pl_syscall_code;
+		call.narg = std::min(info.pl_syscall_narg, (unsigned int)SYSCALL_MAX_ARGS);
+		call.started = 0;
+		if (log && call.narg && dbgPtrace(PT_GET_SC_ARGS, info.pl_lwpid, (caddr_t)call.args, sizeof(call.args)) < 0) { call.narg = 0; }
+		starting.push_back(info.pl_lwpid);
+		return true;
+	}
+	if (!(info.pl_flags & PL_FLAG_SCX)) { return false; }
+
+	uint64_t finished = now();
+	struct ptrace_sc_ret result;
+	if (dbgPtrace(PT_GET_SC_RET, info.pl_lwpid, (caddr_t)&result, sizeof(result)) < 0) { std::memset(&result, 0, sizeof(result)); }
+	auto it = pending.find(info.pl_lwpid);
+	if (it == pending.end()) { return true; } // Tracing was enabled mid-syscall, there's no entry to pair with
+
+	PendingSyscall &call = it->second;
+	uint64_t elapsed = call.started ? finished - call.started : 0;
+	SyscallStats &entry = stats[call.code < SYSCALL_TABLE_SIZE ? call.code : 0];
+	entry.calls++;
+	entry.nanoseconds += elapsed;
+	if (result.sr_error) { entry.errors++; }
+	if (log) { writeLog(call, result.sr_retval[0], result.sr_error, elapsed); }
+	pending.erase(it);
+	return true;
+}
+
+void SyscallTracer::writeLog(const PendingSyscall &call, long retval, int error, uint64_t elapsed)
+{
+	char fallback[24];
+	fprintf(log, "%s(", syscallName(call.code, fallback, sizeof(fallback)));
+	for (unsigned int i = 0; i < call.narg; i++) { fprintf(log, i ? ", 0x%lx" : "0x%lx", (unsigned long)call.args[i]); }
+	if (error) { fprintf(log, ") = -1 %s (%d) <%.3f us>\n", strerror(error), error, elapsed / 1e3); }
+	else { fprintf(log, ") = %ld (0x%lx) <%.3f us>\n", retval, (unsigned long)retval, elapsed / 1e3); }
+}
+
+void SyscallTracer::printSummary() // Same columns as 'truss -c' / 'strace -c'
+{
+	if (log) { fflush(log); }
+	std::vector<unsigned int> numbers;
+	uint64_t total_time = 0, total_calls = 0, total_errors = 0;
+	for (unsigned int i = 0; i < stats.size(); i++)
+	{
+		if (stats[i].calls == 0) { continue; }
+		numbers.push_back(i);
+		total_time += stats[i].nanoseconds;
+		total_calls += stats[i].calls;
+		total_errors += stats[i].errors;
+	}
+	std::sort(numbers.begin(), numbers.end(), [&](unsigned int a, unsigned int b) { return stats[a].nanoseconds > stats[b].nanoseconds; });
+
+	printf("%6s %11s %11s %9s %9s  %s\n", "% time", "seconds", "usecs/call", "calls", "errors", "syscall");
+	char fallback[24];
+	for (unsigned int number: numbers)
+	{
+		SyscallStats &entry = stats[number];
+		printf("%6.2f %11.6f %11.2f %9llu %9llu  %s\n", total_time ? entry.nanoseconds * 100.0 / total_time : 0.0, entry.nanoseconds / 1e9,
+			entry.nanoseconds / 1e3 / entry.calls, (unsigned long long)entry.calls, (unsigned long long)entry.errors,
+			syscallName(number, fallback, sizeof(fallback)));
+	}
+	printf("%6s %11.6f %11s %9llu %9llu  %s\n", "100.00", total_time / 1e9, "", (unsigned long long)total_calls,
+		(unsigned long long)total_errors, "total");
+}
+
+void SyscallTracer::reset()
+{
+	stats.assign(SYSCALL_TABLE_SIZE, SyscallStats());
+}
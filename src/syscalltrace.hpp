@@ -0,0 +1,67 @@
+/*
+* FreeDBG - System Call Tracer (Header)
+*/
+
+#ifndef FREEDBG_SYSCALL_TRACE
+#define FREEDBG_SYSCALL_TRACE
+
+#include <sys/types.h>
+#include <sys/ptrace.h>
+#include <vector>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+#include "types.hpp" // DWORD
+
+
+#define SYSCALL_TABLE_SIZE 1024 // Above the highest FreeBSD syscall number
+#define SYSCALL_MAX_ARGS 8
+#define SYSCALL_LOG_BUFFER 0x10000
+
+
+struct PendingSyscall {
+	unsigned int code = 0;
+	unsigned int narg = 0;
+	DWORD args[SYSCALL_MAX_ARGS];
+	uint64_t started = 0; // Steady clock ns of the resume after the entry stop
+};
+
+struct SyscallStats {
+	uint64_t calls = 0;
+	uint64_t errors = 0;
+	uint64_t nanoseconds = 0;
+};
+
+
+/* Syscall-stop bookkeeping for continueExec. While enabled the debugee is
+* resumed with PT_SYSCALL, and every entry/exit stop is identified from its
+* PT_LWPINFO and folded into fixed per-number counters, so the cost per
+* syscall is constant and nothing accumulates in memory. Entries and exits are
+* paired per thread. The optional log is streamed through a stdio buffer as
+* each syscall completes. */
+class SyscallTracer {
+private:
+	int child_pid;
+	bool enabled = false;
+	FILE *log = nullptr;
+	std::vector<SyscallStats> stats;
+	std::unordered_map<lwpid_t,PendingSyscall> pending; // Threads between entry and exit stops
+	std::vector<lwpid_t> starting; // Entered since the last resume, their time starts with the next one
+	void writeLog(const PendingSyscall &call, long retval, int error, uint64_t elapsed);
+
+public:
+	SyscallTracer(int pid);
+	~SyscallTracer();
+	SyscallTracer(const SyscallTracer&) = delete;
+	SyscallTracer &operator=(const SyscallTracer&) = delete;
+	bool enable(const char *log_path);
+	void disable();
+	bool isEnabled();
+	void resumed();
+	bool handleStop(const struct ptrace_lwpinfo &info);
+	void printSummary();
+	void reset();
+};
+
+
+#endif // FREEDBG_SYSCALL_TRACE
@@ -0,0 +1,111 @@
+/*
+* FreeDBG - Debugee Thread List
+*/
+
+#include <sys/types.h>
+#include <sys/ptrace.h>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "threads.hpp" // ThreadList, ThreadState
+#include "ptracestats.hpp" // dbgPtrace
+
+
+/***************************
+* ThreadList Class Methods *
+***************************/
+ThreadList::ThreadList(int pid) : child_pid(pid) {}
+
+bool ThreadList::refresh() // Full listing, for when events may have been missed (enabling them, attaching)
+{
+	int count = dbgPtrace(PT_GETNUMLWPS, child_pid, 0, 0);
+	if (count <= 0) { return false; }
+	std::vector<lwpid_t> current(count);
+	count = dbgPtrace(PT_GETLWPLIST, child_pid, (caddr_t)current.data(), count);
+	if (count <= 0) { return false; }
+	current.resize(count);
+
+	for (auto it = threads.begin(); it != threads.end();)
+	{
+		if (std::find(current.begin(), current.end(), it->first) != current.end()) { ++it; }
+		else
+		{
+			if (it->second.suspended) { suspended--; }
+			it = threads.erase(it);
+		}
+	}
+	std::sort(current.begin(), current.end());
+	for (lwpid_t lwp: current) { add(lwp); }
+	return true;
+}
+
+ThreadState &ThreadList::add(lwpid_t lwp) // No-op if it's already known
+{
+	auto it = threads.find(lwp);
+	if (it != threads.end()) { return it->second; }
+	ThreadState &thread = threads[lwp];
+	thread.lwp = lwp;
+	thread.number = next_number++;
+	return thread;
+}
+
+void ThreadList::remove(lwpid_t lwp)
+{
+	auto it = threads.find(lwp);
+	if (it == threads.end()) { return; }
+	if (it->second.suspended) { suspended--; }
+	threads.erase(it);
+}
+
+ThreadState *ThreadList::find(lwpid_t lwp)
+{
+	auto it = threads.find(lwp);
+	return (it != threads.end()) ? &it->second : nullptr;
+}
+
+ThreadState *ThreadList::findNumber(int number)
+{
+	for (auto &entry: threads)
+	{
+		if (entry.second.number == number) { return &entry.second; }
+	}
+	return nullptr;
+}
+
+size_t ThreadList::count() { return threads.size(); }
+
+std::vector<lwpid_t> ThreadList::ids()
+{
+	std::vector<lwpid_t> lwps;
+	lwps.reserve(threads.size());
+	for (auto &entry: threads) { lwps.push_back(entry.first); }
+	return lwps;
+}
+
+void ThreadList::holdOthers(lwpid_t running) // Suspends every other thread for a single step, left that way across consecutive steps
+{
+	if (threads.size() < 2 || (held_for == running && suspended == threads.size() - 1)) { return; }
+	for (auto &entry: threads)
+	{
+		ThreadState &thread = entry.second;
+		bool hold = (thread.lwp != running);
+		if (hold == thread.suspended) { continue; }
+		if (dbgPtrace(hold ? PT_SUSPEND : PT_RESUME, thread.lwp, 0, 0) < 0) { continue; }
+		thread.suspended = hold;
+		if (hold) { suspended++; }
+		else { suspended--; }
+	}
+	held_for = running;
+}
+
+void ThreadList::releaseAll()
+{
+	if (suspended == 0) { return; }
+	for (auto &entry: threads)
+	{
+		if (!entry.second.suspended || dbgPtrace(PT_RESUME, entry.first, 0, 0) < 0) { continue; }
+		entry.second.suspended = false;
+		suspended--;
+	}
+	held_for = 0;
+}
@@ -0,0 +1,50 @@
+/*
+* FreeDBG - Debugee Thread List (Header)
+*/
+
+#ifndef FREEDBG_THREADS
+#define FREEDBG_THREADS
+
+#include <sys/types.h>
+#include <sys/ptrace.h>
+#include <map>
+#include <vector>
+#include <cstddef>
+#include "breakpoint.hpp" // BPHANDLE, NO_BREAKPOINT
+
+
+struct ThreadState {
+	lwpid_t lwp;
+	int number; // Stable for the session, 1 is the thread the process started with
+	BPHANDLE breakpoint = NO_BREAKPOINT; // Breakpoint it's parked on while another thread is selected
+	bool suspended = false; // PT_SUSPEND, held while another thread single-steps
+};
+
+
+/* The debugee's LWPs, kept up to date from PT_LWP_EVENTS births and exits
+* instead of listing them on every stop, so a stop costs the same with one
+* thread or hundreds. FreeBSD stops every thread together and reports one
+* stop per process, with PT_LWPINFO naming the thread that caused it. */
+class ThreadList {
+private:
+	int child_pid;
+	std::map<lwpid_t,ThreadState> threads; // By LWP id, creation order for practical purposes
+	int next_number = 1;
+	size_t suspended = 0;
+	lwpid_t held_for = 0; // Thread holdOthers last left running
+
+public:
+	ThreadList(int pid);
+	bool refresh();
+	ThreadState &add(lwpid_t lwp);
+	void remove(lwpid_t lwp);
+	ThreadState *find(lwpid_t lwp);
+	ThreadState *findNumber(int number);
+	size_t count();
+	std::vector<lwpid_t> ids();
+	void holdOthers(lwpid_t running);
+	void releaseAll();
+};
+
+
+#endif // FREEDBG_THREADS
@@ -0,0 +1,207 @@
+/*
+* FreeDBG - Instruction Trace File
+*/
+
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <zlib.h>
+#include "logging.hpp" // logError
+#include "tracefile.hpp" // TraceEncoder, TraceDecoder, TraceWriter, TraceReader, TraceStep
+
+
+static BYTE *putVarint(BYTE *out, uint32_t value)
+{
+	while (value >= 0x80)
+	{
+		*out++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*out++ = value;
+	return out;
+}
+
+static bool getVarint(const BYTE *&cursor, const BYTE *end, uint32_t &value)
+{
+	value = 0;
+	for (int shift = 0; shift < 35 && cursor < end; shift += 7)
+	{
+		BYTE byte = *cursor++;
+		value |= (uint32_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) { return true; }
+	}
+	return false;
+}
+
+static uint32_t zigzag(uint32_t delta) { return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31); }
+
+static uint32_t unzigzag(uint32_t value) { return (value >> 1) ^ (uint32_t)-(int32_t)(value & 1); }
+
+
+/******************************
+* TraceEncoder Class Methods  *
+******************************/
+TraceEncoder::TraceEncoder() { reset(); }
+
+void TraceEncoder::reset() { std::memset(&previous, 0, sizeof(previous)); }
+
+size_t TraceEncoder::encode(const TraceStep &step, BYTE *out)
+{
+	BYTE *start = out;
+	out = putVarint(out, zigzag(step.eip - previous.eip));
+	uint32_t mask = 0;
+	for (int i = 0; i < TRACE_REGISTERS; i++) { mask |= (uint32_t)(step.regs[i] != previous.regs[i]) << i; }
+	out = putVarint(out, mask);
+	for (int i = 0; i < TRACE_REGISTERS; i++)
+	{
+		if (mask & (1u << i)) { out = putVarint(out, zigzag(step.regs[i] - previous.regs[i])); }
+	}
+	previous = step;
+	return out - start;
+}
+
+
+/******************************
+* TraceDecoder Class Methods  *
+******************************/
+TraceDecoder::TraceDecoder(const BYTE *data, size_t length) : cursor(data), end(data + length) { std::memset(&previous, 0, sizeof(previous)); }
+
+bool TraceDecoder::next(TraceStep &step)
+{
+	uint32_t value, mask;
+	if (cursor >= end || !getVarint(cursor, end, value) || !getVarint(cursor, end, mask)) { return false; }
+	step = previous;
+	step.eip += unzigzag(value);
+	for (int i = 0; i < TRACE_REGISTERS; i++)
+	{
+		if (!(mask & (1u << i))) { continue; }
+		if (!getVarint(cursor, end, value)) { return false; }
+		step.regs[i] += unzigzag(value);
+	}
+	previous = step;
+	return true;
+}
+
+
+/*****************************
+* TraceWriter Class Methods  *
+*****************************/
+TraceWriter::~TraceWriter() { close(); }
+
+bool TraceWriter::open(const char *path)
+{
+	close();
+	file = fopen(path, "wb");
+	if (!file)
+	{
+		logError("Unable to open '%s'", path);
+		return false;
+	}
+	index.clear();
+	step_count = raw_bytes = 0;
+	TraceFileHeader header = {TRACE_MAGIC, TRACE_VERSION, TRACE_REGISTERS, TRACE_CHUNK_SIZE};
+	written_bytes = fwrite(&header, sizeof(header), 1, file) * sizeof(header);
+	return written_bytes == sizeof(header);
+}
+
+bool TraceWriter::writeChunk(const BYTE *data, size_t length, uint32_t steps, uint32_t first_eip)
+{
+	if (!file || steps == 0) { return file != nullptr; }
+	uLongf compressed_size = compressBound(length);
+	compressed.resize(compressed_size);
+	if (compress2(compressed.data(), &compressed_size, data, length, 1) != Z_OK) { return false; } // Level 1, the writer has to keep up with stepping
+
+	TraceChunkHeader header = {step_count, steps, (uint32_t)length, (uint32_t)compressed_size, first_eip};
+	index.push_back({step_count, written_bytes});
+	if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(compressed.data(), 1, compressed_size, file) != compressed_size) { return false; }
+	written_bytes += sizeof(header) + compressed_size;
+	raw_bytes += length;
+	step_count += steps;
+	return true;
+}
+
+bool TraceWriter::close()
+{
+	if (!file) { return true; }
+	TraceFileFooter footer = {written_bytes, index.size(), step_count, TRACE_MAGIC, 0};
+	bool written = fwrite(index.data(), sizeof(TraceIndexEntry), index.size(), file) == index.size();
+	written = written && fwrite(&footer, sizeof(footer), 1, file) == 1;
+	written_bytes += index.size() * sizeof(TraceIndexEntry) + sizeof(footer);
+	written = (fclose(file) == 0) && written;
+	file = nullptr;
+	return written;
+}
+
+uint64_t TraceWriter::rawBytes() { return raw_bytes; }
+
+uint64_t TraceWriter::writtenBytes() { return written_bytes; }
+
+
+/*****************************
+* TraceReader Class Methods  *
+*****************************/
+TraceReader::~TraceReader()
+{
+	if (file) { fclose(file); }
+}
+
+bool TraceReader::open(const char *path)
+{
+	file = fopen(path, "rb");
+	if (!file)
+	{
+		logError("Unable to open '%s'", path);
+		return false;
+	}
+
+	TraceFileHeader header;
+	TraceFileFooter footer;
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != TRACE_MAGIC || header.version != TRACE_VERSION ||
+		header.register_count != TRACE_REGISTERS)
+	{
+		logError("'%s' is not a FreeDBG trace", path);
+		return false;
+	}
+	if (fseeko(file, 0, SEEK_END) != 0) { return false; }
+	file_size = ftello(file);
+	if (file_size < sizeof(header) + sizeof(footer) || fseeko(file, file_size - sizeof(footer), SEEK_SET) != 0 ||
+		fread(&footer, sizeof(footer), 1, file) != 1 || footer.magic != TRACE_MAGIC ||
+		footer.index_offset + footer.chunk_count * sizeof(TraceIndexEntry) + sizeof(footer) != file_size)
+	{
+		logError("'%s' is truncated (recording was interrupted?)", path);
+		return false;
+	}
+
+	index.resize(footer.chunk_count);
+	step_count = footer.step_count;
+	return fseeko(file, footer.index_offset, SEEK_SET) == 0 && fread(index.data(), sizeof(TraceIndexEntry), index.size(), file) == index.size();
+}
+
+uint64_t TraceReader::stepCount() { return step_count; }
+
+size_t TraceReader::chunkCount() { return index.size(); }
+
+uint64_t TraceReader::fileSize() { return file_size; }
+
+size_t TraceReader::findChunk(uint64_t step)
+{
+	auto it = std::upper_bound(index.begin(), index.end(), step, [](uint64_t value, const TraceIndexEntry &entry) { return value < entry.first_step; });
+	return it == index.begin() ? 0 : (it - index.begin()) - 1;
+}
+
+uint64_t TraceReader::chunkFirstStep(size_t chunk) { return index[chunk].first_step; }
+
+bool TraceReader::readChunk(size_t chunk, std::vector<BYTE> &raw, uint32_t &steps)
+{
+	TraceChunkHeader header;
+	if (chunk >= index.size() || fseeko(file, index[chunk].offset, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, file) != 1) { return false; }
+	compressed.resize(header.compressed_size);
+	raw.resize(header.raw_size);
+	uLongf raw_size = header.raw_size;
+	if (fread(compressed.data(), 1, compressed.size(), file) != compressed.size() ||
+		uncompress(raw.data(), &raw_size, compressed.data(), compressed.size()) != Z_OK || raw_size != header.raw_size) { return false; }
+	steps = header.step_count;
+	return true;
+}
@@ -0,0 +1,129 @@
+/*
+* FreeDBG - Instruction Trace File (Header)
+*/
+
+#ifndef FREEDBG_TRACE_FILE
+#define FREEDBG_TRACE_FILE
+
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // BYTE
+
+
+#define TRACE_MAGIC 0x43525446 // "FTRC"
+#define TRACE_VERSION 1
+#define TRACE_REGISTERS 9 // eax ebx ecx edx esi edi ebp esp eflags, eip is kept apart as it changes every step
+#define TRACE_CHUNK_SIZE 0x40000 // Raw bytes per chunk, each chunk is compressed and decodable on its own
+#define TRACE_MAX_RECORD 64 // Worst case encoded step: 5 byte eip delta, 2 byte mask, 9 * 5 byte deltas
+
+
+struct TraceStep {
+	uint32_t eip;
+	uint32_t regs[TRACE_REGISTERS];
+};
+
+struct TraceFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t register_count;
+	uint32_t chunk_size;
+};
+
+struct TraceChunkHeader { // Followed by compressed_size bytes of zlib data
+	uint64_t first_step;
+	uint32_t step_count;
+	uint32_t raw_size;
+	uint32_t compressed_size;
+	uint32_t first_eip;
+};
+
+struct TraceIndexEntry {
+	uint64_t first_step;
+	uint64_t offset; // Of the chunk header
+};
+
+struct TraceFileFooter { // Last bytes of the file, the index sits right before it
+	uint64_t index_offset;
+	uint64_t chunk_count;
+	uint64_t step_count;
+	uint32_t magic;
+	uint32_t reserved;
+};
+
+
+/* Steps are stored as the zigzag varint difference of eip from the previous
+* step, a varint mask of the registers that changed, and a zigzag varint delta
+* for each of them. A straight-line step is typically 3-6 bytes before zlib.
+* The previous state is zero at the start of every chunk, so any chunk can be
+* decoded without the ones before it. */
+class TraceEncoder {
+private:
+	TraceStep previous;
+
+public:
+	TraceEncoder();
+	void reset();
+	size_t encode(const TraceStep &step, BYTE *out); // Returns bytes written, at most TRACE_MAX_RECORD
+};
+
+class TraceDecoder {
+private:
+	TraceStep previous;
+	const BYTE *cursor;
+	const BYTE *end;
+
+public:
+	TraceDecoder(const BYTE *data, size_t length);
+	bool next(TraceStep &step);
+};
+
+
+/* Appends compressed chunks, then an index of where each chunk starts and a
+* footer, so readers can seek to any step without scanning the file. */
+class TraceWriter {
+private:
+	FILE *file = nullptr;
+	std::vector<TraceIndexEntry> index;
+	std::vector<BYTE> compressed;
+	uint64_t step_count = 0;
+	uint64_t raw_bytes = 0;
+	uint64_t written_bytes = 0;
+
+public:
+	TraceWriter() = default;
+	~TraceWriter();
+	TraceWriter(const TraceWriter&) = delete;
+	TraceWriter &operator=(const TraceWriter&) = delete;
+	bool open(const char *path);
+	bool writeChunk(const BYTE *data, size_t length, uint32_t steps, uint32_t first_eip);
+	bool close();
+	uint64_t rawBytes();
+	uint64_t writtenBytes();
+};
+
+class TraceReader {
+private:
+	FILE *file = nullptr;
+	std::vector<TraceIndexEntry> index;
+	uint64_t step_count = 0;
+	uint64_t file_size = 0;
+	std::vector<BYTE> compressed;
+
+public:
+	TraceReader() = default;
+	~TraceReader();
+	TraceReader(const TraceReader&) = delete;
+	TraceReader &operator=(const TraceReader&) = delete;
+	bool open(const char *path);
+	uint64_t stepCount();
+	size_t chunkCount();
+	uint64_t fileSize();
+	size_t findChunk(uint64_t step); // Chunk holding the given step
+	uint64_t chunkFirstStep(size_t chunk);
+	bool readChunk(size_t chunk, std::vector<BYTE> &raw, uint32_t &steps);
+};
+
+
+#endif // FREEDBG_TRACE_FILE
@@ -0,0 +1,115 @@
+/*
+* FreeDBG - Tracepoint Class
+*/
+
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include "tracepoint.hpp" // Tracepoint, TraceRecord
+#include "x86relocate.hpp" // relocateInstructions
+#include "memcache.hpp" // MemoryCache
+
+#define TRACE_HEADER_SIZE 8 // Hit counter, ring head
+#define TRACE_CODE_SIZE 128 // Longest trampoline, with room for the relocated instructions
+
+
+static void emit32(std::vector<BYTE> &out, uint32_t value)
+{
+	for (int i = 0; i < 4; i++) { out.push_back((value >> (i * 8)) & 0xff); }
+}
+
+
+Tracepoint::Tracepoint(MemoryCache &mem, ADDR addr, bool log_regs) : memory(&mem), address(addr), log_registers(log_regs) {}
+
+size_t Tracepoint::areaSize(bool log_regs)
+{
+	return TRACE_HEADER_SIZE + (log_regs ? TRACE_RING_ENTRIES * sizeof(TraceRecord) : 0) + TRACE_CODE_SIZE;
+}
+
+bool Tracepoint::install(const BYTE *code, size_t code_length, ADDR area) // area must be areaSize() bytes of zeroed debugee memory
+{
+	data_address = area;
+	ADDR counter = area;
+	ADDR head = area + 4;
+	ADDR ring = area + TRACE_HEADER_SIZE;
+	ADDR trampoline = area + areaSize(log_registers) - TRACE_CODE_SIZE;
+
+	std::vector<BYTE> out;
+	out.push_back(0x9c); // pushfd
+	out.insert(out.end(), {0xf0, 0xff, 0x05}); // lock inc dword [counter]
+	emit32(out, counter);
+	if (log_registers)
+	{
+		out.push_back(0x60); // pushad
+		out.push_back(0xa1); // mov eax, [head]
+		emit32(out, head);
+		out.push_back(0x25); // and eax, ENTRIES-1
+		emit32(out, TRACE_RING_ENTRIES - 1);
+		out.insert(out.end(), {0x6b, 0xc0, (BYTE)sizeof(TraceRecord)}); // imul eax, eax, sizeof(TraceRecord)
+		out.push_back(0x05); // add eax, ring
+		emit32(out, ring);
+		out.insert(out.end(), {0x89, 0xc7}); // mov edi, eax
+		out.insert(out.end(), {0x89, 0xe6}); // mov esi, esp
+		out.push_back(0xb9); // mov ecx, 9
+		emit32(out, sizeof(TraceRecord) / 4);
+		out.push_back(0xfc); // cld (restored by popfd)
+		out.insert(out.end(), {0xf3, 0xa5}); // rep movsd
+		out.insert(out.end(), {0xff, 0x05}); // inc dword [head]
+		emit32(out, head);
+		out.push_back(0x61); // popad
+	}
+	out.push_back(0x9d); // popfd
+
+	size_t consumed;
+	if (!relocateInstructions(code, code_length, address, trampoline, TRACE_JUMP_LENGTH, out, consumed)) { return false; }
+	out.push_back(0xe9); // jmp back, never reached after a relocated call
+	emit32(out, (address + consumed) - (trampoline + out.size() + 4));
+	if (out.size() > TRACE_CODE_SIZE) { return false; }
+
+	/* Jump to the trampoline, pad whatever is left of the last relocated instruction */
+	std::vector<BYTE> patch(consumed, 0x90);
+	patch[0] = 0xe9;
+	uint32_t displacement = trampoline - (address + TRACE_JUMP_LENGTH);
+	std::memcpy(&patch[1], &displacement, sizeof(displacement));
+
+	saved_code.assign(code, code + consumed);
+	if (!memory->write(trampoline, out.data(), out.size())) { return false; }
+	if (!memory->write(address, patch.data(), patch.size())) { return false; }
+	installed = true;
+	return true;
+}
+
+void Tracepoint::remove()
+{
+	if (!installed) { return; }
+	memory->write(address, saved_code.data(), saved_code.size());
+	installed = false;
+}
+
+ADDR Tracepoint::getAddress() { return address; }
+
+size_t Tracepoint::getLength() { return saved_code.size(); }
+
+bool Tracepoint::logsRegisters() { return log_registers; }
+
+bool Tracepoint::readHits(uint32_t &hits) { return memory->read(data_address, &hits, sizeof(hits)); }
+
+bool Tracepoint::readRecords(std::vector<TraceRecord> &records) // Oldest first, at most TRACE_RING_ENTRIES
+{
+	records.clear();
+	if (!log_registers) { return true; }
+
+	uint32_t head;
+	std::vector<TraceRecord> ring(TRACE_RING_ENTRIES);
+	if (!memory->read(data_address + 4, &head, sizeof(head))) { return false; }
+	if (!memory->read(data_address + TRACE_HEADER_SIZE, ring.data(), ring.size() * sizeof(TraceRecord))) { return false; }
+
+	uint32_t count = head < TRACE_RING_ENTRIES ? head : TRACE_RING_ENTRIES;
+	for (uint32_t i = head - count; i != head; i++)
+	{
+		TraceRecord record = ring[i & (TRACE_RING_ENTRIES - 1)];
+		record.esp += 4; // pushad saw the stack after pushfd
+		records.push_back(record);
+	}
+	return true;
+}
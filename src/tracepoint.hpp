@@ -0,0 +1,49 @@
+/*
+* FreeDBG - Tracepoint Class (Header)
+*/
+
+#ifndef FREEDBG_TRACEPOINT
+#define FREEDBG_TRACEPOINT
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // BYTE, ADDR
+#include "memcache.hpp" // MemoryCache
+
+#define TRACE_RING_ENTRIES 256 // Power of two
+#define TRACE_JUMP_LENGTH 5 // jmp rel32
+
+
+struct TraceRecord { // Layout pushed by 'pushad' + 'pushfd' in the trampoline
+	uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax, eflags;
+};
+
+
+/* A tracepoint replaces the instruction(s) at its address with a jump to a trampoline
+* in debugee memory. The trampoline bumps a hit counter (and optionally copies the
+* registers into a ring buffer), runs the relocated instructions and jumps back, so a
+* hit never stops the debugee. Counter and ring are read in bulk whenever asked. */
+class Tracepoint {
+private:
+	MemoryCache *memory;
+	ADDR address;
+	bool log_registers;
+	std::vector<BYTE> saved_code; // Original bytes under the jump
+	ADDR data_address = 0; // Hit counter, ring head, then ring entries
+	bool installed = false;
+
+public:
+	Tracepoint(MemoryCache &mem, ADDR addr, bool log_regs);
+	static size_t areaSize(bool log_regs);
+	bool install(const BYTE *code, size_t code_length, ADDR area);
+	void remove();
+	ADDR getAddress();
+	size_t getLength();
+	bool logsRegisters();
+	bool readHits(uint32_t &hits);
+	bool readRecords(std::vector<TraceRecord> &records);
+};
+
+
+#endif // FREEDBG_TRACEPOINT
@@ -0,0 +1,129 @@
+/*
+* FreeDBG - Trace File Reader
+*
+* Offline companion to the 'record' command: prints, searches and seeks
+* through a trace file without a debugee.
+*/
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include "logging.hpp" // logError, logMsg
+#include "tracefile.hpp" // TraceReader, TraceDecoder, TraceStep
+
+
+static const char *HELP[] = {
+	"Usage: ./freedbg-trace FILE [COMMAND]",
+	"",
+	"Commands:",
+	"\tinfo                      Show step and chunk counts (Default)",
+	"\tdump [FIRST [COUNT]]      Print COUNT steps from step FIRST, with the registers each one changed (Default: all)",
+	"\tfind ADDR                 List every step that executed the instruction at ADDR (hex)",
+	"\tregs STEP                 Print the complete register state before step STEP",
+	0
+};
+
+static const char *REGISTER_NAMES[TRACE_REGISTERS] = {"eax", "ebx", "ecx", "edx", "esi", "edi", "ebp", "esp", "eflags"};
+
+
+/* Calls visit(number, step, previous, first_in_chunk) for steps [first, first + count), decoding only the
+* chunks involved. visit returns false to stop early. */
+template <typename Visitor>
+static bool walkSteps(TraceReader &reader, uint64_t first, uint64_t count, Visitor visit)
+{
+	std::vector<BYTE> raw;
+	uint64_t last = count > reader.stepCount() - first ? reader.stepCount() : first + count;
+	for (size_t chunk = reader.findChunk(first); chunk < reader.chunkCount() && reader.chunkFirstStep(chunk) < last; chunk++)
+	{
+		uint32_t steps;
+		if (!reader.readChunk(chunk, raw, steps))
+		{
+			logError("Chunk %zu is corrupt", chunk);
+			return false;
+		}
+		TraceDecoder decoder(raw.data(), raw.size());
+		TraceStep step, previous;
+		std::memset(&previous, 0, sizeof(previous));
+		uint64_t number = reader.chunkFirstStep(chunk);
+		for (uint32_t i = 0; i < steps && number < last && decoder.next(step); i++, number++)
+		{
+			if (number >= first && !visit(number, step, previous, i == 0)) { return true; }
+			previous = step;
+		}
+	}
+	return true;
+}
+
+
+int main(int argc, char **argv)
+{
+	if (argc < 2 || !strcmp(argv[1], "-h") || !strcmp(argv[1], "--help"))
+	{
+		for (int i = 0; HELP[i]; i++) { fprintf(stderr, "%s\n", HELP[i]); }
+		return 1;
+	}
+
+	TraceReader reader;
+	if (!reader.open(argv[1])) { return 1; }
+	const char *command = argc > 2 ? argv[2] : "info";
+
+	if (!strcmp(command, "info"))
+	{
+		printf("Steps:  %llu\n", (unsigned long long)reader.stepCount());
+		printf("Chunks: %zu\n", reader.chunkCount());
+		printf("Size:   %llu bytes (%.2f per step)\n", (unsigned long long)reader.fileSize(),
+			reader.stepCount() ? (double)reader.fileSize() / reader.stepCount() : 0.0);
+	}
+	else if (!strcmp(command, "dump"))
+	{
+		uint64_t first = argc > 3 ? strtoull(argv[3], NULL, 0) : 0;
+		uint64_t count = argc > 4 ? strtoull(argv[4], NULL, 0) : UINT64_MAX;
+		if (first >= reader.stepCount()) { return 0; }
+		walkSteps(reader, first, count, [](uint64_t number, const TraceStep &step, const TraceStep &previous, bool keyframe) {
+			printf("%10llu  0x%08X ", (unsigned long long)number, step.eip);
+			for (int i = 0; i < TRACE_REGISTERS; i++)
+			{
+				if (keyframe || step.regs[i] != previous.regs[i]) { printf(" %s=0x%X", REGISTER_NAMES[i], step.regs[i]); }
+			}
+			putchar('\n');
+			return true;
+		});
+	}
+	else if (!strcmp(command, "find") && argc > 3)
+	{
+		uint32_t address = strtoul(argv[3], NULL, 16);
+		uint64_t hits = 0;
+		walkSteps(reader, 0, UINT64_MAX, [&](uint64_t number, const TraceStep &step, const TraceStep &, bool) {
+			if (step.eip == address)
+			{
+				printf("%llu\n", (unsigned long long)number);
+				hits++;
+			}
+			return true;
+		});
+		logMsg("0x%X executed %llu time(s)", address, (unsigned long long)hits);
+	}
+	else if (!strcmp(command, "regs") && argc > 3)
+	{
+		uint64_t wanted = strtoull(argv[3], NULL, 0);
+		if (wanted >= reader.stepCount())
+		{
+			logError("Trace only has %llu steps", (unsigned long long)reader.stepCount());
+			return 1;
+		}
+		walkSteps(reader, wanted, 1, [](uint64_t number, const TraceStep &step, const TraceStep &, bool) {
+			printf("Step %llu\neip    = 0x%08X\n", (unsigned long long)number, step.eip);
+			for (int i = 0; i < TRACE_REGISTERS; i++) { printf("%-6s = 0x%08X\n", REGISTER_NAMES[i], step.regs[i]); }
+			return false;
+		});
+	}
+	else
+	{
+		logError("Unknown command '%s', try './freedbg-trace --help'", command);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,23 @@
+/*
+* FreeDBG - Common Types (Header)
+*/
+
+#ifndef FREEDBG_TYPES
+#define FREEDBG_TYPES
+
+#include <cstdint>
+
+#define BYTE uint8_t
+
+#if defined(__LP64__)
+typedef uint32_t WORD;
+typedef uint64_t DWORD;
+#else
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+#endif // (__LP64__)
+
+typedef DWORD ADDR;
+
+
+#endif // FREEDBG_TYPES
@@ -0,0 +1,349 @@
+/*
+* FreeDBG - Stack Unwinder
+*
+* TODO:
+*	- Load .eh_frame of shared libraries too, only the executable's is used for now
+*/
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <machine/reg.h>
+#include "unwinder.hpp" // Unwinder, CommonInformationEntry, FrameDescription
+#include "dwarfreader.hpp" // DwarfReader
+#include "memcache.hpp" // MemoryCache
+#include "symbols.hpp" // SymbolTable
+
+
+enum CFI_REGISTER { CFI_EAX, CFI_ECX, CFI_EDX, CFI_EBX, CFI_ESP, CFI_EBP, CFI_ESI, CFI_EDI, CFI_EIP };
+
+enum CFI_RULE { RULE_SAME, RULE_UNDEFINED, RULE_OFFSET, RULE_VAL_OFFSET, RULE_REGISTER };
+
+struct CFIRule {
+	int type;
+	int64_t value;
+};
+
+struct CFIRow {
+	uint64_t cfa_register;
+	int64_t cfa_offset;
+	bool cfa_expression; // Not evaluated, a frame needing one can't be unwound
+	CFIRule rules[CFI_REGISTERS];
+};
+
+
+static uint64_t readEncoded(DwarfReader &r, int encoding, ADDR field_address) // .eh_frame pointer encodings (DW_EH_PE_*)
+{
+	if (encoding == 0xff) { return 0; } // omit
+	uint64_t value;
+	switch (encoding & 0x0f)
+	{
+		case 0x00: value = r.u32(); break; // absptr, 32-bit targets only
+		case 0x01: value = r.uleb(); break;
+		case 0x02: value = r.u16(); break;
+		case 0x03: value = r.u32(); break;
+		case 0x04: value = r.u64(); break;
+		case 0x09: value = r.sleb(); break;
+		case 0x0a: value = (int16_t)r.u16(); break;
+		case 0x0b: value = (int32_t)r.u32(); break;
+		case 0x0c: value = r.u64(); break;
+		default: r.ok = false; return 0;
+	}
+	if ((encoding & 0x70) == 0x10) { value += field_address; } // pcrel, the only application eh_frame uses for code addresses
+	return value;
+}
+
+/* Executes call frame instructions until the row covering 'target' is reached. 'initial' is the
+* row after the CIE's instructions, for DW_CFA_restore. Notes whether the CFA ever moves to ebp. */
+static bool runProgram(const BYTE *start, const BYTE *end, const CommonInformationEntry &cie, uint64_t location, uint64_t target,
+	CFIRow &row, const CFIRow &initial, bool *frame_pointer)
+{
+	std::vector<CFIRow> remembered;
+	DwarfReader r(start, end);
+	auto setRule = [&](uint64_t reg, int type, int64_t value) {
+		if (reg < CFI_REGISTERS) { row.rules[reg] = {type, value}; }
+	};
+	auto advance = [&](uint64_t delta) {
+		location += delta * cie.code_alignment;
+		return location <= target;
+	};
+
+	while (r.ok && r.cursor < r.end)
+	{
+		BYTE opcode = r.u8();
+		BYTE operand = opcode & 0x3f;
+		switch (opcode & 0xc0)
+		{
+			case 0x40: if (!advance(operand)) { return true; } continue; // advance_loc
+			case 0x80: setRule(operand, RULE_OFFSET, r.uleb() * cie.data_alignment); continue; // offset
+			case 0xc0: if (operand < CFI_REGISTERS) { row.rules[operand] = initial.rules[operand]; } continue; // restore
+		}
+
+		uint64_t reg;
+		switch (opcode)
+		{
+			case 0x00: break; // nop
+			case 0x01: location = r.u32(); if (location > target) { return true; } break; // set_loc
+			case 0x02: if (!advance(r.u8())) { return true; } break; // advance_loc1
+			case 0x03: if (!advance(r.u16())) { return true; } break; // advance_loc2
+			case 0x04: if (!advance(r.u32())) { return true; } break; // advance_loc4
+			case 0x05: reg = r.uleb(); setRule(reg, RULE_OFFSET, r.uleb() * cie.data_alignment); break; // offset_extended
+			case 0x06: reg = r.uleb(); if (reg < CFI_REGISTERS) { row.rules[reg] = initial.rules[reg]; } break; // restore_extended
+			case 0x07: setRule(r.uleb(), RULE_UNDEFINED, 0); break; // undefined
+			case 0x08: setRule(r.uleb(), RULE_SAME, 0); break; // same_value
+			case 0x09: reg = r.uleb(); setRule(reg, RULE_REGISTER, r.uleb()); break; // register
+			case 0x0a: remembered.push_back(row); break; // remember_state
+			case 0x0b: // restore_state
+				if (remembered.empty()) { return false; }
+				row = remembered.back();
+				remembered.pop_back();
+				break;
+			case 0x0c: row.cfa_register = r.uleb(); row.cfa_offset = r.uleb(); row.cfa_expression = false; break; // def_cfa
+			case 0x0d: row.cfa_register = r.uleb(); row.cfa_expression = false; break; // def_cfa_register
+			case 0x0e: row.cfa_offset = r.uleb(); break; // def_cfa_offset
+			case 0x0f: r.skip(r.uleb()); row.cfa_expression = true; break; // def_cfa_expression
+			case 0x10: case 0x16: reg = r.uleb(); r.skip(r.uleb()); setRule(reg, RULE_UNDEFINED, 0); break; // expression, val_expression
+			case 0x11: reg = r.uleb(); setRule(reg, RULE_OFFSET, r.sleb() * cie.data_alignment); break; // offset_extended_sf
+			case 0x12: row.cfa_register = r.uleb(); row.cfa_offset = r.sleb() * cie.data_alignment; row.cfa_expression = false; break; // def_cfa_sf
+			case 0x13: row.cfa_offset = r.sleb() * cie.data_alignment; break; // def_cfa_offset_sf
+			case 0x14: reg = r.uleb(); setRule(reg, RULE_VAL_OFFSET, r.uleb() * cie.data_alignment); break; // val_offset
+			case 0x15: reg = r.uleb(); setRule(reg, RULE_VAL_OFFSET, r.sleb() * cie.data_alignment); break; // val_offset_sf
+			case 0x2e: r.uleb(); break; // GNU_args_size
+			case 0x2f: reg = r.uleb(); setRule(reg, RULE_OFFSET, -(int64_t)(r.uleb() * cie.data_alignment)); break; // GNU_negative_offset_extended
+			default: return false;
+		}
+		if (frame_pointer && row.cfa_register == CFI_EBP && !row.cfa_expression) { *frame_pointer = true; }
+	}
+	return r.ok;
+}
+
+
+/****************************
+* Unwinder Class Methods    *
+****************************/
+Unwinder::Unwinder(SymbolTable &symtab, MemoryCache &mem) : symbols(&symtab), memory(&mem) {}
+
+void Unwinder::parse() // Builds the sorted FDE table from .eh_frame, once
+{
+	parsed = true;
+	const BYTE *data;
+	size_t length;
+	ADDR section_address;
+	if (!symbols->getSection(".eh_frame", data, length, &section_address)) { return; }
+	const BYTE *section_end = data + length;
+	std::unordered_map<size_t,uint32_t> cie_offsets;
+
+	/* Entry header: length, then a CIE id of 0 or the distance back to the FDE's CIE */
+	auto entryBody = [&](const BYTE *entry, const BYTE *&body, const BYTE *&body_end, uint64_t &id, const BYTE *&id_field) {
+		DwarfReader r(entry, section_end);
+		uint64_t entry_length = r.u32();
+		size_t offset_size = 4;
+		if (entry_length == 0xffffffff)
+		{
+			entry_length = r.u64();
+			offset_size = 8;
+		}
+		if (!r.ok || entry_length == 0 || !r.has(entry_length)) { return false; }
+		body_end = r.cursor + entry_length;
+		id_field = r.cursor;
+		id = r.fixed(offset_size);
+		body = r.cursor;
+		return r.ok;
+	};
+
+	auto loadCIE = [&](size_t offset) -> int {
+		auto it = cie_offsets.find(offset);
+		if (it != cie_offsets.end()) { return it->second; }
+
+		const BYTE *body, *body_end, *id_field;
+		uint64_t id;
+		if (offset >= length || !entryBody(data + offset, body, body_end, id, id_field) || id != 0) { return -1; }
+
+		DwarfReader r(body, body_end);
+		CommonInformationEntry cie;
+		int version = r.u8();
+		const char *augmentation = r.cstr();
+		if (strstr(augmentation, "eh")) { r.u32(); } // Ancient GCC eh_ptr
+		cie.code_alignment = r.uleb();
+		cie.data_alignment = r.sleb();
+		cie.return_register = version == 1 ? r.u8() : r.uleb();
+		cie.pointer_encoding = 0;
+		cie.has_augmentation_data = augmentation[0] == 'z';
+		if (cie.has_augmentation_data)
+		{
+			uint64_t augmentation_length = r.uleb();
+			const BYTE *augmentation_end = r.cursor + augmentation_length;
+			for (const char *c = augmentation + 1; *c && r.ok; c++)
+			{
+				if (*c == 'R') { cie.pointer_encoding = r.u8(); }
+				else if (*c == 'L') { r.u8(); }
+				else if (*c == 'P')
+				{
+					int encoding = r.u8();
+					readEncoded(r, encoding & 0x7f, section_address + (r.cursor - data));
+				}
+				else if (*c != 'S' && *c != 'B') { break; }
+			}
+			if (augmentation_end > body_end) { return -1; }
+			r.cursor = augmentation_end;
+		}
+		if (!r.ok) { return -1; }
+		cie.instructions = r.cursor;
+		cie.instructions_end = body_end;
+		cies.push_back(cie);
+		cie_offsets[offset] = cies.size() - 1;
+		return cies.size() - 1;
+	};
+
+	const BYTE *entry = data;
+	while (entry + 4 <= section_end)
+	{
+		const BYTE *body, *body_end, *id_field;
+		uint64_t id;
+		if (!entryBody(entry, body, body_end, id, id_field)) { break; }
+		if (id != 0) // FDE
+		{
+			int cie_index = loadCIE((id_field - data) - id);
+			if (cie_index >= 0)
+			{
+				const CommonInformationEntry &cie = cies[cie_index];
+				DwarfReader r(body, body_end);
+				FrameDescription fde;
+				fde.begin = readEncoded(r, cie.pointer_encoding, section_address + (r.cursor - data));
+				fde.end = fde.begin + readEncoded(r, cie.pointer_encoding & 0x0f, 0);
+				if (cie.has_augmentation_data) { r.skip(r.uleb()); }
+				fde.cie = cie_index;
+				fde.instructions = r.cursor;
+				fde.instructions_end = body_end;
+
+				/* Run the whole program once now, so the unwinder knows which functions keep a frame pointer */
+				CFIRow row = {CFI_ESP, 4, false, {}};
+				fde.frame_pointer = false;
+				bool valid = runProgram(cie.instructions, cie.instructions_end, cie, fde.begin, UINT64_MAX, row, row, &fde.frame_pointer);
+				CFIRow initial = row;
+				valid = valid && runProgram(fde.instructions, fde.instructions_end, cie, fde.begin, UINT64_MAX, row, initial, &fde.frame_pointer);
+				if (valid && r.ok && fde.begin != 0 && fde.end > fde.begin) { fdes.push_back(fde); }
+			}
+		}
+		entry = body_end;
+	}
+
+	std::sort(fdes.begin(), fdes.end(), [](const FrameDescription &a, const FrameDescription &b) { return a.begin < b.begin; });
+}
+
+const FrameDescription *Unwinder::findFrame(ADDR pc)
+{
+	auto it = std::upper_bound(fdes.begin(), fdes.end(), pc, [](ADDR value, const FrameDescription &fde) { return value < fde.begin; });
+	if (it == fdes.begin() || pc >= (it - 1)->end) { return nullptr; }
+	return &*(it - 1);
+}
+
+bool Unwinder::readStack(ADDR address, DWORD &value)
+{
+	if (window && address >= window_base && address - window_base + sizeof(DWORD) <= window_length)
+	{
+		std::memcpy(&value, window + (address - window_base), sizeof(DWORD));
+		return true;
+	}
+	if (window_only)
+	{
+		if (address >= window_base + window_length) { window_missed = true; }
+		return false;
+	}
+	return memory->read(address, &value, sizeof(DWORD));
+}
+
+bool Unwinder::stepCFI(const FrameDescription &fde, ADDR pc, DWORD *regs, uint32_t &valid) // pc as linked
+{
+	const CommonInformationEntry &cie = cies[fde.cie];
+	CFIRow row = {CFI_ESP, 4, false, {}};
+	if (!runProgram(cie.instructions, cie.instructions_end, cie, fde.begin, UINT64_MAX, row, row, nullptr)) { return false; }
+	CFIRow initial = row;
+	if (!runProgram(fde.instructions, fde.instructions_end, cie, fde.begin, pc, row, initial, nullptr)) { return false; }
+	if (row.cfa_expression || row.cfa_register >= CFI_EIP || !(valid & (1u << row.cfa_register))) { return false; }
+
+	DWORD cfa = regs[row.cfa_register] + row.cfa_offset;
+	DWORD caller[CFI_REGISTERS];
+	uint32_t caller_valid = 0;
+	for (int i = 0; i < CFI_REGISTERS; i++)
+	{
+		const CFIRule &rule = row.rules[i];
+		bool known = false;
+		switch (rule.type)
+		{
+			case RULE_SAME: caller[i] = regs[i]; known = (valid >> i) & 1; break;
+			case RULE_OFFSET: known = readStack(cfa + rule.value, caller[i]); break;
+			case RULE_VAL_OFFSET: caller[i] = cfa + rule.value; known = true; break;
+			case RULE_REGISTER:
+				known = rule.value < CFI_REGISTERS && ((valid >> rule.value) & 1);
+				if (known) { caller[i] = regs[rule.value]; }
+				break;
+		}
+		if (known) { caller_valid |= 1u << i; }
+	}
+	caller[CFI_ESP] = cfa; // The CFA is by definition the caller's stack pointer before the call
+	caller_valid |= 1u << CFI_ESP;
+	if (cie.return_register >= CFI_REGISTERS || !(caller_valid & (1u << cie.return_register))) { return false; }
+	caller[CFI_EIP] = caller[cie.return_register];
+
+	std::memcpy(regs, caller, sizeof(caller));
+	valid = caller_valid | (1u << CFI_EIP);
+	return true;
+}
+
+void Unwinder::setWindow(ADDR base, const BYTE *data, size_t length) // Bulk copy of the stack, checked before the page cache
+{
+	window_base = base;
+	window = data;
+	window_length = length;
+}
+
+size_t Unwinder::unwind(const struct reg &state, std::vector<ADDR> &frames, size_t max_depth, bool only_window) // Innermost first
+{
+	if (!parsed) { parse(); }
+	window_only = only_window;
+	window_missed = false;
+
+	DWORD regs[CFI_REGISTERS] = {(DWORD)state.r_eax, (DWORD)state.r_ecx, (DWORD)state.r_edx, (DWORD)state.r_ebx,
+		(DWORD)state.r_esp, (DWORD)state.r_ebp, (DWORD)state.r_esi, (DWORD)state.r_edi, (DWORD)state.r_eip};
+	uint32_t valid = (1u << CFI_REGISTERS) - 1;
+	ADDR bias = symbols->getBias();
+	frames.clear();
+	frames.push_back(regs[CFI_EIP]);
+
+	while (frames.size() < max_depth)
+	{
+		ADDR pc = frames.size() == 1 ? regs[CFI_EIP] : regs[CFI_EIP] - 1; // A return address may lie past a noreturn call's function
+		const FrameDescription *fde = findFrame(pc - bias);
+		DWORD previous_esp = regs[CFI_ESP];
+		auto stepFramePointer = [&]() { // [ebp] = caller's ebp, [ebp+4] = return address, caller's esp = ebp+8
+			DWORD ebp = regs[CFI_EBP], saved_ebp, return_address;
+			if (!(valid & (1u << CFI_EBP)) || ebp < regs[CFI_ESP] || (ebp & 3)) { return false; }
+			if (!readStack(ebp, saved_ebp) || !readStack(ebp + 4, return_address)) { return false; }
+			regs[CFI_ESP] = ebp + 8;
+			regs[CFI_EBP] = saved_ebp;
+			regs[CFI_EIP] = return_address;
+			valid = (1u << CFI_ESP) | (1u << CFI_EBP) | (1u << CFI_EIP); // Scratch and callee-saved registers are unknown now
+			return true;
+		};
+
+		bool frame_pointer_first = frames.size() > 1 && (!fde || fde->frame_pointer);
+		bool stepped = frame_pointer_first && stepFramePointer();
+		if (!stepped && fde) { stepped = stepCFI(*fde, pc - bias, regs, valid); }
+		if (!stepped && !frame_pointer_first) { stepped = stepFramePointer(); }
+
+		if (!stepped || regs[CFI_EIP] < 0x1000 || regs[CFI_ESP] <= previous_esp) { break; } // Past the outermost frame (argc, null page) or not moving up the stack
+		frames.push_back(regs[CFI_EIP]);
+	}
+	return frames.size();
+}
+
+bool Unwinder::leftWindow() { return window_missed; }
+
+size_t Unwinder::tableSize()
+{
+	if (!parsed) { parse(); }
+	return fdes.size();
+}
@@ -0,0 +1,73 @@
+/*
+* FreeDBG - Stack Unwinder (Header)
+*/
+
+#ifndef FREEDBG_UNWINDER
+#define FREEDBG_UNWINDER
+
+#include <machine/reg.h>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // BYTE, DWORD, ADDR
+#include "memcache.hpp" // MemoryCache
+#include "symbols.hpp" // SymbolTable
+
+
+#define CFI_REGISTERS 9 // i386 DWARF numbering: eax ecx edx ebx esp ebp esi edi, eip is the return column
+
+
+struct CommonInformationEntry {
+	uint64_t code_alignment;
+	int64_t data_alignment;
+	uint64_t return_register;
+	int pointer_encoding; // FDE pc_begin/pc_range encoding, from the 'R' augmentation
+	bool has_augmentation_data; // 'z', FDEs carry an augmentation length to skip
+	const BYTE *instructions;
+	const BYTE *instructions_end;
+};
+
+struct FrameDescription {
+	ADDR begin; // As linked
+	ADDR end;
+	uint32_t cie;
+	bool frame_pointer; // Body sets CFA to ebp+8, so a plain frame pointer step is exact past the prologue
+	const BYTE *instructions;
+	const BYTE *instructions_end;
+};
+
+
+/* Produces the return address chain of a stopped debugee. Past the first frame
+* every pc sits at a call site, where a function that keeps a frame pointer is
+* unwound by two loads from [ebp]; CFI from .eh_frame is only interpreted for
+* the innermost frame (which may be mid-prologue), functions built without a
+* frame pointer, and when the chain stops looking like a stack. The FDE table is
+* parsed once per binary, sorted, and binary searched per frame. Stack reads come
+* from a caller supplied window (one bulk read) or the page cache. */
+class Unwinder {
+private:
+	SymbolTable *symbols;
+	MemoryCache *memory;
+	bool parsed = false;
+	std::vector<CommonInformationEntry> cies;
+	std::vector<FrameDescription> fdes; // Sorted by begin
+	ADDR window_base = 0;
+	const BYTE *window = nullptr;
+	size_t window_length = 0;
+	bool window_only = false;
+	bool window_missed = false; // A window only unwind wanted memory past the window's end
+	void parse();
+	const FrameDescription *findFrame(ADDR pc);
+	bool readStack(ADDR address, DWORD &value);
+	bool stepCFI(const FrameDescription &fde, ADDR pc, DWORD *regs, uint32_t &valid);
+
+public:
+	Unwinder(SymbolTable &symtab, MemoryCache &mem);
+	void setWindow(ADDR base, const BYTE *data, size_t length);
+	size_t unwind(const struct reg &regs, std::vector<ADDR> &frames, size_t max_depth, bool only_window = false);
+	bool leftWindow();
+	size_t tableSize();
+};
+
+
+#endif // FREEDBG_UNWINDER
@@ -0,0 +1,56 @@
+/*
+* FreeDBG - Watchpoint Class
+*/
+
+#include <vector>
+#include <algorithm>
+#include "watchpoint.hpp" // Watchpoint, WATCH_ACCESS
+#include "debugregs.hpp" // DebugRegisters, DR_ACCESS, DEBUG_SLOTS
+
+
+Watchpoint::Watchpoint(ADDR addr, size_t len, int acc) : address(addr), length(len), access(acc), last_value(len) {}
+
+ADDR Watchpoint::getAddress() { return address; }
+
+size_t Watchpoint::getLength() { return length; }
+
+int Watchpoint::getAccess() { return access; }
+
+bool Watchpoint::isHardware() { return debug_registers != NULL; }
+
+bool Watchpoint::armHardware(DebugRegisters &dbregs)
+{
+	/* Split into the largest naturally aligned pieces the debug registers can take */
+	std::vector<std::pair<ADDR,size_t>> pieces;
+	ADDR cursor = address;
+	ADDR end = address + length;
+	while (cursor < end && pieces.size() <= DEBUG_SLOTS)
+	{
+		size_t size = 4;
+		while ((cursor & (size - 1)) || cursor + size > end) { size >>= 1; }
+		pieces.emplace_back(cursor, size);
+		cursor += size;
+	}
+	if (pieces.size() > (size_t)dbregs.freeSlots()) { return false; }
+
+	/* x86 has no read-only data breakpoints, reads are caught as read/write */
+	int dr_access = (access == WATCH_WRITE) ? DR_WRITE : DR_READWRITE;
+	for (auto &piece: pieces)
+	{
+		slots.push_back(dbregs.allocate(piece.first, dr_access, piece.second));
+	}
+	debug_registers = &dbregs;
+	return true;
+}
+
+void Watchpoint::disarm()
+{
+	if (debug_registers == NULL) { return; }
+	for (int slot: slots) { debug_registers->release(slot); }
+	slots.clear();
+	debug_registers = NULL;
+}
+
+bool Watchpoint::ownsSlot(int slot) { return std::find(slots.begin(), slots.end(), slot) != slots.end(); }
+
+std::vector<BYTE> &Watchpoint::value() { return last_value; }
@@ -0,0 +1,46 @@
+/*
+* FreeDBG - Watchpoint Class (Header)
+*/
+
+#ifndef FREEDBG_WATCHPOINT
+#define FREEDBG_WATCHPOINT
+
+#include <vector>
+#include <cstddef>
+#include "types.hpp" // BYTE, ADDR
+#include "debugregs.hpp" // DebugRegisters
+
+
+enum WATCH_ACCESS {
+    WATCH_READ = 1 << 0,
+    WATCH_WRITE = 1 << 1,
+    WATCH_READWRITE = WATCH_READ | WATCH_WRITE
+};
+
+
+/* A watched memory region. Small regions are covered by debug registers (split into
+* naturally aligned 1/2/4 byte pieces); anything that doesn't fit in the free slots is
+* left to the Debugger to watch through page protections. */
+class Watchpoint {
+private:
+	ADDR address;
+	size_t length;
+	int access;
+	DebugRegisters *debug_registers = NULL;
+	std::vector<int> slots;
+	std::vector<BYTE> last_value;
+
+public:
+	Watchpoint(ADDR addr, size_t len, int acc);
+	ADDR getAddress();
+	size_t getLength();
+	int getAccess();
+	bool isHardware();
+	bool armHardware(DebugRegisters &dbregs);
+	void disarm();
+	bool ownsSlot(int slot);
+	std::vector<BYTE> &value();
+};
+
+
+#endif // FREEDBG_WATCHPOINT
@@ -0,0 +1,258 @@
+/*
+* FreeDBG - x86 Instruction Length Decoder
+*
+* Only 32-bit (protected mode) encodings are handled, which is all FreeDBG debugs.
+*/
+
+#include <cstdint>
+#include <cstddef>
+#include "x86decode.hpp" // X86Instruction, X86Flow
+
+
+/* Per-opcode attributes */
+#define M   0x01 // ModRM byte follows
+#define I8  0x02 // 8-bit immediate
+#define IZ  0x04 // 16/32-bit immediate, depending on operand size
+#define I16 0x08 // 16-bit immediate
+#define IA  0x10 // Address sized immediate (moffs)
+#define IP  0x20 // Far pointer (16:16 or 16:32)
+#define PF  0x40 // Prefix
+#define XX  0x80 // Invalid/unsupported
+
+static const uint8_t ONE_BYTE[256] = {
+	/*        0      1      2      3      4      5      6      7      8      9      A      B      C      D      E      F  */
+	/* 0 */   M,     M,     M,     M,     I8,    IZ,    0,     0,     M,     M,     M,     M,     I8,    IZ,    0,     0,
+	/* 1 */   M,     M,     M,     M,     I8,    IZ,    0,     0,     M,     M,     M,     M,     I8,    IZ,    0,     0,
+	/* 2 */   M,     M,     M,     M,     I8,    IZ,    PF,    0,     M,     M,     M,     M,     I8,    IZ,    PF,    0,
+	/* 3 */   M,     M,     M,     M,     I8,    IZ,    PF,    0,     M,     M,     M,     M,     I8,    IZ,    PF,    0,
+	/* 4 */   0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+	/* 5 */   0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+	/* 6 */   0,     0,     M,     M,     PF,    PF,    PF,    PF,    IZ,    M|IZ,  I8,    M|I8,  0,     0,     0,     0,
+	/* 7 */   I8,    I8,    I8,    I8,    I8,    I8,    I8,    I8,    I8,    I8,    I8,    I8,    I8,    I8,    I8,    I8,
+	/* 8 */   M|I8,  M|IZ,  M|I8,  M|I8,  M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+	/* 9 */   0,     0,     0,     0,     0,     0,     0,     0,     0,     0,     IP,    0,     0,     0,     0,     0,
+	/* A */   IA,    IA,    IA,    IA,    0,     0,     0,     0,     I8,    IZ,    0,     0,     0,     0,     0,     0,
+	/* B */   I8,    I8,    I8,    I8,    I8,    I8,    I8,    I8,    IZ,    IZ,    IZ,    IZ,    IZ,    IZ,    IZ,    IZ,
+	/* C */   M|I8,  M|I8,  I16,   0,     M,     M,     M|I8,  M|IZ,  I16|I8,0,     I16,   0,     0,     I8,    0,     0,
+	/* D */   M,     M,     M,     M,     I8,    I8,    0,     0,     M,     M,     M,     M,     M,     M,     M,     M,
+	/* E */   I8,    I8,    I8,    I8,    I8,    I8,    I8,    I8,    IZ,    IZ,    IP,    I8,    0,     0,     0,     0,
+	/* F */   PF,    0,     PF,    PF,    0,     0,     M,     M,     0,     0,     0,     0,     0,     0,     M,     M
+};
+
+static const uint8_t TWO_BYTE[256] = { // 0F xx
+	/*        0      1      2      3      4      5      6      7      8      9      A      B      C      D      E      F  */
+	/* 0 */   M,     M,     M,     M,     XX,    0,     0,     0,     0,     0,     XX,    0,     XX,    M,     0,     M|I8,
+	/* 1 */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+	/* 2 */   M,     M,     M,     M,     XX,    XX,    XX,    XX,    M,     M,     M,     M,     M,     M,     M,     M,
+	/* 3 */   0,     0,     0,     0,     0,     0,     XX,    0,     XX,    XX,    XX,    XX,    XX,    XX,    XX,    XX,
+	/* 4 */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+	/* 5 */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+	/* 6 */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+	/* 7 */   M|I8,  M|I8,  M|I8,  M|I8,  M,     M,     M,     0,     M,     M,     XX,    XX,    M,     M,     M,     M,
+	/* 8 */   IZ,    IZ,    IZ,    IZ,    IZ,    IZ,    IZ,    IZ,    IZ,    IZ,    IZ,    IZ,    IZ,    IZ,    IZ,    IZ,
+	/* 9 */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+	/* A */   0,     0,     0,     M,     M|I8,  M,     XX,    XX,    0,     0,     0,     M,     M|I8,  M,     M,     M,
+	/* B */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M|I8,  M,     M,     M,     M,     M,
+	/* C */   M,     M,     M|I8,  M,     M|I8,  M|I8,  M|I8,  M,     0,     0,     0,     0,     0,     0,     0,     0,
+	/* D */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+	/* E */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,
+	/* F */   M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M,     M
+};
+
+
+/* Size of ModRM + SIB + displacement, or 0 if truncated */
+static size_t modrmLength(const BYTE *code, size_t size, bool addr16)
+{
+	if (size < 1) { return 0; }
+	BYTE modrm = code[0];
+	BYTE mod = modrm >> 6;
+	BYTE rm = modrm & 7;
+	size_t length = 1;
+
+	if (mod == 3) { return length; }
+
+	if (addr16)
+	{
+		if (mod == 0 && rm == 6) { length += 2; }
+		else if (mod == 1) { length += 1; }
+		else if (mod == 2) { length += 2; }
+	}
+	else
+	{
+		if (rm == 4) // SIB byte
+		{
+			if (size < 2) { return 0; }
+			length += 1;
+			if (mod == 0 && (code[1] & 7) == 5) { length += 4; }
+		}
+		if (mod == 0 && rm == 5) { length += 4; }
+		else if (mod == 1) { length += 1; }
+		else if (mod == 2) { length += 4; }
+	}
+	return length <= size ? length : 0;
+}
+
+static int32_t readDisplacement(const BYTE *code, size_t size)
+{
+	if (size == 1) { return static_cast<int8_t>(code[0]); }
+	if (size == 2) { return static_cast<int16_t>(code[0] | (code[1] << 8)); }
+	return static_cast<int32_t>(code[0] | (code[1] << 8) | (code[2] << 16) | ((uint32_t)code[3] << 24));
+}
+
+/* Upper bound on the bytes one memory access of the instruction covers (one element of a string
+* instruction). Memory operands of vector instructions are taken to be as wide as the vector. */
+static size_t accessSize(int map, BYTE opcode, BYTE modrm_reg, bool opsize16, size_t vector_size)
+{
+	size_t word = opsize16 ? 2 : 4;
+	if (vector_size) { return vector_size; }
+	if (map == 1)
+	{
+		if (opcode < 0x40 && (opcode & 7) < 4) { return (opcode & 1) ? word : 1; } // ALU r/m forms
+		switch (opcode)
+		{
+			case 0x80: case 0x82: case 0x84: case 0x86: case 0x88: case 0x8a: case 0xa0: case 0xa2: case 0xa4: case 0xa6:
+			case 0xaa: case 0xac: case 0xae: case 0xc0: case 0xc6: case 0xd0: case 0xd2: case 0xd7: case 0xf6: case 0xfe:
+				return 1;
+			case 0x8c: case 0x8e: case 0xde: return 2;
+			case 0xd8: case 0xda: return 4;
+			case 0xdc: return 8;
+			case 0x60: case 0x61: return word * 8; // pusha/popa
+			case 0x62: return word * 2; // bound
+			case 0x9a: case 0xc4: case 0xc5: return word + 2; // Far pointers
+			case 0xff: return (modrm_reg == 3 || modrm_reg == 5) ? word + 2 : word;
+			case 0xd9: return (modrm_reg == 4 || modrm_reg == 6) ? 28 : 4; // fldenv/fnstenv
+			case 0xdb: return (modrm_reg == 5 || modrm_reg == 7) ? 10 : 4;
+			case 0xdd: return (modrm_reg == 4 || modrm_reg == 6) ? 108 : (modrm_reg == 7) ? 2 : 8; // frstor/fnsave
+			case 0xdf: return (modrm_reg >= 4) ? ((modrm_reg & 1) ? 8 : 10) : 2;
+			default: return word;
+		}
+	}
+	if (map == 2)
+	{
+		if (opcode == 0xb6 || opcode == 0xbe || opcode == 0xb0 || opcode == 0xc0 || (opcode >= 0x90 && opcode <= 0x9f)) { return 1; }
+		if (opcode == 0xb7 || opcode == 0xbf || opcode == 0x00) { return 2; }
+		if (opcode == 0x01) { return 6; } // Descriptor table registers
+		if (opcode == 0xc7) { return 8; } // cmpxchg8b
+		if (opcode == 0xae) { return 512; } // fxsave/fxrstor, xsave's area can be larger
+		if ((opcode >= 0x10 && opcode <= 0x17) || (opcode >= 0x28 && opcode <= 0x2f) || (opcode >= 0x50 && opcode <= 0x7f) ||
+			(opcode >= 0xc2 && opcode <= 0xc6) || opcode >= 0xd0) { return 16; } // SSE, the MMX forms are 8
+		return word;
+	}
+	return 16; // 0F 38 and 0F 3A are nearly all SSE
+}
+
+
+bool decodeInstruction(const BYTE *code, size_t size, X86Instruction &insn)
+{
+	insn = X86Instruction();
+	if (size > MAX_INSN_LENGTH) { size = MAX_INSN_LENGTH; }
+
+	bool opsize16 = false;
+	bool addr16 = false;
+	size_t pos = 0;
+
+	/* Legacy prefixes */
+	while (pos < size && (ONE_BYTE[code[pos]] & PF))
+	{
+		if (code[pos] == 0x66) { opsize16 = true; }
+		else if (code[pos] == 0x67) { addr16 = true; }
+		pos++;
+	}
+	if (pos >= size) { return false; }
+
+	BYTE opcode = code[pos++];
+	uint8_t attributes;
+	int map = 1; // 1: one byte, 2: 0F, 3: 0F 38, 4: 0F 3A
+	size_t vector_size = 0; // VEX and EVEX only
+
+	/* VEX (C4/C5) and EVEX (62) only exist in 32-bit mode when the would-be ModRM has mod == 3 */
+	if ((opcode == 0xc4 || opcode == 0xc5 || opcode == 0x62) && pos < size && (code[pos] >> 6) == 3)
+	{
+		size_t prefix_length = (opcode == 0xc5) ? 1 : (opcode == 0xc4) ? 2 : 3;
+		if (pos + prefix_length >= size) { return false; }
+		if (opcode == 0xc5) { map = 2; }
+		else if (opcode == 0xc4) { map = (code[pos] & 0x1f) + 1; }
+		else { map = (code[pos] & 0x7) + 1; }
+		if (opcode == 0xc5) { vector_size = (code[pos] & 0x4) ? 32 : 16; } // VEX.L
+		else if (opcode == 0xc4) { vector_size = (code[pos + 1] & 0x4) ? 32 : 16; }
+		else { vector_size = 16 << ((code[pos + 2] >> 5) & 3); } // EVEX.L'L
+		pos += prefix_length;
+		opcode = code[pos++];
+		if (map == 2) { attributes = (opcode == 0x77) ? 0 : ((TWO_BYTE[opcode] | M) & ~(IZ | XX)); } // vzeroupper/vzeroall have no ModRM
+		else if (map == 3) { attributes = M; }
+		else if (map == 4) { attributes = M | I8; }
+		else { return false; }
+	}
+	else if (opcode == 0x0f)
+	{
+		if (pos >= size) { return false; }
+		opcode = code[pos++];
+		map = 2;
+		if (opcode == 0x38 || opcode == 0x3a)
+		{
+			if (pos >= size) { return false; }
+			map = (opcode == 0x38) ? 3 : 4;
+			attributes = (map == 3) ? M : (M | I8);
+			opcode = code[pos++];
+		}
+		else { attributes = TWO_BYTE[opcode]; }
+	}
+	else { attributes = ONE_BYTE[opcode]; }
+
+	if (attributes & XX) { return false; }
+
+	/* ModRM, SIB and displacement */
+	BYTE modrm_reg = 0;
+	if (attributes & M)
+	{
+		if (pos >= size) { return false; }
+		modrm_reg = (code[pos] >> 3) & 7;
+		size_t length = modrmLength(code + pos, size - pos, addr16);
+		if (length == 0) { return false; }
+		pos += length;
+	}
+
+	/* Group 3 'test' is the only one-byte ModRM group with an immediate */
+	if (map == 1 && (opcode == 0xf6 || opcode == 0xf7) && modrm_reg < 2)
+	{
+		attributes |= (opcode == 0xf6) ? I8 : IZ;
+	}
+
+	/* Immediates */
+	size_t immediate_start = pos;
+	size_t immediate_size = 0;
+	if (attributes & I16) { immediate_size += 2; }
+	if (attributes & I8) { immediate_size += 1; }
+	if (attributes & IZ) { immediate_size += opsize16 ? 2 : 4; }
+	if (attributes & IA) { immediate_size += addr16 ? 2 : 4; }
+	if (attributes & IP) { immediate_size += opsize16 ? 4 : 6; }
+	pos += immediate_size;
+	if (pos > size) { return false; }
+
+	insn.length = pos;
+	insn.access_size = accessSize(map, opcode, modrm_reg, opsize16, vector_size);
+
+	/* Control flow */
+	if (map == 1)
+	{
+		if (opcode == 0xe8) { insn.flow = FLOW_CALL; insn.relative = true; }
+		else if (opcode == 0xe9 || opcode == 0xeb) { insn.flow = FLOW_JUMP; insn.relative = true; }
+		else if ((opcode >= 0x70 && opcode <= 0x7f) || (opcode >= 0xe0 && opcode <= 0xe3)) { insn.flow = FLOW_BRANCH; insn.relative = true; }
+		else if (opcode == 0x9a) { insn.flow = FLOW_CALL; }
+		else if (opcode == 0xea) { insn.flow = FLOW_JUMP; }
+		else if (opcode == 0xc2 || opcode == 0xc3 || opcode == 0xca || opcode == 0xcb || opcode == 0xcf) { insn.flow = FLOW_RETURN; }
+		else if (opcode == 0xff)
+		{
+			if (modrm_reg == 2 || modrm_reg == 3) { insn.flow = FLOW_CALL; }
+			else if (modrm_reg == 4 || modrm_reg == 5) { insn.flow = FLOW_JUMP; }
+		}
+	}
+	else if (map == 2 && (attributes & IZ) && opcode >= 0x80 && opcode <= 0x8f)
+	{
+		insn.flow = FLOW_BRANCH;
+		insn.relative = true;
+	}
+
+	if (insn.relative) { insn.displacement = readDisplacement(code + immediate_start, immediate_size); }
+	return true;
+}
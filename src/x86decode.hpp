@@ -0,0 +1,37 @@
+/*
+* FreeDBG - x86 Instruction Length Decoder (Header)
+*/
+
+#ifndef FREEDBG_X86DECODE
+#define FREEDBG_X86DECODE
+
+#include <cstdint>
+#include <cstddef>
+#include "types.hpp" // BYTE, ADDR
+
+#define MAX_INSN_LENGTH 15
+
+
+enum X86Flow {
+	FLOW_NONE = 0, // Falls through to the next instruction
+	FLOW_CALL,
+	FLOW_JUMP,
+	FLOW_BRANCH, // Conditional jump, loop, jecxz
+	FLOW_RETURN
+};
+
+struct X86Instruction {
+	size_t length = 0;
+	int flow = FLOW_NONE;
+	bool relative = false; // Target is (address + length + displacement)
+	int32_t displacement = 0;
+	size_t access_size = 0; // Upper bound on the bytes one memory access covers, if the instruction accesses memory
+};
+
+
+/* Decodes the length and control flow of one 32-bit mode instruction at code[0].
+* Returns false if the bytes don't form a valid instruction within size bytes. */
+bool decodeInstruction(const BYTE *code, size_t size, X86Instruction &insn);
+
+
+#endif // FREEDBG_X86DECODE
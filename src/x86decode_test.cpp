@@ -0,0 +1,296 @@
+/*
+* FreeDBG - x86 Instruction Length Decoder Tests
+*
+* Standalone, built and run by 'make test'. Every length below is what
+* 'as --32' produced and 'objdump -d' decoded for the same bytes.
+*/
+
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include "x86decode.hpp" // decodeInstruction, X86Instruction, X86Flow
+
+
+struct DecodeCase {
+	const char *bytes; // Hex, one instruction
+	size_t length; // 0 if it must not decode
+	int flow;
+	bool relative;
+	int32_t displacement;
+	const char *text; // objdump's reading, for failure messages
+};
+
+static const DecodeCase CASES[] = {
+	/* One byte opcodes */
+	{"90",                            1, FLOW_NONE,   false, 0,      "nop"},
+	{"55",                            1, FLOW_NONE,   false, 0,      "push ebp"},
+	{"89 e5",                         2, FLOW_NONE,   false, 0,      "mov ebp,esp"},
+	{"cc",                            1, FLOW_NONE,   false, 0,      "int3"},
+	{"cd 80",                         2, FLOW_NONE,   false, 0,      "int 0x80"},
+	{"c9",                            1, FLOW_NONE,   false, 0,      "leave"},
+	{"c8 10 00 00",                   4, FLOW_NONE,   false, 0,      "enter 0x10,0x0"},
+	{"f4",                            1, FLOW_NONE,   false, 0,      "hlt"},
+	{"b8 78 56 34 12",                5, FLOW_NONE,   false, 0,      "mov eax,0x12345678"},
+	{"b0 12",                         2, FLOW_NONE,   false, 0,      "mov al,0x12"},
+	{"83 c0 01",                      3, FLOW_NONE,   false, 0,      "add eax,0x1"},
+	{"05 00 10 00 00",                5, FLOW_NONE,   false, 0,      "add eax,0x1000"},
+	{"80 00 01",                      3, FLOW_NONE,   false, 0,      "add BYTE PTR [eax],0x1"},
+	{"81 43 04 00 01 00 00",          7, FLOW_NONE,   false, 0,      "add DWORD PTR [ebx+0x4],0x100"},
+	{"6b c3 0a",                      3, FLOW_NONE,   false, 0,      "imul eax,ebx,0xa"},
+	{"69 43 04 e8 03 00 00",          7, FLOW_NONE,   false, 0,      "imul eax,DWORD PTR [ebx+0x4],0x3e8"},
+	{"c1 e0 03",                      3, FLOW_NONE,   false, 0,      "shl eax,0x3"},
+	{"d1 2b",                         2, FLOW_NONE,   false, 0,      "shr DWORD PTR [ebx],1"},
+	{"d3 c0",                         2, FLOW_NONE,   false, 0,      "rol eax,cl"},
+	{"68 78 56 34 12",                5, FLOW_NONE,   false, 0,      "push 0x12345678"},
+	{"6a 08",                         2, FLOW_NONE,   false, 0,      "push 0x8"},
+	{"ff 30",                         2, FLOW_NONE,   false, 0,      "push DWORD PTR [eax]"},
+	{"9c",                            1, FLOW_NONE,   false, 0,      "pushf"},
+	{"a1 00 a0 04 08",                5, FLOW_NONE,   false, 0,      "mov eax,ds:0x804a000"},
+	{"a2 00 a0 04 08",                5, FLOW_NONE,   false, 0,      "mov ds:0x804a000,al"},
+	{"c6 44 24 04 7f",                5, FLOW_NONE,   false, 0,      "mov BYTE PTR [esp+0x4],0x7f"},
+	{"c4 03",                         2, FLOW_NONE,   false, 0,      "les eax,[ebx]"},
+	{"c5 43 08",                      3, FLOW_NONE,   false, 0,      "lds eax,[ebx+0x8]"},
+	{"62 00",                         2, FLOW_NONE,   false, 0,      "bound eax,[eax]"},
+
+	/* Group 3, only test takes an immediate */
+	{"a8 01",                         2, FLOW_NONE,   false, 0,      "test al,0x1"},
+	{"a9 00 01 00 00",                5, FLOW_NONE,   false, 0,      "test eax,0x100"},
+	{"f6 00 01",                      3, FLOW_NONE,   false, 0,      "test BYTE PTR [eax],0x1"},
+	{"f7 40 04 00 01 00 00",          7, FLOW_NONE,   false, 0,      "test DWORD PTR [eax+0x4],0x100"},
+	{"66 f7 00 00 01",                5, FLOW_NONE,   false, 0,      "test WORD PTR [eax],0x100"},
+	{"f7 10",                         2, FLOW_NONE,   false, 0,      "not DWORD PTR [eax]"},
+	{"f7 d8",                         2, FLOW_NONE,   false, 0,      "neg eax"},
+	{"f7 f1",                         2, FLOW_NONE,   false, 0,      "div ecx"},
+
+	/* ModRM, SIB and displacements */
+	{"8b 03",                         2, FLOW_NONE,   false, 0,      "mov eax,DWORD PTR [ebx]"},
+	{"8b 45 00",                      3, FLOW_NONE,   false, 0,      "mov eax,DWORD PTR [ebp+0x0]"},
+	{"8b 45 f8",                      3, FLOW_NONE,   false, 0,      "mov eax,DWORD PTR [ebp-0x8]"},
+	{"8b 05 00 a0 04 08",             6, FLOW_NONE,   false, 0,      "mov eax,DWORD PTR ds:0x804a000"},
+	{"8b 04 24",                      3, FLOW_NONE,   false, 0,      "mov eax,DWORD PTR [esp]"},
+	{"8b 44 24 08",                   4, FLOW_NONE,   false, 0,      "mov eax,DWORD PTR [esp+0x8]"},
+	{"8b 84 24 00 10 00 00",          7, FLOW_NONE,   false, 0,      "mov eax,DWORD PTR [esp+0x1000]"},
+	{"8b 04 88",                      3, FLOW_NONE,   false, 0,      "mov eax,DWORD PTR [eax+ecx*4]"},
+	{"8b 44 88 10",                   4, FLOW_NONE,   false, 0,      "mov eax,DWORD PTR [eax+ecx*4+0x10]"},
+	{"8b 84 88 00 10 00 00",          7, FLOW_NONE,   false, 0,      "mov eax,DWORD PTR [eax+ecx*4+0x1000]"},
+	{"8b 04 8d 00 a0 04 08",          7, FLOW_NONE,   false, 0,      "mov eax,DWORD PTR [ecx*4+0x804a000]"},
+	{"8b 44 4d 00",                   4, FLOW_NONE,   false, 0,      "mov eax,DWORD PTR [ebp+ecx*2+0x0]"},
+	{"8d b6 00 00 00 00",             6, FLOW_NONE,   false, 0,      "lea esi,[esi+0x0]"},
+	{"66 c7 00 34 12",                5, FLOW_NONE,   false, 0,      "mov WORD PTR [eax],0x1234"},
+	{"c7 84 d8 00 10 00 00 78 56 34 12", 11, FLOW_NONE, false, 0,    "mov DWORD PTR [eax+ebx*8+0x1000],0x12345678"},
+
+	/* Legacy prefixes */
+	{"66 b8 34 12",                   4, FLOW_NONE,   false, 0,      "mov ax,0x1234"},
+	{"64 a1 10 00 00 00",             6, FLOW_NONE,   false, 0,      "mov eax,fs:0x10"},
+	{"26 8b 00",                      3, FLOW_NONE,   false, 0,      "mov eax,es:[eax]"},
+	{"f0 83 00 01",                   4, FLOW_NONE,   false, 0,      "lock add DWORD PTR [eax],0x1"},
+	{"f0 0f b1 11",                   4, FLOW_NONE,   false, 0,      "lock cmpxchg DWORD PTR [ecx],edx"},
+	{"f3 a4",                         2, FLOW_NONE,   false, 0,      "rep movsb"},
+	{"f3 ab",                         2, FLOW_NONE,   false, 0,      "rep stosd"},
+	{"f2 ae",                         2, FLOW_NONE,   false, 0,      "repnz scasb"},
+	{"66 67 f3 a5",                   4, FLOW_NONE,   false, 0,      "rep movsw"},
+	{"67 66 8b 00",                   4, FLOW_NONE,   false, 0,      "mov ax,WORD PTR [bx+si]"},
+	{"67 8b 40 10",                   4, FLOW_NONE,   false, 0,      "mov eax,DWORD PTR [bx+si+0x10]"},
+	{"67 a1 34 12",                   4, FLOW_NONE,   false, 0,      "addr16 mov eax,ds:0x1234"},
+
+	/* x87 */
+	{"d9 00",                         2, FLOW_NONE,   false, 0,      "fld DWORD PTR [eax]"},
+	{"dd 1c 24",                      3, FLOW_NONE,   false, 0,      "fstp QWORD PTR [esp]"},
+	{"d8 c1",                         2, FLOW_NONE,   false, 0,      "fadd st,st(1)"},
+
+	/* 0F, 0F 38 and 0F 3A maps */
+	{"0f b6 03",                      3, FLOW_NONE,   false, 0,      "movzx eax,BYTE PTR [ebx]"},
+	{"0f bf 43 02",                   4, FLOW_NONE,   false, 0,      "movsx eax,WORD PTR [ebx+0x2]"},
+	{"0f 44 c3",                      3, FLOW_NONE,   false, 0,      "cmove eax,ebx"},
+	{"0f 94 c0",                      3, FLOW_NONE,   false, 0,      "sete al"},
+	{"0f c8",                         2, FLOW_NONE,   false, 0,      "bswap eax"},
+	{"0f a2",                         2, FLOW_NONE,   false, 0,      "cpuid"},
+	{"0f 31",                         2, FLOW_NONE,   false, 0,      "rdtsc"},
+	{"0f 0b",                         2, FLOW_NONE,   false, 0,      "ud2"},
+	{"0f c1 08",                      3, FLOW_NONE,   false, 0,      "xadd DWORD PTR [eax],ecx"},
+	{"0f ba e0 05",                   4, FLOW_NONE,   false, 0,      "bt eax,0x5"},
+	{"0f a4 d8 04",                   4, FLOW_NONE,   false, 0,      "shld eax,ebx,0x4"},
+	{"0f 28 00",                      3, FLOW_NONE,   false, 0,      "movaps xmm0,XMMWORD PTR [eax]"},
+	{"f3 0f 6f 4c 24 10",             6, FLOW_NONE,   false, 0,      "movdqu xmm1,XMMWORD PTR [esp+0x10]"},
+	{"66 0f ef c0",                   4, FLOW_NONE,   false, 0,      "pxor xmm0,xmm0"},
+	{"66 0f 70 c1 1b",                5, FLOW_NONE,   false, 0,      "pshufd xmm0,xmm1,0x1b"},
+	{"66 0f 38 00 c1",                5, FLOW_NONE,   false, 0,      "pshufb xmm0,xmm1"},
+	{"f2 0f 38 f0 03",                5, FLOW_NONE,   false, 0,      "crc32 eax,BYTE PTR [ebx]"},
+	{"66 0f 3a 0f c1 04",             6, FLOW_NONE,   false, 0,      "palignr xmm0,xmm1,0x4"},
+	{"66 0f 3a 0a c1 02",             6, FLOW_NONE,   false, 0,      "roundss xmm0,xmm1,0x2"},
+
+	/* VEX */
+	{"c5 f0 58 c2",                   4, FLOW_NONE,   false, 0,      "vaddps xmm0,xmm1,xmm2"},
+	{"c5 f4 58 c2",                   4, FLOW_NONE,   false, 0,      "vaddps ymm0,ymm1,ymm2"},
+	{"c5 fe 6f c1",                   4, FLOW_NONE,   false, 0,      "vmovdqu ymm0,ymm1"},
+	{"c5 f8 77",                      3, FLOW_NONE,   false, 0,      "vzeroupper"},
+	{"c4 e2 71 00 c2",                5, FLOW_NONE,   false, 0,      "vpshufb xmm0,xmm1,xmm2"},
+	{"c4 e2 71 b8 c2",                5, FLOW_NONE,   false, 0,      "vfmadd231ps xmm0,xmm1,xmm2"},
+	{"c4 e2 79 18 44 24 04",          7, FLOW_NONE,   false, 0,      "vbroadcastss xmm0,DWORD PTR [esp+0x4]"},
+	{"c4 e3 fd 00 c1 1b",             6, FLOW_NONE,   false, 0,      "vpermq ymm0,ymm1,0x1b"},
+	{"c4 e3 75 0c c2 05",             6, FLOW_NONE,   false, 0,      "vblendps ymm0,ymm1,ymm2,0x5"},
+
+	/* EVEX */
+	{"62 f1 74 48 58 c2",             6, FLOW_NONE,   false, 0,      "vaddps zmm0,zmm1,zmm2"},
+	{"62 f1 75 48 fe c2",             6, FLOW_NONE,   false, 0,      "vpaddd zmm0,zmm1,zmm2"},
+	{"62 f1 7c 48 28 44 24 01",       8, FLOW_NONE,   false, 0,      "vmovaps zmm0,ZMMWORD PTR [esp+0x40]"},
+	{"62 f3 fd 48 00 c1 1b",          7, FLOW_NONE,   false, 0,      "vpermq zmm0,zmm1,0x1b"},
+
+	/* Calls */
+	{"e8 1f 00 00 00",                5, FLOW_CALL,   true,  0x1f,   "call rel32"},
+	{"e8 fb ff ff ff",                5, FLOW_CALL,   true,  -5,     "call to itself"},
+	{"66 e8 34 12",                   4, FLOW_CALL,   true,  0x1234, "callw rel16"},
+	{"ff 10",                         2, FLOW_CALL,   false, 0,      "call DWORD PTR [eax]"},
+	{"ff d0",                         2, FLOW_CALL,   false, 0,      "call eax"},
+	{"ff 54 8b 08",                   4, FLOW_CALL,   false, 0,      "call DWORD PTR [ebx+ecx*4+0x8]"},
+	{"ff 1d 00 a0 04 08",             6, FLOW_CALL,   false, 0,      "lcall *0x804a000"},
+	{"9a 78 56 34 12 08 00",          7, FLOW_CALL,   false, 0,      "lcall 0x8:0x12345678"},
+
+	/* Jumps */
+	{"e9 00 01 00 00",                5, FLOW_JUMP,   true,  0x100,  "jmp rel32"},
+	{"eb 15",                         2, FLOW_JUMP,   true,  0x15,   "jmp rel8"},
+	{"eb fe",                         2, FLOW_JUMP,   true,  -2,     "jmp to itself"},
+	{"66 eb 01",                      3, FLOW_JUMP,   true,  1,      "data16 jmp rel8"},
+	{"ff e0",                         2, FLOW_JUMP,   false, 0,      "jmp eax"},
+	{"ff 60 04",                      3, FLOW_JUMP,   false, 0,      "jmp DWORD PTR [eax+0x4]"},
+	{"ff 2d 00 a0 04 08",             6, FLOW_JUMP,   false, 0,      "ljmp *0x804a000"},
+	{"ea 78 56 34 12 08 00",          7, FLOW_JUMP,   false, 0,      "ljmp 0x8:0x12345678"},
+
+	/* Conditional branches */
+	{"74 0b",                         2, FLOW_BRANCH, true,  0x0b,   "je rel8"},
+	{"76 fe",                         2, FLOW_BRANCH, true,  -2,     "jbe to itself"},
+	{"2e 3e 74 05",                   4, FLOW_BRANCH, true,  5,      "cs ds je rel8"},
+	{"0f 84 00 01 00 00",             6, FLOW_BRANCH, true,  0x100,  "je rel32"},
+	{"0f 85 f0 ff ff ff",             6, FLOW_BRANCH, true,  -16,    "jne rel32"},
+	{"66 0f 84 10 00",                5, FLOW_BRANCH, true,  0x10,   "je rel16"},
+	{"e0 fe",                         2, FLOW_BRANCH, true,  -2,     "loopne"},
+	{"e1 fe",                         2, FLOW_BRANCH, true,  -2,     "loope"},
+	{"e2 03",                         2, FLOW_BRANCH, true,  3,      "loop"},
+	{"e3 05",                         2, FLOW_BRANCH, true,  5,      "jecxz"},
+
+	/* Returns */
+	{"c3",                            1, FLOW_RETURN, false, 0,      "ret"},
+	{"c2 08 00",                      3, FLOW_RETURN, false, 0,      "ret 0x8"},
+	{"cb",                            1, FLOW_RETURN, false, 0,      "retf"},
+	{"ca 04 00",                      3, FLOW_RETURN, false, 0,      "retf 0x4"},
+	{"cf",                            1, FLOW_RETURN, false, 0,      "iret"},
+
+	/* Invalid */
+	{"0f 04",                         0, FLOW_NONE,   false, 0,      "(bad)"},
+	{"0f 0a",                         0, FLOW_NONE,   false, 0,      "(bad)"},
+	{"66 66 66 66 66 66 66 66 66 66 66 66 66 66 66 90", 0, FLOW_NONE, false, 0, "longer than 15 bytes"},
+};
+
+struct AccessCase {
+	const char *bytes;
+	size_t access_size; // What the memory operand covers, the decoder may only overestimate it for vectors
+	const char *text;
+};
+
+static const AccessCase ACCESS_CASES[] = {
+	{"88 03",                         1,  "mov BYTE PTR [ebx],al"},
+	{"66 89 03",                      2,  "mov WORD PTR [ebx],ax"},
+	{"89 03",                         4,  "mov DWORD PTR [ebx],eax"},
+	{"80 00 01",                      1,  "add BYTE PTR [eax],0x1"},
+	{"01 03",                         4,  "add DWORD PTR [ebx],eax"},
+	{"f6 00 01",                      1,  "test BYTE PTR [eax],0x1"},
+	{"0f b6 03",                      1,  "movzx eax,BYTE PTR [ebx]"},
+	{"0f bf 43 02",                   2,  "movsx eax,WORD PTR [ebx+0x2]"},
+	{"0f 94 00",                      1,  "sete BYTE PTR [eax]"},
+	{"f3 a4",                         1,  "rep movsb"},
+	{"f3 ab",                         4,  "rep stosd"},
+	{"ff 30",                         4,  "push DWORD PTR [eax]"},
+	{"ff 1d 00 a0 04 08",             6,  "lcall *0x804a000"},
+	{"dd 1c 24",                      8,  "fstp QWORD PTR [esp]"},
+	{"db 38",                         10, "fstp TBYTE PTR [eax]"},
+	{"0f c7 0e",                      8,  "cmpxchg8b QWORD PTR [esi]"},
+	{"0f 29 00",                      16, "movaps XMMWORD PTR [eax],xmm0"},
+	{"f3 0f 7f 4c 24 10",             16, "movdqu XMMWORD PTR [esp+0x10],xmm1"},
+	{"c5 fc 29 00",                   32, "vmovaps YMMWORD PTR [eax],ymm0"},
+	{"62 f1 7c 48 29 44 24 01",       64, "vmovaps ZMMWORD PTR [esp+0x40],zmm0"},
+};
+
+
+static std::vector<BYTE> parseHex(const char *text)
+{
+	std::vector<BYTE> bytes;
+	char *end;
+	while (*text)
+	{
+		unsigned long value = strtoul(text, &end, 16);
+		if (end == text) { break; }
+		bytes.push_back(value);
+		text = end;
+	}
+	return bytes;
+}
+
+static bool check(const DecodeCase &test, const std::vector<BYTE> &code, size_t size, const char *how)
+{
+	X86Instruction insn;
+	bool decoded = decodeInstruction(code.data(), size, insn);
+	if (test.length == 0 || size < test.length)
+	{
+		if (!decoded) { return true; }
+		printf("FAIL %-40s %s: decoded as %zu bytes, expected an error\n", test.text, how, insn.length);
+		return false;
+	}
+	if (decoded && insn.length == test.length && insn.flow == test.flow && insn.relative == test.relative &&
+		insn.displacement == test.displacement) { return true; }
+	if (!decoded) { printf("FAIL %-40s %s: not decoded\n", test.text, how); }
+	else
+	{
+		printf("FAIL %-40s %s: length %zu flow %d relative %d displacement %d, expected %zu %d %d %d\n", test.text, how,
+			insn.length, insn.flow, insn.relative, insn.displacement, test.length, test.flow, test.relative, test.displacement);
+	}
+	return false;
+}
+
+
+int main()
+{
+	size_t checks = 0;
+	size_t failures = 0;
+	for (const DecodeCase &test: CASES)
+	{
+		std::vector<BYTE> code = parseHex(test.bytes);
+		if (test.length != 0 && test.length != code.size())
+		{
+			printf("FAIL %-40s corpus entry has %zu bytes, says %zu\n", test.text, code.size(), test.length);
+			failures++;
+			continue;
+		}
+
+		/* Exactly the instruction, then followed by more code, which mustn't change the answer */
+		checks++;
+		if (!check(test, code, code.size(), "alone")) { failures++; }
+		if (test.length == 0) { continue; }
+		std::vector<BYTE> padded = code;
+		padded.resize(MAX_INSN_LENGTH + 1, 0x90);
+		checks++;
+		if (!check(test, padded, padded.size(), "padded")) { failures++; }
+
+		/* Every truncation has to fail rather than read past the end */
+		for (size_t size = 0; size < code.size(); size++)
+		{
+			std::vector<BYTE> truncated(code.begin(), code.begin() + size);
+			char how[32];
+			snprintf(how, sizeof(how), "cut to %zu", size);
+			checks++;
+			if (!check(test, truncated, size, how)) { failures++; }
+		}
+	}
+	for (const AccessCase &test: ACCESS_CASES)
+	{
+		std::vector<BYTE> code = parseHex(test.bytes);
+		X86Instruction insn;
+		checks++;
+		if (decodeInstruction(code.data(), code.size(), insn) && insn.access_size == test.access_size) { continue; }
+		printf("FAIL %-40s access size %zu, expected %zu\n", test.text, insn.access_size, test.access_size);
+		failures++;
+	}
+	printf("%zu checks, %zu failed\n", checks, failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+/*
+* FreeDBG - x86 Instruction Relocation
+*/
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "x86relocate.hpp" // relocateInstructions
+#include "x86decode.hpp" // decodeInstruction, X86Instruction
+
+
+static void emit32(std::vector<BYTE> &out, uint32_t value)
+{
+	for (int i = 0; i < 4; i++) { out.push_back((value >> (i * 8)) & 0xff); }
+}
+
+bool relocateInstructions(const BYTE *code, size_t length, ADDR from, ADDR to, size_t min_length, std::vector<BYTE> &out, size_t &consumed)
+{
+	consumed = 0;
+	while (consumed < min_length)
+	{
+		X86Instruction insn;
+		if (!decodeInstruction(code + consumed, length - consumed, insn)) { return false; }
+
+		const BYTE *bytes = code + consumed;
+		ADDR here = to + out.size();
+		if (insn.relative)
+		{
+			size_t op = 0;
+			while (bytes[op] == 0x2e || bytes[op] == 0x3e) { op++; } // Branch hints are the only prefixes we keep
+			ADDR next = from + consumed + insn.length;
+			ADDR target = next + insn.displacement;
+
+			if (bytes[op] == 0xe8) // call rel32 -> push next, jmp rel32. PIC thunks and 'call 1f; 1: pop' read the return address
+			{
+				out.push_back(0x68);
+				emit32(out, next);
+				out.push_back(0xe9);
+				emit32(out, target - (here + 10));
+			}
+			else if (bytes[op] == 0xe9 || bytes[op] == 0xeb) // jmp rel
+			{
+				out.push_back(0xe9);
+				emit32(out, target - (here + 5));
+			}
+			else if (bytes[op] >= 0x70 && bytes[op] <= 0x7f) // jcc rel8 -> jcc rel32
+			{
+				out.push_back(0x0f);
+				out.push_back(0x80 | (bytes[op] & 0xf));
+				emit32(out, target - (here + 6));
+			}
+			else if (bytes[op] == 0x0f && (bytes[op + 1] & 0xf0) == 0x80) // jcc rel32
+			{
+				out.push_back(0x0f);
+				out.push_back(bytes[op + 1]);
+				emit32(out, target - (here + 6));
+			}
+			else { return false; } // loop/jecxz have no long form, 16-bit operand branches aren't worth it
+		}
+		else
+		{
+			out.insert(out.end(), bytes, bytes + insn.length);
+		}
+		consumed += insn.length;
+
+		/* Anything after a control transfer may be another block's entry point */
+		if (insn.flow != FLOW_NONE && consumed < min_length) { return false; }
+	}
+	return true;
+}
@@ -0,0 +1,21 @@
+/*
+* FreeDBG - x86 Instruction Relocation (Header)
+*/
+
+#ifndef FREEDBG_X86RELOCATE
+#define FREEDBG_X86RELOCATE
+
+#include <vector>
+#include <cstddef>
+#include "types.hpp" // BYTE, ADDR
+
+
+/* Appends whole instructions from code (located at from) to out (whose first byte runs at to)
+* until at least min_length bytes are covered, consumed is how many were.
+* Relative branches are re-encoded with 32-bit displacements, and a call becomes a push of
+* the original return address and a jump, so the callee still returns (and looks) like it
+* was called from the original code. False if something can't be moved. */
+bool relocateInstructions(const BYTE *code, size_t length, ADDR from, ADDR to, size_t min_length, std::vector<BYTE> &out, size_t &consumed);
+
+
+#endif // FREEDBG_X86RELOCATE
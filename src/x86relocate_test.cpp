@@ -0,0 +1,106 @@
+/*
+* FreeDBG - x86 Instruction Relocation Tests
+*
+* Standalone, built and run by 'make test'. Every expected trampoline below was
+* disassembled with 'objdump -D -b binary -m i386' at the trampoline address to
+* check it still reaches the original targets.
+*/
+
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include "x86relocate.hpp" // relocateInstructions
+
+
+#define RELOCATE_FROM 0x08048100 // Where the original code is
+#define RELOCATE_TO 0x28000000 // Where the trampoline runs
+#define RELOCATE_MIN 5 // A jmp rel32, what tracepoints patch in
+
+
+struct RelocateCase {
+	const char *code; // Hex, at RELOCATE_FROM
+	size_t consumed; // 0 if it must not relocate
+	const char *expected; // Hex, at RELOCATE_TO
+	const char *text;
+};
+
+static const RelocateCase CASES[] = {
+	{"55 89 e5 83 ec 10",             6, "55 89 e5 83 ec 10",
+		"push ebp; mov ebp,esp; sub esp,0x10 (copied as is)"},
+	{"53 e8 f5 00 00 00",             6, "53 68 06 81 04 08 e9 f0 81 04 e0",
+		"push ebx; call __x86.get_pc_thunk.bx (pushes the original return address)"},
+	{"e8 00 00 00 00",                5, "68 05 81 04 08 e9 fb 80 04 e0",
+		"call 1f; 1: (pop reg sees the original address)"},
+	{"90 90 90 74 10",                5, "90 90 90 0f 84 0c 81 04 e0",
+		"je rel8 (widened to rel32)"},
+	{"3e 0f 85 00 01 00 00",          7, "0f 85 01 82 04 e0",
+		"ds jne rel32 (hint dropped)"},
+	{"90 90 90 eb fc",                5, "90 90 90 e9 f9 80 04 e0",
+		"jmp rel8 backwards (widened to rel32)"},
+	{"eb 10 90 90 90",                0, "",
+		"jmp before the end of the patch"},
+	{"c3 90 90 90 90",                0, "",
+		"ret before the end of the patch"},
+	{"90 90 90 e2 fe",                0, "",
+		"loop (no rel32 form)"},
+	{"90 90 90 e8 00",                0, "",
+		"truncated call"},
+};
+
+
+static std::vector<BYTE> parseHex(const char *text)
+{
+	std::vector<BYTE> bytes;
+	char *end;
+	while (*text)
+	{
+		unsigned long value = strtoul(text, &end, 16);
+		if (end == text) { break; }
+		bytes.push_back(value);
+		text = end;
+	}
+	return bytes;
+}
+
+static void printHex(const std::vector<BYTE> &bytes)
+{
+	for (BYTE byte: bytes) { printf(" %02x", byte); }
+	putchar('\n');
+}
+
+
+int main()
+{
+	size_t failures = 0;
+	for (const RelocateCase &test: CASES)
+	{
+		std::vector<BYTE> code = parseHex(test.code);
+		std::vector<BYTE> expected = parseHex(test.expected);
+		std::vector<BYTE> out;
+		size_t consumed = 0;
+		bool relocated = relocateInstructions(code.data(), code.size(), RELOCATE_FROM, RELOCATE_TO, RELOCATE_MIN, out, consumed);
+
+		if (test.consumed == 0)
+		{
+			if (!relocated) { continue; }
+			printf("FAIL %s: relocated %zu bytes, expected an error\n", test.text, consumed);
+			failures++;
+			continue;
+		}
+		if (relocated && consumed == test.consumed && out == expected) { continue; }
+		failures++;
+		if (!relocated)
+		{
+			printf("FAIL %s: not relocated\n", test.text);
+			continue;
+		}
+		printf("FAIL %s: consumed %zu (expected %zu)\n  got:     ", test.text, consumed, test.consumed);
+		printHex(out);
+		printf("  expected:");
+		printHex(expected);
+	}
+	printf("%zu relocations, %zu failed\n", sizeof(CASES) / sizeof(CASES[0]), failures);
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}